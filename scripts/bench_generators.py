@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Generator placeholder cost benchmark against a local keep-alive server.
+
+Runs the same POST in load mode with a static body and with one that
+renders {{seq}}, {{uuid}}, {{rand_int}}, {{rand_str}} and {{now_ms}} on
+every request, and prints the CPU cost per request of each. The difference
+is the price of generation; it should be small next to libcurl's own
+per-request cost.
+
+Usage: scripts/bench_generators.py [path/to/pinga] [concurrency] [requests]
+"""
+import json
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+
+from bench_load import start_server
+
+ROUNDS = 3
+
+
+def write_config(config):
+    with tempfile.NamedTemporaryFile(mode="w", suffix=".json", delete=False) as tmp:
+        json.dump(config, tmp)
+        return tmp.name
+
+
+def run(pinga, config, concurrency, requests):
+    cmd = [pinga, "--concurrency", str(concurrency), "--requests", str(requests), config]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if not result.stdout:
+        raise SystemExit(result.stderr.strip() or "pinga failed")
+    return json.loads(result.stdout)
+
+
+def main():
+    pinga = sys.argv[1] if len(sys.argv) > 1 else "./build/pinga"
+    concurrency = int(sys.argv[2]) if len(sys.argv) > 2 else 100
+    requests = int(sys.argv[3]) if len(sys.argv) > 3 else 50000
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    port = start_server()
+    static = {
+        "url": f"http://127.0.0.1:{port}/items/0",
+        "headers": {"X-Request-Id": "00000000-0000-4000-8000-000000000000"},
+        "payload": {"id": 0, "user": "x" * 64, "score": 50, "at": 0},
+    }
+    generated = {
+        "url": f"http://127.0.0.1:{port}/items/{{{{seq}}}}",
+        "headers": {"X-Request-Id": "{{uuid}}"},
+        "payload": {
+            "id": "{{seq}}",
+            "user": "{{rand_str:64}}",
+            "score": "{{rand_int:1:100}}",
+            "at": "{{now_ms}}",
+        },
+    }
+    configs = {"static": write_config(static), "generated": write_config(generated)}
+
+    print(f"{'body':>10} {'requests':>9} {'rps':>10} {'cpu us/req':>11}")
+    best = {}
+    try:
+        for name, config in configs.items():
+            runs = [run(pinga, config, concurrency, requests) for _ in range(ROUNDS)]
+            summary = min(runs, key=lambda s: s["cpu_us_per_request"])
+            best[name] = summary["cpu_us_per_request"]
+            print(
+                f"{name:>10} {summary['requests']:>9} {summary['rps']:>10.0f} "
+                f"{summary['cpu_us_per_request']:>11.2f}"
+            )
+    finally:
+        for config in configs.values():
+            os.unlink(config)
+    delta = best["generated"] - best["static"]
+    print(f"generation cost: {delta:+.2f} us/request ({delta / best['static'] * 100:+.1f}%)")
+
+
+if __name__ == "__main__":
+    main()
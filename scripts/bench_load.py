@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Load-mode scaling benchmark against a local keep-alive server.
+
+Runs pinga at increasing concurrency and prints throughput and CPU cost per
+request. With the socket-action event loop the per-request CPU cost should
+stay roughly flat as concurrency grows.
+
+Usage: scripts/bench_load.py [path/to/pinga] [concurrency ...]
+"""
+import asyncio
+import json
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+import threading
+
+RESPONSE = (
+    b"HTTP/1.1 200 OK\r\n"
+    b"Content-Type: application/json\r\n"
+    b"Content-Length: 11\r\n"
+    b"\r\n"
+    b'{"ok":true}'
+)
+# Sent when the client asked for Connection: close; the server then hangs up.
+RESPONSE_CLOSE = RESPONSE.replace(b"\r\n\r\n", b"\r\nConnection: close\r\n\r\n", 1)
+
+
+async def handle(reader, writer):
+    try:
+        while True:
+            head = await reader.readuntil(b"\r\n\r\n")
+            length = 0
+            for line in head.split(b"\r\n"):
+                if line.lower().startswith(b"content-length:"):
+                    length = int(line.split(b":", 1)[1])
+            if length:
+                await reader.readexactly(length)
+            if b"\r\nconnection: close" in head.lower():
+                writer.write(RESPONSE_CLOSE)
+                await writer.drain()
+                break
+            writer.write(RESPONSE)
+            await writer.drain()
+    except (asyncio.IncompleteReadError, ConnectionError):
+        pass
+    finally:
+        writer.close()
+
+
+def start_server():
+    ready = threading.Event()
+    state = {}
+
+    def serve():
+        loop = asyncio.new_event_loop()
+        server = loop.run_until_complete(
+            asyncio.start_server(handle, "127.0.0.1", 0, backlog=16384)
+        )
+        state["port"] = server.sockets[0].getsockname()[1]
+        ready.set()
+        loop.run_forever()
+
+    threading.Thread(target=serve, daemon=True).start()
+    ready.wait()
+    return state["port"]
+
+
+def main():
+    pinga = sys.argv[1] if len(sys.argv) > 1 else "./build/pinga"
+    levels = [int(v) for v in sys.argv[2:]] or [10, 100, 1000, 10000]
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    port = start_server()
+    with tempfile.NamedTemporaryFile(mode="w", suffix=".json", delete=False) as tmp:
+        json.dump({"url": f"http://127.0.0.1:{port}/"}, tmp)
+        config = tmp.name
+
+    print(f"{'concurrency':>11} {'requests':>9} {'rps':>10} {'p99 ms':>9} {'cpu us/req':>11}")
+    try:
+        for level in levels:
+            requests = max(20000, level * 4)
+            cmd = [pinga, "--concurrency", str(level), "--requests", str(requests), config]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if not result.stdout:
+                print(result.stderr.strip(), file=sys.stderr)
+                continue
+            summary = json.loads(result.stdout)
+            print(
+                f"{level:>11} {summary['requests']:>9} {summary['rps']:>10.0f} "
+                f"{summary['latency_ms']['p99']:>9.2f} {summary['cpu_us_per_request']:>11.2f}"
+            )
+    finally:
+        os.unlink(config)
+
+
+if __name__ == "__main__":
+    main()
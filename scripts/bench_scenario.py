@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Scenario mix cost benchmark against a local keep-alive server.
+
+Runs one config on its own and then a 70/25/5 scenario of three configs
+(a GET, a GET with a query and a JSON POST) and prints the CPU cost per
+request of each. Picking a config is one alias-table lookup; the remaining
+difference is the handle being set up again whenever a slot switches config.
+
+Usage: scripts/bench_scenario.py [path/to/pinga] [concurrency] [requests]
+"""
+import json
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+
+from bench_load import start_server
+
+ROUNDS = 3
+
+
+def write_json(directory, name, value):
+    path = os.path.join(directory, name)
+    with open(path, "w") as f:
+        json.dump(value, f)
+    return path
+
+
+def run(pinga, args, concurrency, requests):
+    cmd = [pinga, "--concurrency", str(concurrency), "--requests", str(requests), *args]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if not result.stdout:
+        raise SystemExit(result.stderr.strip() or "pinga failed")
+    return json.loads(result.stdout)
+
+
+def main():
+    pinga = sys.argv[1] if len(sys.argv) > 1 else "./build/pinga"
+    concurrency = int(sys.argv[2]) if len(sys.argv) > 2 else 100
+    requests = int(sys.argv[3]) if len(sys.argv) > 3 else 50000
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    port = start_server()
+    base = f"http://127.0.0.1:{port}"
+    with tempfile.TemporaryDirectory() as tmp:
+        read = write_json(tmp, "read.json", {"url": f"{base}/items/1"})
+        write_json(tmp, "search.json", {"url": f"{base}/search?q=pinga&limit=20"})
+        write_json(
+            tmp,
+            "write.json",
+            {"url": f"{base}/items", "method": "POST", "payload": {"name": "x" * 64}},
+        )
+        mix = write_json(
+            tmp,
+            "mix.json",
+            {
+                "mix": [
+                    {"config": "read.json", "weight": 70},
+                    {"config": "search.json", "weight": 25},
+                    {"config": "write.json", "weight": 5},
+                ]
+            },
+        )
+        print(f"{'run':>10} {'requests':>9} {'rps':>10} {'cpu us/req':>11}")
+        best = {}
+        for name, args in (("single", [read]), ("scenario", ["--scenario", mix])):
+            runs = [run(pinga, args, concurrency, requests) for _ in range(ROUNDS)]
+            summary = min(runs, key=lambda s: s["cpu_us_per_request"])
+            best[name] = summary["cpu_us_per_request"]
+            print(
+                f"{name:>10} {summary['requests']:>9} {summary['rps']:>10.0f} "
+                f"{summary['cpu_us_per_request']:>11.2f}"
+            )
+            for entry in summary.get("scenario", []):
+                print(f"{'':>10} {entry['name']:>12} share {entry['share']:.3f}")
+    delta = best["scenario"] - best["single"]
+    print(f"mix cost: {delta:+.2f} us/request ({delta / best['single'] * 100:+.1f}%)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Unix domain socket vs TCP loopback benchmark against a local server.
+
+Serves the same keep-alive handler on 127.0.0.1 and on a Unix socket, then
+runs one config through each with and without connection reuse and prints
+throughput, p99 latency and CPU cost per request. The "close" rows open a
+connection per request, which is where loopback also pays for the TCP
+handshake and an ephemeral port.
+
+Usage: scripts/bench_unix.py [path/to/pinga] [concurrency] [requests]
+"""
+import asyncio
+import json
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+import threading
+
+from bench_load import handle, start_server
+
+ROUNDS = 3
+
+
+def start_unix_server(path):
+    ready = threading.Event()
+
+    def serve():
+        loop = asyncio.new_event_loop()
+        loop.run_until_complete(asyncio.start_unix_server(handle, path, backlog=16384))
+        ready.set()
+        loop.run_forever()
+
+    threading.Thread(target=serve, daemon=True).start()
+    ready.wait()
+
+
+def run(pinga, args, concurrency, requests):
+    cmd = [pinga, "--concurrency", str(concurrency), "--requests", str(requests), *args]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if not result.stdout:
+        raise SystemExit(result.stderr.strip() or "pinga failed")
+    return json.loads(result.stdout)
+
+
+def main():
+    pinga = sys.argv[1] if len(sys.argv) > 1 else "./build/pinga"
+    concurrency = int(sys.argv[2]) if len(sys.argv) > 2 else 50
+    requests = int(sys.argv[3]) if len(sys.argv) > 3 else 20000
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    port = start_server()
+    with tempfile.TemporaryDirectory() as tmp:
+        sock = os.path.join(tmp, "bench.sock")
+        start_unix_server(sock)
+        configs = {}
+        for reuse, headers in (("keep-alive", {}), ("close", {"Connection": "close"})):
+            path = os.path.join(tmp, f"{reuse}.json")
+            with open(path, "w") as f:
+                json.dump({"url": f"http://127.0.0.1:{port}/health", "headers": headers}, f)
+            configs[reuse] = path
+        print(f"{'transport':>10} {'reuse':>11} {'rps':>10} {'p99 ms':>8} {'cpu us/req':>11}")
+        for reuse, config in configs.items():
+            for transport, extra in (("tcp", []), ("unix", ["--unix-socket", sock])):
+                runs = [run(pinga, [*extra, config], concurrency, requests) for _ in range(ROUNDS)]
+                summary = max(runs, key=lambda s: s["rps"])
+                if summary["ok"] != summary["requests"]:
+                    raise SystemExit(f"{transport}/{reuse}: {summary['errors']} errors")
+                print(
+                    f"{transport:>10} {reuse:>11} {summary['rps']:>10.0f} "
+                    f"{summary['latency_ms']['p99']:>8.3f} {summary['cpu_us_per_request']:>11.2f}"
+                )
+
+
+if __name__ == "__main__":
+    main()
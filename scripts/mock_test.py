@@ -1,18 +1,35 @@
 #!/usr/bin/env python3
+import base64
+import email.parser
+import hashlib
 import json
 import os
+import re
+import socket
+import socketserver
+import struct
 import subprocess
+import sys
 import tempfile
 import threading
-from http.server import BaseHTTPRequestHandler, HTTPServer
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from urllib.parse import urlparse, parse_qs
+from urllib.request import urlopen
 
 
 class EchoHandler(BaseHTTPRequestHandler):
+    seen = []
+
     def do_POST(self):
-        length = int(self.headers.get("Content-Length", "0"))
-        body = self.rfile.read(length).decode("utf-8")
+        if self.headers.get("Transfer-Encoding") == "chunked":
+            raw = self.read_chunked()
+        else:
+            raw = self.rfile.read(int(self.headers.get("Content-Length", "0")))
+        body = raw.decode("utf-8", "replace")
         parsed = urlparse(self.path)
+        if parsed.path.startswith("/slow/"):
+            time.sleep(0.2)
         response = {
             "method": self.command,
             "path": parsed.path,
@@ -20,6 +37,7 @@ class EchoHandler(BaseHTTPRequestHandler):
             "headers": dict(self.headers),
             "body": body,
         }
+        EchoHandler.seen.append(dict(response, raw=raw))
         payload = json.dumps(response).encode("utf-8")
         self.send_response(200)
         self.send_header("Content-Type", "application/json")
@@ -27,16 +45,184 @@ class EchoHandler(BaseHTTPRequestHandler):
         self.end_headers()
         self.wfile.write(payload)
 
+    def read_chunked(self):
+        raw = b""
+        while True:
+            size = int(self.rfile.readline().split(b";")[0], 16)
+            raw += self.rfile.read(size)
+            self.rfile.readline()
+            if size == 0:
+                return raw
+
+    def do_GET(self):
+        if self.path in ("/events", "/lines"):
+            self.stream_events()
+            return
+        if self.path.startswith("/cached"):
+            self.cached()
+            return
+        payload = b'{"ok":true}'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def cached(self):
+        """ETag-validated JSON; ?max_age=N sets Cache-Control, Vary: Accept picks the body."""
+        EchoHandler.seen.append({"path": self.path, "headers": dict(self.headers)})
+        query = parse_qs(urlparse(self.path).query)
+        accept = self.headers.get("Accept", "")
+        etag = f'"v-{accept}"'
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return
+        payload = json.dumps({"accept": accept}).encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        self.send_header("ETag", etag)
+        self.send_header("Vary", "Accept")
+        self.send_header("Cache-Control", f"max-age={query.get('max_age', ['0'])[0]}")
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def stream_events(self):
+        """Three events 50 ms apart, SSE or NDJSON, until the connection closes."""
+        sse = self.path == "/events"
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream" if sse else "application/x-ndjson")
+        self.send_header("Connection", "close")
+        self.end_headers()
+        for n in range(3):
+            if sse:
+                chunk = f": tick\r\nevent: tick\r\nid: {n}\r\ndata: {{\"n\":{n}}}\r\ndata: x\r\n\r\n"
+            else:
+                chunk = json.dumps({"n": n}) + "\n"
+            self.wfile.write(chunk.encode())
+            self.wfile.flush()
+            time.sleep(0.05)
+        self.close_connection = True
+
     def log_message(self, fmt, *args):
         return
 
 
-def run():
-    server = HTTPServer(("127.0.0.1", 0), EchoHandler)
-    port = server.server_port
-    thread = threading.Thread(target=server.serve_forever, daemon=True)
-    thread.start()
+class MirrorHandler(BaseHTTPRequestHandler):
+    """Answers with the request path and body; a server with a prefix is the
+    mirror side, which strips it and changes the body of /diff paths."""
+
+    def do_POST(self):
+        raw = self.rfile.read(int(self.headers.get("Content-Length", "0")))
+        prefix = self.server.prefix
+        if not self.path.startswith(prefix):
+            self.send_error(404)
+            return
+        path = self.path[len(prefix):]
+        response = {"path": path, "body": raw.decode("utf-8", "replace")}
+        if prefix and "diff" in path:
+            response["changed"] = True
+        payload = json.dumps(response).encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    do_GET = do_POST
+
+    def log_message(self, fmt, *args):
+        return
+
+
+class WebSocketEchoHandler(socketserver.StreamRequestHandler):
+    """Upgrades to WebSocket (RFC 6455) and echoes every data frame."""
+
+    GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+    messages = []
+    headers = []
+
+    def handle(self):
+        self.rfile.readline()
+        headers = email.parser.BytesParser().parsebytes(self.read_head())
+        WebSocketEchoHandler.headers.append(dict(headers))
+        key = headers["Sec-WebSocket-Key"].encode()
+        accept = base64.b64encode(hashlib.sha1(key + self.GUID).digest())
+        self.wfile.write(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                         b"Connection: Upgrade\r\nSec-WebSocket-Accept: " + accept + b"\r\n\r\n")
+        while True:
+            head = self.rfile.read(2)
+            if len(head) < 2:
+                return
+            opcode, length = head[0] & 0x0F, head[1] & 0x7F
+            if length == 126:
+                length = struct.unpack(">H", self.rfile.read(2))[0]
+            elif length == 127:
+                length = struct.unpack(">Q", self.rfile.read(8))[0]
+            mask = self.rfile.read(4) if head[1] & 0x80 else b"\0\0\0\0"
+            data = bytes(b ^ mask[i % 4] for i, b in enumerate(self.rfile.read(length)))
+            if opcode == 8:
+                self.wfile.write(b"\x88\x00")
+                return
+            WebSocketEchoHandler.messages.append(data)
+            size = bytes([length]) if length < 126 else b"\x7e" + struct.pack(">H", length)
+            self.wfile.write(head[:1] + size + data)
+
+    def read_head(self):
+        head = b""
+        while not head.endswith(b"\r\n\r\n"):
+            line = self.rfile.readline()
+            if not line:
+                break
+            head += line
+        return head
+
+
+class SlowWebSocketEchoHandler(WebSocketEchoHandler):
+    """Echoes like WebSocketEchoHandler, but only after a second of not reading."""
+
+    def handle(self):
+        write = self.wfile.write
+
+        def write_then_stall(data):
+            write(data)
+            self.wfile.write = write
+            time.sleep(1.0)
+
+        self.wfile.write = write_then_stall
+        super().handle()
+
+
+class SmallBufferTCPServer(socketserver.ThreadingTCPServer):
+    daemon_threads = True
+
+    def server_bind(self):
+        # A small receive window makes the client's sends come back short.
+        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        super().server_bind()
+
+
+PINGA = sys.argv[1] if len(sys.argv) > 1 else "./build/pinga"
+
+
+class UnixHTTPServer(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
 
+    def get_request(self):
+        # Handlers expect a (host, port) peer address.
+        conn, _ = super().get_request()
+        return conn, ("local", 0)
+
+
+def write_config(config):
+    with tempfile.NamedTemporaryFile(mode="w", suffix=".json", delete=False) as tmp:
+        json.dump(config, tmp)
+        return tmp.name
+
+
+def test_echo(port):
     payload_obj = {"hello": "pinga", "count": 3}
     payload_raw = json.dumps(payload_obj, separators=(",", ":"))
 
@@ -52,12 +238,9 @@ def run():
         "payload": payload_obj,
     }
 
-    with tempfile.NamedTemporaryFile(mode="w", suffix=".json", delete=False) as tmp:
-        json.dump(config, tmp)
-        tmp_path = tmp.name
-
+    tmp_path = write_config(config)
     try:
-        cmd = ["./build/pinga", "--exclude-response-headers", tmp_path]
+        cmd = [PINGA, "--exclude-response-headers", tmp_path]
         result = subprocess.run(cmd, capture_output=True, text=True)
         if result.returncode != 0:
             raise SystemExit(result.stderr.strip() or "pinga failed")
@@ -80,6 +263,855 @@ def run():
             raise SystemExit("unexpected body")
     finally:
         os.unlink(tmp_path)
+
+
+def test_stream(port):
+    sse = write_config({"url": f"http://127.0.0.1:{port}/events"})
+    lines = write_config({"url": f"http://127.0.0.1:{port}/lines"})
+    try:
+        result = subprocess.run([PINGA, "--stream", sse], capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga stream run failed")
+        records = [json.loads(line) for line in result.stdout.splitlines()]
+        if [(r["seq"], r["event"], r["id"], r["data"]) for r in records] != \
+                [(n, "tick", str(n), f'{{"n":{n}}}\nx') for n in range(3)]:
+            raise SystemExit(f"unexpected SSE events: {records}")
+        summary = json.loads(result.stderr)
+        if summary["framing"] != "sse" or summary["events"] != 3 or \
+                summary["gap_ms"]["min"] < 40 or summary["ttfb_ms"] > records[0]["t_ms"]:
+            raise SystemExit(f"unexpected stream summary: {summary}")
+        result = subprocess.run([PINGA, "--stream", lines], capture_output=True, text=True)
+        records = [json.loads(line) for line in result.stdout.splitlines()]
+        if [r["data"] for r in records] != [{"n": n} for n in range(3)] or \
+                json.loads(result.stderr)["framing"] != "lines":
+            raise SystemExit(f"unexpected line events: {records}")
+        if records[2]["t_ms"] - records[0]["t_ms"] < 80:
+            raise SystemExit("line events were not timed as they arrived")
+    finally:
+        os.unlink(sse)
+        os.unlink(lines)
+
+
+def test_http_cache(port):
+    base = f"http://127.0.0.1:{port}"
+    cache_dir = tempfile.mkdtemp()
+    plain = write_config({"url": base + "/cached"})
+    accept = write_config({"url": base + "/cached", "headers": {"Accept": "x/y"}})
+    fresh = write_config({"url": base + "/cached?max_age=60"})
+
+    def run(config):
+        result = subprocess.run([PINGA, "--http-cache", cache_dir, config],
+                                capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga cached run failed")
+        envelope = json.loads(result.stdout)
+        return envelope["cache"], envelope["status"], envelope["body"]
+
+    try:
+        EchoHandler.seen.clear()
+        results = [run(plain), run(plain), run(accept), run(accept)]
+        if [r[0] for r in results] != ["miss", "revalidated", "miss", "revalidated"] or \
+                any(r[1] != 200 for r in results):
+            raise SystemExit(f"unexpected cache results: {results}")
+        if [r[2]["accept"] for r in results[2:]] != ["x/y", "x/y"]:
+            raise SystemExit("Vary did not separate the cached variants")
+        sent = [seen["headers"].get("If-None-Match") for seen in EchoHandler.seen]
+        if sent != [None, '"v-*/*"', None, '"v-x/y"']:
+            raise SystemExit(f"unexpected conditional headers: {sent}")
+        EchoHandler.seen.clear()
+        if [run(fresh)[0], run(fresh)[0]] != ["miss", "hit"] or len(EchoHandler.seen) != 1:
+            raise SystemExit("fresh response was not served from the cache")
+    finally:
+        for config in (plain, accept, fresh):
+            os.unlink(config)
+        for name in os.listdir(cache_dir):
+            os.unlink(os.path.join(cache_dir, name))
+        os.rmdir(cache_dir)
+
+
+def test_unix_socket():
+    workdir = tempfile.mkdtemp()
+    sock = os.path.join(workdir, "http.sock")
+    server = UnixHTTPServer(sock, EchoHandler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    # The host and port are only for the Host header; nothing listens there.
+    url = "http://svc.local:9/items/{id}"
+    config = write_config({
+        "url": url, "method": "POST", "path_params": {"id": "7"},
+        "query_params": {"q": "a b"}, "unix_socket": sock,
+    })
+    plain = write_config({"url": "http://svc.local:9/health"})
+    try:
+        result = subprocess.run([PINGA, config], capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga unix socket run failed")
+        body = json.loads(result.stdout)["body"]
+        if body["path"] != "/items/7" or body["query"] != {"q": ["a b"]} or \
+                body["headers"]["Host"] != "svc.local:9":
+            raise SystemExit(f"unix socket request lost its url parts: {body}")
+        cmd = [PINGA, "--unix-socket", sock, "--concurrency", "2", "--requests", "10", plain]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0 or json.loads(result.stdout)["ok"] != 10:
+            raise SystemExit(result.stderr.strip() or "--unix-socket load run failed")
+        missing = subprocess.run([PINGA, "--unix-socket", sock + ".gone", plain],
+                                 capture_output=True, text=True)
+        if missing.returncode != 66:
+            raise SystemExit("missing unix socket did not exit 66")
+    finally:
+        server.shutdown()
+        server.server_close()
+        os.unlink(config)
+        os.unlink(plain)
+        os.unlink(sock)
+        os.rmdir(workdir)
+
+
+def test_websocket():
+    server = socketserver.ThreadingTCPServer(("127.0.0.1", 0), WebSocketEchoHandler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    url = f"ws://127.0.0.1:{server.server_address[1]}/echo"
+    ping_pong = write_config({
+        "url": url, "headers": {"X-Client": "pinga"},
+        "websocket": {"message": {"seq": "{{seq}}"}, "connections": 3, "messages": 30},
+    })
+    paced = write_config({
+        "url": url, "websocket": {"message": "tick", "rate": 200, "duration": "500ms"},
+    })
+    large = write_config({})
+    try:
+        result = subprocess.run([PINGA, ping_pong], capture_output=True, text=True)
+        if "without WebSocket support" in result.stderr:
+            print("skipping websocket test: libcurl has no WebSocket support")
+            return
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga websocket run failed")
+        report = json.loads(result.stdout)
+        if (report["mode"], report["sent"], report["received"], report["lost"]) != \
+                ("ping-pong", 30, 30, 0) or report["rtt_ms"]["max"] <= 0:
+            raise SystemExit(f"unexpected websocket report: {report}")
+        seqs = sorted(int(json.loads(m)["seq"]) for m in WebSocketEchoHandler.messages)
+        if seqs != list(range(30)):
+            raise SystemExit("websocket messages were not rendered once per seq")
+        if len(WebSocketEchoHandler.headers) != 3 or \
+                any(h.get("X-Client") != "pinga" for h in WebSocketEchoHandler.headers):
+            raise SystemExit("websocket handshake lost the config headers")
+        cmd = [PINGA, "--concurrency", "2", paced]
+        report = json.loads(subprocess.run(cmd, capture_output=True, text=True).stdout)
+        if report["mode"] != "rate" or report["connections"] != 2 or \
+                not 80 <= report["sent"] <= 101 or report["received"] != report["sent"]:
+            raise SystemExit(f"unexpected paced websocket report: {report}")
+        slow_server = SmallBufferTCPServer(("127.0.0.1", 0), SlowWebSocketEchoHandler)
+        threading.Thread(target=slow_server.serve_forever, daemon=True).start()
+        port = slow_server.server_address[1]
+        with open(large, "w") as f:
+            json.dump({"url": f"ws://127.0.0.1:{port}/echo", "websocket": {
+                "message": "{{rand_str:60000}}", "connections": 2, "rate": 100,
+                "duration": "1s"}}, f)
+        WebSocketEchoHandler.messages.clear()
+        result = subprocess.run([PINGA, large], capture_output=True, text=True)
+        slow_server.shutdown()
+        slow_server.server_close()
+        report = json.loads(result.stdout or "{}")
+        if result.returncode != 0 or report.get("errors") or \
+                report.get("received") != report.get("sent") or \
+                {len(m) for m in WebSocketEchoHandler.messages} != {60000}:
+            raise SystemExit(f"short websocket sends were not resumed: {result.stderr.strip()}")
+    finally:
+        server.shutdown()
+        server.server_close()
+        os.unlink(ping_pong)
+        os.unlink(paced)
+        os.unlink(large)
+
+
+def test_load(port):
+    tmp_path = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    try:
+        cmd = [PINGA, "--concurrency", "4", "--threads", "2", "--requests", "20", tmp_path]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga load run failed")
+        summary = json.loads(result.stdout)
+        if summary["requests"] != 20 or summary["ok"] != 20:
+            raise SystemExit(f"unexpected load summary: {summary}")
+        if summary["status"]["2xx"] != 20:
+            raise SystemExit("unexpected load status counts")
+        if summary["latency_ms"]["max"] < summary["latency_ms"]["p50"]:
+            raise SystemExit("inconsistent latency percentiles")
+    finally:
+        os.unlink(tmp_path)
+
+
+def test_ndjson(port):
+    tmp_path = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    try:
+        cmd = [PINGA, "--ordered", "--concurrency", "4", "--threads", "2", "--requests", "50", tmp_path]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga ndjson run failed")
+        records = [json.loads(line) for line in result.stdout.splitlines()]
+        if [r["seq"] for r in records] != list(range(50)):
+            raise SystemExit("ndjson records missing or out of order")
+        if any(r["status"] != 200 or r["bytes"] != 11 for r in records):
+            raise SystemExit(f"unexpected ndjson record: {records[0]}")
+        if json.loads(result.stderr)["requests"] != 50:
+            raise SystemExit("summary not printed to stderr")
+    finally:
+        os.unlink(tmp_path)
+
+
+def test_trace(port):
+    config = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    trace_path = config + ".trace.json"
+    try:
+        cmd = [PINGA, "--concurrency", "4", "--threads", "2", "--requests", "40",
+               "--trace", trace_path, config]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga trace run failed")
+        with open(trace_path) as f:
+            events = json.load(f)["traceEvents"]
+        names = {(e["pid"], e["tid"]): e["args"]["name"] for e in events
+                 if e["ph"] == "M" and e["name"] == "thread_name"}
+        if sorted(names) != [(1, 1), (1, 2), (2, 1), (2, 2)]:
+            raise SystemExit(f"unexpected trace tracks: {sorted(names)}")
+        requests = [e for e in events if e["name"] == "request"]
+        if sorted(e["args"]["seq"] for e in requests) != list(range(40)):
+            raise SystemExit("trace is missing requests")
+        spans = {}
+        for e in events:
+            if e["ph"] == "X" and e["name"] != "request":
+                spans.setdefault((e["pid"], e["tid"]), []).append(e)
+        for parent in requests:
+            end = parent["ts"] + parent["dur"]
+            children = [e for e in spans[(parent["pid"], parent["tid"])]
+                        if parent["ts"] <= e["ts"] < end]
+            if "ttfb" not in {e["name"] for e in children}:
+                raise SystemExit(f"request {parent['args']} has no phase spans")
+            if any(e["ts"] + e["dur"] > end + 1.0 for e in children):
+                raise SystemExit("phase span ends after its request")
+    finally:
+        os.unlink(config)
+        if os.path.exists(trace_path):
+            os.unlink(trace_path)
+
+
+def test_live_metrics(port):
+    with socket.socket() as probe:
+        probe.bind(("127.0.0.1", 0))
+        metrics_port = probe.getsockname()[1]
+    tmp_path = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    try:
+        cmd = [
+            PINGA, "--report-interval", "200ms", "--duration", "1s",
+            "--metrics-listen", f"127.0.0.1:{metrics_port}", tmp_path,
+        ]
+        proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        time.sleep(0.5)
+        text = urlopen(f"http://127.0.0.1:{metrics_port}/metrics", timeout=5).read().decode()
+        out, err = proc.communicate(timeout=10)
+        if proc.returncode != 0:
+            raise SystemExit(err.strip() or "pinga live metrics run failed")
+        if 'pinga_requests_total{result="ok"}' not in text:
+            raise SystemExit("metrics endpoint missing request counter")
+        intervals = [json.loads(line) for line in err.splitlines()]
+        if len(intervals) < 4:
+            raise SystemExit(f"expected interval reports, got {len(intervals)}")
+        if sum(i["requests"] for i in intervals) != json.loads(out)["requests"]:
+            raise SystemExit("interval counts do not add up to the summary")
+    finally:
+        os.unlink(tmp_path)
+
+
+def test_resolve_prewarm(port):
+    tmp_path = write_config(
+        {
+            "url": f"http://pinga.invalid:{port}/health",
+            "resolve": {f"pinga.invalid:{port}": "127.0.0.1"},
+        }
+    )
+    try:
+        cmd = [PINGA, "--prewarm", "8", "--concurrency", "2", "--requests", "4", tmp_path]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga prewarm run failed")
+        summary = json.loads(result.stdout)
+        if summary["ok"] != 4:
+            raise SystemExit(f"resolve override not applied: {summary}")
+        if summary["prewarm"]["connections"] != 2 or summary["prewarm"]["opened"] != 2:
+            raise SystemExit(f"unexpected prewarm summary: {summary['prewarm']}")
+        bad = [PINGA, "--resolve", "pinga.invalid", tmp_path]
+        failed = subprocess.run(bad, capture_output=True, text=True)
+        if failed.returncode != 65:
+            raise SystemExit("invalid --resolve entry was accepted")
+    finally:
+        os.unlink(tmp_path)
+
+
+def test_generators(port):
+    config = {
+        "url": f"http://127.0.0.1:{port}/gen/{{{{seq}}}}",
+        "method": "POST",
+        "headers": {"X-Token": "t-{{rand_str:12}}"},
+        "query_params": {"id": "{{uuid}}"},
+        "payload": {"n": "{{rand_int:-3:3}}", "at": "{{now_ms}}", "keep": "{{other}}"},
+    }
+    tmp_path = write_config(config)
+    EchoHandler.seen.clear()
+    try:
+        cmd = [PINGA, "--concurrency", "4", "--requests", "40", tmp_path]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga generator run failed")
+        seen = list(EchoHandler.seen)
+        if sorted(r["path"] for r in seen) != sorted(f"/gen/{i}" for i in range(40)):
+            raise SystemExit("{{seq}} did not render once per request")
+        uuids = {r["query"]["id"][0] for r in seen}
+        uuid_re = re.compile(r"^[0-9a-f]{8}-[0-9a-f]{4}-4[0-9a-f]{3}-[89ab][0-9a-f]{3}-[0-9a-f]{12}$")
+        if len(uuids) != 40 or not all(uuid_re.match(u) for u in uuids):
+            raise SystemExit("{{uuid}} values are not unique v4 uuids")
+        if not all(re.fullmatch(r"t-[A-Za-z0-9]{12}", r["headers"]["X-Token"]) for r in seen):
+            raise SystemExit("unexpected {{rand_str}} header")
+        now_ms = time.time() * 1000
+        for r in seen:
+            body = json.loads(r["body"])
+            if not -3 <= int(body["n"]) <= 3 or abs(int(body["at"]) - now_ms) > 60000:
+                raise SystemExit(f"unexpected generated body: {body}")
+            if body["keep"] != "{{other}}":
+                raise SystemExit("unknown placeholder was not left alone")
+    finally:
+        os.unlink(tmp_path)
+
+    bad_path = write_config({"url": f"http://127.0.0.1:{port}/x", "payload": "{{rand_int:9:1}}"})
+    try:
+        result = subprocess.run([PINGA, bad_path], capture_output=True, text=True)
+        if result.returncode != 65 or "rand_int:9:1" not in result.stderr:
+            raise SystemExit("invalid generator was not rejected")
+    finally:
+        os.unlink(bad_path)
+
+
+def multipart_parts(record):
+    head = f"Content-Type: {record['headers']['Content-Type']}\r\n\r\n".encode()
+    message = email.parser.BytesParser().parsebytes(head + record["raw"])
+    return {part.get_param("name", header="content-disposition"): part for part in message.get_payload()}
+
+
+def test_multipart(port):
+    blob = bytes(range(256)) * 64
+    with tempfile.NamedTemporaryFile(suffix=".bin", delete=False) as tmp:
+        tmp.write(blob)
+        blob_path = tmp.name
+    config = {
+        "url": f"http://127.0.0.1:{port}/upload",
+        "multipart": [
+            {"name": "meta", "value": {"a": 1}, "type": "application/json"},
+            {"name": "text", "value": "line1\nline2"},
+            {"name": "blob", "file": blob_path, "type": "application/octet-stream", "filename": "b.bin"},
+            {"name": "in", "stdin": True},
+        ],
+    }
+    tmp_path = write_config(config)
+    EchoHandler.seen.clear()
+    try:
+        result = subprocess.run([PINGA, "--silent", tmp_path], input=b"from\x00stdin", capture_output=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.decode().strip() or "pinga multipart run failed")
+        record = EchoHandler.seen[-1]
+        if record["method"] != "POST" or not record["headers"]["Content-Type"].startswith("multipart/form-data"):
+            raise SystemExit("multipart request was not a form-data POST")
+        parts = multipart_parts(record)
+        meta = parts["meta"]
+        if json.loads(meta.get_payload(decode=True)) != {"a": 1} or meta.get_content_type() != "application/json":
+            raise SystemExit("unexpected multipart value part")
+        if parts["text"].get_payload(decode=True) != b"line1\nline2":
+            raise SystemExit("multipart string value was not unescaped")
+        if parts["blob"].get_payload(decode=True) != blob or parts["blob"].get_filename() != "b.bin":
+            raise SystemExit("multipart file part did not arrive intact")
+        if parts["in"].get_payload(decode=True) != b"from\x00stdin":
+            raise SystemExit("multipart stdin part did not arrive intact")
+
+        result = subprocess.run([PINGA, "--requests", "4", tmp_path], capture_output=True, text=True)
+        if result.returncode != 65 or "single requests only" not in result.stderr:
+            raise SystemExit("stdin part was not rejected in load mode")
+
+        config["multipart"].pop()
+        with open(tmp_path, "w") as fp:
+            json.dump(config, fp)
+        EchoHandler.seen.clear()
+        result = subprocess.run([PINGA, "--concurrency", "3", "--requests", "6", tmp_path], capture_output=True, text=True)
+        if result.returncode != 0 or len(EchoHandler.seen) != 6:
+            raise SystemExit(result.stderr.strip() or "multipart load run failed")
+        if any(multipart_parts(r)["blob"].get_payload(decode=True) != blob for r in EchoHandler.seen):
+            raise SystemExit("multipart file part changed between load requests")
+
+        binary_path = write_config({"url": f"http://127.0.0.1:{port}/raw", "payload_file": blob_path})
+        try:
+            result = subprocess.run([PINGA, "--silent", binary_path], capture_output=True, text=True)
+            if result.returncode != 0 or EchoHandler.seen[-1]["raw"] != blob:
+                raise SystemExit("binary payload_file was truncated")
+        finally:
+            os.unlink(binary_path)
+    finally:
+        os.unlink(tmp_path)
+        os.unlink(blob_path)
+
+
+def test_collection(port):
+    base = f"http://127.0.0.1:{port}"
+    lines = []
+    for i in range(30):
+        if i % 3 == 0:
+            lines.append(json.dumps({"url": f"{base}/echo", "payload": {"i": i, "s": "}{]["}}))
+        else:
+            lines.append(json.dumps({"url": f"{base}/health/{i}"}))
+    with tempfile.NamedTemporaryFile(mode="w", suffix=".jsonl", delete=False) as tmp:
+        tmp.write("\n".join(lines) + "\n")
+        jsonl_path = tmp.name
+    array_path = write_config([json.loads(line) for line in lines])
+    try:
+        for path in (jsonl_path, array_path):
+            cmd = [PINGA, "--collection", path, "--concurrency", "4", "--ordered"]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if result.returncode != 0:
+                raise SystemExit(result.stderr.strip() or "pinga collection run failed")
+            records = [json.loads(line) for line in result.stdout.splitlines()]
+            if [r["seq"] for r in records] != list(range(30)):
+                raise SystemExit("collection records missing or out of order")
+            if json.loads(result.stderr)["ok"] != 30:
+                raise SystemExit("unexpected collection summary")
+        piped = subprocess.run(
+            [PINGA, "--collection", "-", "--requests", "5"],
+            input="\n".join(lines), capture_output=True, text=True,
+        )
+        if piped.returncode != 0 or json.loads(piped.stdout)["requests"] != 5:
+            raise SystemExit("collection from stdin failed")
+        bad = subprocess.run(
+            [PINGA, "--collection", "-"], input=lines[0] + '\n{"method":"GET"}\n',
+            capture_output=True, text=True,
+        )
+        if bad.returncode != 65 or "collection element 2" not in bad.stderr:
+            raise SystemExit("bad collection element was not reported")
+    finally:
+        os.unlink(jsonl_path)
+        os.unlink(array_path)
+
+
+def test_scenario(port):
+    base = f"http://127.0.0.1:{port}"
+    workdir = tempfile.mkdtemp()
+    files = {
+        "read.json": {"url": base + "/health"},
+        "write.json": {"url": base + "/echo/{{seq}}", "payload": {"n": "{{seq}}"}},
+        "mix.json": {"mix": [
+            {"config": "read.json", "weight": 3},
+            {"config": "write.json", "weight": 1, "name": "write"},
+        ]},
+        "bad.json": {"mix": [{"config": "read.json", "weight": 0}]},
+    }
+    for name, value in files.items():
+        with open(os.path.join(workdir, name), "w") as f:
+            json.dump(value, f)
+    try:
+        EchoHandler.seen.clear()
+        result = subprocess.run(
+            [PINGA, "--scenario", os.path.join(workdir, "mix.json"), "--requests", "400",
+             "--concurrency", "4", "--ndjson"],
+            capture_output=True, text=True,
+        )
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "scenario run failed")
+        summary = json.loads(result.stderr)
+        entries = {entry["name"]: entry for entry in summary["scenario"]}
+        if set(entries) != {"read.json", "write"} or entries["write"]["weight"] != 0.25:
+            raise SystemExit(f"unexpected scenario entries: {sorted(entries)}")
+        if sum(entry["requests"] for entry in entries.values()) != 400 or \
+                not 0.15 < entries["write"]["share"] < 0.35:
+            raise SystemExit("scenario requests were not split by weight")
+        records = [json.loads(line) for line in result.stdout.splitlines()]
+        writes = {r["seq"] for r in records if r["config"] == "write"}
+        if len(writes) != entries["write"]["requests"] or \
+                len(EchoHandler.seen) != len(writes):
+            raise SystemExit("scenario records do not match the per-config counts")
+        for seen in EchoHandler.seen:
+            seq = int(seen["path"].rsplit("/", 1)[1])
+            if seq not in writes or json.loads(seen["body"]) != {"n": str(seq)}:
+                raise SystemExit("scenario request was not rendered for its own config")
+        bad = subprocess.run(
+            [PINGA, "--scenario", os.path.join(workdir, "bad.json")],
+            capture_output=True, text=True,
+        )
+        if bad.returncode != 65 or "weight" not in bad.stderr:
+            raise SystemExit("zero scenario weight was not rejected")
+    finally:
+        for name in os.listdir(workdir):
+            os.unlink(os.path.join(workdir, name))
+        os.rmdir(workdir)
+
+
+def test_rate(port):
+    tmp_path = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    try:
+        cmd = [PINGA, "--rate", "100", "--warmup", "200ms", "--duration", "400ms",
+               "--concurrency", "4", tmp_path]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga rate run failed")
+        summary = json.loads(result.stdout)
+        if summary["rate"] != 100 or not 35 <= summary["requests"] <= 41:
+            raise SystemExit(f"rate run did not keep its schedule: {summary}")
+        if not 15 <= summary["warmup"]["requests"] <= 21:
+            raise SystemExit(f"unexpected warm-up count: {summary['warmup']}")
+        # Warm-up seqs get no record; ordered output must not wait for them.
+        cmd = [PINGA, "--rate", "20", "--warmup", "300ms", "--duration", "1500ms",
+               "--ndjson", "--ordered", tmp_path]
+        started = time.monotonic()
+        proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+        first = json.loads(proc.stdout.readline())
+        first_at = time.monotonic() - started
+        rest = [json.loads(line) for line in proc.stdout]
+        ended_at = time.monotonic() - started
+        if proc.wait() != 0 or first["seq"] == 0 or not rest:
+            raise SystemExit("warm-up run wrote unexpected records")
+        if first_at > ended_at - 0.8:
+            raise SystemExit(f"ordered records waited for the run to end ({first_at:.2f}s)")
+        for bad in ("nan", "inf", "1e30"):
+            result = subprocess.run([PINGA, "--duration", bad, tmp_path],
+                                    capture_output=True, text=True, timeout=10)
+            if result.returncode != 65 or "--duration" not in result.stderr:
+                raise SystemExit(f"--duration {bad} was not rejected")
+    finally:
+        os.unlink(tmp_path)
+
+
+def test_capacity(port):
+    fast = write_config({"url": f"http://127.0.0.1:{port}/health"})
+    slow = write_config({"url": f"http://127.0.0.1:{port}/slow/capacity", "payload": "x"})
+    args = ["--find-capacity", "--slo", "p99<150ms,errors<1%", "--rate", "10",
+            "--max-rate", "20", "--duration", "500ms", "--warmup", "100ms"]
+    try:
+        result = subprocess.run([PINGA, *args, fast], capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "capacity search failed")
+        report = json.loads(result.stdout)
+        steps = [json.loads(line) for line in result.stderr.splitlines()]
+        if [s["rate"] for s in report["steps"]] != [10, 20] or steps != report["steps"]:
+            raise SystemExit(f"unexpected capacity steps: {report['steps']}")
+        if report["capacity_rps"] != 20 or report["limit"] is not None or \
+                report["knee"] != report["steps"][-1]:
+            raise SystemExit(f"unexpected capacity result: {report}")
+        result = subprocess.run([PINGA, *args, slow], capture_output=True, text=True)
+        report = json.loads(result.stdout)
+        if result.returncode != 67 or report["knee"] is not None or \
+                report["limit"]["violated"] != "p99":
+            raise SystemExit(f"missed SLO at the minimum rate was not reported: {report}")
+        bad = subprocess.run([PINGA, "--find-capacity", "--slo", "p100<1s", fast],
+                             capture_output=True, text=True)
+        if bad.returncode != 65 or "SLO" not in bad.stderr:
+            raise SystemExit("invalid SLO term was not rejected")
+    finally:
+        os.unlink(fast)
+        os.unlink(slow)
+
+
+def test_body_budget(port):
+    base = f"http://127.0.0.1:{port}"
+    config = write_config({"url": base + "/echo", "payload": {"blob": "x\\n" * 200000}})
+    text_config = write_config({"url": base + "/echo", "payload": "plain \"text\"\n" * 20000})
+    sampled = write_config({"url": base + "/echo/{{seq}}", "payload": {"n": "{{seq}}"}})
+    try:
+        for path in (config, text_config):
+            kept = subprocess.run([PINGA, path], capture_output=True, text=True)
+            spilled = subprocess.run(
+                [PINGA, "--body-memory", "1k", path], capture_output=True, text=True
+            )
+            if kept.returncode != 0 or spilled.returncode != 0:
+                raise SystemExit(spilled.stderr.strip() or "budgeted request failed")
+            # Headers carry the server's Date, which can differ between the runs.
+            spilled_envelope, kept_envelope = json.loads(spilled.stdout), json.loads(kept.stdout)
+            if [spilled_envelope[k] for k in ("status", "body")] != \
+                    [kept_envelope[k] for k in ("status", "body")]:
+                raise SystemExit("spilled body produced a different status or body")
+        result = subprocess.run(
+            [PINGA, "--requests", "40", "--concurrency", "4", "--sample-bodies", "5",
+             "--body-memory", "64", sampled],
+            capture_output=True, text=True,
+        )
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "sampled load run failed")
+        samples = json.loads(result.stdout)["samples"]
+        seqs = [sample["seq"] for sample in samples]
+        if len(samples) != 5 or seqs != sorted(set(seqs)):
+            raise SystemExit("unexpected body samples")
+        for sample in samples:
+            if sample["body"]["path"] != f"/echo/{sample['seq']}":
+                raise SystemExit("sampled body does not belong to its request")
+    finally:
+        os.unlink(config)
+        os.unlink(text_config)
+        os.unlink(sampled)
+
+
+def test_replay(port):
+    workdir = tempfile.mkdtemp()
+    har_path = os.path.join(workdir, "capture.har")
+    log_path = os.path.join(workdir, "access.log")
+    body = '{"msg":"line\\n \\"quoted\\" \\u00e9"}'
+    entries = []
+    for i, ms in enumerate([0, 200, 400]):
+        request = {
+            "method": "POST" if i == 1 else "GET",
+            "url": f"https://prod.invalid/items/{i}?q=1",
+            "headers": [{"name": "X-Replay", "value": str(i)}, {"name": "Host", "value": "prod"}],
+        }
+        if i == 1:
+            request["postData"] = {"mimeType": "application/json", "text": body}
+        entries.append({
+            "startedDateTime": f"2024-05-01T12:00:00.{ms:03d}+02:00",
+            "request": request,
+            "response": {"status": 200, "content": {"text": "{" * 50}},
+        })
+    with open(har_path, "w") as fp:
+        json.dump({"log": {"version": "1.2", "entries": entries}}, fp)
+    with open(log_path, "w") as fp:
+        fp.write('10.0.0.1 - - [01/May/2024:12:00:00 +0000] "GET /a HTTP/1.1" 200 5 "-" "agent/1"\n')
+        fp.write("garbage line\n")
+        fp.write('10.0.0.1 - - [01/May/2024:12:00:01 +0000] "POST /b HTTP/1.1" 201 5 "-" "-"\n')
+    config = write_config({"url": f"http://127.0.0.1:{port}/", "headers": {"X-Env": "staging"}})
+    try:
+        result = subprocess.run(
+            [PINGA, "--replay", har_path, "--speed", "2", config], capture_output=True, text=True
+        )
+        if result.returncode != 0:
+            raise SystemExit(result.stderr.strip() or "pinga replay failed")
+        report = json.loads(result.stdout)
+        if report["entries"] != 3 or report["ok"] != 3 or report["skipped"] != 0:
+            raise SystemExit(f"unexpected replay report: {report}")
+        if report["elapsed_ms"] < 180:
+            raise SystemExit("replay ignored the capture timing")
+        if report["schedule_lag_ms"]["max"] > 100:
+            raise SystemExit("replay fell far behind schedule")
+        result = subprocess.run(
+            [PINGA, "--replay", log_path, "--speed", "10", config], capture_output=True, text=True
+        )
+        report = json.loads(result.stdout)
+        if result.returncode != 0 or report["ok"] != 2 or report["skipped"] != 1:
+            raise SystemExit(f"unexpected access log replay: {report}")
+        result = subprocess.run([PINGA, "--replay", log_path], capture_output=True, text=True)
+        if result.returncode != 65:
+            raise SystemExit("access log replay without a target should fail")
+    finally:
+        os.unlink(config)
+        os.unlink(har_path)
+        os.unlink(log_path)
+        os.rmdir(workdir)
+
+
+def test_workflow(port):
+    base = f"http://127.0.0.1:{port}"
+    workdir = tempfile.mkdtemp()
+    configs = {
+        "login": {"url": base + "/echo/login?t=tok+1", "payload": "x"},
+        "a": {"url": base + "/slow/a/{tok}", "query_params": {"s": "{tok}"}, "payload": "a"},
+        "b": {"url": base + "/slow/b", "headers": {"X-Token": "{type}"}, "payload": {"t": "{tok}"}},
+        "plain": {"url": base + "/echo/plain", "payload": "p"},
+    }
+    for name, config in configs.items():
+        with open(os.path.join(workdir, name + ".json"), "w") as f:
+            json.dump(config, f)
+    flow = {"steps": [
+        {"name": "login", "config": "login.json",
+         "capture": {"tok": "$.query.t[0]", "type": "header:content-type"}},
+        {"name": "a", "config": "a.json", "needs": ["login"]},
+        {"name": "b", "config": "b.json", "needs": ["login"]},
+        {"name": "missing", "config": "plain.json", "needs": ["a"], "capture": {"x": "$.nope"}},
+        {"name": "skipped", "config": "plain.json", "needs": ["missing"]},
+        {"name": "cleanup", "config": "plain.json", "needs": ["skipped", "b"], "always": True},
+    ]}
+    flow_path = os.path.join(workdir, "flow.json")
+    cycle_path = os.path.join(workdir, "cycle.json")
+    with open(flow_path, "w") as f:
+        json.dump(flow, f)
+    with open(cycle_path, "w") as f:
+        json.dump({"steps": [
+            {"name": "a", "config": "plain.json", "needs": ["b"]},
+            {"name": "b", "config": "plain.json", "needs": ["a"]},
+        ]}, f)
+    try:
+        EchoHandler.seen.clear()
+        result = subprocess.run([PINGA, "--workflow", flow_path], capture_output=True, text=True)
+        if result.returncode != 67:
+            raise SystemExit(result.stderr.strip() or "workflow failure did not exit 67")
+        steps = {line["step"]: line for line in map(json.loads, result.stdout.splitlines())}
+        states = {name: step["state"] for name, step in steps.items()}
+        if states != {"login": "ok", "a": "ok", "b": "ok", "missing": "failed",
+                      "skipped": "skipped", "cleanup": "ok"}:
+            raise SystemExit(f"unexpected workflow states: {states}")
+        if steps["missing"].get("capture") != "x":
+            raise SystemExit("missing capture was not reported")
+        a, b = steps["a"], steps["b"]
+        if not (b["start_ms"] < a["start_ms"] + a["latency_ms"] and
+                a["start_ms"] < b["start_ms"] + b["latency_ms"]):
+            raise SystemExit("independent workflow steps did not overlap")
+        seen = {record["path"]: record for record in EchoHandler.seen}
+        sent_a = seen.get("/slow/a/tok%201")
+        sent_b = seen.get("/slow/b")
+        if not sent_a or sent_a["query"] != {"s": ["tok 1"]}:
+            raise SystemExit("captured value did not fill the url")
+        if sent_b["headers"].get("X-Token") != "application/json" or \
+                json.loads(sent_b["body"]) != {"t": "tok 1"}:
+            raise SystemExit("captured values did not fill headers and payload")
+        cycle = subprocess.run([PINGA, "--workflow", cycle_path], capture_output=True, text=True)
+        if cycle.returncode != 65 or "cycle" not in cycle.stderr:
+            raise SystemExit("workflow cycle was not rejected")
+    finally:
+        for name in os.listdir(workdir):
+            os.unlink(os.path.join(workdir, name))
+        os.rmdir(workdir)
+
+
+def test_mirror():
+    servers = []
+    for prefix in ("", "/v2"):
+        server = ThreadingHTTPServer(("127.0.0.1", 0), MirrorHandler)
+        server.prefix = prefix
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        servers.append(server)
+    base = f"http://127.0.0.1:{servers[0].server_port}"
+    mirror = f"http://127.0.0.1:{servers[1].server_port}/v2"
+    config = write_config({
+        "url": base + "/items/{{uuid}}?n={{seq}}",
+        "payload": {"id": "{{uuid}}", "n": "{{rand_int:1:1000}}"},
+    })
+    lines = [json.dumps({"url": f"{base}/same/{i}"}) for i in range(6)]
+    lines.append(json.dumps({"url": f"{base}/diff/0"}))
+    collection = write_config([json.loads(line) for line in lines])
+    try:
+        result = subprocess.run(
+            [PINGA, "--mirror", mirror, "--requests", "10", "--concurrency", "3", config],
+            capture_output=True, text=True,
+        )
+        if result.returncode != 0 or result.stdout:
+            raise SystemExit(result.stderr.strip() or "mirror run reported mismatches")
+        summary = json.loads(result.stderr)
+        if summary["pairs"] != 10 or summary["matched"] != 10:
+            raise SystemExit("mirror sides did not render the same request")
+        result = subprocess.run(
+            [PINGA, "--mirror", mirror, "--collection", collection, "--concurrency", "2"],
+            capture_output=True, text=True,
+        )
+        if result.returncode != 67:
+            raise SystemExit("mirror mismatch did not exit 67")
+        mismatches = [json.loads(line) for line in result.stdout.splitlines()]
+        if len(mismatches) != 1 or mismatches[0]["mismatch"] != ["body"]:
+            raise SystemExit("unexpected mirror mismatch lines")
+        if not mismatches[0]["url"].endswith("/diff/0"):
+            raise SystemExit("mirror mismatch names the wrong url")
+        if json.loads(result.stderr)["matched"] != 6:
+            raise SystemExit("unexpected mirror summary")
+    finally:
+        for server in servers:
+            server.shutdown()
+        os.unlink(config)
+        os.unlink(collection)
+
+
+def test_daemon(port):
+    workdir = tempfile.mkdtemp()
+    sock = os.path.join(workdir, "pinga.sock")
+    with open(os.path.join(workdir, "body.json"), "w") as fp:
+        fp.write('{"via":"daemon"}')
+    config = write_config(
+        {"url": f"http://127.0.0.1:{port}/echo", "payload_file": "body.json"}
+    )
+    daemon = subprocess.Popen([PINGA, "--serve", sock], stderr=subprocess.DEVNULL)
+    try:
+        for _ in range(50):
+            if os.path.exists(sock):
+                break
+            time.sleep(0.05)
+        env = dict(os.environ, PINGA_SOCKET=sock)
+        local = subprocess.run([PINGA, config], capture_output=True, text=True, cwd=workdir)
+        remote = subprocess.run(
+            [PINGA, config], capture_output=True, text=True, cwd=workdir, env=env
+        )
+        if remote.returncode != 0 or local.returncode != 0:
+            raise SystemExit(remote.stderr.strip() or local.stderr.strip() or "daemon run failed")
+        envelope = json.loads(remote.stdout)
+        if json.loads(envelope["body"]["body"]) != {"via": "daemon"}:
+            raise SystemExit("daemon did not resolve payload_file from client cwd")
+        if set(envelope) != set(json.loads(local.stdout)):
+            raise SystemExit("daemon envelope differs from local envelope")
+        bad = write_config({"method": "GET"})
+        failed = subprocess.run([PINGA, bad], capture_output=True, text=True, env=env)
+        os.unlink(bad)
+        if failed.returncode != 65 or "Missing required field: url" not in failed.stderr:
+            raise SystemExit("daemon did not forward config errors")
+        # A client that stops reading a large reply must not hold up the next one.
+        with open(os.path.join(workdir, "big.bin"), "wb") as fp:
+            fp.write(b"x" * (8 << 20))
+        stuck = socket.socket(socket.AF_UNIX)
+        stuck.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        stuck.connect(sock)
+        for kind, payload in ((b"a", {"cwd": workdir}),
+                              (b"c", {"url": f"http://127.0.0.1:{port}/echo",
+                                      "payload_file": "big.bin"})):
+            data = json.dumps(payload).encode()
+            stuck.sendall(kind + struct.pack(">I", len(data)) + data)
+        stuck.settimeout(10)
+        stuck.recv(1, socket.MSG_PEEK)  # the daemon has started replying
+        started = time.monotonic()
+        quick = subprocess.run([PINGA, config], capture_output=True, text=True, cwd=workdir,
+                               env=env, timeout=30)
+        stuck.close()
+        if quick.returncode != 0 or time.monotonic() - started > 2:
+            raise SystemExit("a client that stopped reading held up the daemon")
+        piped = write_config({"url": f"http://127.0.0.1:{port}/echo",
+                              "multipart": [{"name": "in", "stdin": True}]})
+        result = subprocess.run([PINGA, "--silent", piped], input=b"piped", capture_output=True,
+                                env=env)
+        os.unlink(piped)
+        if result.returncode != 0 or b"piped" not in EchoHandler.seen[-1]["raw"]:
+            raise SystemExit("a stdin part with PINGA_SOCKET set did not run in process")
+    finally:
+        daemon.terminate()
+        daemon.wait()
+        os.unlink(config)
+        os.unlink(os.path.join(workdir, "body.json"))
+        if os.path.exists(os.path.join(workdir, "big.bin")):
+            os.unlink(os.path.join(workdir, "big.bin"))
+        os.rmdir(workdir)
+
+
+def run():
+    server = ThreadingHTTPServer(("127.0.0.1", 0), EchoHandler)
+    port = server.server_port
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    try:
+        test_echo(port)
+        test_stream(port)
+        test_http_cache(port)
+        test_unix_socket()
+        test_websocket()
+        test_load(port)
+        test_ndjson(port)
+        test_trace(port)
+        test_resolve_prewarm(port)
+        test_live_metrics(port)
+        test_generators(port)
+        test_multipart(port)
+        test_collection(port)
+        test_scenario(port)
+        test_rate(port)
+        test_capacity(port)
+        test_body_budget(port)
+        test_replay(port)
+        test_mirror()
+        test_workflow(port)
+        test_daemon(port)
+    finally:
         server.shutdown()
 
 
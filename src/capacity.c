@@ -0,0 +1,264 @@
+#include "capacity.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "util.h"
+
+#define MAX_STEPS 64
+/* A step that completes less than this share of its offered requests fails. */
+#define MIN_THROUGHPUT 0.9
+
+/* "99" is 0.99; "99.9" and "999" are 0.999: after "99", further digits are decimals. */
+static bool parse_quantile(const char *digits, double *out) {
+  char buf[16];
+  size_t len = strlen(digits);
+  if (len == 0 || len + 2 > sizeof(buf) || strspn(digits, "0123456789.") != len) {
+    return false;
+  }
+  if (!strchr(digits, '.') && len > 2) {
+    if (strncmp(digits, "99", 2) != 0) {
+      return false;
+    }
+    memcpy(buf, digits, 2);
+    buf[2] = '.';
+    memcpy(buf + 3, digits + 2, len - 1);
+  } else {
+    memcpy(buf, digits, len + 1);
+  }
+  char *end = NULL;
+  double value = strtod(buf, &end);
+  if (*end != '\0' || !(value > 0.0 && value < 100.0)) {
+    return false;
+  }
+  *out = value / 100.0;
+  return true;
+}
+
+static bool parse_error_rate(const char *text, double *out) {
+  char *end = NULL;
+  double value = strtod(text, &end);
+  if (end == text || value < 0.0) {
+    return false;
+  }
+  if (strcmp(end, "%") == 0) {
+    value /= 100.0;
+  } else if (*end != '\0') {
+    return false;
+  }
+  *out = value;
+  return value < 1.0;
+}
+
+static bool parse_term(const char *term, size_t len, struct slo *out) {
+  char buf[64];
+  const char *lt = memchr(term, '<', len);
+  if (!lt || len >= sizeof(buf)) {
+    return false;
+  }
+  size_t name_len = (size_t)(lt - term);
+  memcpy(buf, term, len);
+  buf[len] = '\0';
+  buf[name_len] = '\0';
+  const char *name = buf;
+  const char *limit = buf + name_len + 1;
+  if (strcmp(name, "errors") == 0) {
+    return out->max_error_rate < 0 && parse_error_rate(limit, &out->max_error_rate);
+  }
+  if (out->quantile_count == SLO_MAX_TERMS || name_len >= sizeof(out->names[0])) {
+    return false;
+  }
+  unsigned k = out->quantile_count;
+  uint64_t ns = 0;
+  if (strcmp(name, "max") == 0) {
+    out->quantiles[k] = 1.0;
+  } else if (name[0] != 'p' || !parse_quantile(name + 1, &out->quantiles[k])) {
+    return false;
+  }
+  if (!parse_duration(limit, &ns) || ns < 1000) {
+    return false;
+  }
+  memcpy(out->names[k], name, name_len + 1);
+  out->limits_us[k] = ns / 1000;
+  out->quantile_count++;
+  return true;
+}
+
+bool slo_parse(const char *text, struct slo *out) {
+  memset(out, 0, sizeof(*out));
+  out->max_error_rate = -1.0;
+  out->text = text;
+  const char *p = text;
+  while (*p) {
+    size_t len = strcspn(p, ",");
+    if (!parse_term(p, len, out)) {
+      fprintf(err_stream(), "Invalid SLO term '%.*s': expected pNN<duration, max<duration"
+              " or errors<rate%%.\n", (int)len, p);
+      return false;
+    }
+    p += len;
+    if (*p == ',') {
+      p++;
+    }
+  }
+  if (out->quantile_count == 0 && out->max_error_rate < 0) {
+    fprintf(err_stream(), "The SLO needs at least one term.\n");
+    return false;
+  }
+  return true;
+}
+
+static const char *check_step(const struct capacity_options *opts,
+                              const struct load_report *report, struct capacity_step *step) {
+  const struct slo *slo = &opts->slo;
+  const struct histogram *latency = &report->stats.latency;
+  double offered = opts->step_ns / 1e9 * step->rate;
+  if (step->requests == 0 || (double)step->requests < offered * MIN_THROUGHPUT) {
+    return "throughput";
+  }
+  for (unsigned k = 0; k < slo->quantile_count; k++) {
+    if (histogram_quantile(latency, slo->quantiles[k]) > slo->limits_us[k]) {
+      return slo->names[k];
+    }
+  }
+  if (slo->max_error_rate >= 0 &&
+      (double)step->errors / (double)step->requests > slo->max_error_rate) {
+    return "errors";
+  }
+  return NULL;
+}
+
+static int run_step(const struct request *req, const struct capacity_options *opts,
+                    double rate, bool search, struct capacity_step *step) {
+  struct load_options load = opts->load;
+  load.rate = rate;
+  load.warmup_ns = opts->warmup_ns;
+  load.duration_ns = opts->step_ns;
+  load.requests = 0;
+  struct load_report report;
+  int rc = load_run(req, &load, &report);
+  if (rc != EXIT_OK) {
+    load_report_free(&report);
+    return rc;
+  }
+  const struct load_stats *stats = &report.stats;
+  memset(step, 0, sizeof(*step));
+  step->search = search;
+  step->rate = rate;
+  step->rps = report.elapsed_ns ? (double)stats->completed * 1e9 / (double)report.elapsed_ns
+                                : 0.0;
+  step->requests = stats->completed;
+  step->errors = stats->errors + stats->status_classes[5];
+  step->p50_us = histogram_quantile(&stats->latency, 0.5);
+  step->p90_us = histogram_quantile(&stats->latency, 0.9);
+  step->p99_us = histogram_quantile(&stats->latency, 0.99);
+  step->max_us = stats->latency.max_us;
+  step->violated = check_step(opts, &report, step);
+  load_report_free(&report);
+  return EXIT_OK;
+}
+
+static void print_step(FILE *out, const struct capacity_step *step) {
+  double error_rate = step->requests ? (double)step->errors / (double)step->requests : 0.0;
+  fprintf(out,
+          "{\"phase\":\"%s\",\"rate\":%.1f,\"rps\":%.1f,\"requests\":%llu,\"errors\":%llu,"
+          "\"error_rate\":%.6f,\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,"
+          "\"max\":%.3f},\"pass\":%s,",
+          step->search ? "search" : "ramp", step->rate, step->rps,
+          (unsigned long long)step->requests, (unsigned long long)step->errors, error_rate,
+          step->p50_us / 1e3, step->p90_us / 1e3, step->p99_us / 1e3, step->max_us / 1e3,
+          step->violated ? "false" : "true");
+  if (step->violated) {
+    fprintf(out, "\"violated\":\"%s\"}", step->violated);
+  } else {
+    fputs("\"violated\":null}", out);
+  }
+}
+
+static int add_step(const struct request *req, const struct capacity_options *opts,
+                    struct capacity_report *report, double rate, bool search) {
+  struct capacity_step *step = &report->steps[report->step_count];
+  int rc = run_step(req, opts, rate, search, step);
+  if (rc != EXIT_OK) {
+    return rc;
+  }
+  int index = (int)report->step_count++;
+  if (opts->progress) {
+    print_step(opts->progress, step);
+    fputc('\n', opts->progress);
+    fflush(opts->progress);
+  }
+  if (step->violated) {
+    report->limit = index;
+  } else {
+    report->knee = index;
+  }
+  return EXIT_OK;
+}
+
+int capacity_run(const struct request *req, const struct capacity_options *opts,
+                 struct capacity_report *report) {
+  memset(report, 0, sizeof(*report));
+  report->slo = &opts->slo;
+  report->knee = -1;
+  report->limit = -1;
+  report->steps = (struct capacity_step *)calloc(MAX_STEPS, sizeof(struct capacity_step));
+  if (!report->steps) {
+    fprintf(err_stream(), "Out of memory while planning the capacity search.\n");
+    return EXIT_REQUEST;
+  }
+  /* Ramp: double the rate until a step misses the SLO or max_rate holds. */
+  double rate = opts->min_rate;
+  int rc = EXIT_OK;
+  while (rc == EXIT_OK && report->step_count < MAX_STEPS) {
+    rc = add_step(req, opts, report, rate, false);
+    if (rc != EXIT_OK || report->limit >= 0 || rate >= opts->max_rate) {
+      break;
+    }
+    rate = rate * 2 < opts->max_rate ? rate * 2 : opts->max_rate;
+  }
+  /* Search: halve the gap between the knee and the limit until it is within precision. */
+  while (rc == EXIT_OK && report->knee >= 0 && report->limit >= 0 &&
+         report->step_count < MAX_STEPS) {
+    double pass = report->steps[report->knee].rate;
+    double fail = report->steps[report->limit].rate;
+    if ((fail - pass) / pass <= opts->precision) {
+      break;
+    }
+    rc = add_step(req, opts, report, (pass + fail) / 2, true);
+  }
+  return rc;
+}
+
+void capacity_print_report(FILE *out, const struct capacity_report *report) {
+  char *slo = json_escape(report->slo->text);
+  fprintf(out, "{\"slo\":\"%s\",\"capacity_rps\":%.1f,\"knee\":", slo ? slo : "",
+          report->knee >= 0 ? report->steps[report->knee].rate : 0.0);
+  free(slo);
+  if (report->knee >= 0) {
+    print_step(out, &report->steps[report->knee]);
+  } else {
+    fputs("null", out);
+  }
+  fputs(",\"limit\":", out);
+  if (report->limit >= 0) {
+    print_step(out, &report->steps[report->limit]);
+  } else {
+    fputs("null", out);
+  }
+  fputs(",\"steps\":[", out);
+  for (unsigned i = 0; i < report->step_count; i++) {
+    if (i) {
+      fputc(',', out);
+    }
+    print_step(out, &report->steps[i]);
+  }
+  fputs("]}\n", out);
+}
+
+void capacity_report_free(struct capacity_report *report) {
+  free(report->steps);
+  report->steps = NULL;
+  report->step_count = 0;
+}
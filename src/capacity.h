@@ -0,0 +1,72 @@
+#ifndef PINGA_CAPACITY_H
+#define PINGA_CAPACITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "load.h"
+
+#define SLO_MAX_TERMS 8
+
+/*
+ * "p99<200ms,p50<20ms,errors<0.1%": latency quantiles measured from each
+ * request's scheduled start, and the share of requests that failed to
+ * transfer or got a 5xx.
+ */
+struct slo {
+  char names[SLO_MAX_TERMS][16]; /* "p99", as written */
+  double quantiles[SLO_MAX_TERMS];
+  uint64_t limits_us[SLO_MAX_TERMS];
+  unsigned quantile_count;
+  double max_error_rate; /* < 0: no error term */
+  const char *text;
+};
+
+/* Reports a bad term on err_stream(). A step meets a term at or under its limit. */
+bool slo_parse(const char *text, struct slo *out);
+
+/*
+ * Capacity search: open-loop load steps at a fixed rate, each after its own
+ * warm-up. The rate doubles from min_rate until a step misses the SLO, then
+ * a binary search narrows the gap between the last passing and the first
+ * failing rate to within precision.
+ */
+struct capacity_options {
+  struct load_options load; /* concurrency, threads, scenario; rate and timing are set per step */
+  struct slo slo;
+  double min_rate;
+  double max_rate;
+  double precision;  /* stop when (fail - pass) / pass is below this */
+  uint64_t step_ns;  /* measured time per step */
+  uint64_t warmup_ns;
+  FILE *progress;    /* one JSON line per finished step, or NULL */
+};
+
+struct capacity_step {
+  bool search; /* false while ramping */
+  double rate;
+  double rps;
+  uint64_t requests;
+  uint64_t errors; /* transfer errors plus 5xx */
+  uint64_t p50_us;
+  uint64_t p90_us;
+  uint64_t p99_us;
+  uint64_t max_us;
+  const char *violated; /* first failed SLO term, NULL if the step passed */
+};
+
+struct capacity_report {
+  const struct slo *slo;
+  struct capacity_step *steps;
+  unsigned step_count;
+  int knee;  /* highest passing step, -1 if none passed */
+  int limit; /* lowest failing step above it, -1 if max_rate passed */
+};
+
+int capacity_run(const struct request *req, const struct capacity_options *opts,
+                 struct capacity_report *report);
+void capacity_print_report(FILE *out, const struct capacity_report *report);
+void capacity_report_free(struct capacity_report *report);
+
+#endif
@@ -0,0 +1,244 @@
+#include "collection.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define CHUNK_SIZE (64u * 1024u)
+#define MAX_ELEMENT_SIZE (64u * 1024u * 1024u)
+
+enum layout { LAYOUT_UNKNOWN, LAYOUT_ARRAY, LAYOUT_LINES, LAYOUT_DONE };
+
+struct collection_reader {
+  FILE *fp;
+  bool owns_fp;
+  const char *const *resolve;
+  int resolve_count;
+  const char *unix_socket;
+
+  char chunk[CHUNK_SIZE];
+  size_t chunk_len;
+  size_t chunk_pos;
+  bool eof;
+
+  /* Scanner state, carried across chunk boundaries. */
+  enum layout layout;
+  int depth;
+  bool in_string;
+  bool escape;
+  bool in_element;
+
+  char *element;
+  size_t element_len;
+  size_t element_cap;
+  uint64_t count;
+};
+
+int collection_open(const char *path, struct collection_reader **out) {
+  *out = NULL;
+  struct collection_reader *r =
+      (struct collection_reader *)calloc(1, sizeof(struct collection_reader));
+  if (!r) {
+    fprintf(err_stream(), "Out of memory while opening collection.\n");
+    return EXIT_CONFIG;
+  }
+  if (strcmp(path, "-") == 0) {
+    r->fp = stdin;
+  } else {
+    r->fp = fopen(path, "rb");
+    r->owns_fp = true;
+  }
+  if (!r->fp) {
+    fprintf(err_stream(), "Failed to read collection file: %s\n", path);
+    free(r);
+    return EXIT_CONFIG;
+  }
+  *out = r;
+  return EXIT_OK;
+}
+
+void collection_set_resolve(struct collection_reader *r, const char *const *entries,
+                            int count) {
+  r->resolve = entries;
+  r->resolve_count = count;
+}
+
+void collection_set_unix_socket(struct collection_reader *r, const char *path) {
+  r->unix_socket = path;
+}
+
+static int element_push(struct collection_reader *r, char c) {
+  if (r->element_len + 1 >= r->element_cap) {
+    size_t cap = r->element_cap ? r->element_cap * 2 : 4096;
+    if (cap > MAX_ELEMENT_SIZE) {
+      fprintf(err_stream(), "Collection element %llu is larger than %u bytes.\n",
+              (unsigned long long)r->count + 1, MAX_ELEMENT_SIZE);
+      return -1;
+    }
+    char *next = (char *)realloc(r->element, cap);
+    if (!next) {
+      fprintf(err_stream(), "Out of memory while reading collection.\n");
+      return -1;
+    }
+    r->element = next;
+    r->element_cap = cap;
+  }
+  r->element[r->element_len++] = c;
+  return 0;
+}
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*
+ * Feeds one byte to the scanner. Returns 1 when an element just closed,
+ * 0 to keep going, -1 on malformed input.
+ */
+static int scan_byte(struct collection_reader *r, char c) {
+  int base = r->layout == LAYOUT_ARRAY ? 1 : 0;
+  if (r->in_element) {
+    if (element_push(r, c) != 0) {
+      return -1;
+    }
+    if (r->in_string) {
+      if (r->escape) {
+        r->escape = false;
+      } else if (c == '\\') {
+        r->escape = true;
+      } else if (c == '"') {
+        r->in_string = false;
+      }
+      return 0;
+    }
+    if (c == '"') {
+      r->in_string = true;
+    } else if (c == '{' || c == '[') {
+      r->depth++;
+    } else if (c == '}' || c == ']') {
+      if (--r->depth == base) {
+        r->in_element = false;
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  if (is_space(c)) {
+    return 0;
+  }
+  if (r->layout == LAYOUT_UNKNOWN) {
+    if (c == '[') {
+      r->layout = LAYOUT_ARRAY;
+      r->depth = 1;
+      return 0;
+    }
+    r->layout = LAYOUT_LINES;
+    base = 0;
+  }
+  if (r->layout == LAYOUT_DONE) {
+    fprintf(err_stream(), "Unexpected data after the collection array.\n");
+    return -1;
+  }
+  if (c == '{') {
+    r->in_element = true;
+    r->depth = base + 1;
+    r->element_len = 0;
+    return element_push(r, c);
+  }
+  if (r->layout == LAYOUT_ARRAY && c == ',') {
+    return 0;
+  }
+  if (r->layout == LAYOUT_ARRAY && c == ']') {
+    r->layout = LAYOUT_DONE;
+    return 0;
+  }
+  fprintf(err_stream(), "Collection element %llu is not an object.\n",
+          (unsigned long long)r->count + 1);
+  return -1;
+}
+
+static int parse_element(struct collection_reader *r, struct request *req) {
+  r->count++;
+  int rc = request_parse(r->element, r->element_len, NULL, req);
+  if (rc == EXIT_OK && request_reads_stdin(req)) {
+    fprintf(err_stream(), "Multipart stdin parts apply to single requests only.\n");
+    request_free(req);
+    rc = EXIT_REQUEST;
+  }
+  for (int i = 0; rc == EXIT_OK && i < r->resolve_count; i++) {
+    if (request_add_resolve(req, r->resolve[i]) != 0) {
+      request_free(req);
+      rc = EXIT_REQUEST;
+    }
+  }
+  if (rc == EXIT_OK && r->unix_socket && request_set_unix_socket(req, r->unix_socket) != 0) {
+    request_free(req);
+    rc = EXIT_REQUEST;
+  }
+  if (rc != EXIT_OK) {
+    fprintf(err_stream(), "(in collection element %llu)\n", (unsigned long long)r->count);
+  }
+  return rc;
+}
+
+int collection_next(struct collection_reader *r, struct request *req, bool *got) {
+  *got = false;
+  for (;;) {
+    while (r->chunk_pos < r->chunk_len) {
+      int rc = scan_byte(r, r->chunk[r->chunk_pos++]);
+      if (rc < 0) {
+        return EXIT_CONFIG;
+      }
+      if (rc > 0) {
+        rc = parse_element(r, req);
+        *got = rc == EXIT_OK;
+        return rc;
+      }
+    }
+    if (r->eof) {
+      break;
+    }
+    r->chunk_pos = 0;
+#ifndef _WIN32
+    /* read() hands back whatever a pipe has, so requests start flowing early. */
+    ssize_t n;
+    do {
+      n = read(fileno(r->fp), r->chunk, CHUNK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    r->chunk_len = n > 0 ? (size_t)n : 0;
+    r->eof = n <= 0;
+#else
+    r->chunk_len = fread(r->chunk, 1, CHUNK_SIZE, r->fp);
+    r->eof = r->chunk_len < CHUNK_SIZE;
+#endif
+  }
+  if (r->in_element || r->layout == LAYOUT_ARRAY) {
+    fprintf(err_stream(), "Collection ends in the middle of element %llu.\n",
+            (unsigned long long)r->count + 1);
+    return EXIT_CONFIG;
+  }
+  return EXIT_OK;
+}
+
+uint64_t collection_count(const struct collection_reader *r) {
+  return r->count;
+}
+
+void collection_close(struct collection_reader *r) {
+  if (!r) {
+    return;
+  }
+  if (r->owns_fp && r->fp) {
+    fclose(r->fp);
+  }
+  free(r->element);
+  free(r);
+}
@@ -0,0 +1,32 @@
+#ifndef PINGA_COLLECTION_H
+#define PINGA_COLLECTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "request.h"
+
+/*
+ * Streaming reader for request collections: a JSON array of config objects
+ * or one object per line (JSONL). The file is read in fixed-size chunks and
+ * a scanner that keeps its nesting/string state between chunks cuts out one
+ * object at a time, so memory is bounded by the largest single request.
+ */
+struct collection_reader;
+
+/* path "-" reads stdin. Returns an EXIT_* code. */
+int collection_open(const char *path, struct collection_reader **out);
+/* Extra resolve entries added to every request (borrowed, must outlive r). */
+void collection_set_resolve(struct collection_reader *r, const char *const *entries,
+                            int count);
+/* Unix socket path set on every request when not NULL (borrowed, like resolve). */
+void collection_set_unix_socket(struct collection_reader *r, const char *path);
+/*
+ * Parses the next request into req. Returns EXIT_OK with *got false at the
+ * end of input, or an EXIT_* code (already reported) for a bad element.
+ */
+int collection_next(struct collection_reader *r, struct request *req, bool *got);
+uint64_t collection_count(const struct collection_reader *r);
+void collection_close(struct collection_reader *r);
+
+#endif
@@ -0,0 +1,685 @@
+#include "daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "request.h"
+
+#define FRAME_HEADER_LEN 5
+#define MAX_FRAME_LEN (64u * 1024u * 1024u)
+#define DAEMON_MAX_CONNECTS 64L
+/* Output goes back in frames of up to this many bytes. */
+#define REPLY_CHUNK 65536u
+/* Frames queued for one client per pass, so a fast reader cannot starve the rest. */
+#define REPLY_BURST 16u
+
+enum {
+  FRAME_OPTIONS = 'a',
+  FRAME_CONFIG = 'c',
+  FRAME_STDOUT = 'o',
+  FRAME_STDERR = 'e',
+  FRAME_EXIT = 'x'
+};
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static volatile sig_atomic_t stop_requested;
+
+static int send_all(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, SEND_FLAGS);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static int recv_all(int fd, void *data, size_t len) {
+  char *p = (char *)data;
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static void put_be32(unsigned char *dst, uint32_t v) {
+  dst[0] = (unsigned char)(v >> 24);
+  dst[1] = (unsigned char)(v >> 16);
+  dst[2] = (unsigned char)(v >> 8);
+  dst[3] = (unsigned char)v;
+}
+
+static uint32_t get_be32(const unsigned char *src) {
+  return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) |
+         (uint32_t)src[3];
+}
+
+static int send_frame(int fd, char type, const void *data, size_t len) {
+  unsigned char header[FRAME_HEADER_LEN];
+  header[0] = (unsigned char)type;
+  put_be32(header + 1, (uint32_t)len);
+  if (send_all(fd, header, sizeof(header)) != 0) {
+    return -1;
+  }
+  return len ? send_all(fd, data, len) : 0;
+}
+
+static int connect_unix(const char *path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, strlen(path) + 1);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  return fd;
+}
+
+/* ---- client side ---- */
+
+int daemon_forward(const char *socket_path, const char *config_path,
+                   const struct single_options *opts) {
+  size_t config_len = 0;
+  char *config = read_file(config_path, &config_len);
+  if (!config) {
+    return -1;
+  }
+  int fd = connect_unix(socket_path);
+  if (fd < 0) {
+    free(config);
+    return -1;
+  }
+
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    cwd[0] = '\0';
+  }
+  char *cwd_esc = json_escape(cwd);
+  size_t options_cap = (cwd_esc ? strlen(cwd_esc) : 0) + 96;
+  char *options = (char *)malloc(options_cap);
+  if (!cwd_esc || !options) {
+    free(cwd_esc);
+    free(options);
+    free(config);
+    close(fd);
+    return -1;
+  }
+  int options_len = snprintf(options, options_cap,
+                             "{\"cwd\":\"%s\",\"silent\":%s,\"include_headers\":%s}",
+                             cwd_esc, opts->use_exit_codes ? "true" : "false",
+                             opts->include_headers ? "true" : "false");
+  free(cwd_esc);
+  int sent = send_frame(fd, FRAME_OPTIONS, options, (size_t)options_len) == 0 &&
+             send_frame(fd, FRAME_CONFIG, config, config_len) == 0;
+  free(options);
+  free(config);
+  if (!sent) {
+    close(fd);
+    return -1;
+  }
+
+  int rc = -1;
+  char *payload = NULL;
+  for (;;) {
+    unsigned char header[FRAME_HEADER_LEN];
+    if (recv_all(fd, header, sizeof(header)) != 0) {
+      break;
+    }
+    uint32_t len = get_be32(header + 1);
+    if (len > MAX_FRAME_LEN) {
+      break;
+    }
+    char *next = (char *)realloc(payload, len ? len : 1);
+    if (!next) {
+      break;
+    }
+    payload = next;
+    if (len && recv_all(fd, payload, len) != 0) {
+      break;
+    }
+    if (header[0] == FRAME_STDOUT) {
+      fwrite(payload, 1, len, stdout);
+    } else if (header[0] == FRAME_STDERR) {
+      fwrite(payload, 1, len, stderr);
+    } else if (header[0] == FRAME_EXIT && len == 4) {
+      rc = (int)get_be32((const unsigned char *)payload);
+      break;
+    }
+  }
+  free(payload);
+  close(fd);
+  if (rc < 0) {
+    fprintf(stderr, "Lost connection to pinga daemon at %s.\n", socket_path);
+    return EXIT_HTTP;
+  }
+  return rc;
+}
+
+/* ---- server side ---- */
+
+struct client {
+  int fd;
+  struct response_buffer in;
+  char *cwd;
+  struct single_options opts;
+  bool have_opts;
+  CURL *easy;
+  curl_mime *mime;
+  struct request req;
+  struct single_run run;
+  FILE *err;
+  char *err_data;
+  size_t err_len;
+  /*
+   * Replies are streamed: output is framed as run.out grows and sent without
+   * blocking, so a client that stops reading holds up nobody else.
+   */
+  struct response_buffer reply; /* queued frames */
+  size_t reply_sent;            /* bytes of reply already sent */
+  off_t out_framed; /* bytes of run.out already framed */
+  int rc;
+  bool finished; /* the stderr and exit frames follow the output */
+  bool closing;  /* the exit frame is queued */
+  struct client *next;
+};
+
+struct daemon {
+  int listen_fd;
+  CURLM *multi;
+  CURLSH *share;
+  struct client *clients;
+  uint64_t served; /* {{seq}} for the next request */
+};
+
+static void on_stop_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+static void client_free(struct daemon *d, struct client *c) {
+  struct client **it = &d->clients;
+  while (*it && *it != c) {
+    it = &(*it)->next;
+  }
+  if (*it) {
+    *it = c->next;
+  }
+  if (c->easy) {
+    curl_multi_remove_handle(d->multi, c->easy);
+    curl_easy_cleanup(c->easy);
+  }
+  curl_mime_free(c->mime);
+  if (c->run.out) {
+    fclose(c->run.out);
+  }
+  if (c->err) {
+    fclose(c->err);
+  }
+  single_cleanup(&c->run);
+  request_free(&c->req);
+  free(c->err_data);
+  free(c->reply.data);
+  free(c->in.data);
+  free(c->cwd);
+  if (c->fd >= 0) {
+    close(c->fd);
+  }
+  free(c);
+}
+
+static int queue_frame(struct client *c, char type, const void *data, size_t len) {
+  unsigned char header[FRAME_HEADER_LEN];
+  header[0] = (unsigned char)type;
+  put_be32(header + 1, (uint32_t)len);
+  if (write_buffer(header, 1, sizeof(header), &c->reply) != sizeof(header)) {
+    return -1;
+  }
+  return len && write_buffer((void *)data, 1, len, &c->reply) != len ? -1 : 0;
+}
+
+/* Frames the next chunk of run.out; 1 when one was queued, 0 when there is none yet. */
+static int queue_output(struct client *c) {
+  if (!c->run.out) {
+    return 0;
+  }
+  off_t size = fflush(c->run.out) == 0 ? ftello(c->run.out) : -1;
+  if (size < 0) {
+    return -1;
+  }
+  if (size == c->out_framed) {
+    return 0;
+  }
+  char chunk[REPLY_CHUNK];
+  off_t left = size - c->out_framed;
+  size_t want = left < (off_t)sizeof(chunk) ? (size_t)left : sizeof(chunk);
+  /* pread leaves the stream's own offset alone, so curl keeps appending. */
+  ssize_t n;
+  do {
+    n = pread(fileno(c->run.out), chunk, want, c->out_framed);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0 || queue_frame(c, FRAME_STDOUT, chunk, (size_t)n) != 0) {
+    return -1;
+  }
+  c->out_framed += n;
+  return 1;
+}
+
+/* Sends what is queued and queues more; false once the client is gone. */
+static bool client_flush(struct daemon *d, struct client *c) {
+  for (unsigned burst = 0;;) {
+    while (c->reply_sent < c->reply.len) {
+      ssize_t n = send(c->fd, c->reply.data + c->reply_sent, c->reply.len - c->reply_sent,
+                       SEND_FLAGS);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      }
+      if (n <= 0) {
+        client_free(d, c);
+        return false;
+      }
+      c->reply_sent += (size_t)n;
+    }
+    c->reply.len = 0;
+    c->reply_sent = 0;
+    if (c->closing) {
+      client_free(d, c);
+      return false;
+    }
+    int queued = queue_output(c);
+    if (queued == 0 && c->finished) {
+      unsigned char code[4];
+      put_be32(code, (uint32_t)c->rc);
+      bool ok = (c->err_len == 0 || queue_frame(c, FRAME_STDERR, c->err_data, c->err_len) == 0) &&
+                queue_frame(c, FRAME_EXIT, code, sizeof(code)) == 0;
+      queued = ok ? 1 : -1;
+      c->closing = true;
+    }
+    if (queued < 0) {
+      client_free(d, c);
+      return false;
+    }
+    /* Either nothing to send yet, or a frame is queued and POLLOUT brings us back. */
+    if (queued == 0 || ++burst == REPLY_BURST) {
+      return true;
+    }
+  }
+}
+
+/* Ends the request; the rest of the output, stderr and the exit code follow. */
+static void client_reply(struct daemon *d, struct client *c, int rc) {
+  if (c->err) {
+    fclose(c->err);
+    c->err = NULL;
+  }
+  if (c->easy) {
+    curl_multi_remove_handle(d->multi, c->easy);
+    curl_easy_cleanup(c->easy);
+    c->easy = NULL;
+  }
+  c->rc = rc;
+  c->finished = true;
+  client_flush(d, c);
+}
+
+static bool token_is_true(const char *json, const jsmntok_t *tok) {
+  return tok->type == JSMN_PRIMITIVE && json[tok->start] == 't';
+}
+
+static void client_parse_options(struct client *c, const char *json, size_t len) {
+  jsmn_parser parser;
+  jsmntok_t *tokens = NULL;
+  int count = 0;
+  c->opts.use_exit_codes = false;
+  c->opts.include_headers = true;
+  c->have_opts = true;
+  if (ensure_tokens(&parser, json, len, &tokens, &count) != 0 || count < 1) {
+    free(tokens);
+    return;
+  }
+  int idx = find_object_value(json, tokens, 0, "cwd");
+  if (idx >= 0 && tokens[idx].end > tokens[idx].start) {
+    c->cwd = dup_token_string(json, &tokens[idx]);
+  }
+  idx = find_object_value(json, tokens, 0, "silent");
+  if (idx >= 0) {
+    c->opts.use_exit_codes = token_is_true(json, &tokens[idx]);
+  }
+  idx = find_object_value(json, tokens, 0, "include_headers");
+  if (idx >= 0) {
+    c->opts.include_headers = token_is_true(json, &tokens[idx]);
+  }
+  free(tokens);
+}
+
+static void client_start(struct daemon *d, struct client *c, const char *json, size_t len) {
+  c->err = open_memstream(&c->err_data, &c->err_len);
+  c->run.opts = c->opts;
+  c->run.out = temp_file();
+  if (!c->err || !c->run.out) {
+    client_reply(d, c, EXIT_HTTP);
+    return;
+  }
+  set_err_stream(c->err);
+  int rc = request_parse(json, len, c->cwd, &c->req);
+  if (rc == EXIT_OK) {
+    rc = request_expand(&c->req, d->served++);
+  }
+  if (rc == EXIT_OK && request_reads_stdin(&c->req)) {
+    /* Clients run such configs themselves; this only guards the socket. */
+    fprintf(c->err, "Multipart stdin parts cannot go through the daemon.\n");
+    rc = EXIT_REQUEST;
+  }
+  set_err_stream(NULL);
+  if (rc != EXIT_OK) {
+    client_reply(d, c, rc);
+    return;
+  }
+  c->easy = curl_easy_init();
+  if (!c->easy) {
+    fprintf(c->err, "Failed to init curl.\n");
+    client_reply(d, c, EXIT_HTTP);
+    return;
+  }
+  request_apply(c->easy, &c->req);
+  if (c->req.part_count) {
+    set_err_stream(c->err);
+    c->mime = request_mime(c->easy, &c->req);
+    set_err_stream(NULL);
+    if (!c->mime) {
+      client_reply(d, c, EXIT_CONFIG);
+      return;
+    }
+  }
+  single_setup(c->easy, &c->run);
+  curl_easy_setopt(c->easy, CURLOPT_SHARE, d->share);
+  curl_easy_setopt(c->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(c->easy, CURLOPT_PRIVATE, c);
+  if (curl_multi_add_handle(d->multi, c->easy) != CURLM_OK) {
+    fprintf(c->err, "Failed to queue request.\n");
+    client_reply(d, c, EXIT_HTTP);
+  }
+}
+
+/* Consumes complete frames; returns false once the client is gone. */
+static bool client_read(struct daemon *d, struct client *c) {
+  char chunk[16384];
+  ssize_t n = recv(c->fd, chunk, sizeof(chunk), 0);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return true;
+  }
+  if (n <= 0 || write_buffer(chunk, 1, (size_t)n, &c->in) != (size_t)n) {
+    client_free(d, c);
+    return false;
+  }
+  while (c->in.len >= FRAME_HEADER_LEN) {
+    const unsigned char *head = (const unsigned char *)c->in.data;
+    uint32_t len = get_be32(head + 1);
+    if (len > MAX_FRAME_LEN) {
+      client_free(d, c);
+      return false;
+    }
+    if (c->in.len < FRAME_HEADER_LEN + (size_t)len) {
+      return true;
+    }
+    const char *payload = c->in.data + FRAME_HEADER_LEN;
+    if (head[0] == FRAME_OPTIONS) {
+      client_parse_options(c, payload, len);
+    } else if (head[0] == FRAME_CONFIG) {
+      if (!c->have_opts) {
+        client_parse_options(c, "{}", 2);
+      }
+      client_start(d, c, payload, len);
+      return false;
+    }
+    size_t consumed = FRAME_HEADER_LEN + (size_t)len;
+    memmove(c->in.data, c->in.data + consumed, c->in.len - consumed);
+    c->in.len -= consumed;
+  }
+  return true;
+}
+
+static void accept_clients(struct daemon *d) {
+  for (;;) {
+    int fd = accept(d->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    struct client *c = (struct client *)calloc(1, sizeof(struct client));
+    if (!c) {
+      close(fd);
+      continue;
+    }
+    c->fd = fd;
+    c->next = d->clients;
+    d->clients = c;
+  }
+}
+
+static void drain_finished(struct daemon *d) {
+  CURLMsg *msg;
+  int left = 0;
+  while ((msg = curl_multi_info_read(d->multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    void *priv = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    struct client *c = (struct client *)priv;
+    CURLcode res = msg->data.result;
+    set_err_stream(c->err);
+    int rc = single_finish(c->easy, res, &c->run);
+    set_err_stream(NULL);
+    client_reply(d, c, rc);
+  }
+}
+
+static int open_listener(const char *path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return -1;
+  }
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "Refusing to replace non-socket file: %s\n", path);
+      return -1;
+    }
+    int probe = connect_unix(path);
+    if (probe >= 0) {
+      close(probe);
+      fprintf(stderr, "A pinga daemon is already listening on %s\n", path);
+      return -1;
+    }
+    unlink(path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, strlen(path) + 1);
+  mode_t old_mask = umask(077);
+  int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (bound != 0 || listen(fd, 128) != 0) {
+    fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+int daemon_serve(const char *socket_path) {
+  struct daemon d;
+  memset(&d, 0, sizeof(d));
+  d.listen_fd = open_listener(socket_path);
+  if (d.listen_fd < 0) {
+    return EXIT_REQUEST;
+  }
+  d.multi = curl_multi_init();
+  d.share = curl_share_init();
+  if (!d.multi || !d.share) {
+    fprintf(stderr, "Failed to init curl.\n");
+    close(d.listen_fd);
+    unlink(socket_path);
+    return EXIT_HTTP;
+  }
+  /* Single-threaded, so the share needs no lock callbacks. */
+  curl_share_setopt(d.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(d.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_multi_setopt(d.multi, CURLMOPT_MAXCONNECTS, DAEMON_MAX_CONNECTS);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_stop_signal);
+  signal(SIGTERM, on_stop_signal);
+  fprintf(stderr, "pinga daemon listening on %s\n", socket_path);
+
+  struct curl_waitfd *fds = NULL;
+  size_t fds_cap = 0;
+  while (!stop_requested) {
+    size_t wanted = 1;
+    for (struct client *c = d.clients; c; c = c->next) {
+      wanted++;
+    }
+    if (wanted > fds_cap) {
+      struct curl_waitfd *next = (struct curl_waitfd *)realloc(fds, wanted * sizeof(*fds));
+      if (!next) {
+        break;
+      }
+      fds = next;
+      fds_cap = wanted;
+    }
+    unsigned nfds = 0;
+    fds[nfds].fd = d.listen_fd;
+    fds[nfds].events = CURL_WAIT_POLLIN;
+    fds[nfds++].revents = 0;
+    for (struct client *c = d.clients; c; c = c->next) {
+      bool reading = !c->easy && !c->finished;
+      bool writing = c->reply_sent < c->reply.len;
+      if (reading || writing) {
+        fds[nfds].fd = c->fd;
+        fds[nfds].events = (short)((reading ? CURL_WAIT_POLLIN : 0) |
+                                   (writing ? CURL_WAIT_POLLOUT : 0));
+        fds[nfds++].revents = 0;
+      }
+    }
+    curl_multi_poll(d.multi, fds, nfds, 500, NULL);
+
+    for (unsigned i = 1; i < nfds; i++) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      for (struct client *c = d.clients; c; c = c->next) {
+        if (c->fd != fds[i].fd) {
+          continue;
+        }
+        if (c->reply_sent < c->reply.len) {
+          client_flush(&d, c);
+        } else if (!c->easy && !c->finished) {
+          client_read(&d, c);
+        }
+        break;
+      }
+    }
+    if (fds[0].revents) {
+      accept_clients(&d);
+    }
+    int running = 0;
+    curl_multi_perform(d.multi, &running);
+    drain_finished(&d);
+    /* Output written since the last pass goes out while the request runs. */
+    for (struct client *c = d.clients, *next; c; c = next) {
+      next = c->next;
+      if (c->easy && c->reply_sent == c->reply.len) {
+        client_flush(&d, c);
+      }
+    }
+  }
+
+  free(fds);
+  while (d.clients) {
+    client_free(&d, d.clients);
+  }
+  curl_multi_cleanup(d.multi);
+  curl_share_cleanup(d.share);
+  close(d.listen_fd);
+  unlink(socket_path);
+  return EXIT_OK;
+}
+
+#else
+
+int daemon_serve(const char *socket_path) {
+  (void)socket_path;
+  fprintf(stderr, "--serve is not supported on this platform.\n");
+  return EXIT_REQUEST;
+}
+
+int daemon_forward(const char *socket_path, const char *config_path,
+                   const struct single_options *opts) {
+  (void)socket_path;
+  (void)config_path;
+  (void)opts;
+  return -1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PINGA_DAEMON_H
+#define PINGA_DAEMON_H
+
+#include "single.h"
+
+/*
+ * Long-lived server on a Unix domain socket. Each client sends one request
+ * config and gets back exactly what a local run would print, while the
+ * daemon keeps DNS, TLS sessions and connections warm between clients.
+ *
+ * Wire format, both directions: 1 byte frame type, 4 byte big-endian length,
+ * payload. Client frames: 'a' options JSON, 'c' config JSON. Daemon frames:
+ * 'o' stdout bytes, sent as the run writes them, 'e' stderr bytes, 'x' 4 byte
+ * exit code (always last).
+ */
+int daemon_serve(const char *socket_path);
+
+/*
+ * Runs the config through a daemon listening on socket_path. Returns the exit
+ * code, or -1 when no daemon answered and the caller should run locally.
+ */
+int daemon_forward(const char *socket_path, const char *config_path,
+                   const struct single_options *opts);
+
+#endif
@@ -0,0 +1,353 @@
+#include "generate.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define MAX_PLACEHOLDER 64
+#define MAX_RAND_STR (1u << 20)
+#define MAX_DECIMAL 20 /* "18446744073709551615", "-9223372036854775808" */
+
+enum gen_kind { GEN_LITERAL, GEN_SEQ, GEN_UUID, GEN_RAND_INT, GEN_RAND_STR, GEN_NOW_MS };
+
+struct gen_part {
+  enum gen_kind kind;
+  size_t offset; /* literal: start in text */
+  size_t len;    /* literal: byte count; rand_str: output length */
+  int64_t min;   /* rand_int */
+  uint64_t span; /* rand_int: b - a + 1, 0 for the whole 64-bit range */
+};
+
+struct gen_template {
+  char *text;
+  struct gen_part *parts;
+  size_t part_count;
+  size_t part_cap;
+  size_t max_len;
+};
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+void gen_rng_seed(struct gen_rng *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = splitmix64(&seed);
+  }
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+uint64_t gen_rng_next(struct gen_rng *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+static bool inner_is(const char *inner, size_t len, const char *name) {
+  size_t name_len = strlen(name);
+  return len == name_len && memcmp(inner, name, len) == 0;
+}
+
+static bool inner_has_prefix(const char *inner, size_t len, const char *prefix) {
+  size_t prefix_len = strlen(prefix);
+  return len >= prefix_len && memcmp(inner, prefix, prefix_len) == 0;
+}
+
+size_t gen_placeholder_len(const char *text, size_t len) {
+  if (len < 4 || text[0] != '{' || text[1] != '{') {
+    return 0;
+  }
+  size_t limit = len < MAX_PLACEHOLDER ? len : MAX_PLACEHOLDER;
+  for (size_t i = 2; i + 1 < limit; i++) {
+    if (text[i] != '}' || text[i + 1] != '}') {
+      continue;
+    }
+    const char *inner = text + 2;
+    size_t inner_len = i - 2;
+    if (inner_is(inner, inner_len, "seq") || inner_is(inner, inner_len, "uuid") ||
+        inner_is(inner, inner_len, "now_ms") ||
+        inner_has_prefix(inner, inner_len, "rand_int:") ||
+        inner_has_prefix(inner, inner_len, "rand_str:")) {
+      return i + 2;
+    }
+    return 0;
+  }
+  return 0;
+}
+
+static struct gen_part *add_part(struct gen_template *t, enum gen_kind kind) {
+  if (t->part_count == t->part_cap) {
+    size_t cap = t->part_cap ? t->part_cap * 2 : 8;
+    struct gen_part *next =
+        (struct gen_part *)realloc(t->parts, cap * sizeof(struct gen_part));
+    if (!next) {
+      return NULL;
+    }
+    t->parts = next;
+    t->part_cap = cap;
+  }
+  struct gen_part *part = &t->parts[t->part_count++];
+  memset(part, 0, sizeof(*part));
+  part->kind = kind;
+  return part;
+}
+
+static bool parse_int(const char *text, long long *out) {
+  if (!*text) {
+    return false;
+  }
+  errno = 0;
+  char *end = NULL;
+  *out = strtoll(text, &end, 10);
+  return errno == 0 && *end == '\0';
+}
+
+/* Fills part from a placeholder's inner text ("rand_int:1:9"); false if invalid. */
+static bool parse_placeholder(char *inner, struct gen_part *part, const char **why) {
+  if (strcmp(inner, "seq") == 0) {
+    part->kind = GEN_SEQ;
+    return true;
+  }
+  if (strcmp(inner, "uuid") == 0) {
+    part->kind = GEN_UUID;
+    return true;
+  }
+  if (strcmp(inner, "now_ms") == 0) {
+    part->kind = GEN_NOW_MS;
+    return true;
+  }
+  if (strncmp(inner, "rand_str:", 9) == 0) {
+    long long n = 0;
+    if (!parse_int(inner + 9, &n) || n < 1 || n > (long long)MAX_RAND_STR) {
+      *why = "length must be between 1 and 1048576";
+      return false;
+    }
+    part->kind = GEN_RAND_STR;
+    part->len = (size_t)n;
+    return true;
+  }
+  /* rand_int:a:b */
+  char *lo = inner + 9;
+  char *hi = strchr(lo, ':');
+  long long a = 0;
+  long long b = 0;
+  if (hi) {
+    *hi++ = '\0';
+  }
+  if (!hi || !parse_int(lo, &a) || !parse_int(hi, &b)) {
+    *why = "expected rand_int:min:max";
+    return false;
+  }
+  if (a > b) {
+    *why = "min is greater than max";
+    return false;
+  }
+  part->kind = GEN_RAND_INT;
+  part->min = (int64_t)a;
+  part->span = (uint64_t)b - (uint64_t)a + 1;
+  return true;
+}
+
+static bool add_literal(struct gen_template *t, size_t start, size_t end) {
+  if (end == start) {
+    return true;
+  }
+  struct gen_part *lit = add_part(t, GEN_LITERAL);
+  if (!lit) {
+    return false;
+  }
+  lit->offset = start;
+  lit->len = end - start;
+  t->max_len += lit->len;
+  return true;
+}
+
+static size_t part_max_len(const struct gen_part *part) {
+  switch (part->kind) {
+    case GEN_UUID:
+      return 36;
+    case GEN_RAND_STR:
+      return part->len;
+    default:
+      return MAX_DECIMAL;
+  }
+}
+
+static bool has_placeholder(const char *text, size_t len) {
+  const char *p = text;
+  const char *end = text + len;
+  while ((p = memchr(p, '{', (size_t)(end - p))) != NULL) {
+    if (gen_placeholder_len(p, (size_t)(end - p))) {
+      return true;
+    }
+    p++;
+  }
+  return false;
+}
+
+int gen_compile(const char *text, size_t len, struct gen_template **out) {
+  *out = NULL;
+  if (!has_placeholder(text, len)) {
+    return 0;
+  }
+  struct gen_template *t = (struct gen_template *)calloc(1, sizeof(struct gen_template));
+  if (!t || !(t->text = (char *)malloc(len ? len : 1))) {
+    free(t);
+    fprintf(err_stream(), "Out of memory while compiling generators.\n");
+    return -1;
+  }
+  memcpy(t->text, text, len);
+  bool ok = true;
+  size_t literal_start = 0;
+  for (size_t i = 0; ok && i + 1 < len; i++) {
+    size_t n = text[i] == '{' ? gen_placeholder_len(text + i, len - i) : 0;
+    if (n == 0) {
+      continue;
+    }
+    ok = add_literal(t, literal_start, i);
+    struct gen_part *part = ok ? add_part(t, GEN_LITERAL) : NULL;
+    if (!part) {
+      ok = false;
+      break;
+    }
+    char inner[MAX_PLACEHOLDER];
+    memcpy(inner, text + i + 2, n - 4);
+    inner[n - 4] = '\0';
+    const char *why = NULL;
+    if (!parse_placeholder(inner, part, &why)) {
+      fprintf(err_stream(), "Invalid generator '%.*s': %s.\n", (int)n, text + i, why);
+      gen_free(t);
+      return -1;
+    }
+    t->max_len += part_max_len(part);
+    i += n - 1;
+    literal_start = i + 1;
+  }
+  if (!ok || !add_literal(t, literal_start, len)) {
+    fprintf(err_stream(), "Out of memory while compiling generators.\n");
+    gen_free(t);
+    return -1;
+  }
+  *out = t;
+  return 0;
+}
+
+size_t gen_max_len(const struct gen_template *t) {
+  return t->max_len;
+}
+
+static size_t put_u64(char *out, uint64_t v) {
+  char tmp[MAX_DECIMAL];
+  size_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  for (size_t i = 0; i < n; i++) {
+    out[i] = tmp[n - 1 - i];
+  }
+  return n;
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+static const char alnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+static size_t put_uuid(char *out, struct gen_rng *rng) {
+  uint64_t hi = gen_rng_next(rng);
+  uint64_t lo = gen_rng_next(rng);
+  hi = (hi & ~0xf000ull) | 0x4000ull;                          /* version 4 */
+  lo = (lo & 0x3fffffffffffffffull) | 0x8000000000000000ull;   /* RFC 4122 variant */
+  char *p = out;
+  for (int i = 15; i >= 0; i--) {
+    *p++ = hex_digits[(hi >> (i * 4)) & 0xf];
+    if (i == 8 || i == 4) {
+      *p++ = '-';
+    }
+  }
+  *p++ = '-';
+  for (int i = 15; i >= 0; i--) {
+    *p++ = hex_digits[(lo >> (i * 4)) & 0xf];
+    if (i == 12) {
+      *p++ = '-';
+    }
+  }
+  return (size_t)(p - out);
+}
+
+/* Five characters per draw: each 12-bit slice is scaled onto the alphabet. */
+static void put_rand_str(char *out, size_t len, struct gen_rng *rng) {
+  size_t i = 0;
+  while (i < len) {
+    uint64_t r = gen_rng_next(rng);
+    for (int k = 0; k < 5 && i < len; k++, r >>= 12) {
+      out[i++] = alnum[((r & 0xfff) * 62) >> 12];
+    }
+  }
+}
+
+size_t gen_render(const struct gen_template *t, struct gen_rng *rng, uint64_t seq, char *buf) {
+  char *p = buf;
+  uint64_t now = 0;
+  for (size_t i = 0; i < t->part_count; i++) {
+    const struct gen_part *part = &t->parts[i];
+    switch (part->kind) {
+      case GEN_LITERAL:
+        memcpy(p, t->text + part->offset, part->len);
+        p += part->len;
+        break;
+      case GEN_SEQ:
+        p += put_u64(p, seq);
+        break;
+      case GEN_UUID:
+        p += put_uuid(p, rng);
+        break;
+      case GEN_RAND_INT: {
+        uint64_t r = gen_rng_next(rng);
+        uint64_t v = (uint64_t)part->min + (part->span ? r % part->span : r);
+        if ((int64_t)v < 0) {
+          *p++ = '-';
+          v = 0 - v;
+        }
+        p += put_u64(p, v);
+        break;
+      }
+      case GEN_RAND_STR:
+        put_rand_str(p, part->len, rng);
+        p += part->len;
+        break;
+      case GEN_NOW_MS:
+        if (now == 0) {
+          now = wall_clock_ms();
+        }
+        p += put_u64(p, now);
+        break;
+    }
+  }
+  return (size_t)(p - buf);
+}
+
+void gen_free(struct gen_template *t) {
+  if (!t) {
+    return;
+  }
+  free(t->parts);
+  free(t->text);
+  free(t);
+}
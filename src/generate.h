@@ -0,0 +1,47 @@
+#ifndef PINGA_GENERATE_H
+#define PINGA_GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Generator placeholders for url, header and payload text:
+ *
+ *   {{seq}}             request sequence number
+ *   {{uuid}}            random version 4 UUID
+ *   {{rand_int:a:b}}    integer in [a, b]
+ *   {{rand_str:n}}      n random alphanumeric characters
+ *   {{now_ms}}          wall clock, milliseconds since the epoch
+ *
+ * Text is compiled once; rendering writes into a caller buffer of
+ * gen_max_len() bytes and never allocates. Other {{...}} text is literal.
+ */
+
+/* xoshiro256**; one per thread, no locking. */
+struct gen_rng {
+  uint64_t s[4];
+};
+
+void gen_rng_seed(struct gen_rng *rng, uint64_t seed);
+uint64_t gen_rng_next(struct gen_rng *rng);
+
+struct gen_template;
+
+/*
+ * Length of the placeholder starting at text (0 if there is none). Broken
+ * arguments to a known generator count as a placeholder so that
+ * gen_compile can report them.
+ */
+size_t gen_placeholder_len(const char *text, size_t len);
+
+/*
+ * Returns 0 with *out NULL when text has no placeholders, or -1 after
+ * reporting an invalid one on err_stream().
+ */
+int gen_compile(const char *text, size_t len, struct gen_template **out);
+size_t gen_max_len(const struct gen_template *t);
+/* Writes at most gen_max_len(t) bytes (no NUL) and returns the length. */
+size_t gen_render(const struct gen_template *t, struct gen_rng *rng, uint64_t seq, char *buf);
+void gen_free(struct gen_template *t);
+
+#endif
@@ -0,0 +1,112 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define P1 11400714785074694791ull
+#define P2 14029467366897019727ull
+#define P3 1609587929392839161ull
+#define P4 9650029242287828579ull
+#define P5 2870177450012600261ull
+
+static uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t lane(uint64_t acc, uint64_t input) {
+  acc += input * P2;
+  acc = rotl(acc, 31);
+  return acc * P1;
+}
+
+static uint64_t merge(uint64_t acc, uint64_t v) {
+  acc ^= lane(0, v);
+  return acc * P1 + P4;
+}
+
+static void stripe(uint64_t v[4], const unsigned char *p) {
+  v[0] = lane(v[0], read64(p));
+  v[1] = lane(v[1], read64(p + 8));
+  v[2] = lane(v[2], read64(p + 16));
+  v[3] = lane(v[3], read64(p + 24));
+}
+
+void xxh64_reset(struct xxh64_state *st, uint64_t seed) {
+  memset(st, 0, sizeof(*st));
+  st->seed = seed;
+  st->v[0] = seed + P1 + P2;
+  st->v[1] = seed + P2;
+  st->v[2] = seed;
+  st->v[3] = seed - P1;
+}
+
+void xxh64_update(struct xxh64_state *st, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  const unsigned char *end = p + len;
+  st->total_len += len;
+  if (st->mem_len + len < 32) {
+    memcpy(st->mem + st->mem_len, p, len);
+    st->mem_len += len;
+    return;
+  }
+  if (st->mem_len) {
+    size_t fill = 32 - st->mem_len;
+    memcpy(st->mem + st->mem_len, p, fill);
+    stripe(st->v, st->mem);
+    p += fill;
+    st->mem_len = 0;
+  }
+  while (end - p >= 32) {
+    stripe(st->v, p);
+    p += 32;
+  }
+  st->mem_len = (size_t)(end - p);
+  memcpy(st->mem, p, st->mem_len);
+}
+
+uint64_t xxh64_digest(const struct xxh64_state *st) {
+  uint64_t h;
+  if (st->total_len >= 32) {
+    h = rotl(st->v[0], 1) + rotl(st->v[1], 7) + rotl(st->v[2], 12) + rotl(st->v[3], 18);
+    for (int i = 0; i < 4; i++) {
+      h = merge(h, st->v[i]);
+    }
+  } else {
+    h = st->seed + P5;
+  }
+  h += st->total_len;
+  const unsigned char *p = st->mem;
+  const unsigned char *end = p + st->mem_len;
+  while (end - p >= 8) {
+    h ^= lane(0, read64(p));
+    h = rotl(h, 27) * P1 + P4;
+    p += 8;
+  }
+  if (end - p >= 4) {
+    h ^= (uint64_t)read32(p) * P1;
+    h = rotl(h, 23) * P2 + P3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (uint64_t)*p * P5;
+    h = rotl(h, 11) * P1;
+    p++;
+  }
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
@@ -0,0 +1,24 @@
+#ifndef PINGA_HASH_H
+#define PINGA_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming XXH64: bodies are fingerprinted chunk by chunk as they arrive,
+ * without being stored. Output matches the reference XXH64 on little-endian
+ * hosts.
+ */
+struct xxh64_state {
+  uint64_t total_len;
+  uint64_t v[4];
+  unsigned char mem[32];
+  size_t mem_len;
+  uint64_t seed;
+};
+
+void xxh64_reset(struct xxh64_state *st, uint64_t seed);
+void xxh64_update(struct xxh64_state *st, const void *data, size_t len);
+uint64_t xxh64_digest(const struct xxh64_state *st);
+
+#endif
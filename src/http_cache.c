@@ -0,0 +1,517 @@
+#include "http_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#ifndef _WIN32
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "response.h"
+
+#define ENTRY_MAGIC "pinga-http-cache 1"
+
+enum cache_result { CACHE_MISS, CACHE_HIT, CACHE_REVALIDATED };
+
+/* What an entry file holds besides the body. */
+struct cache_meta {
+  long long stored;   /* unix time the response was stored or last revalidated */
+  long long lifetime; /* seconds it stays fresh after that */
+  long status;
+  char *status_line;
+  char *etag;
+  char *last_modified;
+  struct header_list headers;
+};
+
+struct http_cache {
+  char *dir;
+  const struct request *req;
+  char *path; /* entry for the request's current Vary values */
+  bool loaded;
+  struct cache_meta meta;
+  void *map;
+  size_t map_len;
+  const char *body;
+  size_t body_len;
+  enum cache_result result;
+};
+
+static void meta_free(struct cache_meta *meta) {
+  free(meta->status_line);
+  free(meta->etag);
+  free(meta->last_modified);
+  header_list_free(&meta->headers);
+  memset(meta, 0, sizeof(*meta));
+}
+
+static int prepare_dir(const char *dir) {
+  struct stat st;
+  if (stat(dir, &st) != 0) {
+    if (errno != ENOENT || mkdir(dir, 0700) != 0 || stat(dir, &st) != 0) {
+      fprintf(err_stream(), "Failed to create HTTP cache directory: %s\n", dir);
+      return EXIT_CONFIG;
+    }
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    fprintf(err_stream(), "HTTP cache is not a directory: %s\n", dir);
+    return EXIT_CONFIG;
+  }
+  return EXIT_OK;
+}
+
+/* The value of a request header line "Name: value", or NULL. */
+static const char *request_header(const struct request *req, const char *name, size_t name_len) {
+  for (const struct curl_slist *h = req->headers; h; h = h->next) {
+    if (strncasecmp(h->data, name, name_len) == 0 && h->data[name_len] == ':') {
+      const char *value = h->data + name_len + 1;
+      return value + strspn(value, " \t");
+    }
+  }
+  return NULL;
+}
+
+static const char *response_header(const struct header_list *headers, const char *name) {
+  for (size_t i = 0; i < headers->count; i++) {
+    if (strcasecmp(headers->items[i].name, name) == 0) {
+      return headers->items[i].value;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Entries are named by a hash of method, url and, for each header the
+ * response listed in Vary, the value this request sends for it.
+ */
+static char *entry_path(const char *dir, const struct request *req, const char *vary) {
+  struct xxh64_state st;
+  xxh64_reset(&st, 0);
+  xxh64_update(&st, req->method, strlen(req->method) + 1);
+  xxh64_update(&st, req->url, strlen(req->url) + 1);
+  for (const char *p = vary ? vary : ""; *p;) {
+    p += strspn(p, " \t,");
+    size_t len = strcspn(p, " \t,");
+    if (len) {
+      const char *value = request_header(req, p, len);
+      for (size_t i = 0; i < len; i++) {
+        char c = (char)tolower((unsigned char)p[i]);
+        xxh64_update(&st, &c, 1);
+      }
+      xxh64_update(&st, "=", 1);
+      if (value) {
+        xxh64_update(&st, value, strlen(value));
+      }
+      xxh64_update(&st, "\n", 1);
+    }
+    p += len;
+  }
+  size_t path_len = strlen(dir) + 32;
+  char *path = (char *)malloc(path_len);
+  if (path) {
+    snprintf(path, path_len, "%s/%016llx.entry", dir, (unsigned long long)xxh64_digest(&st));
+  }
+  return path;
+}
+
+/* The Vary names last seen for method + url live beside the entries. */
+static char *vary_path(const char *dir, const struct request *req) {
+  struct xxh64_state st;
+  xxh64_reset(&st, 0);
+  xxh64_update(&st, req->method, strlen(req->method) + 1);
+  xxh64_update(&st, req->url, strlen(req->url) + 1);
+  size_t path_len = strlen(dir) + 32;
+  char *path = (char *)malloc(path_len);
+  if (path) {
+    snprintf(path, path_len, "%s/%016llx.vary", dir, (unsigned long long)xxh64_digest(&st));
+  }
+  return path;
+}
+
+static char *dup_range(const char *p, size_t len) {
+  char *s = (char *)malloc(len + 1);
+  if (s) {
+    memcpy(s, p, len);
+    s[len] = '\0';
+  }
+  return s;
+}
+
+/* Reads the metadata lines up to "body N"; sets *body to the first body byte. */
+static bool parse_meta(const char *data, size_t len, struct cache_meta *meta, size_t *body,
+                       size_t *body_len) {
+  const char *p = data;
+  const char *end = data + len;
+  bool first = true;
+  while (p < end) {
+    const char *nl = (const char *)memchr(p, '\n', (size_t)(end - p));
+    if (!nl) {
+      return false;
+    }
+    size_t n = (size_t)(nl - p);
+    const char *space = (const char *)memchr(p, ' ', n);
+    size_t key_len = space ? (size_t)(space - p) : n;
+    const char *value = space ? space + 1 : nl;
+    size_t value_len = (size_t)(nl - value);
+    if (first) {
+      if (n != strlen(ENTRY_MAGIC) || memcmp(p, ENTRY_MAGIC, n) != 0) {
+        return false;
+      }
+      first = false;
+    } else if (key_len == 4 && memcmp(p, "body", 4) == 0) {
+      unsigned long long size = strtoull(value, NULL, 10);
+      *body = (size_t)(nl + 1 - data);
+      *body_len = (size_t)size;
+      return size == (unsigned long long)(len - *body) && meta->status > 0;
+    } else if (key_len == 6 && memcmp(p, "stored", 6) == 0) {
+      meta->stored = strtoll(value, NULL, 10);
+    } else if (key_len == 8 && memcmp(p, "lifetime", 8) == 0) {
+      meta->lifetime = strtoll(value, NULL, 10);
+    } else if (key_len == 6 && memcmp(p, "status", 6) == 0) {
+      meta->status = strtol(value, NULL, 10);
+    } else if (key_len == 11 && memcmp(p, "status-line", 11) == 0) {
+      free(meta->status_line);
+      meta->status_line = dup_range(value, value_len);
+    } else if (key_len == 4 && memcmp(p, "etag", 4) == 0) {
+      free(meta->etag);
+      meta->etag = dup_range(value, value_len);
+    } else if (key_len == 13 && memcmp(p, "last-modified", 13) == 0) {
+      free(meta->last_modified);
+      meta->last_modified = dup_range(value, value_len);
+    } else if (key_len == 6 && memcmp(p, "header", 6) == 0) {
+      const char *colon = (const char *)memchr(value, ':', value_len);
+      if (colon && colon + 2 > nl) {
+        colon = NULL;
+      }
+      char *name = colon ? dup_range(value, (size_t)(colon - value)) : NULL;
+      char *hvalue = colon ? dup_range(colon + 2, (size_t)(nl - colon - 2)) : NULL;
+      if (name && hvalue) {
+        header_list_append(&meta->headers, name, hvalue);
+      }
+      free(name);
+      free(hvalue);
+    }
+    p = nl + 1;
+  }
+  return false;
+}
+
+static void load_entry(struct http_cache *cache) {
+  int fd = open(cache->path, O_RDONLY | O_NOFOLLOW);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    close(fd);
+    return;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return;
+  }
+  size_t body = 0;
+  size_t body_len = 0;
+  if (!parse_meta((const char *)map, (size_t)st.st_size, &cache->meta, &body, &body_len)) {
+    meta_free(&cache->meta);
+    munmap(map, (size_t)st.st_size);
+    return;
+  }
+  cache->map = map;
+  cache->map_len = (size_t)st.st_size;
+  cache->body = (const char *)map + body;
+  cache->body_len = body_len;
+  cache->loaded = true;
+}
+
+static bool add_request_header(struct request *req, const char *name, const char *value) {
+  size_t len = strlen(name) + strlen(value) + 3;
+  char *line = (char *)malloc(len);
+  struct curl_slist *next = NULL;
+  if (line) {
+    snprintf(line, len, "%s: %s", name, value);
+    next = curl_slist_append(req->headers, line);
+    free(line);
+  }
+  if (next) {
+    req->headers = next;
+  }
+  return next != NULL;
+}
+
+int http_cache_open(const char *dir, struct request *req, struct http_cache **out) {
+  *out = NULL;
+  if (strcmp(req->method, "GET") != 0) {
+    return EXIT_OK;
+  }
+  int rc = prepare_dir(dir);
+  if (rc != EXIT_OK) {
+    return rc;
+  }
+  struct http_cache *cache = (struct http_cache *)calloc(1, sizeof(struct http_cache));
+  char *vpath = vary_path(dir, req);
+  char *vary = vpath ? read_file(vpath, NULL) : NULL;
+  free(vpath);
+  if (cache) {
+    cache->dir = dup_string(dir);
+    cache->req = req;
+    cache->path = entry_path(dir, req, vary);
+  }
+  free(vary);
+  if (!cache || !cache->dir || !cache->path) {
+    fprintf(err_stream(), "Out of memory while opening the HTTP cache.\n");
+    http_cache_free(cache);
+    return EXIT_REQUEST;
+  }
+  load_entry(cache);
+  if (cache->loaded && !http_cache_fresh(cache)) {
+    bool ok = true;
+    if (cache->meta.etag && !request_header(req, "If-None-Match", 13)) {
+      ok = add_request_header(req, "If-None-Match", cache->meta.etag);
+    }
+    if (ok && cache->meta.last_modified && !request_header(req, "If-Modified-Since", 17)) {
+      ok = add_request_header(req, "If-Modified-Since", cache->meta.last_modified);
+    }
+    if (!ok) {
+      fprintf(err_stream(), "Out of memory while opening the HTTP cache.\n");
+      http_cache_free(cache);
+      return EXIT_REQUEST;
+    }
+  }
+  *out = cache;
+  return EXIT_OK;
+}
+
+bool http_cache_fresh(const struct http_cache *cache) {
+  return cache && cache->loaded &&
+         (long long)time(NULL) < cache->meta.stored + cache->meta.lifetime;
+}
+
+int http_cache_serve(struct http_cache *cache, struct single_run *run) {
+  struct response_buffer view = {.data = (char *)cache->body, .len = cache->body_len};
+  cache->result = cache->result == CACHE_REVALIDATED ? CACHE_REVALIDATED : CACHE_HIT;
+  return single_emit(run, cache->meta.status, cache->meta.status_line, &cache->meta.headers,
+                     &view);
+}
+
+/*
+ * Freshness lifetime from Cache-Control max-age less Age; -1 for no-store.
+ * Without max-age (or with no-cache) the response must be revalidated: 0.
+ */
+static long long lifetime_of(const struct header_list *headers) {
+  long long max_age = 0;
+  bool no_cache = false;
+  for (size_t i = 0; i < headers->count; i++) {
+    if (strcasecmp(headers->items[i].name, "Cache-Control") != 0) {
+      continue;
+    }
+    for (const char *p = headers->items[i].value; *p;) {
+      p += strspn(p, " \t,");
+      size_t len = strcspn(p, ",");
+      if (len >= 8 && strncasecmp(p, "no-store", 8) == 0) {
+        return -1;
+      }
+      if (len >= 8 && strncasecmp(p, "no-cache", 8) == 0) {
+        no_cache = true;
+      } else if (len > 8 && strncasecmp(p, "max-age=", 8) == 0) {
+        max_age = strtoll(p + 8, NULL, 10);
+      }
+      p += len;
+    }
+  }
+  const char *age = response_header(headers, "Age");
+  if (age) {
+    max_age -= strtoll(age, NULL, 10);
+  }
+  return no_cache || max_age < 0 ? 0 : max_age;
+}
+
+/* Writes the entry to a temp file beside it and renames it into place. */
+static void write_entry(const char *path, const struct cache_meta *meta,
+                        const struct response_buffer *body, size_t body_len) {
+  size_t tmp_len = strlen(path) + 32;
+  char *tmp = (char *)malloc(tmp_len);
+  if (!tmp) {
+    return;
+  }
+  snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+  FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (!f) {
+    if (fd >= 0) {
+      close(fd);
+      unlink(tmp);
+    }
+    free(tmp);
+    return;
+  }
+  fprintf(f, ENTRY_MAGIC "\nstored %lld\nlifetime %lld\nstatus %ld\nstatus-line %s\n",
+          meta->stored, meta->lifetime, meta->status,
+          meta->status_line ? meta->status_line : "");
+  if (meta->etag) {
+    fprintf(f, "etag %s\n", meta->etag);
+  }
+  if (meta->last_modified) {
+    fprintf(f, "last-modified %s\n", meta->last_modified);
+  }
+  for (size_t i = 0; i < meta->headers.count; i++) {
+    fprintf(f, "header %s: %s\n", meta->headers.items[i].name, meta->headers.items[i].value);
+  }
+  fprintf(f, "body %llu\n", (unsigned long long)body_len);
+  bool ok = write_raw_body(f, body);
+  if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+  free(tmp);
+}
+
+/* A 304 may carry new validators; the stored ones are replaced by them. */
+static void replace_validator(char **field, const char *value) {
+  if (value) {
+    free(*field);
+    *field = dup_string(value);
+  }
+}
+
+static void revalidate(struct http_cache *cache, const struct header_list *headers) {
+  long long lifetime = lifetime_of(headers);
+  if (lifetime < 0) {
+    unlink(cache->path);
+    return;
+  }
+  cache->meta.stored = (long long)time(NULL);
+  cache->meta.lifetime = lifetime;
+  replace_validator(&cache->meta.etag, response_header(headers, "ETag"));
+  replace_validator(&cache->meta.last_modified, response_header(headers, "Last-Modified"));
+  struct response_buffer view = {.data = (char *)cache->body, .len = cache->body_len};
+  write_entry(cache->path, &cache->meta, &view, cache->body_len);
+}
+
+static void store(struct http_cache *cache, const struct single_run *run) {
+  const struct header_list *headers = &run->headers.headers;
+  long long lifetime = lifetime_of(headers);
+  const char *vary = response_header(headers, "Vary");
+  const char *etag = response_header(headers, "ETag");
+  const char *last_modified = response_header(headers, "Last-Modified");
+  if (lifetime < 0 || (vary && strchr(vary, '*')) || (lifetime == 0 && !etag && !last_modified)) {
+    return;
+  }
+  char *vpath = vary_path(cache->dir, cache->req);
+  char *path = entry_path(cache->dir, cache->req, vary);
+  if (vpath && path) {
+    if (vary) {
+      int fd = open(vpath, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+      if (fd >= 0) {
+        bool ok = write(fd, vary, strlen(vary)) == (ssize_t)strlen(vary);
+        if (close(fd) != 0 || !ok) {
+          unlink(vpath);
+        }
+      }
+    } else {
+      unlink(vpath);
+    }
+    struct cache_meta meta = {
+      .stored = (long long)time(NULL),
+      .lifetime = lifetime,
+      .status = 200,
+      .status_line = run->headers.status_line,
+      .etag = (char *)etag,
+      .last_modified = (char *)last_modified,
+      .headers = *headers
+    };
+    size_t body_len = run->body.len;
+    if (run->body.spill) {
+      fseek(run->body.spill, 0, SEEK_END);
+      body_len = (size_t)ftell(run->body.spill);
+    }
+    write_entry(path, &meta, &run->body, body_len);
+  }
+  free(vpath);
+  free(path);
+}
+
+bool http_cache_update(struct http_cache *cache, CURL *curl, struct single_run *run) {
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (status == 304 && cache->loaded) {
+    revalidate(cache, &run->headers.headers);
+    cache->result = CACHE_REVALIDATED;
+    return true;
+  }
+  if (status == 200) {
+    store(cache, run);
+  }
+  return false;
+}
+
+const char *http_cache_result(const struct http_cache *cache) {
+  static const char *const names[] = {"miss", "hit", "revalidated"};
+  return names[cache->result];
+}
+
+void http_cache_free(struct http_cache *cache) {
+  if (!cache) {
+    return;
+  }
+  if (cache->map) {
+    munmap(cache->map, cache->map_len);
+  }
+  meta_free(&cache->meta);
+  free(cache->dir);
+  free(cache->path);
+  free(cache);
+}
+
+#else
+
+struct http_cache {
+  int unused;
+};
+
+int http_cache_open(const char *dir, struct request *req, struct http_cache **out) {
+  (void)dir;
+  (void)req;
+  *out = NULL;
+  fprintf(err_stream(), "--http-cache is not supported by this build.\n");
+  return EXIT_REQUEST;
+}
+
+bool http_cache_fresh(const struct http_cache *cache) {
+  (void)cache;
+  return false;
+}
+
+int http_cache_serve(struct http_cache *cache, struct single_run *run) {
+  (void)cache;
+  (void)run;
+  return EXIT_REQUEST;
+}
+
+bool http_cache_update(struct http_cache *cache, CURL *curl, struct single_run *run) {
+  (void)cache;
+  (void)curl;
+  (void)run;
+  return false;
+}
+
+const char *http_cache_result(const struct http_cache *cache) {
+  (void)cache;
+  return "miss";
+}
+
+void http_cache_free(struct http_cache *cache) {
+  (void)cache;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PINGA_HTTP_CACHE_H
+#define PINGA_HTTP_CACHE_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+
+#include "request.h"
+#include "single.h"
+
+/*
+ * On-disk HTTP cache for GET requests (--http-cache DIR), keyed by method,
+ * final url and the request headers the response named in Vary. A response
+ * is kept while Cache-Control max-age says it is fresh; after that its ETag
+ * or Last-Modified turns the next request into a conditional one, and a 304
+ * serves the stored body again. Stored bodies are mapped, not read.
+ */
+struct http_cache;
+
+/*
+ * Returns EXIT_OK and sets *out (NULL when the request is not a GET), or an
+ * EXIT_* code. For a stale entry, adds If-None-Match / If-Modified-Since to
+ * req's headers unless the config sets them.
+ */
+int http_cache_open(const char *dir, struct request *req, struct http_cache **out);
+/* True when the stored response can be served without a request. */
+bool http_cache_fresh(const struct http_cache *cache);
+/* Serves the stored response through single_emit; returns its exit code. */
+int http_cache_serve(struct http_cache *cache, struct single_run *run);
+/*
+ * After a successful transfer captured into run: stores a cacheable 200,
+ * or refreshes the entry on a 304. True when the stored response should be
+ * served in place of what the transfer returned.
+ */
+bool http_cache_update(struct http_cache *cache, CURL *curl, struct single_run *run);
+/* "hit", "revalidated" or "miss". */
+const char *http_cache_result(const struct http_cache *cache);
+void http_cache_free(struct http_cache *cache);
+
+#endif
@@ -0,0 +1,665 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+int ensure_tokens(jsmn_parser *parser, const char *json, size_t len,
+                  jsmntok_t **tokens_out, int *count_out) {
+  return ensure_tokens_max(parser, json, len, 4096, tokens_out, count_out);
+}
+
+int ensure_tokens_max(jsmn_parser *parser, const char *json, size_t len, int max_tokens,
+                      jsmntok_t **tokens_out, int *count_out) {
+  int token_count = 256;
+  for (;;) {
+    jsmntok_t *tokens = (jsmntok_t *)calloc((size_t)token_count, sizeof(jsmntok_t));
+    if (!tokens) {
+      return -1;
+    }
+    jsmn_init(parser);
+    int parsed = jsmn_parse(parser, json, len, tokens, (unsigned int)token_count);
+    if (parsed >= 0) {
+      *tokens_out = tokens;
+      *count_out = parsed;
+      return 0;
+    }
+    free(tokens);
+    if (parsed == -1) {
+      token_count *= 2;
+      if (token_count > max_tokens) {
+        return -1;
+      }
+      continue;
+    }
+    return -1;
+  }
+}
+
+int skip_token(const jsmntok_t *toks, int index) {
+  int i = index;
+  switch (toks[i].type) {
+    case JSMN_STRING:
+    case JSMN_PRIMITIVE:
+      return i + 1;
+    case JSMN_ARRAY: {
+      i++;
+      for (int k = 0; k < toks[index].size; k++) {
+        i = skip_token(toks, i);
+      }
+      return i;
+    }
+    case JSMN_OBJECT: {
+      int pairs = toks[index].size / 2;
+      i++;
+      for (int k = 0; k < pairs; k++) {
+        i = skip_token(toks, i);
+        i = skip_token(toks, i);
+      }
+      return i;
+    }
+    default:
+      return i + 1;
+  }
+}
+
+bool jsoneq(const char *json, const jsmntok_t *tok, const char *s) {
+  size_t len = (size_t)(tok->end - tok->start);
+  return tok->type == JSMN_STRING &&
+         strlen(s) == len &&
+         strncmp(json + tok->start, s, len) == 0;
+}
+
+int find_object_value(const char *json, jsmntok_t *toks, int obj_index,
+                      const char *key) {
+  if (toks[obj_index].type != JSMN_OBJECT) {
+    return -1;
+  }
+  int i = obj_index + 1;
+  int pairs = toks[obj_index].size / 2;
+  for (int pair = 0; pair < pairs; pair++) {
+    int key_index = i;
+    int value_index = i + 1;
+    if (jsoneq(json, &toks[key_index], key)) {
+      return value_index;
+    }
+    i = skip_token(toks, value_index);
+  }
+  return -1;
+}
+
+char *dup_token_string(const char *json, const jsmntok_t *tok) {
+  if (tok->type != JSMN_STRING) {
+    return NULL;
+  }
+  size_t len = (size_t)(tok->end - tok->start);
+  char *out = (char *)malloc(len + 1);
+  if (!out) {
+    return NULL;
+  }
+  memcpy(out, json + tok->start, len);
+  out[len] = '\0';
+  return out;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static long read_hex4(const char *p, const char *end) {
+  if (end - p < 4) {
+    return -1;
+  }
+  long v = 0;
+  for (int i = 0; i < 4; i++) {
+    int h = hex_value(p[i]);
+    if (h < 0) {
+      return -1;
+    }
+    v = (v << 4) | h;
+  }
+  return v;
+}
+
+static char *put_utf8(char *dst, unsigned long cp) {
+  if (cp < 0x80) {
+    *dst++ = (char)cp;
+  } else if (cp < 0x800) {
+    *dst++ = (char)(0xC0 | (cp >> 6));
+    *dst++ = (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    *dst++ = (char)(0xE0 | (cp >> 12));
+    *dst++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *dst++ = (char)(0x80 | (cp & 0x3F));
+  } else {
+    *dst++ = (char)(0xF0 | (cp >> 18));
+    *dst++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+    *dst++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *dst++ = (char)(0x80 | (cp & 0x3F));
+  }
+  return dst;
+}
+
+char *dup_token_unescaped(const char *json, const jsmntok_t *tok, size_t *len_out) {
+  if (tok->type != JSMN_STRING) {
+    return NULL;
+  }
+  const char *p = json + tok->start;
+  const char *end = json + tok->end;
+  /* Escapes never grow: \uXXXX (6 bytes) decodes to at most 3, pairs to 4. */
+  char *out = (char *)malloc((size_t)(end - p) + 1);
+  if (!out) {
+    return NULL;
+  }
+  char *dst = out;
+  while (p < end) {
+    if (*p != '\\' || p + 1 >= end) {
+      *dst++ = *p++;
+      continue;
+    }
+    char c = p[1];
+    p += 2;
+    switch (c) {
+      case 'b':
+        *dst++ = '\b';
+        break;
+      case 'f':
+        *dst++ = '\f';
+        break;
+      case 'n':
+        *dst++ = '\n';
+        break;
+      case 'r':
+        *dst++ = '\r';
+        break;
+      case 't':
+        *dst++ = '\t';
+        break;
+      case 'u': {
+        long cp = read_hex4(p, end);
+        if (cp < 0) {
+          *dst++ = 'u';
+          break;
+        }
+        p += 4;
+        if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+          long low = read_hex4(p + 2, end);
+          if (low >= 0xDC00 && low < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+          }
+        }
+        dst = put_utf8(dst, (unsigned long)cp);
+        break;
+      }
+      default:
+        *dst++ = c;
+    }
+  }
+  *dst = '\0';
+  if (len_out) {
+    *len_out = (size_t)(dst - out);
+  }
+  return out;
+}
+
+char *dup_token_raw(const char *json, const jsmntok_t *tok) {
+  if (tok->start < 0 || tok->end < 0 || tok->end < tok->start) {
+    return NULL;
+  }
+  size_t len = (size_t)(tok->end - tok->start);
+  char *out = (char *)malloc(len + 1);
+  if (!out) {
+    return NULL;
+  }
+  memcpy(out, json + tok->start, len);
+  out[len] = '\0';
+  return out;
+}
+
+const char *tok_type_name(jsmntype_t type) {
+  switch (type) {
+    case JSMN_UNDEFINED:
+      return "undefined";
+    case JSMN_OBJECT:
+      return "object";
+    case JSMN_ARRAY:
+      return "array";
+    case JSMN_STRING:
+      return "string";
+    case JSMN_PRIMITIVE:
+      return "primitive";
+    default:
+      return "unknown";
+  }
+}
+
+int iterate_kv(const char *json, jsmntok_t *toks, int index,
+               const char *label, kv_callback cb, void *userdata) {
+  if (index < 0) {
+    return 0;
+  }
+  if (toks[index].type == JSMN_ARRAY) {
+    int i = index + 1;
+    for (int e = 0; e < toks[index].size; e++) {
+      int elem_index = i;
+      if (toks[elem_index].type == JSMN_OBJECT) {
+        int name_idx = find_object_value(json, toks, elem_index, "name");
+        if (name_idx < 0) {
+          name_idx = find_object_value(json, toks, elem_index, "key");
+        }
+        int value_idx = find_object_value(json, toks, elem_index, "value");
+        if (name_idx >= 0 && value_idx >= 0) {
+          if (toks[name_idx].type != JSMN_STRING || toks[value_idx].type != JSMN_STRING) {
+            fprintf(err_stream(),
+                    "Invalid %s entry: name/value must be strings (got %s/%s).\n",
+                    label, tok_type_name(toks[name_idx].type),
+                    tok_type_name(toks[value_idx].type));
+            return -1;
+          }
+          char *name = dup_token_string(json, &toks[name_idx]);
+          char *value = dup_token_string(json, &toks[value_idx]);
+          if (!name || !value) {
+            fprintf(err_stream(), "Out of memory while reading %s.\n", label);
+            free(name);
+            free(value);
+            return -1;
+          }
+          cb(name, value, userdata);
+          free(name);
+          free(value);
+        }
+      }
+      i = skip_token(toks, elem_index);
+    }
+    return 0;
+  }
+  if (toks[index].type == JSMN_OBJECT) {
+    int i = index + 1;
+    int pairs = toks[index].size / 2;
+    for (int pair = 0; pair < pairs; pair++) {
+      int key_index = i;
+      int value_index = i + 1;
+      if (toks[key_index].type != JSMN_STRING || toks[value_index].type != JSMN_STRING) {
+        fprintf(err_stream(),
+                "Invalid %s entry: key/value must be strings (got %s/%s).\n",
+                label, tok_type_name(toks[key_index].type),
+                tok_type_name(toks[value_index].type));
+        return -1;
+      }
+      char *name = dup_token_string(json, &toks[key_index]);
+      char *value = dup_token_string(json, &toks[value_index]);
+      if (!name || !value) {
+        fprintf(err_stream(), "Out of memory while reading %s.\n", label);
+        free(name);
+        free(value);
+        return -1;
+      }
+      cb(name, value, userdata);
+      free(name);
+      free(value);
+      i = skip_token(toks, value_index);
+    }
+    return 0;
+  }
+  fprintf(err_stream(), "Invalid %s: expected array or object.\n", label);
+  return -1;
+}
+
+char *json_escape(const char *src) {
+  size_t len = 0;
+  for (const unsigned char *p = (const unsigned char *)src; *p; p++) {
+    switch (*p) {
+      case '\\':
+      case '"':
+      case '\b':
+      case '\f':
+      case '\n':
+      case '\r':
+      case '\t':
+        len += 2;
+        break;
+      default:
+        len += (*p < 0x20) ? 6 : 1;
+    }
+  }
+  char *out = (char *)malloc(len + 1);
+  if (!out) {
+    return NULL;
+  }
+  char *dst = out;
+  for (const unsigned char *p = (const unsigned char *)src; *p; p++) {
+    switch (*p) {
+      case '\\':
+        *dst++ = '\\';
+        *dst++ = '\\';
+        break;
+      case '"':
+        *dst++ = '\\';
+        *dst++ = '"';
+        break;
+      case '\b':
+        *dst++ = '\\';
+        *dst++ = 'b';
+        break;
+      case '\f':
+        *dst++ = '\\';
+        *dst++ = 'f';
+        break;
+      case '\n':
+        *dst++ = '\\';
+        *dst++ = 'n';
+        break;
+      case '\r':
+        *dst++ = '\\';
+        *dst++ = 'r';
+        break;
+      case '\t':
+        *dst++ = '\\';
+        *dst++ = 't';
+        break;
+      default:
+        if (*p < 0x20) {
+          snprintf(dst, 7, "\\u%04x", *p);
+          dst += 6;
+        } else {
+          *dst++ = (char)*p;
+        }
+    }
+  }
+  *dst = '\0';
+  return out;
+}
+
+enum {
+  JC_VALUE,        /* a value must follow */
+  JC_VALUE_OR_END, /* first array element or ']' */
+  JC_KEY,          /* an object key must follow */
+  JC_KEY_OR_END,   /* first key or '}' */
+  JC_COLON,
+  JC_AFTER,        /* ',' or a closer; only whitespace at depth 0 */
+  JC_STRING,
+  JC_ESCAPE,
+  JC_UNICODE,
+  JC_NUMBER,
+  JC_LITERAL,
+  JC_FAILED
+};
+
+/* Number phases: which characters may come next. */
+enum { NUM_SIGN, NUM_ZERO, NUM_INT, NUM_DOT, NUM_FRAC, NUM_EXP, NUM_EXP_SIGN, NUM_EXP_INT };
+
+void json_check_init(struct json_check *c) {
+  memset(c, 0, sizeof(*c));
+  c->state = JC_VALUE;
+}
+
+static bool is_space(unsigned char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static bool number_complete(const struct json_check *c) {
+  return c->sub == NUM_ZERO || c->sub == NUM_INT || c->sub == NUM_FRAC || c->sub == NUM_EXP_INT;
+}
+
+static bool start_value(struct json_check *c, unsigned char ch) {
+  switch (ch) {
+    case '{':
+    case '[':
+      if (c->depth == JSON_CHECK_DEPTH) {
+        return false;
+      }
+      c->stack[c->depth++] = (char)ch;
+      c->state = ch == '{' ? JC_KEY_OR_END : JC_VALUE_OR_END;
+      return true;
+    case '"':
+      c->state = JC_STRING;
+      c->in_key = false;
+      return true;
+    case 't':
+      c->literal = "true";
+      break;
+    case 'f':
+      c->literal = "false";
+      break;
+    case 'n':
+      c->literal = "null";
+      break;
+    case '-':
+      c->state = JC_NUMBER;
+      c->sub = NUM_SIGN;
+      return true;
+    default:
+      if (ch < '0' || ch > '9') {
+        return false;
+      }
+      c->state = JC_NUMBER;
+      c->sub = ch == '0' ? NUM_ZERO : NUM_INT;
+      return true;
+  }
+  c->state = JC_LITERAL;
+  c->sub = 1;
+  return true;
+}
+
+static bool close_container(struct json_check *c, unsigned char ch) {
+  char open = ch == '}' ? '{' : '[';
+  if (c->depth == 0 || c->stack[c->depth - 1] != open) {
+    return false;
+  }
+  c->depth--;
+  c->state = JC_AFTER;
+  return true;
+}
+
+/* Advances the number state; false when ch is not part of the number. */
+static bool number_step(struct json_check *c, unsigned char ch) {
+  bool digit = ch >= '0' && ch <= '9';
+  switch (c->sub) {
+    case NUM_SIGN:
+      if (digit) {
+        c->sub = ch == '0' ? NUM_ZERO : NUM_INT;
+        return true;
+      }
+      return false;
+    case NUM_INT:
+      if (digit) {
+        return true;
+      }
+      /* fall through */
+    case NUM_ZERO:
+      if (ch == '.') {
+        c->sub = NUM_DOT;
+        return true;
+      }
+      if (ch == 'e' || ch == 'E') {
+        c->sub = NUM_EXP;
+        return true;
+      }
+      return false;
+    case NUM_DOT:
+    case NUM_FRAC:
+      if (digit) {
+        c->sub = NUM_FRAC;
+        return true;
+      }
+      if (c->sub == NUM_FRAC && (ch == 'e' || ch == 'E')) {
+        c->sub = NUM_EXP;
+        return true;
+      }
+      return false;
+    case NUM_EXP:
+      if (ch == '+' || ch == '-') {
+        c->sub = NUM_EXP_SIGN;
+        return true;
+      }
+      /* fall through */
+    default:
+      if (digit) {
+        c->sub = NUM_EXP_INT;
+        return true;
+      }
+      return false;
+  }
+}
+
+static bool check_byte(struct json_check *c, unsigned char ch) {
+  switch (c->state) {
+    case JC_STRING:
+      if (ch == '"') {
+        c->state = c->in_key ? JC_COLON : JC_AFTER;
+      } else if (ch == '\\') {
+        c->state = JC_ESCAPE;
+      } else if (ch < 0x20) {
+        return false;
+      }
+      return true;
+    case JC_ESCAPE:
+      if (ch == 'u') {
+        c->state = JC_UNICODE;
+        c->sub = 0;
+        return true;
+      }
+      c->state = JC_STRING;
+      return strchr("\"\\/bfnrt", ch) != NULL && ch != '\0';
+    case JC_UNICODE:
+      if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F'))) {
+        return false;
+      }
+      if (++c->sub == 4) {
+        c->state = JC_STRING;
+      }
+      return true;
+    case JC_LITERAL:
+      if (ch != (unsigned char)c->literal[c->sub]) {
+        return false;
+      }
+      if (c->literal[++c->sub] == '\0') {
+        c->state = JC_AFTER;
+      }
+      return true;
+    case JC_NUMBER:
+      if (number_step(c, ch)) {
+        return true;
+      }
+      if (!number_complete(c)) {
+        return false;
+      }
+      c->state = JC_AFTER;
+      return check_byte(c, ch);
+    default:
+      break;
+  }
+  if (is_space(ch)) {
+    return true;
+  }
+  switch (c->state) {
+    case JC_VALUE_OR_END:
+      if (ch == ']') {
+        return close_container(c, ch);
+      }
+      /* fall through */
+    case JC_VALUE:
+      return start_value(c, ch);
+    case JC_KEY_OR_END:
+      if (ch == '}') {
+        return close_container(c, ch);
+      }
+      /* fall through */
+    case JC_KEY:
+      if (ch != '"') {
+        return false;
+      }
+      c->state = JC_STRING;
+      c->in_key = true;
+      return true;
+    case JC_COLON:
+      if (ch != ':') {
+        return false;
+      }
+      c->state = JC_VALUE;
+      return true;
+    case JC_AFTER:
+      if (ch == '}' || ch == ']') {
+        return close_container(c, ch);
+      }
+      if (ch != ',' || c->depth == 0) {
+        return false;
+      }
+      c->state = c->stack[c->depth - 1] == '{' ? JC_KEY : JC_VALUE;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool json_check_feed(struct json_check *c, const char *data, size_t len) {
+  for (size_t i = 0; i < len && c->state != JC_FAILED; i++) {
+    if (!check_byte(c, (unsigned char)data[i])) {
+      c->state = JC_FAILED;
+    }
+  }
+  return c->state != JC_FAILED;
+}
+
+bool json_check_finish(const struct json_check *c) {
+  if (c->depth != 0) {
+    return false;
+  }
+  return c->state == JC_AFTER || (c->state == JC_NUMBER && number_complete(c));
+}
+
+bool is_valid_json(const char *json, size_t len) {
+  struct json_check check;
+  json_check_init(&check);
+  return json_check_feed(&check, json, len) && json_check_finish(&check);
+}
+
+void json_write_escaped(FILE *out, const char *data, size_t len) {
+  size_t run = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char ch = (unsigned char)data[i];
+    if (ch >= 0x20 && ch != '"' && ch != '\\') {
+      continue;
+    }
+    fwrite(data + run, 1, i - run, out);
+    run = i + 1;
+    switch (ch) {
+      case '"':
+        fputs("\\\"", out);
+        break;
+      case '\\':
+        fputs("\\\\", out);
+        break;
+      case '\b':
+        fputs("\\b", out);
+        break;
+      case '\f':
+        fputs("\\f", out);
+        break;
+      case '\n':
+        fputs("\\n", out);
+        break;
+      case '\r':
+        fputs("\\r", out);
+        break;
+      case '\t':
+        fputs("\\t", out);
+        break;
+      default:
+        fprintf(out, "\\u%04x", ch);
+    }
+  }
+  fwrite(data + run, 1, len - run, out);
+}
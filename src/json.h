@@ -0,0 +1,55 @@
+#ifndef PINGA_JSON_H
+#define PINGA_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "jsmn.h"
+
+typedef int (*kv_callback)(const char *name, const char *value, void *userdata);
+
+int ensure_tokens(jsmn_parser *parser, const char *json, size_t len,
+                  jsmntok_t **tokens_out, int *count_out);
+/* ensure_tokens() gives up past 4096 tokens; this takes the limit. */
+int ensure_tokens_max(jsmn_parser *parser, const char *json, size_t len, int max_tokens,
+                      jsmntok_t **tokens_out, int *count_out);
+int skip_token(const jsmntok_t *toks, int index);
+bool jsoneq(const char *json, const jsmntok_t *tok, const char *s);
+int find_object_value(const char *json, jsmntok_t *toks, int obj_index, const char *key);
+char *dup_token_string(const char *json, const jsmntok_t *tok);
+/* Decodes escapes (\\n, \\uXXXX, ...) into UTF-8; *len_out excludes the NUL. */
+char *dup_token_unescaped(const char *json, const jsmntok_t *tok, size_t *len_out);
+char *dup_token_raw(const char *json, const jsmntok_t *tok);
+const char *tok_type_name(jsmntype_t type);
+int iterate_kv(const char *json, jsmntok_t *toks, int index, const char *label,
+               kv_callback cb, void *userdata);
+
+char *json_escape(const char *src);
+/* Strict RFC 8259 check of a complete text. */
+bool is_valid_json(const char *json, size_t len);
+
+/*
+ * Same check for text that arrives in pieces (a body read back from disk),
+ * in constant memory. Nesting deeper than JSON_CHECK_DEPTH counts as invalid.
+ */
+#define JSON_CHECK_DEPTH 512
+
+struct json_check {
+  char stack[JSON_CHECK_DEPTH];
+  unsigned depth;
+  int state;
+  unsigned sub;
+  const char *literal;
+  bool in_key;
+};
+
+void json_check_init(struct json_check *c);
+/* Returns false as soon as the text cannot be valid JSON. */
+bool json_check_feed(struct json_check *c, const char *data, size_t len);
+bool json_check_finish(const struct json_check *c);
+
+/* Writes data as the inside of a JSON string literal. */
+void json_write_escaped(FILE *out, const char *data, size_t len);
+
+#endif
@@ -0,0 +1,1406 @@
+#include "load.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "collection.h"
+#include "json.h"
+#include "metrics.h"
+#include "response.h"
+#include "scenario.h"
+#include "trace.h"
+#include "util.h"
+
+#define MAX_EVENTS 1024
+
+/*
+ * libcurl looks up reusable connections by scanning the per-host pool of a
+ * multi handle, so one multi with thousands of connections makes every new
+ * transfer O(n). Workers spread their slots over several small multi
+ * handles ("shards") that share one epoll instance instead.
+ */
+#ifdef __linux__
+#define SHARD_SLOTS 256u
+#else
+#define SHARD_SLOTS UINT_MAX
+#endif
+
+struct load_shared {
+  const struct request *req;
+  const struct load_options *opts;
+  uint64_t start_ns;
+  uint64_t measure_ns; /* end of warm-up: earlier requests are not recorded */
+  uint64_t deadline_ns; /* no request starts after this */
+  uint64_t stop_ns;     /* transfers still running are abandoned */
+  atomic_uint_fast64_t issued;
+  /* Collection runs: transfers take turns pulling the next request. */
+  pthread_mutex_t source_lock;
+  bool source_done;
+  int source_rc;
+  char **entry_names; /* scenario runs: JSON-escaped, for records */
+};
+
+struct worker;
+
+struct shard {
+  struct worker *worker;
+  CURLM *multi;
+  unsigned index;
+  unsigned active;
+#ifdef __linux__
+  int tfd;
+#endif
+};
+
+struct transfer {
+  CURL *easy;
+  struct shard *shard;
+  unsigned slot; /* position in the worker, the trace track */
+  uint64_t started_ns;
+  uint64_t seq;
+  uint64_t bytes;
+  struct request req; /* collection runs only */
+  struct request_render *render; /* when the request has generators */
+  curl_mime *mime;               /* when the request is multipart */
+  unsigned entry;                /* scenario runs: entry the handle is set up for */
+  struct request_render **renders; /* scenario runs: per entry, made on first use */
+  uint64_t sample_key;
+  bool sampling;                 /* body is buffered as a sample candidate */
+  struct response_buffer body;
+};
+
+struct worker {
+  struct load_shared *shared;
+  struct shard *shards;
+  unsigned shard_count;
+  struct transfer *transfers;
+  unsigned slots;
+  unsigned active;
+  unsigned prewarm;  /* transfers used to open connections up front */
+  bool prewarming;
+  unsigned warmed;
+  struct gen_rng rng;
+  struct load_stats stats;
+  struct load_stats *entries; /* scenario runs: per entry */
+  struct trace_buffer *trace;
+  /* Rate runs: free slots, and the one holding a request that is not due yet. */
+  struct transfer **idle;
+  unsigned idle_count;
+  struct transfer *next;
+  bool exhausted;
+  uint64_t warmup_requests; /* finished before the measured window */
+  struct load_sample *samples; /* opts->sample_bodies slots */
+  unsigned sample_count;
+  unsigned sample_max; /* index of the largest kept key */
+  /*
+   * Interval stats for live reporting: the worker records into
+   * interval[interval_index] while the reporter drains the other half.
+   */
+  bool live;
+  struct load_stats interval[2];
+  atomic_uint interval_index;
+  atomic_bool recording;
+  atomic_bool done;
+  pthread_t thread;
+  int rc;
+#ifdef __linux__
+  int epfd;
+  int pace_tfd;     /* rate runs: fires when the next request is due */
+  uint64_t pace_at; /* due time the pace timer is armed for */
+#endif
+};
+
+static size_t write_count(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  (void)ptr;
+  struct transfer *t = (struct transfer *)userdata;
+  size_t total = size * nmemb;
+  t->bytes += total;
+  if (t->sampling && write_body(ptr, size, nmemb, &t->body) != total) {
+    /* No temp file for a spilled body: drop the candidate, not the transfer. */
+    t->sampling = false;
+    response_buffer_free(&t->body);
+  }
+  return total;
+}
+
+/*
+ * Bottom-k sampling: every response draws a random key and each worker keeps
+ * the bodies with the smallest keys, so the pooled workers' samples stay a
+ * uniform sample of the whole run. A key that loses at the start of a
+ * transfer can only lose later, so its body is never buffered.
+ */
+static bool sample_wanted(const struct worker *w, uint64_t key) {
+  return w->sample_count < w->shared->opts->sample_bodies ||
+         key < w->samples[w->sample_max].key;
+}
+
+static void keep_sample(struct worker *w, struct transfer *t, long status) {
+  struct load_sample *slot;
+  if (w->sample_count < w->shared->opts->sample_bodies) {
+    slot = &w->samples[w->sample_count++];
+  } else {
+    slot = &w->samples[w->sample_max];
+    response_buffer_free(&slot->body);
+  }
+  slot->key = t->sample_key;
+  slot->seq = t->seq;
+  slot->status = status;
+  slot->body = t->body;
+  memset(&t->body, 0, sizeof(t->body));
+  w->sample_max = 0;
+  for (unsigned i = 1; i < w->sample_count; i++) {
+    if (w->samples[i].key > w->samples[w->sample_max].key) {
+      w->sample_max = i;
+    }
+  }
+}
+
+static int configure_transfer(struct transfer *t, const struct request *req) {
+  request_apply(t->easy, req);
+  if (req->part_count && !(t->mime = request_mime(t->easy, req))) {
+    return -1;
+  }
+  curl_easy_setopt(t->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(t->easy, CURLOPT_WRITEFUNCTION, write_count);
+  curl_easy_setopt(t->easy, CURLOPT_WRITEDATA, t);
+  curl_easy_setopt(t->easy, CURLOPT_PRIVATE, t);
+  return 0;
+}
+
+/*
+ * Counts a claimed request that could not be started as a failed one, so the
+ * totals still add up and an ordered sink does not wait for its seq.
+ */
+static void record_setup_failure(struct worker *w, struct transfer *t, uint64_t started_ns) {
+  struct sink *records = w->shared->opts->records;
+  if (started_ns < w->shared->measure_ns) {
+    w->warmup_requests++;
+  } else {
+    load_stats_record(&w->stats, 0, 0, CURLE_FAILED_INIT, 0);
+    if (w->entries && t->entry != UINT_MAX) {
+      load_stats_record(&w->entries[t->entry], 0, 0, CURLE_FAILED_INIT, 0);
+    }
+    if (w->live) {
+      atomic_store(&w->recording, true);
+      unsigned idx = atomic_load(&w->interval_index);
+      load_stats_record(&w->interval[idx], 0, 0, CURLE_FAILED_INIT, 0);
+      atomic_store_explicit(&w->recording, false, memory_order_release);
+    }
+  }
+  if (records) {
+    sink_skip(records, t->seq);
+  }
+}
+
+/* Drops what a collection element set up on t once it is done with. */
+static void release_element(struct worker *w, struct transfer *t) {
+  if (!w->shared->opts->collection) {
+    return;
+  }
+  request_render_free(t->render);
+  t->render = NULL;
+  curl_mime_free(t->mime);
+  t->mime = NULL;
+  request_free(&t->req);
+}
+
+/*
+ * Reads the next collection element into t; seq follows file order. An
+ * element that cannot be set up counts as a failed request and the next one
+ * is read in its place.
+ */
+static bool claim_from_collection(struct worker *w, struct transfer *t) {
+  struct load_shared *shared = w->shared;
+  for (;;) {
+    bool got = false;
+    if (shared->deadline_ns && now_ns() >= shared->deadline_ns) {
+      return false;
+    }
+    pthread_mutex_lock(&shared->source_lock);
+    if (shared->opts->requests && atomic_load(&shared->issued) >= shared->opts->requests) {
+      shared->source_done = true;
+    }
+    if (!shared->source_done) {
+      int rc = collection_next(shared->opts->collection, &t->req, &got);
+      if (rc != EXIT_OK) {
+        shared->source_rc = rc;
+      }
+      if (got) {
+        t->seq = atomic_fetch_add(&shared->issued, 1);
+      } else {
+        shared->source_done = true;
+      }
+    }
+    pthread_mutex_unlock(&shared->source_lock);
+    if (!got) {
+      return false;
+    }
+    /* Reset so nothing (a body, a custom method) leaks from the previous element. */
+    curl_easy_reset(t->easy);
+    if (configure_transfer(t, &t->req) == 0) {
+      if (!t->req.gen || (t->render = request_render_new(&t->req)) != NULL) {
+        return true;
+      }
+      fprintf(err_stream(), "Out of memory while rendering generators.\n");
+    }
+    record_setup_failure(w, t, now_ns());
+    release_element(w, t);
+  }
+}
+
+/*
+ * Sets t up for a scenario entry. Handles keep the entry they were last set
+ * up for, so only a change of entry costs a reset and a fresh set of options.
+ */
+static bool use_entry(struct worker *w, struct transfer *t, unsigned entry) {
+  const struct request *req = &w->shared->opts->scenario->entries[entry].req;
+  if (entry == t->entry) {
+    return true;
+  }
+  curl_easy_reset(t->easy);
+  curl_mime_free(t->mime);
+  t->mime = NULL;
+  t->entry = UINT_MAX;
+  t->render = NULL;
+  if (configure_transfer(t, req) != 0) {
+    return false;
+  }
+  if (req->gen && !t->renders[entry] && !(t->renders[entry] = request_render_new(req))) {
+    fprintf(err_stream(), "Out of memory while rendering generators.\n");
+    return false;
+  }
+  t->entry = entry;
+  t->render = t->renders[entry];
+  return true;
+}
+
+static const struct request *transfer_request(const struct worker *w,
+                                              const struct transfer *t) {
+  const struct load_options *opts = w->shared->opts;
+  if (opts->collection) {
+    return &t->req;
+  }
+  return opts->scenario ? &opts->scenario->entries[t->entry].req : w->shared->req;
+}
+
+static bool claim_request(struct worker *w, uint64_t *seq) {
+  struct load_shared *shared = w->shared;
+  if (shared->deadline_ns && now_ns() >= shared->deadline_ns) {
+    return false;
+  }
+  uint64_t n = atomic_fetch_add(&shared->issued, 1);
+  if (shared->opts->requests && n >= shared->opts->requests) {
+    return false;
+  }
+  *seq = n;
+  return true;
+}
+
+/* Takes the next request for t; false when there is none left. */
+static bool claim_next(struct worker *w, struct transfer *t) {
+  const struct load_options *opts = w->shared->opts;
+  for (;;) {
+    bool claimed = opts->collection ? claim_from_collection(w, t) : claim_request(w, &t->seq);
+    if (!claimed) {
+      return false;
+    }
+    if (!opts->scenario ||
+        use_entry(w, t, scenario_pick(opts->scenario, gen_rng_next(&w->rng)))) {
+      return true;
+    }
+    record_setup_failure(w, t, now_ns());
+  }
+}
+
+/*
+ * Hands a claimed transfer to libcurl; its latency counts from started_ns.
+ * False when libcurl refused it: the request is counted as failed and t is free.
+ */
+static bool launch_transfer(struct worker *w, struct transfer *t, uint64_t started_ns) {
+  struct shard *sh = t->shard;
+  if (t->render) {
+    request_render(t->easy, transfer_request(w, t), t->render, &w->rng, t->seq);
+  }
+  if (w->samples) {
+    t->sample_key = gen_rng_next(&w->rng);
+    t->sampling = sample_wanted(w, t->sample_key);
+  }
+  t->started_ns = started_ns;
+  t->bytes = 0;
+  if (curl_multi_add_handle(sh->multi, t->easy) != CURLM_OK) {
+    t->sampling = false;
+    record_setup_failure(w, t, started_ns);
+    release_element(w, t);
+    return false;
+  }
+  sh->active++;
+  w->active++;
+  return true;
+}
+
+static void start_transfer(struct transfer *t) {
+  struct worker *w = t->shard->worker;
+  if (w->shared->opts->rate > 0) {
+    /* Paced runs start slots from start_due, on the request schedule. */
+    w->idle[w->idle_count++] = t;
+    return;
+  }
+  while (claim_next(w, t)) {
+    if (launch_transfer(w, t, now_ns())) {
+      return;
+    }
+  }
+}
+
+static uint64_t due_ns(const struct load_shared *shared, uint64_t seq) {
+  return shared->start_ns + (uint64_t)((double)seq * 1e9 / shared->opts->rate);
+}
+
+/*
+ * Rate runs: request n is due n / rate seconds into the run, whether or not
+ * earlier ones have finished. Latency counts from the due time, so a request
+ * that had to wait for a free slot shows that wait instead of hiding it.
+ */
+static void start_due(struct worker *w) {
+  for (;;) {
+    if (!w->next) {
+      if (w->idle_count == 0 || w->exhausted) {
+        return;
+      }
+      struct transfer *t = w->idle[--w->idle_count];
+      if (!claim_next(w, t)) {
+        w->idle[w->idle_count++] = t;
+        w->exhausted = true;
+        return;
+      }
+      w->next = t;
+    }
+    uint64_t due = due_ns(w->shared, w->next->seq);
+    if (due > now_ns()) {
+      return;
+    }
+    if (!launch_transfer(w, w->next, due)) {
+      w->idle[w->idle_count++] = w->next;
+    }
+    w->next = NULL;
+  }
+}
+
+static bool worker_busy(const struct worker *w) {
+  return w->active > 0 || w->next || (w->idle_count > 0 && !w->exhausted);
+}
+
+static void emit_record(struct sink *sink, const struct load_shared *shared,
+                        const struct transfer *t, uint64_t latency_us, long status,
+                        CURLcode res) {
+  char *line = sink_reserve(sink, t->seq);
+  int n = snprintf(line, SINK_RECORD_MAX,
+                   "{\"seq\":%llu,\"start_ms\":%.3f,\"latency_ms\":%.3f,\"status\":%ld,"
+                   "\"bytes\":%llu",
+                   (unsigned long long)t->seq,
+                   (double)(t->started_ns - shared->start_ns) / 1e6,
+                   (double)latency_us / 1000.0, status, (unsigned long long)t->bytes);
+  if (shared->entry_names && n > 0 && (size_t)n < SINK_RECORD_MAX) {
+    n += snprintf(line + n, SINK_RECORD_MAX - (size_t)n, ",\"config\":\"%s\"",
+                  shared->entry_names[t->entry]);
+  }
+  if (res != CURLE_OK && n > 0 && (size_t)n < SINK_RECORD_MAX) {
+    n += snprintf(line + n, SINK_RECORD_MAX - (size_t)n, ",\"error\":\"%s\"",
+                  curl_easy_strerror(res));
+  }
+  if (n > 0 && (size_t)n < SINK_RECORD_MAX - 2) {
+    n += snprintf(line + n, SINK_RECORD_MAX - (size_t)n, "}\n");
+  } else {
+    n = snprintf(line, SINK_RECORD_MAX, "{\"seq\":%llu}\n", (unsigned long long)t->seq);
+  }
+  sink_commit(sink, line, (size_t)n);
+}
+
+void load_stats_record(struct load_stats *stats, uint64_t latency_us, long status,
+                       CURLcode res, uint64_t bytes) {
+  stats->completed++;
+  stats->bytes_received += bytes;
+  histogram_record(&stats->latency, latency_us);
+  if (res != CURLE_OK) {
+    stats->errors++;
+    if ((unsigned)res < CURL_LAST) {
+      stats->curl_errors[res]++;
+    }
+    return;
+  }
+  stats->ok++;
+  stats->status_classes[status >= 100 && status < 600 ? status / 100 : 0]++;
+}
+
+static void record_result(struct worker *w, struct transfer *t, CURLcode res) {
+  if (t->started_ns < w->shared->measure_ns) {
+    w->warmup_requests++;
+    if (w->shared->opts->records) {
+      sink_skip(w->shared->opts->records, t->seq);
+    }
+    response_buffer_free(&t->body);
+    t->sampling = false;
+    return;
+  }
+  uint64_t wall_ns = now_ns() - t->started_ns;
+  uint64_t latency_us = wall_ns / 1000;
+  long status = 0;
+  if (res == CURLE_OK) {
+    curl_easy_getinfo(t->easy, CURLINFO_RESPONSE_CODE, &status);
+  }
+  load_stats_record(&w->stats, latency_us, status, res, t->bytes);
+  if (w->entries) {
+    load_stats_record(&w->entries[t->entry], latency_us, status, res, t->bytes);
+  }
+  if (w->live) {
+    /* Pairs with the store/load order in collect_interval. */
+    atomic_store(&w->recording, true);
+    unsigned idx = atomic_load(&w->interval_index);
+    load_stats_record(&w->interval[idx], latency_us, status, res, t->bytes);
+    atomic_store_explicit(&w->recording, false, memory_order_release);
+  }
+  if (w->shared->opts->records) {
+    emit_record(w->shared->opts->records, w->shared, t, latency_us, status, res);
+  }
+  if (w->trace) {
+    trace_request(w->trace, t->slot + 1, t->easy, t->started_ns - w->shared->start_ns, wall_ns,
+                  t->seq, status, res, t->bytes);
+  }
+  if (t->sampling) {
+    if (res == CURLE_OK && sample_wanted(w, t->sample_key)) {
+      keep_sample(w, t, status);
+    }
+    response_buffer_free(&t->body);
+    t->sampling = false;
+  }
+}
+
+static void drain_completions(struct shard *sh) {
+  CURLMsg *msg;
+  int left = 0;
+  while ((msg = curl_multi_info_read(sh->multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    void *priv = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    struct transfer *t = (struct transfer *)priv;
+    CURLcode res = msg->data.result;
+    curl_multi_remove_handle(sh->multi, t->easy);
+    sh->active--;
+    sh->worker->active--;
+    if (sh->worker->prewarming) {
+      sh->worker->warmed += res == CURLE_OK;
+      continue;
+    }
+    record_result(sh->worker, t, res);
+    release_element(sh->worker, t);
+    start_transfer(t);
+  }
+}
+
+static void abort_transfers(struct worker *w) {
+  for (unsigned i = 0; i < w->slots; i++) {
+    curl_multi_remove_handle(w->transfers[i].shard->multi, w->transfers[i].easy);
+  }
+  for (unsigned i = 0; i < w->shard_count; i++) {
+    w->shards[i].active = 0;
+  }
+  w->active = 0;
+  w->next = NULL;
+  w->exhausted = true;
+}
+
+static int wait_timeout_ms(const struct worker *w, int fallback_ms) {
+  if (!w->shared->stop_ns) {
+    return fallback_ms;
+  }
+  uint64_t now = now_ns();
+  if (now >= w->shared->stop_ns) {
+    return 0;
+  }
+  uint64_t left_ms = (w->shared->stop_ns - now + 999999) / 1000000;
+  if (fallback_ms >= 0 && (uint64_t)fallback_ms < left_ms) {
+    return fallback_ms;
+  }
+  return left_ms > 1000 ? 1000 : (int)left_ms;
+}
+
+static bool deadline_passed(const struct worker *w) {
+  return w->shared->stop_ns && now_ns() >= w->shared->stop_ns;
+}
+
+#ifdef __linux__
+/* epoll user data: shard index in the high half, fd in the low half. */
+#define WATCH_TIMER (1ull << 63)
+#define WATCH_PACE (1ull << 62)
+
+static uint64_t watch_key(const struct shard *sh, int fd) {
+  return ((uint64_t)sh->index << 32) | (uint32_t)fd;
+}
+
+static int on_socket(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+  (void)easy;
+  struct shard *sh = (struct shard *)userp;
+  int epfd = sh->worker->epfd;
+  if (what == CURL_POLL_REMOVE) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s, NULL);
+    return 0;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = ((what & CURL_POLL_IN) ? EPOLLIN : 0u) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0u);
+  ev.data.u64 = watch_key(sh, s);
+  if (socketp && epoll_ctl(epfd, EPOLL_CTL_MOD, s, &ev) == 0) {
+    return 0;
+  }
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, s, &ev) != 0 &&
+      (errno != EEXIST || epoll_ctl(epfd, EPOLL_CTL_MOD, s, &ev) != 0)) {
+    return -1;
+  }
+  curl_multi_assign(sh->multi, s, sh);
+  return 0;
+}
+
+static int on_timer(CURLM *multi, long timeout_ms, void *userp) {
+  (void)multi;
+  struct shard *sh = (struct shard *)userp;
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  if (timeout_ms > 0) {
+    its.it_value.tv_sec = timeout_ms / 1000;
+    its.it_value.tv_nsec = (timeout_ms % 1000) * 1000000;
+  } else if (timeout_ms == 0) {
+    /* timerfd treats an all-zero value as "disarm", so fire almost now. */
+    its.it_value.tv_nsec = 1;
+  }
+  return timerfd_settime(sh->tfd, 0, &its, NULL) == 0 ? 0 : -1;
+}
+
+static int worker_open_loop(struct worker *w) {
+  w->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (w->epfd < 0) {
+    return -1;
+  }
+  for (unsigned i = 0; i < w->shard_count; i++) {
+    struct shard *sh = &w->shards[i];
+    sh->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sh->tfd < 0) {
+      return -1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WATCH_TIMER | watch_key(sh, sh->tfd);
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, sh->tfd, &ev) != 0) {
+      return -1;
+    }
+    curl_multi_setopt(sh->multi, CURLMOPT_SOCKETFUNCTION, on_socket);
+    curl_multi_setopt(sh->multi, CURLMOPT_SOCKETDATA, sh);
+    curl_multi_setopt(sh->multi, CURLMOPT_TIMERFUNCTION, on_timer);
+    curl_multi_setopt(sh->multi, CURLMOPT_TIMERDATA, sh);
+  }
+  if (w->shared->opts->rate > 0) {
+    w->pace_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WATCH_PACE;
+    if (w->pace_tfd < 0 || epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->pace_tfd, &ev) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Starts what is due and arms the pace timer (absolute, ns) for the next one. */
+static void pace(struct worker *w) {
+  start_due(w);
+  uint64_t at = w->next ? due_ns(w->shared, w->next->seq) : 0;
+  if (at == w->pace_at) {
+    return;
+  }
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = (time_t)(at / 1000000000ull);
+  its.it_value.tv_nsec = (long)(at % 1000000000ull);
+  if (timerfd_settime(w->pace_tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+    w->pace_at = at;
+  }
+}
+
+static void worker_close_loop(struct worker *w) {
+  for (unsigned i = 0; i < w->shard_count; i++) {
+    if (w->shards[i].tfd >= 0) {
+      close(w->shards[i].tfd);
+    }
+  }
+  if (w->pace_tfd >= 0) {
+    close(w->pace_tfd);
+  }
+  if (w->epfd >= 0) {
+    close(w->epfd);
+  }
+}
+
+static void worker_loop(struct worker *w) {
+  struct epoll_event events[MAX_EVENTS];
+  int running = 0;
+  bool paced = w->shared->opts->rate > 0 && !w->prewarming;
+  for (;;) {
+    if (paced) {
+      pace(w);
+    }
+    if (!worker_busy(w)) {
+      break;
+    }
+    int n = epoll_wait(w->epfd, events, MAX_EVENTS, wait_timeout_ms(w, -1));
+    if (n < 0 && errno != EINTR) {
+      w->rc = EXIT_HTTP;
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      uint64_t key = events[i].data.u64;
+      if (key == WATCH_PACE) {
+        uint64_t expirations;
+        if (read(w->pace_tfd, &expirations, sizeof(expirations)) < 0) {
+          w->pace_at = 0;
+        }
+        continue;
+      }
+      struct shard *sh = &w->shards[(key & ~WATCH_TIMER) >> 32];
+      int fd = (int)(uint32_t)key;
+      if (key & WATCH_TIMER) {
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+          continue;
+        }
+        curl_multi_socket_action(sh->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+      } else {
+        int mask = 0;
+        if (events[i].events & EPOLLIN) {
+          mask |= CURL_CSELECT_IN;
+        }
+        if (events[i].events & EPOLLOUT) {
+          mask |= CURL_CSELECT_OUT;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          mask |= CURL_CSELECT_ERR;
+        }
+        curl_multi_socket_action(sh->multi, fd, mask, &running);
+      }
+      drain_completions(sh);
+    }
+    if (deadline_passed(w)) {
+      abort_transfers(w);
+    }
+  }
+}
+#else
+static int worker_open_loop(struct worker *w) {
+  (void)w;
+  return 0;
+}
+
+static void worker_close_loop(struct worker *w) {
+  (void)w;
+}
+
+/* Without epoll every worker has a single shard driven by curl_multi_poll. */
+static void worker_loop(struct worker *w) {
+  struct shard *sh = &w->shards[0];
+  int running = 0;
+  bool paced = w->shared->opts->rate > 0 && !w->prewarming;
+  for (;;) {
+    if (paced) {
+      start_due(w);
+    }
+    if (!worker_busy(w)) {
+      break;
+    }
+    curl_multi_perform(sh->multi, &running);
+    drain_completions(sh);
+    if (deadline_passed(w)) {
+      abort_transfers(w);
+      break;
+    }
+    int timeout_ms = wait_timeout_ms(w, 1000);
+    if (w->next) {
+      /* Millisecond polls: a request can start up to 1 ms after it is due. */
+      uint64_t due = due_ns(w->shared, w->next->seq);
+      uint64_t now = now_ns();
+      int due_ms = due > now ? (int)((due - now) / 1000000) : 0;
+      timeout_ms = due_ms < timeout_ms ? due_ms : timeout_ms;
+    }
+    if (worker_busy(w)) {
+      curl_multi_poll(sh->multi, NULL, 0, timeout_ms, NULL);
+    }
+  }
+}
+#endif
+
+static void *worker_main(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  for (unsigned i = 0; i < w->slots; i++) {
+    start_transfer(&w->transfers[i]);
+  }
+  worker_loop(w);
+  atomic_store(&w->done, true);
+  return NULL;
+}
+
+/*
+ * CONNECT_ONLY connections never go back to the pool for later transfers, so
+ * warm-up sends a HEAD on each of the first w->prewarm handles instead: the
+ * keep-alive connection lands in the same shard the measured run will use.
+ */
+static void *worker_prewarm_main(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  w->prewarming = true;
+  for (unsigned i = 0; i < w->prewarm; i++) {
+    struct transfer *t = &w->transfers[i];
+    curl_easy_setopt(t->easy, CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(t->easy, CURLOPT_NOBODY, 1L);
+    if (curl_multi_add_handle(t->shard->multi, t->easy) == CURLM_OK) {
+      t->shard->active++;
+      w->active++;
+    }
+  }
+  worker_loop(w);
+  for (unsigned i = 0; i < w->prewarm; i++) {
+    struct transfer *t = &w->transfers[i];
+    curl_easy_setopt(t->easy, CURLOPT_NOBODY, 0L);
+    request_apply(t->easy, transfer_request(w, t));
+    if (t->mime) {
+      curl_easy_setopt(t->easy, CURLOPT_MIMEPOST, t->mime);
+    }
+  }
+  w->prewarming = false;
+  return NULL;
+}
+
+static int worker_init(struct worker *w, struct load_shared *shared, unsigned index,
+                       unsigned slots) {
+  memset(w, 0, sizeof(*w));
+  w->shared = shared;
+  w->slots = slots;
+  w->shard_count = slots / SHARD_SLOTS + (slots % SHARD_SLOTS ? 1 : 0);
+  if (w->shard_count == 0) {
+    w->shard_count = 1;
+  }
+  histogram_reset(&w->stats.latency);
+  gen_rng_seed(&w->rng, now_ns() ^ (uint64_t)(uintptr_t)w);
+  w->live = shared->opts->report_interval_ns || shared->opts->metrics;
+  histogram_reset(&w->interval[0].latency);
+  histogram_reset(&w->interval[1].latency);
+  atomic_init(&w->interval_index, 0);
+  atomic_init(&w->recording, false);
+  atomic_init(&w->done, false);
+#ifdef __linux__
+  w->epfd = -1;
+  w->pace_tfd = -1;
+#endif
+  w->shards = (struct shard *)calloc(w->shard_count, sizeof(struct shard));
+  w->transfers = (struct transfer *)calloc(slots ? slots : 1, sizeof(struct transfer));
+  if (!w->shards || !w->transfers) {
+    return -1;
+  }
+  if (shared->opts->rate > 0) {
+    w->idle = (struct transfer **)calloc(slots ? slots : 1, sizeof(struct transfer *));
+    if (!w->idle) {
+      return -1;
+    }
+  }
+  const struct scenario *scenario = shared->opts->scenario;
+  if (scenario) {
+    w->entries = (struct load_stats *)malloc(scenario->count * sizeof(struct load_stats));
+    if (!w->entries) {
+      return -1;
+    }
+    for (unsigned i = 0; i < scenario->count; i++) {
+      load_stats_reset(&w->entries[i]);
+    }
+  }
+  if (shared->opts->sample_bodies) {
+    w->samples =
+        (struct load_sample *)calloc(shared->opts->sample_bodies, sizeof(struct load_sample));
+    if (!w->samples) {
+      return -1;
+    }
+  }
+  for (unsigned i = 0; i < w->shard_count; i++) {
+    struct shard *sh = &w->shards[i];
+    sh->worker = w;
+    sh->index = i;
+#ifdef __linux__
+    sh->tfd = -1;
+#endif
+    sh->multi = curl_multi_init();
+    if (!sh->multi) {
+      return -1;
+    }
+  }
+  if (worker_open_loop(w) != 0) {
+    return -1;
+  }
+  for (unsigned i = 0; i < slots; i++) {
+    struct transfer *t = &w->transfers[i];
+    t->shard = &w->shards[i % w->shard_count];
+    t->slot = i;
+    t->easy = curl_easy_init();
+    t->entry = UINT_MAX;
+    if (!t->easy) {
+      return -1;
+    }
+    if (scenario) {
+      /* Set up for a first entry now, so prewarm has somewhere to connect. */
+      t->renders =
+          (struct request_render **)calloc(scenario->count, sizeof(struct request_render *));
+      if (!t->renders || !use_entry(w, t, scenario_pick(scenario, gen_rng_next(&w->rng)))) {
+        return -1;
+      }
+      if (t->render) {
+        request_render(t->easy, transfer_request(w, t), t->render, &w->rng, 0);
+      }
+    }
+    if (shared->req && configure_transfer(t, shared->req) != 0) {
+      return -1;
+    }
+    if (shared->req && shared->req->gen) {
+      /* Rendered once up front so prewarm sends a well-formed request. */
+      t->render = request_render_new(shared->req);
+      if (!t->render) {
+        return -1;
+      }
+      request_render(t->easy, shared->req, t->render, &w->rng, 0);
+    }
+  }
+  if (shared->opts->trace) {
+    w->trace = trace_buffer_new(shared->opts->trace, index + 1);
+    if (!w->trace) {
+      return -1;
+    }
+    for (unsigned i = 0; i < slots; i++) {
+      trace_track(w->trace, i + 1);
+    }
+  }
+  for (unsigned i = 0; i < w->shard_count; i++) {
+    unsigned shard_slots = slots / w->shard_count + (i < slots % w->shard_count ? 1 : 0);
+    curl_multi_setopt(w->shards[i].multi, CURLMOPT_MAXCONNECTS, (long)shard_slots);
+  }
+  return 0;
+}
+
+static void worker_cleanup(struct worker *w) {
+  if (w->transfers) {
+    for (unsigned i = 0; i < w->slots; i++) {
+      struct transfer *t = &w->transfers[i];
+      if (t->easy) {
+        curl_multi_remove_handle(t->shard->multi, t->easy);
+        curl_easy_cleanup(t->easy);
+      }
+      request_free(&t->req);
+      if (t->renders) {
+        for (unsigned k = 0; k < w->shared->opts->scenario->count; k++) {
+          request_render_free(t->renders[k]);
+        }
+        free(t->renders);
+      } else {
+        request_render_free(t->render);
+      }
+      curl_mime_free(t->mime);
+      response_buffer_free(&t->body);
+    }
+  }
+  for (unsigned i = 0; i < w->sample_count; i++) {
+    response_buffer_free(&w->samples[i].body);
+  }
+  free(w->samples);
+  free(w->entries);
+  free(w->idle);
+  trace_buffer_free(w->trace);
+  if (w->shards) {
+    for (unsigned i = 0; i < w->shard_count; i++) {
+      if (w->shards[i].multi) {
+        curl_multi_cleanup(w->shards[i].multi);
+      }
+    }
+    worker_close_loop(w);
+  }
+  free(w->shards);
+  free(w->transfers);
+}
+
+void load_stats_reset(struct load_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  histogram_reset(&stats->latency);
+}
+
+static void merge_stats(struct load_stats *dst, const struct load_stats *src) {
+  dst->completed += src->completed;
+  dst->ok += src->ok;
+  dst->errors += src->errors;
+  for (unsigned i = 0; i < 6; i++) {
+    dst->status_classes[i] += src->status_classes[i];
+  }
+  for (unsigned i = 0; i < CURL_LAST; i++) {
+    dst->curl_errors[i] += src->curl_errors[i];
+  }
+  dst->bytes_received += src->bytes_received;
+  histogram_merge(&dst->latency, &src->latency);
+}
+
+/*
+ * Flips every worker to its other interval buffer and folds the one it just
+ * left into out. A worker that read the old index before the flip is still
+ * inside record_result with recording set, so wait for it to clear.
+ */
+static void collect_interval(struct worker *workers, unsigned count, struct load_stats *out) {
+  load_stats_reset(out);
+  for (unsigned i = 0; i < count; i++) {
+    struct worker *w = &workers[i];
+    unsigned old = atomic_load(&w->interval_index);
+    atomic_store(&w->interval_index, old ^ 1u);
+    while (atomic_load(&w->recording)) {
+    }
+    merge_stats(out, &w->interval[old]);
+    load_stats_reset(&w->interval[old]);
+  }
+}
+
+static void print_interval(unsigned index, uint64_t elapsed_ns, uint64_t span_ns,
+                           const struct load_stats *stats) {
+  const struct histogram *h = &stats->latency;
+  double span_s = (double)span_ns / 1e9;
+  fprintf(stderr,
+          "{\"interval\":%u,\"elapsed_ms\":%.3f,\"requests\":%llu,\"errors\":%llu,"
+          "\"rps\":%.1f,\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,"
+          "\"max\":%.3f}}\n",
+          index, (double)elapsed_ns / 1e6, (unsigned long long)stats->completed,
+          (unsigned long long)stats->errors,
+          span_s > 0 ? (double)stats->completed / span_s : 0.0,
+          (double)histogram_quantile(h, 0.50) / 1000.0,
+          (double)histogram_quantile(h, 0.90) / 1000.0,
+          (double)histogram_quantile(h, 0.99) / 1000.0, (double)h->max_us / 1000.0);
+}
+
+static bool workers_done(struct worker *workers, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    if (!atomic_load(&workers[i].done)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Runs on the main thread while workers are busy; metrics default to 1s ticks. */
+static void report_live(struct worker *workers, unsigned count, const struct load_options *opts,
+                        uint64_t start, unsigned concurrency) {
+  uint64_t tick = opts->report_interval_ns ? opts->report_interval_ns : 1000000000ull;
+  struct load_stats *interval = (struct load_stats *)malloc(sizeof(struct load_stats));
+  struct load_stats *total = (struct load_stats *)malloc(sizeof(struct load_stats));
+  if (!interval || !total) {
+    free(interval);
+    free(total);
+    return;
+  }
+  load_stats_reset(total);
+  metrics_publish(opts->metrics, total, 0.0, concurrency);
+  unsigned index = 0;
+  uint64_t last = start;
+  bool done = false;
+  while (!done) {
+    uint64_t next = last + tick;
+    for (;;) {
+      done = workers_done(workers, count);
+      uint64_t now = now_ns();
+      if (done || now >= next) {
+        break;
+      }
+      uint64_t left = next - now;
+      sleep_ns(left < 20000000ull ? left : 20000000ull);
+    }
+    uint64_t now = now_ns();
+    collect_interval(workers, count, interval);
+    merge_stats(total, interval);
+    if (opts->report_interval_ns && (!done || interval->completed > 0)) {
+      print_interval(++index, now - start, now - last, interval);
+    }
+    double span_s = (double)(now - last) / 1e9;
+    metrics_publish(opts->metrics, total, span_s > 0 ? (double)interval->completed / span_s : 0.0,
+                    concurrency);
+    last = now;
+  }
+  free(interval);
+  free(total);
+}
+
+static int sample_by_key(const void *a, const void *b) {
+  uint64_t x = ((const struct load_sample *)a)->key;
+  uint64_t y = ((const struct load_sample *)b)->key;
+  return x < y ? -1 : x > y;
+}
+
+static int sample_by_seq(const void *a, const void *b) {
+  uint64_t x = ((const struct load_sample *)a)->seq;
+  uint64_t y = ((const struct load_sample *)b)->seq;
+  return x < y ? -1 : x > y;
+}
+
+/* Pools the workers' samples and keeps the smallest keys of the run. */
+static void collect_samples(struct worker *workers, unsigned count, unsigned keep,
+                            struct load_report *report) {
+  size_t total = 0;
+  for (unsigned i = 0; i < count; i++) {
+    total += workers[i].sample_count;
+  }
+  struct load_sample *all =
+      (struct load_sample *)calloc(total ? total : 1, sizeof(struct load_sample));
+  if (!all) {
+    return;
+  }
+  size_t n = 0;
+  for (unsigned i = 0; i < count; i++) {
+    memcpy(all + n, workers[i].samples, workers[i].sample_count * sizeof(struct load_sample));
+    n += workers[i].sample_count;
+    workers[i].sample_count = 0;
+  }
+  qsort(all, n, sizeof(struct load_sample), sample_by_key);
+  for (size_t i = keep; i < n; i++) {
+    response_buffer_free(&all[i].body);
+  }
+  report->samples = all;
+  report->sample_count = n < keep ? (unsigned)n : keep;
+  qsort(all, report->sample_count, sizeof(struct load_sample), sample_by_seq);
+}
+
+static void close_scenario(struct load_shared *shared) {
+  if (!shared->entry_names) {
+    return;
+  }
+  for (unsigned i = 0; i < shared->opts->scenario->count; i++) {
+    free(shared->entry_names[i]);
+  }
+  free(shared->entry_names);
+  shared->entry_names = NULL;
+}
+
+static int open_scenario(struct load_shared *shared, struct load_report *report) {
+  const struct scenario *scenario = shared->opts->scenario;
+  report->entries = (struct load_stats *)malloc(scenario->count * sizeof(struct load_stats));
+  if (!report->entries) {
+    return -1;
+  }
+  for (unsigned i = 0; i < scenario->count; i++) {
+    load_stats_reset(&report->entries[i]);
+  }
+  if (!shared->opts->records) {
+    return 0;
+  }
+  shared->entry_names = (char **)calloc(scenario->count, sizeof(char *));
+  if (!shared->entry_names) {
+    return -1;
+  }
+  for (unsigned i = 0; i < scenario->count; i++) {
+    if (!(shared->entry_names[i] = json_escape(scenario->entries[i].name))) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static double process_cpu_seconds(void) {
+#ifndef _WIN32
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0) {
+    return (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6 +
+           (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+  }
+#endif
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* Every connection is a descriptor; lift the soft limit as far as allowed. */
+static void raise_fd_limit(unsigned concurrency) {
+#ifndef _WIN32
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+    return;
+  }
+  if (rl.rlim_cur < rl.rlim_max) {
+    rlim_t wanted = rl.rlim_max;
+#ifdef __APPLE__
+    if (wanted > OPEN_MAX) {
+      wanted = OPEN_MAX;
+    }
+#endif
+    struct rlimit next = rl;
+    next.rlim_cur = wanted;
+    if (setrlimit(RLIMIT_NOFILE, &next) == 0) {
+      rl = next;
+    }
+  }
+  if (rl.rlim_cur != RLIM_INFINITY && (rlim_t)concurrency + 64 > rl.rlim_cur) {
+    fprintf(stderr,
+            "Warning: concurrency %u is close to the open file limit (%llu).\n",
+            concurrency, (unsigned long long)rl.rlim_cur);
+  }
+#else
+  (void)concurrency;
+#endif
+}
+
+int load_run(const struct request *req, const struct load_options *opts,
+             struct load_report *report) {
+  unsigned threads = opts->threads ? opts->threads : 1;
+  unsigned concurrency = opts->concurrency ? opts->concurrency : 1;
+  if (threads > concurrency) {
+    threads = concurrency;
+  }
+  raise_fd_limit(concurrency);
+
+  struct load_shared shared;
+  memset(&shared, 0, sizeof(shared));
+  shared.req = req;
+  shared.opts = opts;
+  atomic_init(&shared.issued, 0);
+  pthread_mutex_init(&shared.source_lock, NULL);
+
+  memset(report, 0, sizeof(*report));
+  histogram_reset(&report->stats.latency);
+  report->concurrency = concurrency;
+  report->threads = threads;
+  report->rate = opts->rate;
+  report->warmup_ns = opts->warmup_ns;
+  report->scenario = opts->scenario;
+  struct worker *workers = (struct worker *)calloc(threads, sizeof(struct worker));
+  if (!workers) {
+    fprintf(stderr, "Out of memory while starting workers.\n");
+    return EXIT_HTTP;
+  }
+
+  int rc = EXIT_OK;
+  if (opts->scenario && open_scenario(&shared, report) != 0) {
+    fprintf(stderr, "Out of memory while starting workers.\n");
+    rc = EXIT_HTTP;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    unsigned slots = concurrency / threads + (i < concurrency % threads ? 1 : 0);
+    if (worker_init(&workers[i], &shared, i, slots) != 0) {
+      fprintf(stderr, "Failed to init worker event loop.\n");
+      rc = EXIT_HTTP;
+    }
+  }
+
+  if (rc == EXIT_OK && opts->prewarm) {
+    unsigned prewarm = opts->prewarm < concurrency ? opts->prewarm : concurrency;
+    report->prewarm_requested = prewarm;
+    uint64_t warm_start = now_ns();
+    unsigned warming = 0;
+    for (; warming < threads; warming++) {
+      struct worker *w = &workers[warming];
+      w->prewarm = prewarm / threads + (warming < prewarm % threads ? 1 : 0);
+      if (pthread_create(&w->thread, NULL, worker_prewarm_main, w) != 0) {
+        fprintf(stderr, "Failed to start worker thread.\n");
+        rc = EXIT_HTTP;
+        break;
+      }
+    }
+    for (unsigned i = 0; i < warming; i++) {
+      pthread_join(workers[i].thread, NULL);
+      report->prewarm_opened += workers[i].warmed;
+      if (workers[i].rc != EXIT_OK) {
+        rc = workers[i].rc;
+      }
+    }
+    report->prewarm_ns = now_ns() - warm_start;
+  }
+
+  unsigned started = 0;
+  if (rc == EXIT_OK) {
+    double cpu_start = process_cpu_seconds();
+    uint64_t start = now_ns();
+    shared.start_ns = start;
+    shared.measure_ns = start + opts->warmup_ns;
+    if (opts->duration_ns) {
+      shared.deadline_ns = shared.measure_ns + opts->duration_ns;
+      /*
+       * Paced requests sent before the deadline get up to another duration to
+       * finish: dropping them would drop exactly the slowest ones.
+       */
+      shared.stop_ns = shared.deadline_ns + (opts->rate > 0 ? opts->duration_ns : 0);
+    }
+    for (; started < threads; started++) {
+      if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+        fprintf(stderr, "Failed to start worker thread.\n");
+        rc = EXIT_HTTP;
+        break;
+      }
+    }
+    if (started == threads && (opts->report_interval_ns || opts->metrics)) {
+      report_live(workers, threads, opts, start, concurrency);
+    }
+    for (unsigned i = 0; i < started; i++) {
+      pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t end = now_ns();
+    if (shared.deadline_ns && end > shared.deadline_ns) {
+      end = shared.deadline_ns;
+    }
+    report->elapsed_ns = end > shared.measure_ns ? end - shared.measure_ns : 0;
+    report->cpu_seconds = process_cpu_seconds() - cpu_start;
+  }
+
+  if (opts->sample_bodies) {
+    collect_samples(workers, started, opts->sample_bodies, report);
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    if (i < started) {
+      merge_stats(&report->stats, &workers[i].stats);
+      report->warmup_requests += workers[i].warmup_requests;
+      for (unsigned k = 0; report->entries && k < opts->scenario->count; k++) {
+        merge_stats(&report->entries[k], &workers[i].entries[k]);
+      }
+      if (workers[i].rc != EXIT_OK) {
+        rc = workers[i].rc;
+      }
+    }
+    worker_cleanup(&workers[i]);
+  }
+  free(workers);
+  close_scenario(&shared);
+  report->source_rc = shared.source_rc;
+  pthread_mutex_destroy(&shared.source_lock);
+  return rc;
+}
+
+static double us_to_ms(uint64_t us) {
+  return (double)us / 1000.0;
+}
+
+void load_print_status(FILE *out, const struct load_stats *stats) {
+  fprintf(out,
+          "\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,"
+          "\"5xx\":%llu,\"other\":%llu},",
+          (unsigned long long)stats->status_classes[1],
+          (unsigned long long)stats->status_classes[2],
+          (unsigned long long)stats->status_classes[3],
+          (unsigned long long)stats->status_classes[4],
+          (unsigned long long)stats->status_classes[5],
+          (unsigned long long)stats->status_classes[0]);
+}
+
+void load_print_latency(FILE *out, const char *name, const struct histogram *h) {
+  fprintf(out,
+          "\"%s\":{\"min\":%.3f,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,"
+          "\"p99\":%.3f,\"max\":%.3f},",
+          name, us_to_ms(h->min_us), histogram_mean(h) / 1000.0,
+          us_to_ms(histogram_quantile(h, 0.50)), us_to_ms(histogram_quantile(h, 0.90)),
+          us_to_ms(histogram_quantile(h, 0.99)), us_to_ms(h->max_us));
+}
+
+void load_print_error_reasons(FILE *out, const struct load_stats *stats) {
+  fprintf(out, "\"error_reasons\":{");
+  bool first = true;
+  for (unsigned i = 1; i < CURL_LAST; i++) {
+    if (stats->curl_errors[i] == 0) {
+      continue;
+    }
+    fprintf(out, "%s\"%s\":%llu", first ? "" : ",", curl_easy_strerror((CURLcode)i),
+            (unsigned long long)stats->curl_errors[i]);
+    first = false;
+  }
+  fprintf(out, "}");
+}
+
+void load_print_report(FILE *out, const struct load_report *report) {
+  const struct load_stats *stats = &report->stats;
+  double elapsed_s = (double)report->elapsed_ns / 1e9;
+  double rps = elapsed_s > 0 ? (double)stats->completed / elapsed_s : 0.0;
+  /* CPU time covers the warm-up too, so spread it over those requests as well. */
+  uint64_t all = stats->completed + report->warmup_requests;
+  double cpu_per_req = all ? report->cpu_seconds * 1e6 / (double)all : 0.0;
+  fprintf(out,
+          "{\"requests\":%llu,\"ok\":%llu,\"errors\":%llu,\"concurrency\":%u,"
+          "\"threads\":%u,\"elapsed_ms\":%.3f,\"rps\":%.1f,",
+          (unsigned long long)stats->completed, (unsigned long long)stats->ok,
+          (unsigned long long)stats->errors, report->concurrency, report->threads,
+          (double)report->elapsed_ns / 1e6, rps);
+  if (report->rate > 0) {
+    fprintf(out, "\"rate\":%.1f,", report->rate);
+  }
+  if (report->warmup_ns) {
+    fprintf(out, "\"warmup\":{\"requests\":%llu,\"elapsed_ms\":%.3f},",
+            (unsigned long long)report->warmup_requests, (double)report->warmup_ns / 1e6);
+  }
+  load_print_status(out, stats);
+  load_print_latency(out, "latency_ms", &stats->latency);
+  if (report->prewarm_requested) {
+    fprintf(out, "\"prewarm\":{\"connections\":%u,\"opened\":%u,\"elapsed_ms\":%.3f},",
+            report->prewarm_requested, report->prewarm_opened,
+            (double)report->prewarm_ns / 1e6);
+  }
+  fprintf(out, "\"bytes_received\":%llu,\"cpu_us_per_request\":%.2f,",
+          (unsigned long long)stats->bytes_received, cpu_per_req);
+  load_print_error_reasons(out, stats);
+  if (report->entries) {
+    fprintf(out, ",\"scenario\":[");
+    for (unsigned i = 0; i < report->scenario->count; i++) {
+      const struct scenario_entry *entry = &report->scenario->entries[i];
+      const struct load_stats *es = &report->entries[i];
+      char *name = json_escape(entry->name);
+      fprintf(out,
+              "%s{\"name\":\"%s\",\"weight\":%.4f,\"share\":%.4f,\"requests\":%llu,"
+              "\"ok\":%llu,\"errors\":%llu,\"rps\":%.1f,",
+              i ? "," : "", name ? name : "", entry->share,
+              stats->completed ? (double)es->completed / (double)stats->completed : 0.0,
+              (unsigned long long)es->completed, (unsigned long long)es->ok,
+              (unsigned long long)es->errors,
+              elapsed_s > 0 ? (double)es->completed / elapsed_s : 0.0);
+      free(name);
+      load_print_status(out, es);
+      load_print_latency(out, "latency_ms", &es->latency);
+      fprintf(out, "\"bytes_received\":%llu}", (unsigned long long)es->bytes_received);
+    }
+    fputc(']', out);
+  }
+  if (report->samples) {
+    fprintf(out, ",\"samples\":[");
+    for (unsigned i = 0; i < report->sample_count; i++) {
+      const struct load_sample *sample = &report->samples[i];
+      fprintf(out, "%s{\"seq\":%llu,\"status\":%ld,\"bytes\":%llu,\"body\":", i ? "," : "",
+              (unsigned long long)sample->seq, sample->status,
+              (unsigned long long)sample->body.len);
+      print_json_body(out, &sample->body);
+      fputc('}', out);
+    }
+    fputc(']', out);
+  }
+  fprintf(out, "}\n");
+}
+
+void load_report_free(struct load_report *report) {
+  for (unsigned i = 0; i < report->sample_count; i++) {
+    response_buffer_free(&report->samples[i].body);
+  }
+  free(report->samples);
+  report->samples = NULL;
+  report->sample_count = 0;
+  free(report->entries);
+  report->entries = NULL;
+}
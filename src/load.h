@@ -0,0 +1,93 @@
+#ifndef PINGA_LOAD_H
+#define PINGA_LOAD_H
+
+#include <curl/curl.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "request.h"
+#include "response.h"
+#include "sink.h"
+#include "stats.h"
+
+struct collection_reader;
+struct metrics;
+struct scenario;
+struct trace;
+
+struct load_options {
+  unsigned concurrency;
+  unsigned threads;
+  uint64_t requests;    /* 0: bounded by duration only */
+  uint64_t duration_ns; /* 0: bounded by requests only */
+  double rate;          /* requests started per second on a fixed schedule; 0: closed loop */
+  uint64_t warmup_ns;   /* run this long before the measured duration, unrecorded */
+  unsigned prewarm;     /* connections to open before the clock starts */
+  struct sink *records; /* optional: one NDJSON line per finished request */
+  struct trace *trace;  /* optional: Chrome trace events per finished request */
+  uint64_t report_interval_ns; /* 0: no interval lines on stderr */
+  struct metrics *metrics;     /* optional Prometheus snapshot target */
+  /* Optional: each transfer pulls its own request from here instead of req. */
+  struct collection_reader *collection;
+  /* Optional: each request draws one of the scenario's configs instead of req. */
+  const struct scenario *scenario;
+  unsigned sample_bodies; /* keep a uniform random sample of this many bodies */
+};
+
+struct load_stats {
+  uint64_t completed;
+  uint64_t ok;
+  uint64_t errors;
+  uint64_t status_classes[6]; /* index is status / 100, 0 for anything else */
+  uint64_t curl_errors[CURL_LAST];
+  uint64_t bytes_received;
+  struct histogram latency;
+};
+
+struct load_sample {
+  uint64_t key; /* random; the run keeps the bodies with the smallest keys */
+  uint64_t seq;
+  long status;
+  struct response_buffer body;
+};
+
+struct load_report {
+  struct load_stats stats;
+  unsigned concurrency;
+  unsigned threads;
+  double rate;
+  uint64_t warmup_ns;
+  uint64_t warmup_requests; /* finished during warm-up; not in stats */
+  uint64_t elapsed_ns;
+  double cpu_seconds;
+  unsigned prewarm_requested;
+  unsigned prewarm_opened;
+  uint64_t prewarm_ns; /* not part of elapsed_ns or cpu_seconds */
+  int source_rc;       /* EXIT_* code if a collection element was rejected */
+  struct load_sample *samples; /* sorted by seq; NULL unless sample_bodies */
+  unsigned sample_count;
+  const struct scenario *scenario;
+  struct load_stats *entries; /* per scenario entry; NULL without a scenario */
+};
+
+/*
+ * Runs the request repeatedly with up to opts->concurrency transfers in
+ * flight, spread over opts->threads workers. Each worker owns a multi handle
+ * driven by curl_multi_socket_action (epoll + timerfd on Linux), so the cost
+ * of a wakeup does not grow with the number of open connections. With
+ * opts->rate, requests start on a fixed schedule rather than as slots free up.
+ */
+int load_run(const struct request *req, const struct load_options *opts,
+             struct load_report *report);
+void load_print_report(FILE *out, const struct load_report *report);
+void load_report_free(struct load_report *report);
+
+/* Shared with the other runners (replay) that report in the same shape. */
+void load_stats_reset(struct load_stats *stats);
+void load_stats_record(struct load_stats *stats, uint64_t latency_us, long status,
+                       CURLcode res, uint64_t bytes);
+void load_print_status(FILE *out, const struct load_stats *stats);
+void load_print_latency(FILE *out, const char *name, const struct histogram *h);
+void load_print_error_reasons(FILE *out, const struct load_stats *stats);
+
+#endif
@@ -4,633 +4,281 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "jsmn.h"
-
-enum {
-  EXIT_OK = 0,
-  EXIT_CONFIG = 64,
-  EXIT_REQUEST = 65,
-  EXIT_HTTP = 66,
-  EXIT_RESPONSE = 67
-};
-
-static int ensure_tokens(jsmn_parser *parser, const char *json, size_t len,
-                         jsmntok_t **tokens_out, int *count_out);
+#include "capacity.h"
+#include "collection.h"
+#include "daemon.h"
+#include "http_cache.h"
+#include "load.h"
+#include "metrics.h"
+#include "mirror.h"
+#include "replay.h"
+#include "request.h"
+#include "scenario.h"
+#include "single.h"
+#include "sink.h"
+#include "stream.h"
+#include "tls_cache.h"
+#include "trace.h"
+#include "util.h"
+#include "websocket.h"
+#include "workflow.h"
+
+#define MAX_CONCURRENCY 1000000
+#define MAX_THREADS 1024
+#define MAX_SAMPLES 10000
+#define MAX_RATE 1e7
 
 static void print_usage(const char *prog) {
   fprintf(stderr,
-          "Usage: %s [--silent] [--exclude-response-headers] [--version] <config.json>\n",
-          prog);
+          "Usage: %s [--silent] [--exclude-response-headers] [--stream] [--version]\n"
+          "       [--tls-session-cache DIR] [--http-cache DIR] [--resolve HOST:PORT:ADDR]...\n"
+          "       [--unix-socket PATH]\n"
+          "       [--concurrency N] [--requests N] [--duration T] [--threads N]\n"
+          "       [--rate R] [--warmup T] [--prewarm N] [--ndjson] [--ordered] [--trace FILE]\n"
+          "       [--report-interval T] [--metrics-listen HOST:PORT] [--sample-bodies N]\n"
+          "       [--body-memory SIZE] [--body-memory-total SIZE]\n"
+          "       <config.json>\n"
+          "       %s --replay <capture.har|access.log> [--speed X] [--concurrency N]\n"
+          "       [--silent] [--resolve HOST:PORT:ADDR]... [--unix-socket PATH] [config.json]\n"
+          "       %s --collection <requests.jsonl|requests.json|-> [load options]\n"
+          "       %s --scenario <mix.json> [load options]\n"
+          "       %s --find-capacity --slo SPEC [--rate MIN] [--max-rate R]\n"
+          "       [--duration STEP] [--warmup T] [--concurrency N] [--threads N]\n"
+          "       [--silent] <config.json | --scenario FILE>\n"
+          "       %s --mirror <base_url> [--compare-header NAME]... [--concurrency N]\n"
+          "       [--requests N] [--silent] [--resolve HOST:PORT:ADDR]...\n"
+          "       <config.json | --collection FILE>\n"
+          "       %s <config.json with a websocket section> [--concurrency N] [--rate R]\n"
+          "       [--requests N] [--duration T] [--silent]\n"
+          "       %s --workflow <workflow.json> [--concurrency N] [--silent]\n"
+          "       [--resolve HOST:PORT:ADDR]...\n"
+          "       %s --serve <socket>\n",
+          prog, prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
-static char *read_file(const char *path, size_t *out_len) {
-  FILE *fp = fopen(path, "rb");
-  if (!fp) {
-    return NULL;
-  }
-  if (fseek(fp, 0, SEEK_END) != 0) {
-    fclose(fp);
-    return NULL;
-  }
-  long len = ftell(fp);
-  if (len < 0) {
-    fclose(fp);
-    return NULL;
-  }
-  rewind(fp);
-  char *buf = (char *)malloc((size_t)len + 1);
-  if (!buf) {
-    fclose(fp);
-    return NULL;
-  }
-  size_t read_len = fread(buf, 1, (size_t)len, fp);
-  fclose(fp);
-  if (read_len != (size_t)len) {
-    free(buf);
-    return NULL;
-  }
-  buf[len] = '\0';
-  if (out_len) {
-    *out_len = (size_t)len;
-  }
-  return buf;
-}
-
-static int skip_token(const jsmntok_t *toks, int index) {
-  int i = index;
-  switch (toks[i].type) {
-    case JSMN_STRING:
-    case JSMN_PRIMITIVE:
-      return i + 1;
-    case JSMN_ARRAY: {
-      i++;
-      for (int k = 0; k < toks[index].size; k++) {
-        i = skip_token(toks, i);
-      }
-      return i;
-    }
-    case JSMN_OBJECT: {
-      int pairs = toks[index].size / 2;
-      i++;
-      for (int k = 0; k < pairs; k++) {
-        i = skip_token(toks, i);
-        i = skip_token(toks, i);
-      }
-      return i;
-    }
-    default:
-      return i + 1;
+static bool read_rate_arg(int argc, char **argv, int *i, double *out) {
+  char *end = NULL;
+  *out = *i + 1 < argc ? strtod(argv[*i + 1], &end) : 0.0;
+  if (!end || *end != '\0' || !(*out > 0.0 && *out < MAX_RATE)) {
+    fprintf(stderr, "Invalid value for %s.\n", argv[*i]);
+    return false;
   }
+  (*i)++;
+  return true;
 }
 
-static bool jsoneq(const char *json, const jsmntok_t *tok, const char *s) {
-  size_t len = (size_t)(tok->end - tok->start);
-  return tok->type == JSMN_STRING &&
-         strlen(s) == len &&
-         strncmp(json + tok->start, s, len) == 0;
+static bool read_count_arg(int argc, char **argv, int *i, uint64_t max, uint64_t *out) {
+  if (*i + 1 >= argc || !parse_count(argv[*i + 1], out) || *out == 0 || *out > max) {
+    fprintf(stderr, "Invalid value for %s.\n", argv[*i]);
+    return false;
+  }
+  (*i)++;
+  return true;
 }
 
-static int find_object_value(const char *json, jsmntok_t *toks, int obj_index,
-                             const char *key) {
-  if (toks[obj_index].type != JSMN_OBJECT) {
-    return -1;
+static int run_load(const struct request *req, struct load_options *opts,
+                    bool use_exit_codes, bool ndjson, bool ordered, const char *metrics_addr,
+                    const char *trace_path) {
+  if (metrics_addr) {
+    int rc = metrics_listen(metrics_addr, &opts->metrics);
+    if (rc != EXIT_OK) {
+      return rc;
+    }
   }
-  int i = obj_index + 1;
-  int pairs = toks[obj_index].size / 2;
-  for (int pair = 0; pair < pairs; pair++) {
-    int key_index = i;
-    int value_index = i + 1;
-    if (jsoneq(json, &toks[key_index], key)) {
-      return value_index;
+  if (trace_path) {
+    int rc = trace_open(trace_path, &opts->trace);
+    if (rc != EXIT_OK) {
+      metrics_close(opts->metrics);
+      return rc;
     }
-    i = skip_token(toks, value_index);
   }
-  return -1;
-}
-
-static char *dup_token_string(const char *json, const jsmntok_t *tok) {
-  if (tok->type != JSMN_STRING) {
-    return NULL;
+  if (ndjson) {
+    fflush(stdout);
+    opts->records = sink_open(fileno(stdout), ordered);
+    if (!opts->records) {
+      fprintf(stderr, "Failed to start the result writer.\n");
+      trace_close(opts->trace);
+      metrics_close(opts->metrics);
+      return EXIT_HTTP;
+    }
   }
-  size_t len = (size_t)(tok->end - tok->start);
-  char *out = (char *)malloc(len + 1);
-  if (!out) {
-    return NULL;
+  struct load_report report;
+  int rc = load_run(req, opts, &report);
+  sink_close(opts->records);
+  trace_close(opts->trace);
+  metrics_close(opts->metrics);
+  if (rc != EXIT_OK) {
+    load_report_free(&report);
+    return rc;
   }
-  memcpy(out, json + tok->start, len);
-  out[len] = '\0';
-  return out;
-}
-
-static char *dup_token_raw(const char *json, const jsmntok_t *tok) {
-  if (tok->start < 0 || tok->end < 0 || tok->end < tok->start) {
-    return NULL;
+  if (!use_exit_codes) {
+    /* Per-request records own stdout; the summary moves to stderr. */
+    load_print_report(ndjson ? stderr : stdout, &report);
   }
-  size_t len = (size_t)(tok->end - tok->start);
-  char *out = (char *)malloc(len + 1);
-  if (!out) {
-    return NULL;
+  load_report_free(&report);
+  if (report.source_rc != EXIT_OK) {
+    return report.source_rc;
   }
-  memcpy(out, json + tok->start, len);
-  out[len] = '\0';
-  return out;
-}
-
-static char *dup_string(const char *src) {
-  size_t len = strlen(src);
-  char *out = (char *)malloc(len + 1);
-  if (!out) {
-    return NULL;
+  if (report.stats.errors > 0) {
+    return EXIT_HTTP;
   }
-  memcpy(out, src, len + 1);
-  return out;
-}
-
-typedef int (*kv_callback)(const char *name, const char *value, void *userdata);
-
-static const char *tok_type_name(jsmntype_t type) {
-  switch (type) {
-    case JSMN_UNDEFINED:
-      return "undefined";
-    case JSMN_OBJECT:
-      return "object";
-    case JSMN_ARRAY:
-      return "array";
-    case JSMN_STRING:
-      return "string";
-    case JSMN_PRIMITIVE:
-      return "primitive";
-    default:
-      return "unknown";
+  if (use_exit_codes &&
+      (report.stats.status_classes[4] > 0 || report.stats.status_classes[5] > 0)) {
+    return EXIT_RESPONSE;
   }
+  return EXIT_OK;
 }
 
-static int iterate_kv(const char *json, jsmntok_t *toks, int index,
-                      const char *label, kv_callback cb, void *userdata) {
-  if (index < 0) {
-    return 0;
-  }
-  if (toks[index].type == JSMN_ARRAY) {
-    int i = index + 1;
-    for (int e = 0; e < toks[index].size; e++) {
-      int elem_index = i;
-      if (toks[elem_index].type == JSMN_OBJECT) {
-        int name_idx = find_object_value(json, toks, elem_index, "name");
-        if (name_idx < 0) {
-          name_idx = find_object_value(json, toks, elem_index, "key");
-        }
-        int value_idx = find_object_value(json, toks, elem_index, "value");
-        if (name_idx >= 0 && value_idx >= 0) {
-          if (toks[name_idx].type != JSMN_STRING || toks[value_idx].type != JSMN_STRING) {
-            fprintf(stderr,
-                    "Invalid %s entry: name/value must be strings (got %s/%s).\n",
-                    label, tok_type_name(toks[name_idx].type),
-                    tok_type_name(toks[value_idx].type));
-            return -1;
-          }
-          char *name = dup_token_string(json, &toks[name_idx]);
-          char *value = dup_token_string(json, &toks[value_idx]);
-          if (!name || !value) {
-            fprintf(stderr, "Out of memory while reading %s.\n", label);
-            free(name);
-            free(value);
-            return -1;
-          }
-          cb(name, value, userdata);
-          free(name);
-          free(value);
-        }
-      }
-      i = skip_token(toks, elem_index);
-    }
-    return 0;
-  }
-  if (toks[index].type == JSMN_OBJECT) {
-    int i = index + 1;
-    int pairs = toks[index].size / 2;
-    for (int pair = 0; pair < pairs; pair++) {
-      int key_index = i;
-      int value_index = i + 1;
-      if (toks[key_index].type != JSMN_STRING || toks[value_index].type != JSMN_STRING) {
-        fprintf(stderr,
-                "Invalid %s entry: key/value must be strings (got %s/%s).\n",
-                label, tok_type_name(toks[key_index].type),
-                tok_type_name(toks[value_index].type));
-        return -1;
-      }
-      char *name = dup_token_string(json, &toks[key_index]);
-      char *value = dup_token_string(json, &toks[value_index]);
-      if (!name || !value) {
-        fprintf(stderr, "Out of memory while reading %s.\n", label);
-        free(name);
-        free(value);
-        return -1;
-      }
-      cb(name, value, userdata);
-      free(name);
-      free(value);
-      i = skip_token(toks, value_index);
-    }
-    return 0;
-  }
-  fprintf(stderr, "Invalid %s: expected array or object.\n", label);
-  return -1;
-}
-
-static char *replace_all(const char *src, const char *search, const char *replace) {
-  if (!src || !search || !replace) {
-    return NULL;
+static int run_capacity(const struct request *req, struct capacity_options *opts,
+                        bool use_exit_codes) {
+  opts->progress = use_exit_codes ? NULL : stderr;
+  struct capacity_report report;
+  int rc = capacity_run(req, opts, &report);
+  if (rc == EXIT_OK && !use_exit_codes) {
+    capacity_print_report(stdout, &report);
   }
-  size_t src_len = strlen(src);
-  size_t search_len = strlen(search);
-  size_t replace_len = strlen(replace);
-  if (search_len == 0) {
-    return strdup(src);
+  if (rc == EXIT_OK && report.knee < 0) {
+    rc = EXIT_RESPONSE;
   }
+  capacity_report_free(&report);
+  return rc;
+}
 
-  size_t count = 0;
-  const char *pos = src;
-  while ((pos = strstr(pos, search)) != NULL) {
-    count++;
-    pos += search_len;
+static int run_mirror(const struct request *req, struct mirror_options *opts,
+                      bool use_exit_codes) {
+  if (!opts->header_count) {
+    static const char *const default_headers[] = {"Content-Type"};
+    opts->headers = default_headers;
+    opts->header_count = 1;
   }
-  if (count == 0) {
-    return strdup(src);
+  opts->mismatches = use_exit_codes ? NULL : stdout;
+  struct mirror_report report;
+  int rc = mirror_run(req, opts, &report);
+  if (rc != EXIT_OK) {
+    return rc;
   }
-
-  size_t out_len = src_len + count * (replace_len - search_len);
-  char *out = (char *)malloc(out_len + 1);
-  if (!out) {
-    return NULL;
+  if (!use_exit_codes) {
+    /* Mismatch lines own stdout, like --ndjson records. */
+    fflush(stdout);
+    mirror_print_report(stderr, &report);
   }
-
-  const char *src_it = src;
-  char *dst_it = out;
-  while ((pos = strstr(src_it, search)) != NULL) {
-    size_t chunk = (size_t)(pos - src_it);
-    memcpy(dst_it, src_it, chunk);
-    dst_it += chunk;
-    memcpy(dst_it, replace, replace_len);
-    dst_it += replace_len;
-    src_it = pos + search_len;
+  if (report.source_rc != EXIT_OK) {
+    return report.source_rc;
   }
-  strcpy(dst_it, src_it);
-  return out;
-}
-
-static int append_query_param(char **url, const char *name, const char *value,
-                              bool *has_query) {
-  const char *prefix = *has_query ? "&" : "?";
-  size_t new_len = strlen(*url) + strlen(prefix) + strlen(name) + 1 + strlen(value) + 1;
-  char *out = (char *)malloc(new_len);
-  if (!out) {
-    return -1;
-  }
-  snprintf(out, new_len, "%s%s%s=%s", *url, prefix, name, value);
-  free(*url);
-  *url = out;
-  *has_query = true;
-  return 0;
-}
-
-static size_t write_stdout(void *ptr, size_t size, size_t nmemb, void *userdata) {
-  (void)userdata;
-  return fwrite(ptr, size, nmemb, stdout);
-}
-
-static size_t write_discard(void *ptr, size_t size, size_t nmemb, void *userdata) {
-  (void)ptr;
-  (void)userdata;
-  return size * nmemb;
-}
-
-struct response_buffer {
-  char *data;
-  size_t len;
-};
-
-static size_t write_buffer(void *ptr, size_t size, size_t nmemb, void *userdata) {
-  struct response_buffer *buf = (struct response_buffer *)userdata;
-  size_t total = size * nmemb;
-  char *next = (char *)realloc(buf->data, buf->len + total + 1);
-  if (!next) {
-    return 0;
-  }
-  memcpy(next + buf->len, ptr, total);
-  buf->data = next;
-  buf->len += total;
-  buf->data[buf->len] = '\0';
-  return total;
-}
-
-struct header_entry {
-  char *name;
-  char *value;
-};
-
-struct header_list {
-  struct header_entry *items;
-  size_t count;
-  size_t cap;
-};
-
-struct response_headers {
-  struct header_list headers;
-  char *status_line;
-};
-
-static void header_list_free(struct header_list *list) {
-  for (size_t i = 0; i < list->count; i++) {
-    free(list->items[i].name);
-    free(list->items[i].value);
-  }
-  free(list->items);
-  list->items = NULL;
-  list->count = 0;
-  list->cap = 0;
-}
-
-static int header_list_append(struct header_list *list, const char *name, const char *value) {
-  if (list->count == list->cap) {
-    size_t next_cap = list->cap == 0 ? 8 : list->cap * 2;
-    struct header_entry *next = (struct header_entry *)realloc(
-        list->items, next_cap * sizeof(struct header_entry));
-    if (!next) {
-      return -1;
-    }
-    list->items = next;
-    list->cap = next_cap;
-  }
-  list->items[list->count].name = dup_string(name);
-  list->items[list->count].value = dup_string(value);
-  if (!list->items[list->count].name || !list->items[list->count].value) {
-    free(list->items[list->count].name);
-    free(list->items[list->count].value);
-    return -1;
-  }
-  list->count++;
-  return 0;
+  if (report.errors > 0) {
+    return EXIT_HTTP;
+  }
+  return report.matched == report.pairs ? EXIT_OK : EXIT_RESPONSE;
 }
 
-static void trim_whitespace(char *str) {
-  char *end = str + strlen(str);
-  while (end > str && (*(end - 1) == ' ' || *(end - 1) == '\t')) {
-    end--;
+static int run_workflow(const char *path, const char *const *resolve, int resolve_count,
+                        unsigned concurrency, bool use_exit_codes) {
+  struct workflow *wf = NULL;
+  int rc = workflow_load(path, resolve, resolve_count, &wf);
+  if (rc != EXIT_OK) {
+    return rc;
   }
-  *end = '\0';
-  while (*str == ' ' || *str == '\t') {
-    memmove(str, str + 1, strlen(str));
+  if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+    fprintf(stderr, "Failed to init curl globals.\n");
+    workflow_free(wf);
+    return EXIT_HTTP;
   }
-}
-
-static size_t write_header(void *ptr, size_t size, size_t nmemb, void *userdata) {
-  struct response_headers *resp = (struct response_headers *)userdata;
-  size_t total = size * nmemb;
-  char *line = (char *)malloc(total + 1);
-  if (!line) {
-    return 0;
-  }
-  memcpy(line, ptr, total);
-  line[total] = '\0';
-  while (total > 0 && (line[total - 1] == '\n' || line[total - 1] == '\r')) {
-    line[--total] = '\0';
-  }
-  if (total == 0) {
-    free(line);
-    return size * nmemb;
-  }
-  if (strncmp(line, "HTTP/", 5) == 0) {
-    free(resp->status_line);
-    resp->status_line = dup_string(line);
-    free(line);
-    return size * nmemb;
-  }
-  char *colon = strchr(line, ':');
-  if (!colon) {
-    free(line);
-    return size * nmemb;
-  }
-  *colon = '\0';
-  char *name = line;
-  char *value = colon + 1;
-  while (*value == ' ' || *value == '\t') {
-    value++;
-  }
-  trim_whitespace(name);
-  trim_whitespace(value);
-  header_list_append(&resp->headers, name, value);
-  free(line);
-  return size * nmemb;
-}
-
-static char *json_escape(const char *src) {
-  size_t len = 0;
-  for (const unsigned char *p = (const unsigned char *)src; *p; p++) {
-    switch (*p) {
-      case '\\':
-      case '"':
-      case '\b':
-      case '\f':
-      case '\n':
-      case '\r':
-      case '\t':
-        len += 2;
-        break;
-      default:
-        len += (*p < 0x20) ? 6 : 1;
-    }
-  }
-  char *out = (char *)malloc(len + 1);
-  if (!out) {
-    return NULL;
-  }
-  char *dst = out;
-  for (const unsigned char *p = (const unsigned char *)src; *p; p++) {
-    switch (*p) {
-      case '\\':
-        *dst++ = '\\';
-        *dst++ = '\\';
-        break;
-      case '"':
-        *dst++ = '\\';
-        *dst++ = '"';
-        break;
-      case '\b':
-        *dst++ = '\\';
-        *dst++ = 'b';
-        break;
-      case '\f':
-        *dst++ = '\\';
-        *dst++ = 'f';
-        break;
-      case '\n':
-        *dst++ = '\\';
-        *dst++ = 'n';
-        break;
-      case '\r':
-        *dst++ = '\\';
-        *dst++ = 'r';
-        break;
-      case '\t':
-        *dst++ = '\\';
-        *dst++ = 't';
-        break;
-      default:
-        if (*p < 0x20) {
-          snprintf(dst, 7, "\\u%04x", *p);
-          dst += 6;
-        } else {
-          *dst++ = (char)*p;
-        }
-    }
+  struct workflow_options opts = {
+    .concurrency = concurrency,
+    .steps = use_exit_codes ? NULL : stdout
+  };
+  struct workflow_report report;
+  rc = workflow_run(wf, &opts, &report);
+  workflow_free(wf);
+  curl_global_cleanup();
+  if (rc != EXIT_OK) {
+    return rc;
   }
-  *dst = '\0';
-  return out;
-}
-
-static bool is_valid_json(const char *json, size_t len) {
-  jsmn_parser parser;
-  jsmntok_t *tokens = NULL;
-  int tok_count = 0;
-  if (ensure_tokens(&parser, json, len, &tokens, &tok_count) != 0) {
-    return false;
+  if (!use_exit_codes) {
+    /* Step lines own stdout, like --ndjson records. */
+    workflow_print_report(stderr, &report);
   }
-  bool ok = tok_count > 0;
-  free(tokens);
-  return ok;
-}
-
-static void print_json_response(long status, const char *status_line,
-                                const struct header_list *headers,
-                                const struct response_buffer *body) {
-  const char *status_src = status_line ? status_line : "";
-  char *status_esc = json_escape(status_src);
-  if (!status_esc) {
-    return;
-  }
-  printf("{\"status\":%ld,\"status_text\":\"%s\",\"headers\":[", status, status_esc);
-  free(status_esc);
-  for (size_t i = 0; i < headers->count; i++) {
-    char *name_esc = json_escape(headers->items[i].name);
-    char *value_esc = json_escape(headers->items[i].value);
-    if (!name_esc || !value_esc) {
-      free(name_esc);
-      free(value_esc);
-      return;
-    }
-    if (i > 0) {
-      fputc(',', stdout);
-    }
-    printf("{\"name\":\"%s\",\"value\":\"%s\"}", name_esc, value_esc);
-    free(name_esc);
-    free(value_esc);
-  }
-  printf("],\"body\":");
-  if (body && body->data && body->len > 0 && is_valid_json(body->data, body->len)) {
-    fwrite(body->data, 1, body->len, stdout);
-  } else {
-    const char *body_src = body && body->data ? body->data : "";
-    char *body_esc = json_escape(body_src);
-    if (!body_esc) {
-      return;
-    }
-    printf("\"%s\"", body_esc);
-    free(body_esc);
+  if (report.transfer_errors > 0) {
+    return EXIT_HTTP;
   }
-  printf("}\n");
+  return report.ok == report.steps ? EXIT_OK : EXIT_RESPONSE;
 }
 
-struct curl_ctx {
-  CURL *curl;
-  char **url;
-  bool *has_query;
-  struct curl_slist **headers;
-};
-
-static int apply_path_param(const char *name, const char *value, void *userdata) {
-  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
-  char *escaped = curl_easy_escape(ctx->curl, value, 0);
-  if (!escaped) {
-    return 0;
-  }
-  size_t placeholder_len = strlen(name) + 2;
-  char *placeholder = (char *)malloc(placeholder_len + 1);
-  if (placeholder) {
-    snprintf(placeholder, placeholder_len + 1, "{%s}", name);
-    char *replaced = replace_all(*ctx->url, placeholder, escaped);
-    if (replaced) {
-      free(*ctx->url);
-      *ctx->url = replaced;
-    }
-    free(placeholder);
-  }
-  curl_free(escaped);
-  return 0;
-}
-
-static int apply_query_param(const char *name, const char *value, void *userdata) {
-  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
-  char *enc_name = curl_easy_escape(ctx->curl, name, 0);
-  char *enc_value = curl_easy_escape(ctx->curl, value, 0);
-  if (enc_name && enc_value) {
-    append_query_param(ctx->url, enc_name, enc_value, ctx->has_query);
+static int run_websocket(const struct request *req, const struct websocket_options *opts,
+                         bool use_exit_codes) {
+  if (req->payload || req->part_count) {
+    fprintf(stderr, "A websocket config sends websocket.message; drop payload and multipart.\n");
+    return EXIT_REQUEST;
   }
-  if (enc_name) {
-    curl_free(enc_name);
+  struct websocket_report report;
+  int rc = websocket_run(req, opts, &report);
+  if (rc != EXIT_OK) {
+    return rc;
   }
-  if (enc_value) {
-    curl_free(enc_value);
+  if (!use_exit_codes) {
+    websocket_print_report(stdout, &report);
   }
-  return 0;
-}
-
-static int apply_header(const char *name, const char *value, void *userdata) {
-  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
-  size_t header_len = strlen(name) + strlen(value) + 3;
-  char *header = (char *)malloc(header_len);
-  if (header) {
-    snprintf(header, header_len, "%s: %s", name, value);
-    *ctx->headers = curl_slist_append(*ctx->headers, header);
-    free(header);
+  if (report.errors > 0) {
+    return EXIT_HTTP;
   }
-  return 0;
+  return use_exit_codes && report.lost > 0 ? EXIT_RESPONSE : EXIT_OK;
 }
 
-static int ensure_tokens(jsmn_parser *parser, const char *json, size_t len,
-                         jsmntok_t **tokens_out, int *count_out) {
-  int token_count = 256;
-  for (;;) {
-    jsmntok_t *tokens = (jsmntok_t *)calloc((size_t)token_count, sizeof(jsmntok_t));
-    if (!tokens) {
-      return -1;
-    }
-    jsmn_init(parser);
-    int parsed = jsmn_parse(parser, json, len, tokens, (unsigned int)token_count);
-    if (parsed >= 0) {
-      *tokens_out = tokens;
-      *count_out = parsed;
-      return 0;
-    }
-    free(tokens);
-    if (parsed == -1) {
-      token_count *= 2;
-      if (token_count > 4096) {
-        return -1;
-      }
-      continue;
-    }
-    return -1;
+static int run_replay(const char *path, const struct replay_options *opts,
+                      bool use_exit_codes) {
+  struct replay_report report;
+  int rc = replay_run(path, opts, &report);
+  if (rc != EXIT_OK) {
+    return rc;
   }
-}
-
-static void print_parse_error(void) {
-  fprintf(stderr, "Invalid JSON structure.\n");
+  if (!use_exit_codes) {
+    replay_print_report(stdout, &report);
+  }
+  if (report.stats.errors > 0) {
+    return EXIT_HTTP;
+  }
+  if (use_exit_codes &&
+      (report.stats.status_classes[4] > 0 || report.stats.status_classes[5] > 0)) {
+    return EXIT_RESPONSE;
+  }
+  return EXIT_OK;
 }
 
 int main(int argc, char **argv) {
   bool use_exit_codes = false;
   bool include_headers = true;
+  bool load_mode = false;
+  bool ndjson = false;
+  bool ordered = false;
+  bool stream = false;
+  struct load_options load_opts = {0};
   const char *config_path = NULL;
+  const char *serve_path = NULL;
+  const char *tls_cache_dir = NULL;
+  const char *http_cache_dir = NULL;
+  const char *metrics_addr = NULL;
+  const char *trace_path = NULL;
+  const char *replay_path = NULL;
+  const char *collection_path = NULL;
+  const char *scenario_path = NULL;
+  const char *mirror_url = NULL;
+  const char *workflow_path = NULL;
+  bool find_capacity = false;
+  const char *slo_text = NULL;
+  double max_rate = 0.0;
+  const char *compare_headers[MIRROR_MAX_HEADERS];
+  int compare_count = 0;
+  double replay_speed = 1.0;
+  const char **resolve_args = (const char **)calloc((size_t)argc, sizeof(char *));
+  int resolve_count = 0;
+  const char *unix_socket = NULL;
+  uint64_t value = 0;
+  uint64_t body_memory = RESPONSE_BODY_LIMIT;
+  uint64_t body_memory_total = RESPONSE_TOTAL_LIMIT;
+  if (!resolve_args) {
+    fprintf(stderr, "Out of memory while reading arguments.\n");
+    return EXIT_REQUEST;
+  }
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--version") == 0) {
       printf("pinga %s\n", PINGA_VERSION);
@@ -644,6 +292,241 @@ int main(int argc, char **argv) {
       include_headers = false;
       continue;
     }
+    if (strcmp(argv[i], "--stream") == 0) {
+      stream = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--concurrency") == 0) {
+      if (!read_count_arg(argc, argv, &i, MAX_CONCURRENCY, &value)) {
+        return EXIT_REQUEST;
+      }
+      load_opts.concurrency = (unsigned)value;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--requests") == 0) {
+      if (!read_count_arg(argc, argv, &i, UINT64_MAX, &load_opts.requests)) {
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--threads") == 0) {
+      if (!read_count_arg(argc, argv, &i, MAX_THREADS, &value)) {
+        return EXIT_REQUEST;
+      }
+      load_opts.threads = (unsigned)value;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--prewarm") == 0) {
+      if (!read_count_arg(argc, argv, &i, MAX_CONCURRENCY, &value)) {
+        return EXIT_REQUEST;
+      }
+      load_opts.prewarm = (unsigned)value;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--rate") == 0) {
+      if (!read_rate_arg(argc, argv, &i, &load_opts.rate)) {
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--warmup") == 0) {
+      if (i + 1 >= argc || !parse_duration(argv[i + 1], &load_opts.warmup_ns) ||
+          load_opts.warmup_ns == 0) {
+        fprintf(stderr, "Invalid value for --warmup.\n");
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--find-capacity") == 0) {
+      find_capacity = true;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--slo") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      slo_text = argv[++i];
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--max-rate") == 0) {
+      if (!read_rate_arg(argc, argv, &i, &max_rate)) {
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--sample-bodies") == 0) {
+      if (!read_count_arg(argc, argv, &i, MAX_SAMPLES, &value)) {
+        return EXIT_REQUEST;
+      }
+      load_opts.sample_bodies = (unsigned)value;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--body-memory") == 0 || strcmp(argv[i], "--body-memory-total") == 0) {
+      bool total = strcmp(argv[i], "--body-memory-total") == 0;
+      uint64_t *limit = total ? &body_memory_total : &body_memory;
+      if (i + 1 >= argc || !parse_size(argv[i + 1], limit) || *limit > SIZE_MAX / 2) {
+        fprintf(stderr, "Invalid value for %s.\n", argv[i]);
+        return EXIT_REQUEST;
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--ndjson") == 0 || strcmp(argv[i], "--ordered") == 0) {
+      ordered = ordered || strcmp(argv[i], "--ordered") == 0;
+      ndjson = true;
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--trace") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      trace_path = argv[++i];
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--report-interval") == 0) {
+      if (i + 1 >= argc || !parse_duration(argv[i + 1], &load_opts.report_interval_ns) ||
+          load_opts.report_interval_ns < 1000000) {
+        fprintf(stderr, "Invalid value for --report-interval.\n");
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--metrics-listen") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      metrics_addr = argv[++i];
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--resolve") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      resolve_args[resolve_count++] = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--unix-socket") == 0) {
+      if (i + 1 >= argc || argv[i + 1][0] == '\0') {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      unix_socket = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--replay") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      replay_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--collection") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      collection_path = argv[++i];
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--scenario") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      scenario_path = argv[++i];
+      load_mode = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--mirror") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      mirror_url = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--workflow") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      workflow_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--compare-header") == 0) {
+      if (i + 1 >= argc || compare_count == MIRROR_MAX_HEADERS) {
+        fprintf(stderr, "--compare-header takes a name, up to %d times.\n", MIRROR_MAX_HEADERS);
+        return EXIT_REQUEST;
+      }
+      compare_headers[compare_count++] = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--speed") == 0) {
+      char *end = NULL;
+      replay_speed = i + 1 < argc ? strtod(argv[i + 1], &end) : 0.0;
+      if (!end || *end != '\0' || !(replay_speed > 0.0 && replay_speed < 1e6)) {
+        fprintf(stderr, "Invalid value for --speed.\n");
+        return EXIT_REQUEST;
+      }
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--serve") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      serve_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--tls-session-cache") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      tls_cache_dir = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--http-cache") == 0) {
+      if (i + 1 >= argc) {
+        print_usage(argv[0]);
+        return EXIT_REQUEST;
+      }
+      http_cache_dir = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--duration") == 0) {
+      if (i + 1 >= argc || !parse_duration(argv[i + 1], &load_opts.duration_ns) ||
+          load_opts.duration_ns == 0) {
+        fprintf(stderr, "Invalid value for --duration.\n");
+        return EXIT_REQUEST;
+      }
+      load_mode = true;
+      i++;
+      continue;
+    }
     if (argv[i][0] == '-') {
       print_usage(argv[0]);
       return EXIT_REQUEST;
@@ -655,256 +538,485 @@ int main(int argc, char **argv) {
     config_path = argv[i];
   }
 
-  if (!config_path) {
-    print_usage(argv[0]);
+  response_set_budget((size_t)body_memory, (size_t)body_memory_total);
+  bool paced = load_opts.rate > 0 || load_opts.warmup_ns || find_capacity || slo_text ||
+               max_rate > 0;
+
+  if (stream && (load_mode || replay_path || mirror_url || workflow_path)) {
+    fprintf(stderr, "--stream applies to single requests only.\n");
     return EXIT_REQUEST;
   }
-
-  size_t json_len = 0;
-  char *json = read_file(config_path, &json_len);
-  if (!json) {
-    fprintf(stderr, "Failed to read file: %s\n", config_path);
-    return EXIT_CONFIG;
+  if (http_cache_dir &&
+      (load_mode || replay_path || mirror_url || workflow_path || serve_path || stream)) {
+    fprintf(stderr, "--http-cache applies to single requests without --stream only.\n");
+    return EXIT_REQUEST;
   }
-
-  jsmn_parser parser;
-  jsmntok_t *tokens = NULL;
-  int tok_count = 0;
-  if (ensure_tokens(&parser, json, json_len, &tokens, &tok_count) != 0) {
-    free(json);
-    print_parse_error();
-    return EXIT_CONFIG;
+  if (serve_path) {
+    if (config_path || load_mode || resolve_count || unix_socket || stream) {
+      print_usage(argv[0]);
+      return EXIT_REQUEST;
+    }
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+      fprintf(stderr, "Failed to init curl globals.\n");
+      return EXIT_HTTP;
+    }
+    free(resolve_args);
+    int rc = daemon_serve(serve_path);
+    curl_global_cleanup();
+    return rc;
   }
 
-  if (tok_count < 1 || tokens[0].type != JSMN_OBJECT) {
-    free(tokens);
-    free(json);
-    print_parse_error();
-    return EXIT_CONFIG;
+  if (workflow_path) {
+    if (config_path || replay_path || collection_path || scenario_path || mirror_url ||
+        tls_cache_dir || unix_socket ||
+        load_opts.requests || load_opts.duration_ns || load_opts.threads || load_opts.prewarm ||
+        ndjson || load_opts.report_interval_ns || metrics_addr || load_opts.sample_bodies ||
+        trace_path || paced) {
+      fprintf(stderr, "--workflow takes --concurrency, --resolve and --silent only.\n");
+      return EXIT_REQUEST;
+    }
+    int rc = run_workflow(workflow_path, resolve_args, resolve_count, load_opts.concurrency,
+                          use_exit_codes);
+    free(resolve_args);
+    return rc;
   }
 
-  int url_idx = find_object_value(json, tokens, 0, "url");
-  if (url_idx < 0) {
-    fprintf(stderr, "Missing required field: url\n");
-    free(tokens);
-    free(json);
+  if (compare_count && !mirror_url) {
+    fprintf(stderr, "--compare-header needs --mirror.\n");
     return EXIT_REQUEST;
   }
-  char *url = dup_token_string(json, &tokens[url_idx]);
-  if (!url) {
-    fprintf(stderr, "Invalid url value.\n");
-    free(tokens);
-    free(json);
-    return EXIT_REQUEST;
+  if (mirror_url) {
+    if (replay_path || tls_cache_dir || load_opts.duration_ns || load_opts.threads ||
+        load_opts.prewarm || ndjson || load_opts.report_interval_ns || metrics_addr ||
+        load_opts.sample_bodies || scenario_path || trace_path || paced || unix_socket ||
+        (config_path && collection_path) ||
+        (!config_path && !collection_path)) {
+      fprintf(stderr,
+              "--mirror takes a config or --collection, with --concurrency, --requests,\n"
+              "--compare-header, --resolve and --silent only.\n");
+      return EXIT_REQUEST;
+    }
+    struct mirror_options mirror_opts = {
+      .base_url = mirror_url,
+      .concurrency = load_opts.concurrency,
+      .requests = load_opts.requests,
+      .headers = compare_headers,
+      .header_count = compare_count
+    };
+    struct request req;
+    memset(&req, 0, sizeof(req));
+    int rc = EXIT_OK;
+    if (collection_path) {
+      rc = collection_open(collection_path, &mirror_opts.collection);
+      if (rc == EXIT_OK) {
+        collection_set_resolve(mirror_opts.collection, resolve_args, resolve_count);
+      }
+    } else {
+      rc = request_load(config_path, &req);
+      for (int i = 0; rc == EXIT_OK && i < resolve_count; i++) {
+        if (request_add_resolve(&req, resolve_args[i]) != 0) {
+          rc = EXIT_REQUEST;
+        }
+      }
+      if (rc == EXIT_OK && request_reads_stdin(&req)) {
+        fprintf(stderr, "Multipart stdin parts apply to single requests only.\n");
+        rc = EXIT_REQUEST;
+      }
+      if (!mirror_opts.requests) {
+        mirror_opts.requests = 1;
+      }
+    }
+    if (rc == EXIT_OK && curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+      fprintf(stderr, "Failed to init curl globals.\n");
+      rc = EXIT_HTTP;
+    } else if (rc == EXIT_OK) {
+      rc = run_mirror(collection_path ? NULL : &req, &mirror_opts, use_exit_codes);
+      curl_global_cleanup();
+    }
+    collection_close(mirror_opts.collection);
+    request_free(&req);
+    free(resolve_args);
+    return rc;
+  }
+
+  if (replay_path) {
+    if (tls_cache_dir || load_opts.requests || load_opts.duration_ns || load_opts.threads ||
+        load_opts.prewarm || ndjson || load_opts.report_interval_ns || metrics_addr ||
+        load_opts.sample_bodies || collection_path || scenario_path || trace_path || paced ||
+        ((resolve_count || unix_socket) && !config_path)) {
+      fprintf(stderr, "--replay takes --speed, --concurrency, --silent and a config only.\n");
+      return EXIT_REQUEST;
+    }
+    struct request target;
+    memset(&target, 0, sizeof(target));
+    if (config_path) {
+      int rc = request_load(config_path, &target);
+      if (rc != EXIT_OK) {
+        return rc;
+      }
+      for (int i = 0; i < resolve_count; i++) {
+        if (request_add_resolve(&target, resolve_args[i]) != 0) {
+          request_free(&target);
+          return EXIT_REQUEST;
+        }
+      }
+      if (unix_socket && request_set_unix_socket(&target, unix_socket) != 0) {
+        request_free(&target);
+        return EXIT_REQUEST;
+      }
+    }
+    free(resolve_args);
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+      fprintf(stderr, "Failed to init curl globals.\n");
+      request_free(&target);
+      return EXIT_HTTP;
+    }
+    struct replay_options replay_opts = {
+      .speed = replay_speed,
+      .concurrency = load_opts.concurrency,
+      .target = config_path ? &target : NULL
+    };
+    int rc = run_replay(replay_path, &replay_opts, use_exit_codes);
+    curl_global_cleanup();
+    request_free(&target);
+    return rc;
   }
 
-  bool method_provided = false;
-  char *method = NULL;
-  int method_idx = find_object_value(json, tokens, 0, "method");
-  if (method_idx >= 0) {
-    method = dup_token_string(json, &tokens[method_idx]);
-    if (!method) {
-      fprintf(stderr, "Invalid method value.\n");
-      free(url);
-      free(tokens);
-      free(json);
+  struct capacity_options capacity_opts;
+  memset(&capacity_opts, 0, sizeof(capacity_opts));
+  if (find_capacity || slo_text || max_rate > 0) {
+    if (!find_capacity || !slo_text) {
+      fprintf(stderr, "--find-capacity needs --slo; --slo and --max-rate need --find-capacity.\n");
+      return EXIT_REQUEST;
+    }
+    if (load_opts.requests || ndjson || load_opts.sample_bodies || trace_path || metrics_addr ||
+        load_opts.report_interval_ns || load_opts.prewarm || collection_path || tls_cache_dir) {
+      fprintf(stderr,
+              "--find-capacity runs timed steps of a config or --scenario; it takes no\n"
+              "--requests, --ndjson, --sample-bodies, --trace, --metrics-listen,\n"
+              "--report-interval, --prewarm, --collection or --tls-session-cache.\n");
+      return EXIT_REQUEST;
+    }
+    if (!slo_parse(slo_text, &capacity_opts.slo)) {
       return EXIT_REQUEST;
     }
-    method_provided = true;
+    capacity_opts.min_rate = load_opts.rate > 0 ? load_opts.rate : 10.0;
+    capacity_opts.max_rate = max_rate > 0 ? max_rate : 100000.0;
+    if (capacity_opts.max_rate < capacity_opts.min_rate) {
+      fprintf(stderr, "--max-rate is below the starting --rate.\n");
+      return EXIT_REQUEST;
+    }
+    capacity_opts.precision = 0.05;
+    capacity_opts.step_ns = load_opts.duration_ns ? load_opts.duration_ns : 10000000000ull;
+    capacity_opts.warmup_ns = load_opts.warmup_ns ? load_opts.warmup_ns : 2000000000ull;
+    if (!load_opts.concurrency) {
+      load_opts.concurrency = 256;
+    }
   }
 
-  int payload_idx = find_object_value(json, tokens, 0, "payload");
-  char *payload = NULL;
-  if (payload_idx >= 0) {
-    if (tokens[payload_idx].type == JSMN_STRING) {
-      payload = dup_token_string(json, &tokens[payload_idx]);
-    } else {
-      payload = dup_token_raw(json, &tokens[payload_idx]);
-    }
-    if (!payload) {
-      fprintf(stderr, "Invalid payload value.\n");
-      free(method);
-      free(url);
-      free(tokens);
-      free(json);
+  if (collection_path) {
+    if (config_path || scenario_path || tls_cache_dir || load_opts.prewarm) {
+      fprintf(stderr,
+              "--collection takes no config file, --scenario, --tls-session-cache or --prewarm.\n");
       return EXIT_REQUEST;
     }
+    struct collection_reader *reader = NULL;
+    int rc = collection_open(collection_path, &reader);
+    if (rc != EXIT_OK) {
+      return rc;
+    }
+    collection_set_resolve(reader, resolve_args, resolve_count);
+    collection_set_unix_socket(reader, unix_socket);
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+      fprintf(stderr, "Failed to init curl globals.\n");
+      collection_close(reader);
+      return EXIT_HTTP;
+    }
+    load_opts.collection = reader;
+    rc = run_load(NULL, &load_opts, use_exit_codes, ndjson, ordered, metrics_addr,
+                  trace_path);
+    curl_global_cleanup();
+    collection_close(reader);
+    free(resolve_args);
+    return rc;
   }
 
-  int payload_file_idx = find_object_value(json, tokens, 0, "payload_file");
-  if (payload_file_idx >= 0) {
-    if (payload) {
-      fprintf(stderr, "Use only one of payload or payload_file.\n");
-      free(payload);
-      free(method);
-      free(url);
-      free(tokens);
-      free(json);
+  if (scenario_path) {
+    if (config_path || tls_cache_dir) {
+      fprintf(stderr, "--scenario takes no config file or --tls-session-cache.\n");
       return EXIT_REQUEST;
     }
-    char *payload_path = dup_token_string(json, &tokens[payload_file_idx]);
-    if (!payload_path) {
-      fprintf(stderr, "Invalid payload_file value.\n");
-      free(method);
-      free(url);
-      free(tokens);
-      free(json);
+    struct scenario *scenario = NULL;
+    int rc = scenario_load(scenario_path, resolve_args, resolve_count, &scenario);
+    free(resolve_args);
+    if (rc != EXIT_OK) {
+      return rc;
+    }
+    for (unsigned i = 0; unix_socket && i < scenario->count; i++) {
+      if (request_set_unix_socket(&scenario->entries[i].req, unix_socket) != 0) {
+        scenario_free(scenario);
+        return EXIT_REQUEST;
+      }
+    }
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+      fprintf(stderr, "Failed to init curl globals.\n");
+      scenario_free(scenario);
+      return EXIT_HTTP;
+    }
+    if (!load_opts.concurrency) {
+      load_opts.concurrency = 1;
+    }
+    if (!load_opts.requests && !load_opts.duration_ns) {
+      load_opts.requests = load_opts.concurrency;
+    }
+    load_opts.scenario = scenario;
+    if (find_capacity) {
+      capacity_opts.load = load_opts;
+      rc = run_capacity(NULL, &capacity_opts, use_exit_codes);
+    } else {
+      rc = run_load(NULL, &load_opts, use_exit_codes, ndjson, ordered, metrics_addr,
+                    trace_path);
+    }
+    curl_global_cleanup();
+    scenario_free(scenario);
+    return rc;
+  }
+
+  if (!config_path) {
+    print_usage(argv[0]);
+    return EXIT_REQUEST;
+  }
+  if (tls_cache_dir && load_mode) {
+    fprintf(stderr, "--tls-session-cache applies to single requests only.\n");
+    return EXIT_REQUEST;
+  }
+
+  /* A websocket section turns the config into a message run; --concurrency,
+   * --rate, --requests and --duration override its settings. */
+  struct websocket_options ws_opts;
+  bool websocket = false;
+  int ws_rc = websocket_load(config_path, &ws_opts, &websocket);
+  if (ws_rc != EXIT_OK) {
+    free(resolve_args);
+    return ws_rc;
+  }
+  if (websocket) {
+    if (load_opts.threads || load_opts.prewarm || load_opts.warmup_ns || ndjson ||
+        trace_path || metrics_addr || load_opts.sample_bodies ||
+        load_opts.report_interval_ns || find_capacity || stream || http_cache_dir ||
+        tls_cache_dir || load_opts.concurrency > WEBSOCKET_MAX_CONNECTIONS) {
+      fprintf(stderr,
+              "A websocket config takes --concurrency (up to %u), --rate, --requests,\n"
+              "--duration, --resolve, --unix-socket and --silent only.\n",
+              WEBSOCKET_MAX_CONNECTIONS);
+      websocket_options_free(&ws_opts);
+      free(resolve_args);
       return EXIT_REQUEST;
     }
-    size_t payload_len = 0;
-    payload = read_file(payload_path, &payload_len);
-    if (!payload) {
-      fprintf(stderr, "Failed to read payload_file: %s\n", payload_path);
-      free(payload_path);
-      free(method);
-      free(url);
-      free(tokens);
-      free(json);
-      return EXIT_CONFIG;
+    if (load_opts.concurrency) {
+      ws_opts.connections = load_opts.concurrency;
+    }
+    if (load_opts.rate > 0) {
+      ws_opts.rate = load_opts.rate;
+    }
+    /* Either limit on the command line replaces both of the config's. */
+    if (load_opts.requests || load_opts.duration_ns) {
+      ws_opts.messages = load_opts.requests;
+      ws_opts.duration_ns = load_opts.duration_ns;
+    }
+    if (!ws_opts.messages && !ws_opts.duration_ns) {
+      ws_opts.messages = ws_opts.connections;
     }
-    free(payload_path);
   }
 
-  if (!method_provided) {
-    if (payload) {
-      method = strdup("POST");
-    } else {
-      method = strdup("GET");
+  struct single_options single_opts = {
+    .use_exit_codes = use_exit_codes,
+    .include_headers = include_headers
+  };
+  struct request req;
+  int load_rc = request_load(config_path, &req);
+  if (load_rc != EXIT_OK) {
+    free(resolve_args);
+    return load_rc;
+  }
+  const char *daemon_socket = getenv("PINGA_SOCKET");
+  /*
+   * The daemon only knows plain single requests, and stdin parts can only be
+   * read by this process; everything else runs in process.
+   */
+  bool in_process = load_mode || tls_cache_dir || http_cache_dir || resolve_count ||
+                    unix_socket || stream || websocket || request_reads_stdin(&req);
+  if (!in_process && daemon_socket && *daemon_socket) {
+    int rc = daemon_forward(daemon_socket, config_path, &single_opts);
+    if (rc >= 0) {
+      request_free(&req);
+      free(resolve_args);
+      return rc;
+    }
+  }
+  /* Command line entries come after the config's, so they take precedence. */
+  for (int i = 0; i < resolve_count; i++) {
+    if (request_add_resolve(&req, resolve_args[i]) != 0) {
+      request_free(&req);
+      return EXIT_REQUEST;
     }
   }
-  if (!method) {
-    fprintf(stderr, "Failed to set method.\n");
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
+  free(resolve_args);
+  if (unix_socket && request_set_unix_socket(&req, unix_socket) != 0) {
+    request_free(&req);
+    return EXIT_REQUEST;
+  }
+  if ((!load_mode || websocket) && request_expand(&req, 0) != EXIT_OK) {
+    request_free(&req);
     return EXIT_REQUEST;
   }
 
   if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
     fprintf(stderr, "Failed to init curl globals.\n");
-    free(method);
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
+    request_free(&req);
     return EXIT_HTTP;
   }
 
+  if (websocket) {
+    int rc = run_websocket(&req, &ws_opts, use_exit_codes);
+    websocket_options_free(&ws_opts);
+    curl_global_cleanup();
+    request_free(&req);
+    return rc;
+  }
+
+  if (load_mode) {
+    if (request_reads_stdin(&req)) {
+      fprintf(stderr, "Multipart stdin parts apply to single requests only.\n");
+      curl_global_cleanup();
+      request_free(&req);
+      return EXIT_REQUEST;
+    }
+    if (!load_opts.concurrency) {
+      load_opts.concurrency = 1;
+    }
+    if (!load_opts.requests && !load_opts.duration_ns) {
+      load_opts.requests = load_opts.concurrency;
+    }
+    int rc = EXIT_OK;
+    if (find_capacity) {
+      capacity_opts.load = load_opts;
+      rc = run_capacity(&req, &capacity_opts, use_exit_codes);
+    } else {
+      rc = run_load(&req, &load_opts, use_exit_codes, ndjson, ordered, metrics_addr,
+                    trace_path);
+    }
+    curl_global_cleanup();
+    request_free(&req);
+    return rc;
+  }
+
+  /* A fresh cached response needs no transfer at all. */
+  struct http_cache *http_cache = NULL;
+  if (http_cache_dir) {
+    int rc = http_cache_open(http_cache_dir, &req, &http_cache);
+    if (rc != EXIT_OK || http_cache_fresh(http_cache)) {
+      struct single_run run = {
+        .opts = single_opts,
+        .out = stdout,
+        .envelope_extra = "\"cache\":\"hit\"",
+        .capture = true
+      };
+      if (rc == EXIT_OK) {
+        rc = http_cache_serve(http_cache, &run);
+      }
+      http_cache_free(http_cache);
+      curl_global_cleanup();
+      request_free(&req);
+      return rc;
+    }
+  }
+
   CURL *curl = curl_easy_init();
   if (!curl) {
     fprintf(stderr, "Failed to init curl.\n");
+    http_cache_free(http_cache);
     curl_global_cleanup();
-    free(method);
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
+    request_free(&req);
     return EXIT_HTTP;
   }
 
-  bool has_query = strchr(url, '?') != NULL;
-  struct curl_slist *headers = NULL;
-  struct curl_ctx ctx = {
-    .curl = curl,
-    .url = &url,
-    .has_query = &has_query,
-    .headers = &headers
-  };
-
-  int path_idx = find_object_value(json, tokens, 0, "path_params");
-  if (iterate_kv(json, tokens, path_idx, "path_params", apply_path_param, &ctx) != 0) {
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    free(method);
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
-    return EXIT_REQUEST;
+  struct tls_cache *tls_cache = NULL;
+  if (tls_cache_dir) {
+    int rc = tls_cache_open(tls_cache_dir, req.url, &tls_cache);
+    if (rc == EXIT_OK && tls_cache) {
+      rc = tls_cache_attach(tls_cache, curl);
+    }
+    if (rc != EXIT_OK) {
+      tls_cache_free(tls_cache);
+      http_cache_free(http_cache);
+      curl_easy_cleanup(curl);
+      curl_global_cleanup();
+      request_free(&req);
+      return rc;
+    }
   }
 
-  int query_idx = find_object_value(json, tokens, 0, "query_params");
-  if (iterate_kv(json, tokens, query_idx, "query_params", apply_query_param, &ctx) != 0) {
+  struct single_run run = {
+    .opts = single_opts,
+    .out = stdout,
+    .capture = http_cache != NULL
+  };
+  request_apply(curl, &req);
+  curl_mime *mime = NULL;
+  if (req.part_count && !(mime = request_mime(curl, &req))) {
     curl_easy_cleanup(curl);
     curl_global_cleanup();
-    free(method);
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
-    return EXIT_REQUEST;
+    tls_cache_free(tls_cache);
+    http_cache_free(http_cache);
+    request_free(&req);
+    return EXIT_CONFIG;
   }
-
-  int headers_idx = find_object_value(json, tokens, 0, "headers");
-  if (iterate_kv(json, tokens, headers_idx, "headers", apply_header, &ctx) != 0) {
+  /* Streamed events are records on stdout, so the summary goes to stderr. */
+  struct stream_run *events = NULL;
+  if (stream && !(events = stream_new(use_exit_codes ? NULL : stdout))) {
+    fprintf(stderr, "Out of memory while setting up the stream.\n");
     curl_easy_cleanup(curl);
+    curl_mime_free(mime);
     curl_global_cleanup();
-    free(method);
-    free(payload);
-    free(url);
-    free(tokens);
-    free(json);
-    return EXIT_REQUEST;
+    tls_cache_free(tls_cache);
+    request_free(&req);
+    return EXIT_HTTP;
   }
-
-  struct response_buffer body = {0};
-  struct response_headers resp_headers = {0};
-
-  curl_easy_setopt(curl, CURLOPT_URL, url);
-  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-  if (!use_exit_codes && include_headers) {
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_header);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &resp_headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_buffer);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
-  } else if (use_exit_codes) {
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_discard);
+  if (events) {
+    stream_setup(curl, events);
   } else {
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_stdout);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, stdout);
-  }
-
-  if (payload) {
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(payload));
+    single_setup(curl, &run);
   }
 
   CURLcode res = curl_easy_perform(curl);
-  long http_status = 0;
-  if (res == CURLE_OK) {
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
-  }
-  if (res != CURLE_OK) {
-    fprintf(stderr, "\nRequest failed: %s\n", curl_easy_strerror(res));
-  }
-
-  if (!use_exit_codes && include_headers && res == CURLE_OK) {
-    print_json_response(http_status, resp_headers.status_line, &resp_headers.headers,
-                        &body);
-  }
-
-  curl_slist_free_all(headers);
+  tls_cache_save(tls_cache);
+  /* On a 304 the stored response stands in for the empty one. */
+  bool revalidated = res == CURLE_OK && http_cache && http_cache_update(http_cache, curl, &run);
+  char extra[96] = "";
+  const char *tls_result = tls_cache_result(tls_cache);
+  if (tls_result) {
+    snprintf(extra, sizeof(extra), "\"tls_session\":\"%s\"", tls_result);
+    run.envelope_extra = extra;
+  }
+  if (http_cache) {
+    size_t used = strlen(extra);
+    snprintf(extra + used, sizeof(extra) - used, "%s\"cache\":\"%s\"", used ? "," : "",
+             http_cache_result(http_cache));
+    run.envelope_extra = extra;
+  }
+  int rc = events ? stream_finish(curl, res, events, use_exit_codes ? NULL : stderr,
+                                  use_exit_codes)
+           : revalidated ? http_cache_serve(http_cache, &run)
+                         : single_finish(curl, res, &run);
+
+  stream_free(events);
+  http_cache_free(http_cache);
   curl_easy_cleanup(curl);
+  curl_mime_free(mime);
   curl_global_cleanup();
-  free(body.data);
-  header_list_free(&resp_headers.headers);
-  free(resp_headers.status_line);
-  free(method);
-  free(payload);
-  free(url);
-  free(tokens);
-  free(json);
-
-  if (!use_exit_codes) {
-    return res == CURLE_OK ? EXIT_OK : EXIT_HTTP;
-  }
-  if (res != CURLE_OK) {
-    return EXIT_HTTP;
-  }
-  if (http_status >= 400) {
-    return EXIT_RESPONSE;
-  }
-  return EXIT_OK;
+  tls_cache_free(tls_cache);
+  single_cleanup(&run);
+  request_free(&req);
+  return rc;
 }
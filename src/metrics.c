@@ -0,0 +1,321 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#define MAX_REQUEST_HEAD 8192
+
+struct metrics {
+  int fd;
+  int wake[2];
+  pthread_t thread;
+  pthread_mutex_t lock;
+  char *text;
+  size_t len;
+};
+
+static int send_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, SEND_FLAGS);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/* Reads (and ignores) the request head; every path gets the snapshot. */
+static void serve_client(struct metrics *m, int fd) {
+  struct timeval tv = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  char head[MAX_REQUEST_HEAD + 1];
+  size_t got = 0;
+  while (got < MAX_REQUEST_HEAD) {
+    ssize_t n = recv(fd, head + got, MAX_REQUEST_HEAD - got, 0);
+    if (n <= 0) {
+      return;
+    }
+    got += (size_t)n;
+    head[got] = '\0';
+    if (strstr(head, "\r\n\r\n") || strstr(head, "\n\n")) {
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&m->lock);
+  size_t len = m->len;
+  char *body = (char *)malloc(len ? len : 1);
+  if (body && len) {
+    memcpy(body, m->text, len);
+  }
+  pthread_mutex_unlock(&m->lock);
+  if (!body) {
+    return;
+  }
+  char header[160];
+  int header_len = snprintf(header, sizeof(header),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n\r\n",
+                            len);
+  if (send_all(fd, header, (size_t)header_len) == 0 && strncmp(head, "HEAD ", 5) != 0) {
+    send_all(fd, body, len);
+  }
+  free(body);
+}
+
+static void *metrics_main(void *arg) {
+  struct metrics *m = (struct metrics *)arg;
+  struct pollfd fds[2];
+  fds[0].fd = m->fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = m->wake[0];
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    if (fds[0].revents & POLLIN) {
+      int client = accept(m->fd, NULL, NULL);
+      if (client >= 0) {
+        serve_client(m, client);
+        close(client);
+      }
+    }
+  }
+  return NULL;
+}
+
+static int open_listener(const char *addr) {
+  const char *colon = strrchr(addr, ':');
+  if (!colon || colon == addr || colon[1] == '\0') {
+    return -1;
+  }
+  size_t host_len = (size_t)(colon - addr);
+  const char *host_start = addr;
+  if (addr[0] == '[' && colon[-1] == ']') {
+    host_start++;
+    host_len -= 2;
+  }
+  char host[256];
+  if (host_len >= sizeof(host)) {
+    return -1;
+  }
+  memcpy(host, host_start, host_len);
+  host[host_len] = '\0';
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(host_len ? host : NULL, colon + 1, &hints, &res) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+int metrics_listen(const char *addr, struct metrics **out) {
+  *out = NULL;
+  struct metrics *m = (struct metrics *)calloc(1, sizeof(struct metrics));
+  if (!m) {
+    fprintf(err_stream(), "Out of memory while starting metrics listener.\n");
+    return EXIT_HTTP;
+  }
+  m->fd = open_listener(addr);
+  if (m->fd < 0) {
+    fprintf(err_stream(), "Failed to listen for metrics on %s.\n", addr);
+    free(m);
+    return EXIT_REQUEST;
+  }
+  if (pipe(m->wake) != 0) {
+    close(m->fd);
+    free(m);
+    fprintf(err_stream(), "Failed to start metrics listener.\n");
+    return EXIT_HTTP;
+  }
+  pthread_mutex_init(&m->lock, NULL);
+  if (pthread_create(&m->thread, NULL, metrics_main, m) != 0) {
+    close(m->wake[0]);
+    close(m->wake[1]);
+    close(m->fd);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+    fprintf(err_stream(), "Failed to start metrics listener.\n");
+    return EXIT_HTTP;
+  }
+  *out = m;
+  return EXIT_OK;
+}
+
+static void write_label(FILE *out, const char *value) {
+  for (const char *p = value; *p; p++) {
+    if (*p == '\\' || *p == '"') {
+      fputc('\\', out);
+      fputc(*p, out);
+    } else if (*p == '\n') {
+      fputs("\\n", out);
+    } else {
+      fputc(*p, out);
+    }
+  }
+}
+
+void metrics_publish(struct metrics *m, const struct load_stats *total,
+                     double interval_rps, unsigned concurrency) {
+  if (!m) {
+    return;
+  }
+  char *text = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&text, &len);
+  if (!out) {
+    return;
+  }
+  fprintf(out,
+          "# HELP pinga_requests_total Finished requests by transfer result.\n"
+          "# TYPE pinga_requests_total counter\n"
+          "pinga_requests_total{result=\"ok\"} %llu\n"
+          "pinga_requests_total{result=\"error\"} %llu\n",
+          (unsigned long long)total->ok, (unsigned long long)total->errors);
+  fprintf(out,
+          "# HELP pinga_responses_total Responses by HTTP status class.\n"
+          "# TYPE pinga_responses_total counter\n");
+  static const char *classes[6] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+  for (unsigned i = 0; i < 6; i++) {
+    fprintf(out, "pinga_responses_total{class=\"%s\"} %llu\n", classes[i],
+            (unsigned long long)total->status_classes[i]);
+  }
+  fprintf(out,
+          "# HELP pinga_transfer_errors_total Failed transfers by libcurl error.\n"
+          "# TYPE pinga_transfer_errors_total counter\n");
+  for (unsigned i = 1; i < CURL_LAST; i++) {
+    if (total->curl_errors[i] == 0) {
+      continue;
+    }
+    fputs("pinga_transfer_errors_total{reason=\"", out);
+    write_label(out, curl_easy_strerror((CURLcode)i));
+    fprintf(out, "\"} %llu\n", (unsigned long long)total->curl_errors[i]);
+  }
+  const struct histogram *h = &total->latency;
+  fprintf(out,
+          "# HELP pinga_request_duration_seconds Request latency.\n"
+          "# TYPE pinga_request_duration_seconds summary\n"
+          "pinga_request_duration_seconds{quantile=\"0.5\"} %.6f\n"
+          "pinga_request_duration_seconds{quantile=\"0.9\"} %.6f\n"
+          "pinga_request_duration_seconds{quantile=\"0.99\"} %.6f\n"
+          "pinga_request_duration_seconds_sum %.6f\n"
+          "pinga_request_duration_seconds_count %llu\n",
+          (double)histogram_quantile(h, 0.50) / 1e6, (double)histogram_quantile(h, 0.90) / 1e6,
+          (double)histogram_quantile(h, 0.99) / 1e6, (double)h->sum_us / 1e6,
+          (unsigned long long)h->total);
+  fprintf(out,
+          "# HELP pinga_bytes_received_total Response body bytes received.\n"
+          "# TYPE pinga_bytes_received_total counter\n"
+          "pinga_bytes_received_total %llu\n"
+          "# HELP pinga_requests_per_second Throughput over the last report interval.\n"
+          "# TYPE pinga_requests_per_second gauge\n"
+          "pinga_requests_per_second %.1f\n"
+          "# HELP pinga_concurrency Configured transfers in flight.\n"
+          "# TYPE pinga_concurrency gauge\n"
+          "pinga_concurrency %u\n",
+          (unsigned long long)total->bytes_received, interval_rps, concurrency);
+  if (fclose(out) != 0) {
+    free(text);
+    return;
+  }
+  pthread_mutex_lock(&m->lock);
+  free(m->text);
+  m->text = text;
+  m->len = len;
+  pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_close(struct metrics *m) {
+  if (!m) {
+    return;
+  }
+  char byte = 0;
+  ssize_t n = write(m->wake[1], &byte, 1);
+  (void)n;
+  pthread_join(m->thread, NULL);
+  close(m->wake[0]);
+  close(m->wake[1]);
+  close(m->fd);
+  pthread_mutex_destroy(&m->lock);
+  free(m->text);
+  free(m);
+}
+
+#else
+
+struct metrics {
+  int unused;
+};
+
+int metrics_listen(const char *addr, struct metrics **out) {
+  (void)addr;
+  *out = NULL;
+  fprintf(err_stream(), "--metrics-listen is not supported on Windows.\n");
+  return EXIT_REQUEST;
+}
+
+void metrics_publish(struct metrics *metrics, const struct load_stats *total,
+                     double interval_rps, unsigned concurrency) {
+  (void)metrics;
+  (void)total;
+  (void)interval_rps;
+  (void)concurrency;
+}
+
+void metrics_close(struct metrics *metrics) {
+  (void)metrics;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef PINGA_METRICS_H
+#define PINGA_METRICS_H
+
+#include "load.h"
+
+/*
+ * Prometheus text endpoint for load runs. A background thread answers every
+ * HTTP request on the listening socket with the latest published snapshot;
+ * the load runner publishes a new one on each report tick.
+ */
+struct metrics;
+
+/* addr is "host:port" ("[::1]:9464" for IPv6). Returns an EXIT_* code. */
+int metrics_listen(const char *addr, struct metrics **out);
+void metrics_publish(struct metrics *metrics, const struct load_stats *total,
+                     double interval_rps, unsigned concurrency);
+void metrics_close(struct metrics *metrics);
+
+#endif
@@ -0,0 +1,539 @@
+#include "mirror.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "hash.h"
+#include "json.h"
+#include "load.h"
+#include "util.h"
+
+#define MAX_HEADER_VALUE 1024
+
+struct pair;
+
+struct side {
+  struct pair *pair;
+  CURL *easy;
+  curl_mime *mime;
+  struct request_render *render;
+  uint64_t started_ns;
+  uint64_t latency_us;
+  long status;
+  CURLcode res;
+  uint64_t bytes;
+  struct xxh64_state hash;
+  char *values[MIRROR_MAX_HEADERS]; /* compared headers, repeats joined with ", " */
+};
+
+struct pair {
+  struct mirror *m;
+  struct side side[2]; /* primary, mirror */
+  struct request req;  /* collection runs only */
+  uint64_t seq;
+  unsigned pending;
+};
+
+struct mirror {
+  const struct mirror_options *opts;
+  struct mirror_report *report;
+  CURLM *multi;
+  char *scheme;
+  char *host;
+  char *port; /* NULL for the scheme's default */
+  char *path; /* prefix from the base url, without the trailing '/' */
+  struct gen_rng rng;
+  struct pair *pairs;
+  struct pair **free_list;
+  unsigned free_count;
+};
+
+static size_t on_body(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  struct side *s = (struct side *)userdata;
+  size_t len = size * nmemb;
+  xxh64_update(&s->hash, ptr, len);
+  s->bytes += len;
+  return len;
+}
+
+static void clear_values(struct side *s) {
+  for (int i = 0; i < MIRROR_MAX_HEADERS; i++) {
+    free(s->values[i]);
+    s->values[i] = NULL;
+  }
+}
+
+static void append_value(char **slot, const char *value, size_t len) {
+  size_t have = *slot ? strlen(*slot) : 0;
+  size_t sep = have ? 2 : 0;
+  if (have + sep + len > MAX_HEADER_VALUE) {
+    len = have + sep < MAX_HEADER_VALUE ? MAX_HEADER_VALUE - have - sep : 0;
+  }
+  char *next = (char *)realloc(*slot, have + sep + len + 1);
+  if (!next) {
+    return;
+  }
+  memcpy(next + have, ", ", sep);
+  memcpy(next + have + sep, value, len);
+  next[have + sep + len] = '\0';
+  *slot = next;
+}
+
+static size_t on_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+  struct side *s = (struct side *)userdata;
+  const struct mirror_options *opts = s->pair->m->opts;
+  size_t len = size * nitems;
+  if (len >= 5 && memcmp(buffer, "HTTP/", 5) == 0) {
+    /* A new response head (after a 1xx): only the final one counts. */
+    clear_values(s);
+    return len;
+  }
+  const char *colon = (const char *)memchr(buffer, ':', len);
+  if (!colon) {
+    return len;
+  }
+  size_t name_len = (size_t)(colon - buffer);
+  const char *value = colon + 1;
+  const char *end = buffer + len;
+  while (value < end && (*value == ' ' || *value == '\t')) {
+    value++;
+  }
+  while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) {
+    end--;
+  }
+  for (int i = 0; i < opts->header_count; i++) {
+    if (strlen(opts->headers[i]) == name_len &&
+        strncasecmp(buffer, opts->headers[i], name_len) == 0) {
+      append_value(&s->values[i], value, (size_t)(end - value));
+    }
+  }
+  return len;
+}
+
+/* Splits the base url once; every pair reuses the pieces. */
+static int parse_base(struct mirror *m, const char *base_url) {
+  CURLU *u = curl_url();
+  char *path = NULL;
+  bool ok = u && curl_url_set(u, CURLUPART_URL, base_url, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_SCHEME, &m->scheme, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_HOST, &m->host, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_PATH, &path, 0) == CURLUE_OK;
+  if (ok && curl_url_get(u, CURLUPART_PORT, &m->port, 0) != CURLUE_OK) {
+    m->port = NULL;
+  }
+  if (ok) {
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') {
+      len--;
+    }
+    m->path = (char *)malloc(len + 1);
+    if ((ok = m->path != NULL)) {
+      memcpy(m->path, path, len);
+      m->path[len] = '\0';
+    }
+  }
+  curl_free(path);
+  curl_url_cleanup(u);
+  if (!ok) {
+    fprintf(err_stream(), "Invalid --mirror url '%s'.\n", base_url);
+    return EXIT_REQUEST;
+  }
+  return EXIT_OK;
+}
+
+/* Same path and query as url, on the mirror's origin (under its path, if any). */
+static char *mirror_url(const struct mirror *m, const char *url) {
+  CURLU *u = curl_url();
+  char *path = NULL;
+  char *out = NULL;
+  bool ok = u && curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+            curl_url_set(u, CURLUPART_SCHEME, m->scheme, 0) == CURLUE_OK &&
+            curl_url_set(u, CURLUPART_HOST, m->host, 0) == CURLUE_OK &&
+            curl_url_set(u, CURLUPART_PORT, m->port, 0) == CURLUE_OK;
+  if (ok && m->path[0] && curl_url_get(u, CURLUPART_PATH, &path, 0) == CURLUE_OK) {
+    size_t len = strlen(m->path) + strlen(path) + 1;
+    char *joined = (char *)malloc(len);
+    ok = joined != NULL;
+    if (ok) {
+      snprintf(joined, len, "%s%s", m->path, path);
+      ok = curl_url_set(u, CURLUPART_PATH, joined, 0) == CURLUE_OK;
+      free(joined);
+    }
+    curl_free(path);
+  }
+  char *full = NULL;
+  if (ok && curl_url_get(u, CURLUPART_URL, &full, 0) == CURLUE_OK) {
+    out = dup_string(full);
+    curl_free(full);
+  }
+  curl_url_cleanup(u);
+  return out;
+}
+
+static void release_pair(struct mirror *m, struct pair *p) {
+  for (int i = 0; i < 2; i++) {
+    struct side *s = &p->side[i];
+    curl_mime_free(s->mime);
+    s->mime = NULL;
+    request_render_free(s->render);
+    s->render = NULL;
+    clear_values(s);
+  }
+  request_free(&p->req);
+  m->free_list[m->free_count++] = p;
+}
+
+/*
+ * Both sides get the same rendered generator values: each renders from the
+ * same PRNG state, and the mirror side is then moved onto the base url.
+ */
+static bool prepare_side(struct mirror *m, struct side *s, const struct request *req,
+                         uint64_t seq, const struct gen_rng *rng_start, bool is_mirror) {
+  curl_easy_reset(s->easy);
+  request_apply(s->easy, req);
+  if (req->part_count && !(s->mime = request_mime(s->easy, req))) {
+    return false;
+  }
+  const char *url = req->url;
+  if (req->gen) {
+    if (!(s->render = request_render_new(req))) {
+      fprintf(err_stream(), "Out of memory while rendering generators.\n");
+      return false;
+    }
+    m->rng = *rng_start;
+    request_render(s->easy, req, s->render, &m->rng, seq);
+    if (request_render_url(s->render)) {
+      url = request_render_url(s->render);
+    }
+  }
+  if (is_mirror) {
+    char *target = mirror_url(m, url);
+    if (!target) {
+      fprintf(err_stream(), "Failed to build the mirror url for %s\n", url);
+      return false;
+    }
+    curl_easy_setopt(s->easy, CURLOPT_URL, target);
+    free(target);
+  }
+  curl_easy_setopt(s->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(s->easy, CURLOPT_WRITEFUNCTION, on_body);
+  curl_easy_setopt(s->easy, CURLOPT_WRITEDATA, s);
+  curl_easy_setopt(s->easy, CURLOPT_HEADERFUNCTION, on_header);
+  curl_easy_setopt(s->easy, CURLOPT_HEADERDATA, s);
+  curl_easy_setopt(s->easy, CURLOPT_PRIVATE, s);
+  xxh64_reset(&s->hash, 0);
+  s->bytes = 0;
+  s->status = 0;
+  s->res = CURLE_OK;
+  return true;
+}
+
+static bool send_pair(struct mirror *m, struct pair *p, const struct request *req) {
+  struct gen_rng rng_start = m->rng;
+  for (int i = 0; i < 2; i++) {
+    struct side *s = &p->side[i];
+    if (!s->easy && !(s->easy = curl_easy_init())) {
+      return false;
+    }
+    if (!prepare_side(m, s, req, p->seq, &rng_start, i == 1)) {
+      return false;
+    }
+  }
+  uint64_t now = now_ns();
+  for (int i = 0; i < 2; i++) {
+    p->side[i].started_ns = now;
+    if (curl_multi_add_handle(m->multi, p->side[i].easy) != CURLM_OK) {
+      if (i == 1) {
+        curl_multi_remove_handle(m->multi, p->side[0].easy);
+      }
+      return false;
+    }
+  }
+  p->pending = 2;
+  return true;
+}
+
+static bool same_value(const char *a, const char *b) {
+  return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
+static void print_string_or_null(FILE *out, const char *value) {
+  char *escaped = value ? json_escape(value) : NULL;
+  if (escaped) {
+    fprintf(out, "\"%s\"", escaped);
+  } else {
+    fputs("null", out);
+  }
+  free(escaped);
+}
+
+static void print_side(FILE *out, const char *name, const struct side *s) {
+  fprintf(out, ",\"%s\":{\"status\":%ld,\"latency_ms\":%.3f,\"bytes\":%llu,\"xxh64\":\"%016llx\"",
+          name, s->status, (double)s->latency_us / 1000.0, (unsigned long long)s->bytes,
+          (unsigned long long)xxh64_digest(&s->hash));
+  if (s->res != CURLE_OK) {
+    fprintf(out, ",\"error\":\"%s\"", curl_easy_strerror(s->res));
+  }
+  fputc('}', out);
+}
+
+static void print_mismatch(const struct mirror *m, const struct pair *p, bool error,
+                           bool status, unsigned header_mask, bool body) {
+  FILE *out = m->opts->mismatches;
+  const struct side *a = &p->side[0];
+  const struct side *b = &p->side[1];
+  char *url = NULL;
+  curl_easy_getinfo(a->easy, CURLINFO_EFFECTIVE_URL, &url);
+  fprintf(out, "{\"seq\":%llu,\"url\":", (unsigned long long)p->seq);
+  print_string_or_null(out, url);
+  fputs(",\"mismatch\":[", out);
+  const char *sep = "";
+  if (error) {
+    fprintf(out, "%s\"error\"", sep);
+    sep = ",";
+  }
+  if (status) {
+    fprintf(out, "%s\"status\"", sep);
+    sep = ",";
+  }
+  if (header_mask) {
+    fprintf(out, "%s\"headers\"", sep);
+    sep = ",";
+  }
+  if (body) {
+    fprintf(out, "%s\"body\"", sep);
+  }
+  fputc(']', out);
+  print_side(out, "primary", a);
+  print_side(out, "mirror", b);
+  if (header_mask) {
+    fputs(",\"headers\":{", out);
+    sep = "";
+    for (int i = 0; i < m->opts->header_count; i++) {
+      if (!(header_mask & (1u << i))) {
+        continue;
+      }
+      fputs(sep, out);
+      print_string_or_null(out, m->opts->headers[i]);
+      fputs(":[", out);
+      print_string_or_null(out, a->values[i]);
+      fputc(',', out);
+      print_string_or_null(out, b->values[i]);
+      fputc(']', out);
+      sep = ",";
+    }
+    fputc('}', out);
+  }
+  fputs("}\n", out);
+}
+
+static void compare_pair(struct mirror *m, struct pair *p) {
+  struct mirror_report *r = m->report;
+  const struct side *a = &p->side[0];
+  const struct side *b = &p->side[1];
+  r->pairs++;
+  bool error = a->res != CURLE_OK || b->res != CURLE_OK;
+  bool status = false;
+  unsigned header_mask = 0;
+  bool body = false;
+  if (!error) {
+    status = a->status != b->status;
+    for (int i = 0; i < m->opts->header_count; i++) {
+      if (!same_value(a->values[i], b->values[i])) {
+        header_mask |= 1u << i;
+      }
+    }
+    body = a->bytes != b->bytes || xxh64_digest(&a->hash) != xxh64_digest(&b->hash);
+    histogram_record(&r->primary, a->latency_us);
+    histogram_record(&r->mirror, b->latency_us);
+    int64_t delta = (int64_t)b->latency_us - (int64_t)a->latency_us;
+    r->delta_sum_us += delta;
+    if (delta > 0) {
+      histogram_record(&r->slower, (uint64_t)delta);
+    } else {
+      histogram_record(&r->faster, (uint64_t)-delta);
+    }
+  }
+  r->errors += error;
+  r->status_mismatches += status;
+  r->header_mismatches += header_mask != 0;
+  r->body_mismatches += body;
+  if (!error && !status && !header_mask && !body) {
+    r->matched++;
+    return;
+  }
+  if (m->opts->mismatches) {
+    print_mismatch(m, p, error, status, header_mask, body);
+  }
+}
+
+static void drain(struct mirror *m, unsigned *in_flight) {
+  CURLMsg *msg;
+  int left = 0;
+  while ((msg = curl_multi_info_read(m->multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    void *priv = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    struct side *s = (struct side *)priv;
+    s->res = msg->data.result;
+    s->latency_us = (now_ns() - s->started_ns) / 1000;
+    if (s->res == CURLE_OK) {
+      curl_easy_getinfo(s->easy, CURLINFO_RESPONSE_CODE, &s->status);
+    }
+    curl_multi_remove_handle(m->multi, s->easy);
+    struct pair *p = s->pair;
+    if (--p->pending > 0) {
+      continue;
+    }
+    compare_pair(m, p);
+    release_pair(m, p);
+    (*in_flight)--;
+  }
+}
+
+/* Next request to mirror: the next collection element, or req again. */
+static const struct request *next_request(struct mirror *m, const struct request *req,
+                                          struct pair *p, uint64_t issued) {
+  const struct mirror_options *opts = m->opts;
+  if (opts->requests && issued >= opts->requests) {
+    return NULL;
+  }
+  if (!opts->collection) {
+    return req;
+  }
+  bool got = false;
+  int rc = collection_next(opts->collection, &p->req, &got);
+  if (rc != EXIT_OK) {
+    m->report->source_rc = rc;
+  }
+  return got ? &p->req : NULL;
+}
+
+int mirror_run(const struct request *req, const struct mirror_options *opts,
+               struct mirror_report *report) {
+  memset(report, 0, sizeof(*report));
+  histogram_reset(&report->primary);
+  histogram_reset(&report->mirror);
+  histogram_reset(&report->slower);
+  histogram_reset(&report->faster);
+
+  struct mirror m;
+  memset(&m, 0, sizeof(m));
+  m.opts = opts;
+  m.report = report;
+  int rc = parse_base(&m, opts->base_url);
+  unsigned slots = opts->concurrency ? opts->concurrency : 1;
+  if (rc == EXIT_OK) {
+    m.multi = curl_multi_init();
+    m.pairs = (struct pair *)calloc(slots, sizeof(struct pair));
+    m.free_list = (struct pair **)calloc(slots, sizeof(struct pair *));
+    if (!m.multi || !m.pairs || !m.free_list) {
+      fprintf(err_stream(), "Out of memory while starting mirror run.\n");
+      rc = EXIT_HTTP;
+    }
+  }
+  if (rc == EXIT_OK) {
+    gen_rng_seed(&m.rng, now_ns() ^ (wall_clock_ms() << 20));
+    for (unsigned i = slots; i-- > 0;) {
+      m.pairs[i].m = &m;
+      m.pairs[i].side[0].pair = &m.pairs[i];
+      m.pairs[i].side[1].pair = &m.pairs[i];
+      m.free_list[m.free_count++] = &m.pairs[i];
+    }
+
+    uint64_t issued = 0;
+    unsigned in_flight = 0;
+    bool more = true;
+    uint64_t start = now_ns();
+    while (more || in_flight > 0) {
+      while (more && m.free_count > 0) {
+        struct pair *p = m.free_list[--m.free_count];
+        const struct request *next = next_request(&m, req, p, issued);
+        if (!next) {
+          m.free_list[m.free_count++] = p;
+          more = false;
+          break;
+        }
+        p->seq = issued++;
+        if (send_pair(&m, p, next)) {
+          in_flight++;
+        } else {
+          report->pairs++;
+          report->errors++;
+          release_pair(&m, p);
+        }
+      }
+      if (in_flight > 0) {
+        int running = 0;
+        curl_multi_perform(m.multi, &running);
+        drain(&m, &in_flight);
+        if (in_flight > 0) {
+          curl_multi_poll(m.multi, NULL, 0, 1000, NULL);
+        }
+      }
+    }
+    report->elapsed_ns = now_ns() - start;
+  }
+
+  if (m.pairs) {
+    for (unsigned i = 0; i < slots; i++) {
+      for (int k = 0; k < 2; k++) {
+        if (m.pairs[i].side[k].easy) {
+          curl_easy_cleanup(m.pairs[i].side[k].easy);
+        }
+      }
+    }
+  }
+  free(m.pairs);
+  free(m.free_list);
+  if (m.multi) {
+    curl_multi_cleanup(m.multi);
+  }
+  curl_free(m.scheme);
+  curl_free(m.host);
+  curl_free(m.port);
+  free(m.path);
+  return rc;
+}
+
+/* Quantile q of the signed per-pair delta, from its two halves. */
+static double delta_quantile_ms(const struct mirror_report *r, double q) {
+  uint64_t total = r->slower.total + r->faster.total;
+  if (total == 0) {
+    return 0.0;
+  }
+  double rank = q * (double)total;
+  if (rank < (double)r->faster.total) {
+    /* Largest improvements come first. */
+    double within = 1.0 - rank / (double)r->faster.total;
+    return -(double)histogram_quantile(&r->faster, within) / 1000.0;
+  }
+  double within = (rank - (double)r->faster.total) / (double)r->slower.total;
+  return (double)histogram_quantile(&r->slower, within > 1.0 ? 1.0 : within) / 1000.0;
+}
+
+void mirror_print_report(FILE *out, const struct mirror_report *report) {
+  uint64_t compared = report->slower.total + report->faster.total;
+  fprintf(out,
+          "{\"pairs\":%llu,\"matched\":%llu,\"mismatched\":%llu,"
+          "\"mismatches\":{\"status\":%llu,\"headers\":%llu,\"body\":%llu,\"error\":%llu},"
+          "\"elapsed_ms\":%.3f,",
+          (unsigned long long)report->pairs, (unsigned long long)report->matched,
+          (unsigned long long)(report->pairs - report->matched),
+          (unsigned long long)report->status_mismatches,
+          (unsigned long long)report->header_mismatches,
+          (unsigned long long)report->body_mismatches, (unsigned long long)report->errors,
+          (double)report->elapsed_ns / 1e6);
+  load_print_latency(out, "primary_latency_ms", &report->primary);
+  load_print_latency(out, "mirror_latency_ms", &report->mirror);
+  fprintf(out,
+          "\"latency_delta_ms\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f},"
+          "\"mirror_slower\":%llu}\n",
+          compared ? (double)report->delta_sum_us / (double)compared / 1000.0 : 0.0,
+          delta_quantile_ms(report, 0.50), delta_quantile_ms(report, 0.90),
+          delta_quantile_ms(report, 0.99), (unsigned long long)report->slower.total);
+}
@@ -0,0 +1,50 @@
+#ifndef PINGA_MIRROR_H
+#define PINGA_MIRROR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "collection.h"
+#include "request.h"
+#include "stats.h"
+
+#define MIRROR_MAX_HEADERS 16
+
+/*
+ * Sends every request to its own url and, at the same time, to the same
+ * path and query on base_url. Status, the selected response headers and an
+ * XXH64 of each body (hashed as it arrives, never stored) are compared per
+ * pair; only pairs that differ are written out.
+ */
+struct mirror_options {
+  const char *base_url;
+  unsigned concurrency;  /* pairs in flight */
+  uint64_t requests;     /* pairs to send; 0 runs the collection to its end */
+  const char *const *headers;
+  int header_count;
+  struct collection_reader *collection; /* instead of one repeated request */
+  FILE *mismatches;      /* one JSON line per differing pair, or NULL */
+};
+
+struct mirror_report {
+  uint64_t pairs;
+  uint64_t matched;
+  uint64_t status_mismatches;
+  uint64_t header_mismatches;
+  uint64_t body_mismatches;
+  uint64_t errors; /* pairs where either side failed to transfer */
+  struct histogram primary;
+  struct histogram mirror;
+  /* Per-pair mirror minus primary latency, split by sign. */
+  struct histogram slower;
+  struct histogram faster;
+  int64_t delta_sum_us;
+  uint64_t elapsed_ns;
+  int source_rc;
+};
+
+int mirror_run(const struct request *req, const struct mirror_options *opts,
+               struct mirror_report *report);
+void mirror_print_report(FILE *out, const struct mirror_report *report);
+
+#endif
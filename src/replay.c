@@ -0,0 +1,721 @@
+#include "replay.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "json.h"
+#include "util.h"
+
+#define DEFAULT_REPLAY_CONCURRENCY 1024u
+
+/* One captured request, already turned into what a config would produce. */
+struct entry {
+  int64_t at_ms; /* capture time, ms since the epoch */
+  struct request req;
+};
+
+struct source {
+  struct mapped_file file;
+  size_t pos;
+  bool har;
+  const struct request *target;
+  CURLU *target_url;
+  char *target_scheme;
+  char *target_host;
+  char *target_port;
+};
+
+struct replay_slot {
+  CURL *easy;
+  struct request req;
+  uint64_t started_ns;
+  uint64_t bytes;
+};
+
+/* ---- minimal structural JSON scanning over the mapped file ---- */
+
+static size_t skip_ws(const char *d, size_t len, size_t i) {
+  while (i < len && (d[i] == ' ' || d[i] == '\t' || d[i] == '\n' || d[i] == '\r')) {
+    i++;
+  }
+  return i;
+}
+
+/* i is at the opening quote; returns the index after the closing one. */
+static size_t skip_string(const char *d, size_t len, size_t i) {
+  for (i++; i < len; i++) {
+    if (d[i] == '\\') {
+      i++;
+    } else if (d[i] == '"') {
+      return i + 1;
+    }
+  }
+  return len;
+}
+
+static size_t skip_value(const char *d, size_t len, size_t i) {
+  if (i >= len) {
+    return len;
+  }
+  if (d[i] == '"') {
+    return skip_string(d, len, i);
+  }
+  if (d[i] == '{' || d[i] == '[') {
+    int depth = 0;
+    while (i < len) {
+      char c = d[i];
+      if (c == '"') {
+        i = skip_string(d, len, i);
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0) {
+          return i + 1;
+        }
+      }
+      i++;
+    }
+    return len;
+  }
+  while (i < len && d[i] != ',' && d[i] != '}' && d[i] != ']' && d[i] != ' ' &&
+         d[i] != '\n' && d[i] != '\r' && d[i] != '\t') {
+    i++;
+  }
+  return i;
+}
+
+static bool key_is(const char *d, size_t start, size_t end, const char *key) {
+  size_t n = strlen(key);
+  return end - start == n + 2 && memcmp(d + start + 1, key, n) == 0;
+}
+
+/* Position just inside the first "entries": [ array, or 0 if there is none. */
+static size_t find_entries(const char *d, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    if (d[i] != '"') {
+      i++;
+      continue;
+    }
+    size_t end = skip_string(d, len, i);
+    if (key_is(d, i, end, "entries")) {
+      size_t k = skip_ws(d, len, end);
+      if (k < len && d[k] == ':') {
+        k = skip_ws(d, len, k + 1);
+        if (k < len && d[k] == '[') {
+          return k + 1;
+        }
+      }
+    }
+    i = end;
+  }
+  return 0;
+}
+
+/* ---- timestamps ---- */
+
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+static int64_t civil_ms(int y, int mon, int d, int h, int mi, int s) {
+  return ((days_from_civil(y, (unsigned)mon, (unsigned)d) * 24 + h) * 60 + mi) * 60000 +
+         (int64_t)s * 1000;
+}
+
+/* "2024-05-01T12:00:00.123Z" or with a +hh:mm / -hhmm offset. */
+static bool parse_iso8601(const char *text, int64_t *out_ms) {
+  int y, mon, d, h, mi, s, n = 0;
+  if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d%n", &y, &mon, &d, &h, &mi, &s, &n) != 6) {
+    return false;
+  }
+  int64_t ms = civil_ms(y, mon, d, h, mi, s);
+  const char *p = text + n;
+  if (*p == '.') {
+    int scale = 100;
+    for (p++; *p >= '0' && *p <= '9'; p++) {
+      ms += (*p - '0') * scale;
+      scale /= 10;
+    }
+  }
+  if (*p == '+' || *p == '-') {
+    int oh = 0, om = 0;
+    if (sscanf(p + 1, "%2d:%2d", &oh, &om) != 2 && sscanf(p + 1, "%2d%2d", &oh, &om) != 2) {
+      return false;
+    }
+    int64_t offset = ((int64_t)oh * 60 + om) * 60000;
+    ms += *p == '+' ? -offset : offset;
+  }
+  *out_ms = ms;
+  return true;
+}
+
+/* Access log time: "10/Oct/2000:13:55:36 -0700". */
+static bool parse_log_time(const char *text, int64_t *out_ms) {
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  int d, y, h, mi, s, off;
+  char mon[4];
+  if (sscanf(text, "%2d/%3s/%4d:%2d:%2d:%2d %5d", &d, mon, &y, &h, &mi, &s, &off) != 7) {
+    return false;
+  }
+  const char *m = strstr(months, mon);
+  if (!m || strlen(mon) != 3) {
+    return false;
+  }
+  int64_t ms = civil_ms(y, (int)((m - months) / 3) + 1, d, h, mi, s);
+  int sign = off < 0 ? -1 : 1;
+  off *= sign;
+  *out_ms = ms - sign * ((int64_t)(off / 100) * 60 + off % 100) * 60000;
+  return true;
+}
+
+/* ---- turning entries into requests ---- */
+
+static bool target_has_header(const struct source *src, const char *name, size_t name_len) {
+  if (!src->target) {
+    return false;
+  }
+  for (const struct curl_slist *h = src->target->headers; h; h = h->next) {
+    size_t len = strcspn(h->data, ":;");
+    if (len == name_len && strncasecmp(h->data, name, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Headers libcurl derives itself, or that would break when replayed. */
+static bool skip_header(const struct source *src, const char *name) {
+  static const char *derived[] = {"content-length", "connection", "transfer-encoding",
+                                  "keep-alive", "upgrade", "expect", NULL};
+  if (name[0] == ':' || name[0] == '\0') {
+    return true;
+  }
+  for (const char **p = derived; *p; p++) {
+    if (strcasecmp(name, *p) == 0) {
+      return true;
+    }
+  }
+  if (src->target && strcasecmp(name, "host") == 0) {
+    return true;
+  }
+  return target_has_header(src, name, strlen(name));
+}
+
+static int add_header(struct request *req, const char *name, const char *value) {
+  size_t len = strlen(name) + strlen(value) + 3;
+  char *line = (char *)malloc(len);
+  if (!line) {
+    return -1;
+  }
+  if (*value) {
+    snprintf(line, len, "%s: %s", name, value);
+  } else {
+    snprintf(line, len, "%s;", name);
+  }
+  struct curl_slist *next = curl_slist_append(req->headers, line);
+  free(line);
+  if (!next) {
+    return -1;
+  }
+  req->headers = next;
+  return 0;
+}
+
+static int add_target_headers(const struct source *src, struct request *req) {
+  if (!src->target) {
+    return 0;
+  }
+  for (const struct curl_slist *h = src->target->headers; h; h = h->next) {
+    struct curl_slist *next = curl_slist_append(req->headers, h->data);
+    if (!next) {
+      return -1;
+    }
+    req->headers = next;
+  }
+  return 0;
+}
+
+/* Moves the captured url onto the target's origin; log paths resolve against it. */
+static char *target_url(const struct source *src, const char *url) {
+  if (!src->target) {
+    return dup_string(url);
+  }
+  CURLU *u = src->har ? curl_url() : curl_url_dup(src->target_url);
+  char *out = NULL;
+  if (u && curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+      (!src->har || (curl_url_set(u, CURLUPART_SCHEME, src->target_scheme, 0) == CURLUE_OK &&
+                     curl_url_set(u, CURLUPART_HOST, src->target_host, 0) == CURLUE_OK &&
+                     curl_url_set(u, CURLUPART_PORT, src->target_port, 0) == CURLUE_OK))) {
+    char *full = NULL;
+    if (curl_url_get(u, CURLUPART_URL, &full, 0) == CURLUE_OK) {
+      out = dup_string(full);
+      curl_free(full);
+    }
+  }
+  curl_url_cleanup(u);
+  return out;
+}
+
+static int har_headers(const struct source *src, const char *json, jsmntok_t *toks,
+                       int index, struct request *req) {
+  if (index < 0 || toks[index].type != JSMN_ARRAY) {
+    return 0;
+  }
+  int i = index + 1;
+  for (int e = 0; e < toks[index].size; e++) {
+    int name_idx = toks[i].type == JSMN_OBJECT ? find_object_value(json, toks, i, "name") : -1;
+    int value_idx = toks[i].type == JSMN_OBJECT ? find_object_value(json, toks, i, "value") : -1;
+    if (name_idx >= 0 && value_idx >= 0) {
+      char *name = dup_token_unescaped(json, &toks[name_idx], NULL);
+      char *value = dup_token_unescaped(json, &toks[value_idx], NULL);
+      int rc = 0;
+      if (!name || !value) {
+        rc = -1;
+      } else if (!skip_header(src, name)) {
+        rc = add_header(req, name, value);
+      }
+      free(name);
+      free(value);
+      if (rc != 0) {
+        return -1;
+      }
+    }
+    i = skip_token(toks, i);
+  }
+  return 0;
+}
+
+/* Parses the "request" object of one HAR entry. */
+static bool har_request(const struct source *src, const char *json, size_t len,
+                        struct request *req) {
+  jsmn_parser parser;
+  jsmntok_t *toks = NULL;
+  int count = 0;
+  if (ensure_tokens(&parser, json, len, &toks, &count) != 0 || count < 1 ||
+      toks[0].type != JSMN_OBJECT) {
+    free(toks);
+    return false;
+  }
+  bool ok = false;
+  char *url = NULL;
+  int url_idx = find_object_value(json, toks, 0, "url");
+  int method_idx = find_object_value(json, toks, 0, "method");
+  int post_idx = find_object_value(json, toks, 0, "postData");
+  int text_idx = post_idx >= 0 && toks[post_idx].type == JSMN_OBJECT
+                     ? find_object_value(json, toks, post_idx, "text")
+                     : -1;
+  if (url_idx >= 0 && method_idx >= 0 &&
+      (url = dup_token_unescaped(json, &toks[url_idx], NULL)) != NULL &&
+      (req->url = target_url(src, url)) != NULL &&
+      (req->method = dup_token_unescaped(json, &toks[method_idx], NULL)) != NULL &&
+      har_headers(src, json, toks, find_object_value(json, toks, 0, "headers"), req) == 0 &&
+      add_target_headers(src, req) == 0) {
+    ok = true;
+    if (text_idx >= 0) {
+      req->payload = dup_token_unescaped(json, &toks[text_idx], &req->payload_len);
+      ok = req->payload != NULL;
+    }
+  }
+  free(url);
+  free(toks);
+  return ok;
+}
+
+/* 1: entry read, 0: end of input, -1: entry skipped (malformed). */
+static int next_har(struct source *src, struct entry *out) {
+  const char *d = src->file.data;
+  size_t len = src->file.len;
+  size_t i = skip_ws(d, len, src->pos);
+  if (i < len && d[i] == ',') {
+    i = skip_ws(d, len, i + 1);
+  }
+  if (i >= len || d[i] != '{') {
+    src->pos = len;
+    return 0;
+  }
+  size_t end = skip_value(d, len, i);
+  src->pos = end;
+
+  size_t started = 0;
+  size_t request_start = 0;
+  size_t request_end = 0;
+  size_t k = skip_ws(d, end, i + 1);
+  while (k < end && d[k] == '"') {
+    size_t key_end = skip_string(d, end, k);
+    size_t v = skip_ws(d, end, key_end);
+    if (v >= end || d[v] != ':') {
+      break;
+    }
+    v = skip_ws(d, end, v + 1);
+    size_t v_end = skip_value(d, end, v);
+    if (key_is(d, k, key_end, "startedDateTime") && d[v] == '"') {
+      started = v;
+    } else if (key_is(d, k, key_end, "request") && d[v] == '{') {
+      request_start = v;
+      request_end = v_end;
+    }
+    k = skip_ws(d, end, v_end);
+    if (k < end && d[k] == ',') {
+      k = skip_ws(d, end, k + 1);
+    }
+  }
+
+  char stamp[64];
+  size_t stamp_len = started ? skip_string(d, end, started) - started - 2 : 0;
+  if (!started || !request_start || stamp_len >= sizeof(stamp)) {
+    return -1;
+  }
+  memcpy(stamp, d + started + 1, stamp_len);
+  stamp[stamp_len] = '\0';
+  memset(out, 0, sizeof(*out));
+  if (!parse_iso8601(stamp, &out->at_ms) ||
+      !har_request(src, d + request_start, request_end - request_start, &out->req)) {
+    request_free(&out->req);
+    return -1;
+  }
+  return 1;
+}
+
+/* Copies a quoted log field; returns the index after its closing quote. */
+static size_t log_quoted(const char *line, size_t len, size_t i, char *buf, size_t cap) {
+  size_t n = 0;
+  for (i++; i < len && line[i] != '"'; i++) {
+    if (line[i] == '\\' && i + 1 < len) {
+      i++;
+    }
+    if (n + 1 < cap) {
+      buf[n++] = line[i];
+    }
+  }
+  buf[n] = '\0';
+  return i < len ? i + 1 : len;
+}
+
+/* host ident user [time] "METHOD /path HTTP/x" status bytes "referer" "agent" */
+static int next_log(struct source *src, struct entry *out) {
+  const char *d = src->file.data;
+  size_t len = src->file.len;
+  while (src->pos < len && (d[src->pos] == '\n' || d[src->pos] == '\r')) {
+    src->pos++;
+  }
+  if (src->pos >= len) {
+    return 0;
+  }
+  const char *line = d + src->pos;
+  const char *nl = memchr(line, '\n', len - src->pos);
+  size_t line_len = nl ? (size_t)(nl - line) : len - src->pos;
+  src->pos += line_len;
+
+  const char *open = memchr(line, '[', line_len);
+  const char *quote = open ? memchr(open, '"', line_len - (size_t)(open - line)) : NULL;
+  if (!quote) {
+    return -1;
+  }
+  char stamp[64];
+  size_t stamp_len = strcspn(open + 1, "]");
+  if (stamp_len >= sizeof(stamp) || open + 1 + stamp_len > quote) {
+    return -1;
+  }
+  memcpy(stamp, open + 1, stamp_len);
+  stamp[stamp_len] = '\0';
+
+  char request_line[8192];
+  char method[32];
+  char path[8192];
+  size_t i = log_quoted(line, line_len, (size_t)(quote - line), request_line,
+                        sizeof(request_line));
+  memset(out, 0, sizeof(*out));
+  if (!parse_log_time(stamp, &out->at_ms) ||
+      sscanf(request_line, "%31s %8191s", method, path) != 2) {
+    return -1;
+  }
+
+  char referer[2048] = "";
+  char agent[2048] = "";
+  const char *q = memchr(line + i, '"', line_len - i);
+  if (q) {
+    i = log_quoted(line, line_len, (size_t)(q - line), referer, sizeof(referer));
+    q = memchr(line + i, '"', line_len - i);
+    if (q) {
+      log_quoted(line, line_len, (size_t)(q - line), agent, sizeof(agent));
+    }
+  }
+
+  struct request *req = &out->req;
+  bool ok = (req->url = target_url(src, path)) != NULL &&
+            (req->method = dup_string(method)) != NULL;
+  if (ok && strcmp(referer, "-") != 0 && *referer && !skip_header(src, "Referer")) {
+    ok = add_header(req, "Referer", referer) == 0;
+  }
+  if (ok && strcmp(agent, "-") != 0 && *agent && !skip_header(src, "User-Agent")) {
+    ok = add_header(req, "User-Agent", agent) == 0;
+  }
+  if (ok) {
+    ok = add_target_headers(src, req) == 0;
+  }
+  if (!ok) {
+    request_free(req);
+    return -1;
+  }
+  return 1;
+}
+
+static int source_open(const char *path, const struct request *target, struct source *src) {
+  memset(src, 0, sizeof(*src));
+  src->target = target;
+  if (map_file(path, &src->file) != 0) {
+    fprintf(err_stream(), "Failed to read replay file: %s\n", path);
+    return EXIT_CONFIG;
+  }
+  size_t start = skip_ws(src->file.data, src->file.len, 0);
+  src->har = start < src->file.len && src->file.data[start] == '{';
+  if (src->har) {
+    src->pos = find_entries(src->file.data, src->file.len);
+    if (!src->pos) {
+      fprintf(err_stream(), "No log.entries array in HAR file: %s\n", path);
+      return EXIT_CONFIG;
+    }
+  } else if (!target) {
+    fprintf(err_stream(), "Replaying an access log needs a config for the target url.\n");
+    return EXIT_REQUEST;
+  }
+  if (target) {
+    src->target_url = curl_url();
+    if (!src->target_url ||
+        curl_url_set(src->target_url, CURLUPART_URL, target->url, 0) != CURLUE_OK ||
+        curl_url_get(src->target_url, CURLUPART_SCHEME, &src->target_scheme, 0) != CURLUE_OK ||
+        curl_url_get(src->target_url, CURLUPART_HOST, &src->target_host, 0) != CURLUE_OK) {
+      fprintf(err_stream(), "Invalid target url: %s\n", target->url);
+      return EXIT_REQUEST;
+    }
+    curl_url_get(src->target_url, CURLUPART_PORT, &src->target_port, 0);
+  }
+  return EXIT_OK;
+}
+
+/* Skips malformed entries (counting them); false at the end of input. */
+static bool source_next(struct source *src, struct entry *out, uint64_t *skipped) {
+  for (;;) {
+    int rc = src->har ? next_har(src, out) : next_log(src, out);
+    if (rc > 0) {
+      return true;
+    }
+    if (rc == 0) {
+      return false;
+    }
+    (*skipped)++;
+  }
+}
+
+static void source_close(struct source *src) {
+  curl_free(src->target_scheme);
+  curl_free(src->target_host);
+  curl_free(src->target_port);
+  curl_url_cleanup(src->target_url);
+  unmap_file(&src->file);
+}
+
+/* ---- sending ---- */
+
+static size_t write_count(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  (void)ptr;
+  struct replay_slot *slot = (struct replay_slot *)userdata;
+  slot->bytes += size * nmemb;
+  return size * nmemb;
+}
+
+static bool send_entry(CURLM *multi, struct replay_slot *slot, struct entry *e,
+                       const struct request *target) {
+  slot->req = e->req;
+  memset(&e->req, 0, sizeof(e->req));
+  curl_easy_reset(slot->easy);
+  request_apply(slot->easy, &slot->req);
+  if (slot->req.method && strcmp(slot->req.method, "HEAD") == 0) {
+    curl_easy_setopt(slot->easy, CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(slot->easy, CURLOPT_NOBODY, 1L);
+  }
+  if (target && target->resolve) {
+    curl_easy_setopt(slot->easy, CURLOPT_RESOLVE, target->resolve);
+  }
+  if (target && target->unix_socket) {
+    curl_easy_setopt(slot->easy, CURLOPT_UNIX_SOCKET_PATH, target->unix_socket);
+  }
+  curl_easy_setopt(slot->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(slot->easy, CURLOPT_WRITEFUNCTION, write_count);
+  curl_easy_setopt(slot->easy, CURLOPT_WRITEDATA, slot);
+  curl_easy_setopt(slot->easy, CURLOPT_PRIVATE, slot);
+  slot->bytes = 0;
+  slot->started_ns = now_ns();
+  return curl_multi_add_handle(multi, slot->easy) == CURLM_OK;
+}
+
+struct slot_pool {
+  struct replay_slot **all;
+  struct replay_slot **free_list;
+  unsigned count;
+  unsigned free_count;
+  unsigned cap;
+};
+
+static struct replay_slot *pool_take(struct slot_pool *pool) {
+  if (pool->free_count > 0) {
+    return pool->free_list[--pool->free_count];
+  }
+  if (pool->count == pool->cap) {
+    return NULL;
+  }
+  struct replay_slot *slot = (struct replay_slot *)calloc(1, sizeof(struct replay_slot));
+  if (!slot || !(slot->easy = curl_easy_init())) {
+    free(slot);
+    return NULL;
+  }
+  pool->all[pool->count++] = slot;
+  return slot;
+}
+
+static void drain(CURLM *multi, struct slot_pool *pool, struct replay_report *report,
+                  unsigned *in_flight) {
+  CURLMsg *msg;
+  int left = 0;
+  while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    void *priv = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    struct replay_slot *slot = (struct replay_slot *)priv;
+    CURLcode res = msg->data.result;
+    long status = 0;
+    if (res == CURLE_OK) {
+      curl_easy_getinfo(slot->easy, CURLINFO_RESPONSE_CODE, &status);
+    }
+    load_stats_record(&report->stats, (now_ns() - slot->started_ns) / 1000, status, res,
+                      slot->bytes);
+    curl_multi_remove_handle(multi, slot->easy);
+    request_free(&slot->req);
+    pool->free_list[pool->free_count++] = slot;
+    (*in_flight)--;
+  }
+}
+
+int replay_run(const char *path, const struct replay_options *opts,
+               struct replay_report *report) {
+  memset(report, 0, sizeof(*report));
+  load_stats_reset(&report->stats);
+  histogram_reset(&report->lag);
+  report->speed = opts->speed > 0 ? opts->speed : 1.0;
+
+  struct source src;
+  int rc = source_open(path, opts->target, &src);
+  if (rc != EXIT_OK) {
+    source_close(&src);
+    return rc;
+  }
+
+  struct slot_pool pool;
+  memset(&pool, 0, sizeof(pool));
+  pool.cap = opts->concurrency ? opts->concurrency : DEFAULT_REPLAY_CONCURRENCY;
+  pool.all = (struct replay_slot **)calloc(pool.cap, sizeof(struct replay_slot *));
+  pool.free_list = (struct replay_slot **)calloc(pool.cap, sizeof(struct replay_slot *));
+  CURLM *multi = curl_multi_init();
+  if (!pool.all || !pool.free_list || !multi) {
+    fprintf(err_stream(), "Out of memory while starting replay.\n");
+    free(pool.all);
+    free(pool.free_list);
+    if (multi) {
+      curl_multi_cleanup(multi);
+    }
+    source_close(&src);
+    return EXIT_HTTP;
+  }
+
+  struct entry pending;
+  bool have = source_next(&src, &pending, &report->skipped);
+  int64_t first_ms = have ? pending.at_ms : 0;
+  unsigned in_flight = 0;
+  uint64_t start = now_ns();
+  while (have || in_flight > 0) {
+    uint64_t now = now_ns();
+    uint64_t due = 0;
+    while (have) {
+      int64_t offset_ms = pending.at_ms > first_ms ? pending.at_ms - first_ms : 0;
+      due = start + (uint64_t)((double)offset_ms * 1e6 / report->speed);
+      if (now < due) {
+        break;
+      }
+      struct replay_slot *slot = pool_take(&pool);
+      if (!slot) {
+        break;
+      }
+      report->entries++;
+      histogram_record(&report->lag, (now - due) / 1000);
+      if (send_entry(multi, slot, &pending, opts->target)) {
+        in_flight++;
+        if (in_flight > report->max_in_flight) {
+          report->max_in_flight = in_flight;
+        }
+      } else {
+        load_stats_record(&report->stats, 0, 0, CURLE_FAILED_INIT, 0);
+        request_free(&slot->req);
+        pool.free_list[pool.free_count++] = slot;
+      }
+      have = source_next(&src, &pending, &report->skipped);
+      now = now_ns();
+    }
+    int timeout_ms = 1000;
+    if (have && now < due && (pool.free_count > 0 || pool.count < pool.cap)) {
+      uint64_t wait_ms = (due - now) / 1000000;
+      timeout_ms = wait_ms < 1000 ? (int)wait_ms : 1000;
+    }
+    if (in_flight > 0) {
+      int running = 0;
+      curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
+      curl_multi_perform(multi, &running);
+      drain(multi, &pool, report, &in_flight);
+    } else if (timeout_ms > 0) {
+      sleep_ns((uint64_t)timeout_ms * 1000000ull);
+    }
+  }
+  report->elapsed_ns = now_ns() - start;
+
+  for (unsigned i = 0; i < pool.count; i++) {
+    curl_multi_remove_handle(multi, pool.all[i]->easy);
+    curl_easy_cleanup(pool.all[i]->easy);
+    request_free(&pool.all[i]->req);
+    free(pool.all[i]);
+  }
+  free(pool.all);
+  free(pool.free_list);
+  curl_multi_cleanup(multi);
+  source_close(&src);
+  return EXIT_OK;
+}
+
+void replay_print_report(FILE *out, const struct replay_report *report) {
+  const struct load_stats *stats = &report->stats;
+  double elapsed_s = (double)report->elapsed_ns / 1e9;
+  fprintf(out,
+          "{\"entries\":%llu,\"skipped\":%llu,\"requests\":%llu,\"ok\":%llu,\"errors\":%llu,"
+          "\"speed\":%g,\"max_in_flight\":%u,\"elapsed_ms\":%.3f,\"rps\":%.1f,",
+          (unsigned long long)report->entries, (unsigned long long)report->skipped,
+          (unsigned long long)stats->completed, (unsigned long long)stats->ok,
+          (unsigned long long)stats->errors, report->speed, report->max_in_flight,
+          (double)report->elapsed_ns / 1e6,
+          elapsed_s > 0 ? (double)stats->completed / elapsed_s : 0.0);
+  load_print_status(out, stats);
+  load_print_latency(out, "latency_ms", &stats->latency);
+  load_print_latency(out, "schedule_lag_ms", &report->lag);
+  fprintf(out, "\"bytes_received\":%llu,", (unsigned long long)stats->bytes_received);
+  load_print_error_reasons(out, stats);
+  fprintf(out, "}\n");
+}
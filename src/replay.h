@@ -0,0 +1,42 @@
+#ifndef PINGA_REPLAY_H
+#define PINGA_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "load.h"
+#include "request.h"
+#include "stats.h"
+
+/*
+ * Replays captured traffic: a HAR file (log.entries) or an access log in
+ * combined log format. The file is mapped and parsed one entry ahead of the
+ * send schedule, so memory does not grow with the capture size. Each entry
+ * is sent at its original offset from the first one divided by speed.
+ */
+struct replay_options {
+  double speed;         /* 2.0 replays twice as fast */
+  unsigned concurrency; /* cap on transfers in flight */
+  /*
+   * Optional config: its url's scheme/host/port replace each entry's (and
+   * are required for access logs), its headers and resolve entries are
+   * added to every request, and its unix_socket carries them all.
+   */
+  const struct request *target;
+};
+
+struct replay_report {
+  struct load_stats stats;
+  struct histogram lag; /* how late each send was vs. its scaled capture time */
+  uint64_t entries;
+  uint64_t skipped;
+  unsigned max_in_flight;
+  double speed;
+  uint64_t elapsed_ns;
+};
+
+int replay_run(const char *path, const struct replay_options *opts,
+               struct replay_report *report);
+void replay_print_report(FILE *out, const struct replay_report *report);
+
+#endif
@@ -0,0 +1,924 @@
+#include "request.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "util.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static char *replace_all(const char *src, const char *search, const char *replace) {
+  if (!src || !search || !replace) {
+    return NULL;
+  }
+  size_t src_len = strlen(src);
+  size_t search_len = strlen(search);
+  size_t replace_len = strlen(replace);
+  if (search_len == 0) {
+    return strdup(src);
+  }
+
+  size_t count = 0;
+  const char *pos = src;
+  while ((pos = strstr(pos, search)) != NULL) {
+    count++;
+    pos += search_len;
+  }
+  if (count == 0) {
+    return strdup(src);
+  }
+
+  size_t out_len = src_len + count * (replace_len - search_len);
+  char *out = (char *)malloc(out_len + 1);
+  if (!out) {
+    return NULL;
+  }
+
+  const char *src_it = src;
+  char *dst_it = out;
+  while ((pos = strstr(src_it, search)) != NULL) {
+    size_t chunk = (size_t)(pos - src_it);
+    memcpy(dst_it, src_it, chunk);
+    dst_it += chunk;
+    memcpy(dst_it, replace, replace_len);
+    dst_it += replace_len;
+    src_it = pos + search_len;
+  }
+  strcpy(dst_it, src_it);
+  return out;
+}
+
+static int append_query_param(char **url, const char *name, const char *value,
+                              bool *has_query) {
+  const char *prefix = *has_query ? "&" : "?";
+  size_t new_len = strlen(*url) + strlen(prefix) + strlen(name) + 1 + strlen(value) + 1;
+  char *out = (char *)malloc(new_len);
+  if (!out) {
+    return -1;
+  }
+  snprintf(out, new_len, "%s%s%s=%s", *url, prefix, name, value);
+  free(*url);
+  *url = out;
+  *has_query = true;
+  return 0;
+}
+
+/*
+ * curl_easy_escape(), except that generator placeholders stay intact so
+ * they can still be rendered in the finished url.
+ */
+static char *escape_value(const char *value) {
+  size_t len = strlen(value);
+  char *out = (char *)malloc(len * 3 + 1);
+  if (!out) {
+    return NULL;
+  }
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    size_t n = value[i] == '{' ? gen_placeholder_len(value + i, len - i) : 0;
+    if (n) {
+      memcpy(out + o, value + i, n);
+      o += n;
+      i += n;
+      continue;
+    }
+    unsigned char c = (unsigned char)value[i++];
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+        c == '-' || c == '.' || c == '_' || c == '~') {
+      out[o++] = (char)c;
+    } else {
+      static const char hex[] = "0123456789ABCDEF";
+      out[o++] = '%';
+      out[o++] = hex[c >> 4];
+      out[o++] = hex[c & 0xf];
+    }
+  }
+  out[o] = '\0';
+  return out;
+}
+
+struct curl_ctx {
+  char **url;
+  bool *has_query;
+  struct curl_slist **headers;
+};
+
+static int apply_path_param(const char *name, const char *value, void *userdata) {
+  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
+  char *escaped = escape_value(value);
+  if (!escaped) {
+    return 0;
+  }
+  size_t placeholder_len = strlen(name) + 2;
+  char *placeholder = (char *)malloc(placeholder_len + 1);
+  if (placeholder) {
+    snprintf(placeholder, placeholder_len + 1, "{%s}", name);
+    char *replaced = replace_all(*ctx->url, placeholder, escaped);
+    if (replaced) {
+      free(*ctx->url);
+      *ctx->url = replaced;
+    }
+    free(placeholder);
+  }
+  free(escaped);
+  return 0;
+}
+
+static int apply_query_param(const char *name, const char *value, void *userdata) {
+  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
+  char *enc_name = curl_easy_escape(NULL, name, 0);
+  char *enc_value = escape_value(value);
+  if (enc_name && enc_value) {
+    append_query_param(ctx->url, enc_name, enc_value, ctx->has_query);
+  }
+  if (enc_name) {
+    curl_free(enc_name);
+  }
+  free(enc_value);
+  return 0;
+}
+
+static int apply_header(const char *name, const char *value, void *userdata) {
+  struct curl_ctx *ctx = (struct curl_ctx *)userdata;
+  size_t header_len = strlen(name) + strlen(value) + 3;
+  char *header = (char *)malloc(header_len);
+  if (header) {
+    snprintf(header, header_len, "%s: %s", name, value);
+    *ctx->headers = curl_slist_append(*ctx->headers, header);
+    free(header);
+  }
+  return 0;
+}
+
+
+struct resolve_ctx {
+  struct request *req;
+  bool failed;
+};
+
+static int apply_resolve(const char *name, const char *value, void *userdata) {
+  struct resolve_ctx *ctx = (struct resolve_ctx *)userdata;
+  size_t len = strlen(name) + strlen(value) + 2;
+  char *entry = (char *)malloc(len);
+  if (!entry) {
+    fprintf(err_stream(), "Out of memory while reading resolve.\n");
+    ctx->failed = true;
+    return -1;
+  }
+  snprintf(entry, len, "%s:%s", name, value);
+  if (request_add_resolve(ctx->req, entry) != 0) {
+    ctx->failed = true;
+  }
+  free(entry);
+  return ctx->failed ? -1 : 0;
+}
+
+/* "resolve": ["host:port:addr", ...] or {"host:port": "addr[,addr]"}. */
+static int parse_resolve(const char *json, jsmntok_t *toks, int index, struct request *req) {
+  if (toks[index].type == JSMN_OBJECT) {
+    struct resolve_ctx ctx = {req, false};
+    if (iterate_kv(json, toks, index, "resolve", apply_resolve, &ctx) != 0 || ctx.failed) {
+      return -1;
+    }
+    return 0;
+  }
+  if (toks[index].type != JSMN_ARRAY) {
+    fprintf(err_stream(), "Invalid resolve: expected array or object.\n");
+    return -1;
+  }
+  int i = index + 1;
+  for (int e = 0; e < toks[index].size; e++) {
+    char *entry = dup_token_string(json, &toks[i]);
+    if (!entry) {
+      fprintf(err_stream(), "Invalid resolve entry: expected string (got %s).\n",
+              tok_type_name(toks[i].type));
+      return -1;
+    }
+    int rc = request_add_resolve(req, entry);
+    free(entry);
+    if (rc != 0) {
+      return -1;
+    }
+    i = skip_token(toks, i);
+  }
+  return 0;
+}
+
+struct request_gen {
+  struct gen_template *url;
+  struct gen_template *payload;
+  struct gen_template **headers; /* one per header line, NULL when static */
+  size_t header_count;
+  bool any_header;
+};
+
+static void request_gen_free(struct request_gen *gen) {
+  if (!gen) {
+    return;
+  }
+  gen_free(gen->url);
+  gen_free(gen->payload);
+  for (size_t i = 0; i < gen->header_count; i++) {
+    gen_free(gen->headers[i]);
+  }
+  free(gen->headers);
+  free(gen);
+}
+
+/* Compiles placeholders in the finished url, body and header lines. */
+static int compile_generators(struct request *req) {
+  struct request_gen *gen = (struct request_gen *)calloc(1, sizeof(struct request_gen));
+  if (!gen) {
+    fprintf(err_stream(), "Out of memory while compiling generators.\n");
+    return EXIT_REQUEST;
+  }
+  for (const struct curl_slist *h = req->headers; h; h = h->next) {
+    gen->header_count++;
+  }
+  if (gen->header_count) {
+    gen->headers =
+        (struct gen_template **)calloc(gen->header_count, sizeof(struct gen_template *));
+    if (!gen->headers) {
+      fprintf(err_stream(), "Out of memory while compiling generators.\n");
+      request_gen_free(gen);
+      return EXIT_REQUEST;
+    }
+  }
+  int failed = gen_compile(req->url, strlen(req->url), &gen->url);
+  if (!failed && req->payload) {
+    failed = gen_compile(req->payload, req->payload_len, &gen->payload);
+  }
+  size_t i = 0;
+  for (const struct curl_slist *h = req->headers; h && !failed; h = h->next, i++) {
+    failed = gen_compile(h->data, strlen(h->data), &gen->headers[i]);
+    gen->any_header = gen->any_header || gen->headers[i];
+  }
+  if (failed || (!gen->url && !gen->payload && !gen->any_header)) {
+    request_gen_free(gen);
+    return failed ? EXIT_REQUEST : EXIT_OK;
+  }
+  req->gen = gen;
+  return EXIT_OK;
+}
+
+static char *join_path(const char *dir, const char *name) {
+  size_t len = strlen(dir) + 1 + strlen(name) + 1;
+  char *out = (char *)malloc(len);
+  if (!out) {
+    return NULL;
+  }
+  snprintf(out, len, "%s/%s", dir, name);
+  return out;
+}
+
+/* Takes ownership of path; relative paths are joined onto base_dir when set. */
+static char *resolve_config_path(const char *base_dir, char *path) {
+  if (!base_dir || path[0] == '/') {
+    return path;
+  }
+  char *joined = join_path(base_dir, path);
+  free(path);
+  return joined;
+}
+
+static void free_parts(struct request *req) {
+  for (size_t i = 0; i < req->part_count; i++) {
+    struct request_part *part = &req->parts[i];
+    free(part->name);
+    free(part->type);
+    free(part->filename);
+    free(part->file);
+    free(part->value);
+  }
+  free(req->parts);
+  req->parts = NULL;
+  req->part_count = 0;
+}
+
+static int dup_optional_string(const char *json, jsmntok_t *toks, int obj, const char *key,
+                               char **out) {
+  int idx = find_object_value(json, toks, obj, key);
+  if (idx < 0) {
+    return 0;
+  }
+  *out = dup_token_string(json, &toks[idx]);
+  return *out ? 0 : -1;
+}
+
+static int parse_part(const char *json, jsmntok_t *toks, int index, const char *base_dir,
+                      size_t number, struct request_part *part) {
+  if (toks[index].type != JSMN_OBJECT) {
+    fprintf(err_stream(), "Invalid multipart part %zu: expected object (got %s).\n", number,
+            tok_type_name(toks[index].type));
+    return EXIT_REQUEST;
+  }
+  int value_idx = find_object_value(json, toks, index, "value");
+  int file_idx = find_object_value(json, toks, index, "file");
+  int stdin_idx = find_object_value(json, toks, index, "stdin");
+  if ((value_idx >= 0) + (file_idx >= 0) + (stdin_idx >= 0) != 1) {
+    fprintf(err_stream(), "Multipart part %zu needs exactly one of value, file or stdin.\n",
+            number);
+    return EXIT_REQUEST;
+  }
+  if (dup_optional_string(json, toks, index, "name", &part->name) != 0 || !part->name) {
+    fprintf(err_stream(), "Multipart part %zu needs a string name.\n", number);
+    return EXIT_REQUEST;
+  }
+  if (dup_optional_string(json, toks, index, "type", &part->type) != 0 ||
+      dup_optional_string(json, toks, index, "filename", &part->filename) != 0) {
+    fprintf(err_stream(), "Invalid type or filename in multipart part %zu.\n", number);
+    return EXIT_REQUEST;
+  }
+  if (value_idx >= 0) {
+    if (toks[value_idx].type == JSMN_STRING) {
+      part->value = dup_token_unescaped(json, &toks[value_idx], &part->value_len);
+    } else {
+      part->value = dup_token_raw(json, &toks[value_idx]);
+      part->value_len = part->value ? strlen(part->value) : 0;
+    }
+    if (!part->value) {
+      fprintf(err_stream(), "Invalid value in multipart part %zu.\n", number);
+      return EXIT_REQUEST;
+    }
+    return EXIT_OK;
+  }
+  if (stdin_idx >= 0) {
+    const jsmntok_t *tok = &toks[stdin_idx];
+    if (tok->type != JSMN_PRIMITIVE || json[tok->start] != 't') {
+      fprintf(err_stream(), "Invalid stdin in multipart part %zu: expected true.\n", number);
+      return EXIT_REQUEST;
+    }
+    part->from_stdin = true;
+    return EXIT_OK;
+  }
+  char *path = dup_token_string(json, &toks[file_idx]);
+  if (!path) {
+    fprintf(err_stream(), "Invalid file in multipart part %zu.\n", number);
+    return EXIT_REQUEST;
+  }
+  part->file = resolve_config_path(base_dir, path);
+  if (!part->file) {
+    fprintf(err_stream(), "Out of memory while reading multipart.\n");
+    return EXIT_CONFIG;
+  }
+  /* Checked now so a missing file is a config error, not a failed upload. */
+  FILE *fp = fopen(part->file, "rb");
+  if (!fp) {
+    fprintf(err_stream(), "Failed to read multipart file: %s\n", part->file);
+    return EXIT_CONFIG;
+  }
+  fclose(fp);
+  return EXIT_OK;
+}
+
+/* "multipart": [{"name", "value" | "file" | "stdin": true, "type", "filename"}, ...] */
+static int parse_multipart(const char *json, jsmntok_t *toks, int index, const char *base_dir,
+                           struct request *req) {
+  if (toks[index].type != JSMN_ARRAY || toks[index].size == 0) {
+    fprintf(err_stream(), "Invalid multipart: expected a non-empty array of parts.\n");
+    return EXIT_REQUEST;
+  }
+  req->parts = (struct request_part *)calloc((size_t)toks[index].size,
+                                             sizeof(struct request_part));
+  if (!req->parts) {
+    fprintf(err_stream(), "Out of memory while reading multipart.\n");
+    return EXIT_CONFIG;
+  }
+  bool have_stdin = false;
+  int i = index + 1;
+  for (int e = 0; e < toks[index].size; e++) {
+    struct request_part *part = &req->parts[req->part_count++];
+    int rc = parse_part(json, toks, i, base_dir, (size_t)e + 1, part);
+    if (rc != EXIT_OK) {
+      return rc;
+    }
+    if (part->from_stdin && have_stdin) {
+      fprintf(err_stream(), "Only one multipart part can read stdin.\n");
+      return EXIT_REQUEST;
+    }
+    have_stdin = have_stdin || part->from_stdin;
+    i = skip_token(toks, i);
+  }
+  return EXIT_OK;
+}
+
+static void print_parse_error(void) {
+  fprintf(err_stream(), "Invalid JSON structure.\n");
+}
+
+int request_load(const char *config_path, struct request *req) {
+  size_t json_len = 0;
+  char *json = read_file(config_path, &json_len);
+  if (!json) {
+    fprintf(err_stream(), "Failed to read file: %s\n", config_path);
+    return EXIT_CONFIG;
+  }
+  int rc = request_parse(json, json_len, NULL, req);
+  free(json);
+  return rc;
+}
+
+int request_parse(const char *json, size_t json_len, const char *base_dir,
+                  struct request *req) {
+  memset(req, 0, sizeof(*req));
+
+  jsmn_parser parser;
+  jsmntok_t *tokens = NULL;
+  int tok_count = 0;
+  if (ensure_tokens(&parser, json, json_len, &tokens, &tok_count) != 0) {
+    print_parse_error();
+    return EXIT_CONFIG;
+  }
+
+  if (tok_count < 1 || tokens[0].type != JSMN_OBJECT) {
+    free(tokens);
+    print_parse_error();
+    return EXIT_CONFIG;
+  }
+
+  int url_idx = find_object_value(json, tokens, 0, "url");
+  if (url_idx < 0) {
+    fprintf(err_stream(), "Missing required field: url\n");
+    free(tokens);
+    return EXIT_REQUEST;
+  }
+  req->url = dup_token_string(json, &tokens[url_idx]);
+  if (!req->url) {
+    fprintf(err_stream(), "Invalid url value.\n");
+    free(tokens);
+    return EXIT_REQUEST;
+  }
+
+  int method_idx = find_object_value(json, tokens, 0, "method");
+  if (method_idx >= 0) {
+    req->method = dup_token_string(json, &tokens[method_idx]);
+    if (!req->method) {
+      fprintf(err_stream(), "Invalid method value.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+  }
+
+  int payload_idx = find_object_value(json, tokens, 0, "payload");
+  if (payload_idx >= 0) {
+    if (tokens[payload_idx].type == JSMN_STRING) {
+      req->payload = dup_token_string(json, &tokens[payload_idx]);
+    } else {
+      req->payload = dup_token_raw(json, &tokens[payload_idx]);
+    }
+    if (!req->payload) {
+      fprintf(err_stream(), "Invalid payload value.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+  }
+
+  int payload_file_idx = find_object_value(json, tokens, 0, "payload_file");
+  if (payload_file_idx >= 0) {
+    if (req->payload) {
+      fprintf(err_stream(), "Use only one of payload or payload_file.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+    char *payload_path = dup_token_string(json, &tokens[payload_file_idx]);
+    if (!payload_path) {
+      fprintf(err_stream(), "Invalid payload_file value.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+    payload_path = resolve_config_path(base_dir, payload_path);
+    if (!payload_path) {
+      fprintf(err_stream(), "Out of memory while reading payload_file.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_CONFIG;
+    }
+    /* The length comes from the file, so binary bodies with NUL bytes survive. */
+    req->payload = read_file(payload_path, &req->payload_len);
+    if (!req->payload) {
+      fprintf(err_stream(), "Failed to read payload_file: %s\n", payload_path);
+      free(payload_path);
+      request_free(req);
+      free(tokens);
+      return EXIT_CONFIG;
+    }
+    free(payload_path);
+  } else if (req->payload) {
+    req->payload_len = strlen(req->payload);
+  }
+
+  int multipart_idx = find_object_value(json, tokens, 0, "multipart");
+  if (multipart_idx >= 0) {
+    if (req->payload) {
+      fprintf(err_stream(), "Use only one of payload, payload_file or multipart.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+    int rc = parse_multipart(json, tokens, multipart_idx, base_dir, req);
+    if (rc != EXIT_OK) {
+      request_free(req);
+      free(tokens);
+      return rc;
+    }
+  }
+
+  if (!req->method) {
+    req->method = dup_string(req->payload || req->part_count ? "POST" : "GET");
+    if (!req->method) {
+      fprintf(err_stream(), "Failed to set method.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+  }
+
+  bool has_query = strchr(req->url, '?') != NULL;
+  struct curl_ctx ctx = {
+    .url = &req->url,
+    .has_query = &has_query,
+    .headers = &req->headers
+  };
+
+  int path_idx = find_object_value(json, tokens, 0, "path_params");
+  int query_idx = find_object_value(json, tokens, 0, "query_params");
+  int headers_idx = find_object_value(json, tokens, 0, "headers");
+  if (iterate_kv(json, tokens, path_idx, "path_params", apply_path_param, &ctx) != 0 ||
+      iterate_kv(json, tokens, query_idx, "query_params", apply_query_param, &ctx) != 0 ||
+      iterate_kv(json, tokens, headers_idx, "headers", apply_header, &ctx) != 0) {
+    request_free(req);
+    free(tokens);
+    return EXIT_REQUEST;
+  }
+
+  int resolve_idx = find_object_value(json, tokens, 0, "resolve");
+  if (resolve_idx >= 0 && parse_resolve(json, tokens, resolve_idx, req) != 0) {
+    request_free(req);
+    free(tokens);
+    return EXIT_REQUEST;
+  }
+
+  int socket_idx = find_object_value(json, tokens, 0, "unix_socket");
+  if (socket_idx >= 0) {
+    char *socket_path = dup_token_string(json, &tokens[socket_idx]);
+    if (!socket_path || socket_path[0] == '\0') {
+      fprintf(err_stream(), "Invalid unix_socket value.\n");
+      free(socket_path);
+      request_free(req);
+      free(tokens);
+      return EXIT_REQUEST;
+    }
+    req->unix_socket = resolve_config_path(base_dir, socket_path);
+    if (!req->unix_socket) {
+      fprintf(err_stream(), "Out of memory while reading unix_socket.\n");
+      request_free(req);
+      free(tokens);
+      return EXIT_CONFIG;
+    }
+  }
+  free(tokens);
+
+  int rc = compile_generators(req);
+  if (rc != EXIT_OK) {
+    request_free(req);
+  }
+  return rc;
+}
+
+int request_add_resolve(struct request *req, const char *entry) {
+  const char *port = strchr(entry, ':');
+  const char *addr = port ? strchr(port + 1, ':') : NULL;
+  if (!port || port == entry || !addr || addr == port + 1 || addr[1] == '\0') {
+    fprintf(err_stream(), "Invalid resolve entry '%s': expected host:port:address.\n", entry);
+    return -1;
+  }
+  struct curl_slist *next = curl_slist_append(req->resolve, entry);
+  if (!next) {
+    fprintf(err_stream(), "Out of memory while reading resolve.\n");
+    return -1;
+  }
+  req->resolve = next;
+  return 0;
+}
+
+int request_set_unix_socket(struct request *req, const char *path) {
+  if (path[0] == '\0') {
+    fprintf(err_stream(), "Invalid unix socket path: empty.\n");
+    return -1;
+  }
+  char *copy = dup_string(path);
+  if (!copy) {
+    fprintf(err_stream(), "Out of memory while reading unix socket path.\n");
+    return -1;
+  }
+  free(req->unix_socket);
+  req->unix_socket = copy;
+  return 0;
+}
+
+void request_apply(CURL *curl, const struct request *req) {
+  curl_easy_setopt(curl, CURLOPT_URL, req->url);
+  /* Set even when NULL, so a reused handle goes back to TCP. */
+  curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, req->unix_socket);
+  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, req->method);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->headers);
+  if (req->resolve) {
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, req->resolve);
+  }
+  if (req->payload) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->payload);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)req->payload_len);
+  }
+}
+
+static size_t read_stdin(char *buffer, size_t size, size_t nitems, void *arg) {
+  (void)arg;
+  size_t n = fread(buffer, 1, size * nitems, stdin);
+  return n == 0 && ferror(stdin) ? CURL_READFUNC_ABORT : n;
+}
+
+curl_mime *request_mime(CURL *curl, const struct request *req) {
+  curl_mime *mime = curl_mime_init(curl);
+  if (!mime) {
+    fprintf(err_stream(), "Out of memory while building multipart body.\n");
+    return NULL;
+  }
+  for (size_t i = 0; i < req->part_count; i++) {
+    const struct request_part *src = &req->parts[i];
+    curl_mimepart *part = curl_mime_addpart(mime);
+    CURLcode rc = part ? curl_mime_name(part, src->name) : CURLE_OUT_OF_MEMORY;
+    if (rc == CURLE_OK) {
+      if (src->file) {
+        rc = curl_mime_filedata(part, src->file);
+      } else if (src->from_stdin) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        /* Unknown size: the body goes out with chunked encoding. */
+        rc = curl_mime_data_cb(part, -1, read_stdin, NULL, NULL, NULL);
+      } else {
+        rc = curl_mime_data(part, src->value, src->value_len);
+      }
+    }
+    if (rc == CURLE_OK && src->filename) {
+      rc = curl_mime_filename(part, src->filename);
+    }
+    if (rc == CURLE_OK && src->type) {
+      rc = curl_mime_type(part, src->type);
+    }
+    if (rc != CURLE_OK) {
+      fprintf(err_stream(), "Failed to build multipart part '%s': %s\n", src->name,
+              curl_easy_strerror(rc));
+      curl_mime_free(mime);
+      return NULL;
+    }
+  }
+  curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+  return mime;
+}
+
+bool request_reads_stdin(const struct request *req) {
+  for (size_t i = 0; i < req->part_count; i++) {
+    if (req->parts[i].from_stdin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct request_render {
+  char *url;
+  char *payload;
+  struct curl_slist *headers; /* header_count nodes; static lines point into req */
+  char *header_text;
+};
+
+struct request_render *request_render_new(const struct request *req) {
+  const struct request_gen *gen = req->gen;
+  struct request_render *render =
+      (struct request_render *)calloc(1, sizeof(struct request_render));
+  if (!render) {
+    return NULL;
+  }
+  bool ok = true;
+  if (gen->url) {
+    ok = (render->url = (char *)malloc(gen_max_len(gen->url) + 1)) != NULL;
+  }
+  if (ok && gen->payload) {
+    ok = (render->payload = (char *)malloc(gen_max_len(gen->payload) + 1)) != NULL;
+  }
+  if (ok && gen->any_header) {
+    size_t text_len = 0;
+    for (size_t i = 0; i < gen->header_count; i++) {
+      text_len += gen->headers[i] ? gen_max_len(gen->headers[i]) + 1 : 0;
+    }
+    render->headers = (struct curl_slist *)calloc(gen->header_count, sizeof(struct curl_slist));
+    render->header_text = (char *)malloc(text_len);
+    ok = render->headers && render->header_text;
+  }
+  if (!ok) {
+    request_render_free(render);
+    return NULL;
+  }
+  if (gen->any_header) {
+    char *text = render->header_text;
+    const struct curl_slist *src = req->headers;
+    for (size_t i = 0; i < gen->header_count; i++, src = src->next) {
+      if (gen->headers[i]) {
+        render->headers[i].data = text;
+        text += gen_max_len(gen->headers[i]) + 1;
+      } else {
+        render->headers[i].data = src->data;
+      }
+      render->headers[i].next = i + 1 < gen->header_count ? &render->headers[i + 1] : NULL;
+    }
+  }
+  return render;
+}
+
+void request_render(CURL *curl, const struct request *req, struct request_render *render,
+                    struct gen_rng *rng, uint64_t seq) {
+  const struct request_gen *gen = req->gen;
+  if (gen->url) {
+    render->url[gen_render(gen->url, rng, seq, render->url)] = '\0';
+    curl_easy_setopt(curl, CURLOPT_URL, render->url);
+  }
+  if (gen->payload) {
+    size_t len = gen_render(gen->payload, rng, seq, render->payload);
+    render->payload[len] = '\0';
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, render->payload);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)len);
+  }
+  if (gen->any_header) {
+    for (size_t i = 0; i < gen->header_count; i++) {
+      if (gen->headers[i]) {
+        char *line = render->headers[i].data;
+        line[gen_render(gen->headers[i], rng, seq, line)] = '\0';
+      }
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, render->headers);
+  }
+}
+
+void request_render_free(struct request_render *render) {
+  if (!render) {
+    return;
+  }
+  free(render->url);
+  free(render->payload);
+  free(render->headers);
+  free(render->header_text);
+  free(render);
+}
+
+const char *request_render_url(const struct request_render *render) {
+  return render->url;
+}
+
+static char *render_string(const struct gen_template *t, struct gen_rng *rng, uint64_t seq,
+                           size_t *len_out) {
+  char *out = (char *)malloc(gen_max_len(t) + 1);
+  if (out) {
+    size_t len = gen_render(t, rng, seq, out);
+    out[len] = '\0';
+    if (len_out) {
+      *len_out = len;
+    }
+  }
+  return out;
+}
+
+int request_expand(struct request *req, uint64_t seq) {
+  struct request_gen *gen = req->gen;
+  if (!gen) {
+    return EXIT_OK;
+  }
+  struct gen_rng rng;
+  gen_rng_seed(&rng, now_ns() ^ (wall_clock_ms() << 20));
+  bool ok = true;
+  if (gen->url) {
+    char *url = render_string(gen->url, &rng, seq, NULL);
+    if ((ok = url != NULL)) {
+      free(req->url);
+      req->url = url;
+    }
+  }
+  if (ok && gen->payload) {
+    char *payload = render_string(gen->payload, &rng, seq, &req->payload_len);
+    if ((ok = payload != NULL)) {
+      free(req->payload);
+      req->payload = payload;
+    }
+  }
+  if (ok && gen->any_header) {
+    struct curl_slist *headers = NULL;
+    size_t i = 0;
+    for (const struct curl_slist *h = req->headers; h && ok; h = h->next, i++) {
+      char *line = gen->headers[i] ? render_string(gen->headers[i], &rng, seq, NULL) : NULL;
+      struct curl_slist *next = NULL;
+      if (line || !gen->headers[i]) {
+        next = curl_slist_append(headers, line ? line : h->data);
+      }
+      free(line);
+      if ((ok = next != NULL)) {
+        headers = next;
+      }
+    }
+    if (ok) {
+      curl_slist_free_all(req->headers);
+      req->headers = headers;
+    } else {
+      curl_slist_free_all(headers);
+    }
+  }
+  if (!ok) {
+    fprintf(err_stream(), "Out of memory while rendering generators.\n");
+    return EXIT_REQUEST;
+  }
+  request_gen_free(gen);
+  req->gen = NULL;
+  return EXIT_OK;
+}
+
+static bool substitute_string(char **text, const char *placeholder, const char *value) {
+  char *replaced = replace_all(*text, placeholder, value);
+  if (!replaced) {
+    return false;
+  }
+  free(*text);
+  *text = replaced;
+  return true;
+}
+
+static bool substitute_headers(struct curl_slist **headers, const char *placeholder,
+                               const char *value) {
+  struct curl_slist *out = NULL;
+  for (const struct curl_slist *h = *headers; h; h = h->next) {
+    char *line = replace_all(h->data, placeholder, value);
+    struct curl_slist *next = line ? curl_slist_append(out, line) : NULL;
+    free(line);
+    if (!next) {
+      curl_slist_free_all(out);
+      return false;
+    }
+    out = next;
+  }
+  curl_slist_free_all(*headers);
+  *headers = out;
+  return true;
+}
+
+int request_substitute(struct request *req, const struct request_var *vars, size_t count) {
+  bool ok = true;
+  for (size_t i = 0; ok && i < count; i++) {
+    size_t placeholder_len = strlen(vars[i].name) + sizeof("%7B%7D");
+    char *placeholder = (char *)malloc(placeholder_len);
+    char *escaped = escape_value(vars[i].value);
+    ok = placeholder && escaped;
+    if (ok) {
+      snprintf(placeholder, placeholder_len, "{%s}", vars[i].name);
+      ok = substitute_string(&req->url, placeholder, escaped) &&
+           substitute_headers(&req->headers, placeholder, vars[i].value);
+    }
+    /* Binary bodies (payload_file with NUL bytes) are left alone. */
+    if (ok && req->payload && strlen(req->payload) == req->payload_len) {
+      ok = substitute_string(&req->payload, placeholder, vars[i].value);
+      req->payload_len = ok ? strlen(req->payload) : req->payload_len;
+    }
+    if (ok) {
+      /* query_params escaped the braces along with the rest of the value. */
+      snprintf(placeholder, placeholder_len, "%%7B%s%%7D", vars[i].name);
+      ok = substitute_string(&req->url, placeholder, escaped);
+    }
+    free(placeholder);
+    free(escaped);
+  }
+  if (!ok) {
+    fprintf(err_stream(), "Out of memory while filling in captured values.\n");
+    return EXIT_REQUEST;
+  }
+  return EXIT_OK;
+}
+
+void request_free(struct request *req) {
+  request_gen_free(req->gen);
+  free_parts(req);
+  curl_slist_free_all(req->headers);
+  curl_slist_free_all(req->resolve);
+  free(req->unix_socket);
+  free(req->payload);
+  free(req->method);
+  free(req->url);
+  memset(req, 0, sizeof(*req));
+}
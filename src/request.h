@@ -0,0 +1,102 @@
+#ifndef PINGA_REQUEST_H
+#define PINGA_REQUEST_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "generate.h"
+
+struct request_gen;
+
+/* One multipart/form-data part: exactly one of value, file or stdin. */
+struct request_part {
+  char *name;
+  char *type;     /* Content-Type, optional */
+  char *filename; /* optional; file parts default to the file's base name */
+  char *file;     /* streamed from disk while sending */
+  char *value;
+  size_t value_len;
+  bool from_stdin; /* streamed from stdin, sent chunked */
+};
+
+/*
+ * A request config resolved into what libcurl needs: the final url (path and
+ * query params applied), method, header list and body. Built once and then
+ * applied to as many easy handles as needed.
+ */
+struct request {
+  char *url;
+  char *method;
+  char *payload;
+  size_t payload_len;
+  struct curl_slist *headers;
+  struct curl_slist *resolve; /* CURLOPT_RESOLVE entries, host:port:addr */
+  char *unix_socket;          /* connect here instead of the url's host; NULL for TCP */
+  struct request_part *parts; /* multipart body, instead of payload */
+  size_t part_count;
+  struct request_gen *gen;    /* generator placeholders; NULL when there are none */
+};
+
+/*
+ * Both return an EXIT_* code and report problems on err_stream(). A relative
+ * payload_file is resolved against base_dir, or the working directory when
+ * base_dir is NULL.
+ */
+int request_load(const char *config_path, struct request *req);
+int request_parse(const char *json, size_t json_len, const char *base_dir,
+                  struct request *req);
+
+/* Appends a host:port:addr override; later entries win over earlier ones. */
+int request_add_resolve(struct request *req, const char *entry);
+/*
+ * Sends the request over a Unix domain socket; the url still supplies the
+ * Host header, path and query. Replaces any unix_socket from the config.
+ */
+int request_set_unix_socket(struct request *req, const char *path);
+
+void request_apply(CURL *curl, const struct request *req);
+void request_free(struct request *req);
+
+/*
+ * Builds the multipart body (req->parts) for one easy handle and sets
+ * CURLOPT_MIMEPOST. Nothing is buffered: file parts are read in chunks as
+ * the upload goes out. Free the result with curl_mime_free() once the handle
+ * is done. Returns NULL after reporting a failure.
+ */
+curl_mime *request_mime(CURL *curl, const struct request *req);
+/* True when a part reads stdin, which can only be sent once. */
+bool request_reads_stdin(const struct request *req);
+
+/*
+ * Per-handle buffers for a request with generators (req->gen set), sized
+ * once so that request_render() fills in fresh values without allocating.
+ * request_render() goes after request_apply() and replaces the url, body
+ * and headers that contain placeholders.
+ */
+struct request_render;
+
+struct request_render *request_render_new(const struct request *req);
+void request_render(CURL *curl, const struct request *req, struct request_render *render,
+                    struct gen_rng *rng, uint64_t seq);
+void request_render_free(struct request_render *render);
+/* The url from the last request_render(), or NULL when the url is static. */
+const char *request_render_url(const struct request_render *render);
+
+/* Renders the placeholders into req itself, for one-shot requests. */
+int request_expand(struct request *req, uint64_t seq);
+
+struct request_var {
+  const char *name;
+  const char *value;
+};
+
+/*
+ * Fills {name} placeholders left in a parsed request, the way path_params
+ * do: escaped in the url (query_params included), as is in header lines and
+ * a text payload. Returns an EXIT_* code.
+ */
+int request_substitute(struct request *req, const struct request_var *vars, size_t count);
+
+#endif
@@ -0,0 +1,277 @@
+#include "response.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "util.h"
+
+size_t write_stdout(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  FILE *out = userdata ? (FILE *)userdata : stdout;
+  return fwrite(ptr, size, nmemb, out);
+}
+
+size_t write_discard(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  (void)ptr;
+  (void)userdata;
+  return size * nmemb;
+}
+
+size_t write_buffer(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  struct response_buffer *buf = (struct response_buffer *)userdata;
+  size_t total = size * nmemb;
+  char *next = (char *)realloc(buf->data, buf->len + total + 1);
+  if (!next) {
+    return 0;
+  }
+  memcpy(next + buf->len, ptr, total);
+  buf->data = next;
+  buf->len += total;
+  buf->data[buf->len] = '\0';
+  return total;
+}
+
+static size_t body_limit = RESPONSE_BODY_LIMIT;
+static size_t total_limit = RESPONSE_TOTAL_LIMIT;
+static atomic_size_t held; /* cap of every in-memory body, all threads */
+
+void response_set_budget(size_t per_body, size_t total) {
+  body_limit = per_body;
+  total_limit = total;
+}
+
+static bool spill_body(struct response_buffer *buf) {
+  buf->spill = temp_file();
+  if (!buf->spill) {
+    fprintf(err_stream(), "Failed to create a temp file for a large response body.\n");
+    return false;
+  }
+  if (buf->len && fwrite(buf->data, 1, buf->len, buf->spill) != buf->len) {
+    return false;
+  }
+  free(buf->data);
+  buf->data = NULL;
+  atomic_fetch_sub(&held, buf->cap);
+  buf->cap = 0;
+  return true;
+}
+
+/* Grows buf to hold need bytes if both limits allow it. */
+static bool reserve_body(struct response_buffer *buf, size_t need) {
+  if (need > body_limit) {
+    return false;
+  }
+  size_t cap = buf->cap ? buf->cap : 16384;
+  while (cap < need) {
+    cap *= 2;
+  }
+  if (cap > body_limit) {
+    cap = body_limit;
+  }
+  size_t grow = cap - buf->cap;
+  if (atomic_fetch_add(&held, grow) + grow > total_limit) {
+    atomic_fetch_sub(&held, grow);
+    return false;
+  }
+  char *next = (char *)realloc(buf->data, cap);
+  if (!next) {
+    atomic_fetch_sub(&held, grow);
+    return false;
+  }
+  buf->data = next;
+  buf->cap = cap;
+  return true;
+}
+
+size_t write_body(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  struct response_buffer *buf = (struct response_buffer *)userdata;
+  size_t total = size * nmemb;
+  if (!buf->spill && buf->len + total + 1 > buf->cap &&
+      !reserve_body(buf, buf->len + total + 1) && !spill_body(buf)) {
+    return 0;
+  }
+  if (buf->spill) {
+    if (fwrite(ptr, 1, total, buf->spill) != total) {
+      return 0;
+    }
+    buf->len += total;
+    return total;
+  }
+  memcpy(buf->data + buf->len, ptr, total);
+  buf->len += total;
+  buf->data[buf->len] = '\0';
+  return total;
+}
+
+void response_buffer_free(struct response_buffer *buf) {
+  free(buf->data);
+  atomic_fetch_sub(&held, buf->cap);
+  if (buf->spill) {
+    fclose(buf->spill);
+  }
+  memset(buf, 0, sizeof(*buf));
+}
+
+void header_list_free(struct header_list *list) {
+  for (size_t i = 0; i < list->count; i++) {
+    free(list->items[i].name);
+    free(list->items[i].value);
+  }
+  free(list->items);
+  list->items = NULL;
+  list->count = 0;
+  list->cap = 0;
+}
+
+int header_list_append(struct header_list *list, const char *name, const char *value) {
+  if (list->count == list->cap) {
+    size_t next_cap = list->cap == 0 ? 8 : list->cap * 2;
+    struct header_entry *next = (struct header_entry *)realloc(
+        list->items, next_cap * sizeof(struct header_entry));
+    if (!next) {
+      return -1;
+    }
+    list->items = next;
+    list->cap = next_cap;
+  }
+  list->items[list->count].name = dup_string(name);
+  list->items[list->count].value = dup_string(value);
+  if (!list->items[list->count].name || !list->items[list->count].value) {
+    free(list->items[list->count].name);
+    free(list->items[list->count].value);
+    return -1;
+  }
+  list->count++;
+  return 0;
+}
+
+size_t write_header(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  struct response_headers *resp = (struct response_headers *)userdata;
+  size_t total = size * nmemb;
+  char *line = (char *)malloc(total + 1);
+  if (!line) {
+    return 0;
+  }
+  memcpy(line, ptr, total);
+  line[total] = '\0';
+  while (total > 0 && (line[total - 1] == '\n' || line[total - 1] == '\r')) {
+    line[--total] = '\0';
+  }
+  if (total == 0) {
+    free(line);
+    return size * nmemb;
+  }
+  if (strncmp(line, "HTTP/", 5) == 0) {
+    free(resp->status_line);
+    resp->status_line = dup_string(line);
+    free(line);
+    return size * nmemb;
+  }
+  char *colon = strchr(line, ':');
+  if (!colon) {
+    free(line);
+    return size * nmemb;
+  }
+  *colon = '\0';
+  char *name = line;
+  char *value = colon + 1;
+  while (*value == ' ' || *value == '\t') {
+    value++;
+  }
+  trim_whitespace(name);
+  trim_whitespace(value);
+  header_list_append(&resp->headers, name, value);
+  free(line);
+  return size * nmemb;
+}
+
+void print_json_response(FILE *out, long status, const char *status_line,
+                         const struct header_list *headers,
+                         const struct response_buffer *body, const char *extra) {
+  const char *status_src = status_line ? status_line : "";
+  char *status_esc = json_escape(status_src);
+  if (!status_esc) {
+    return;
+  }
+  fprintf(out, "{\"status\":%ld,\"status_text\":\"%s\",\"headers\":[", status, status_esc);
+  free(status_esc);
+  for (size_t i = 0; i < headers->count; i++) {
+    char *name_esc = json_escape(headers->items[i].name);
+    char *value_esc = json_escape(headers->items[i].value);
+    if (!name_esc || !value_esc) {
+      free(name_esc);
+      free(value_esc);
+      return;
+    }
+    if (i > 0) {
+      fputc(',', out);
+    }
+    fprintf(out, "{\"name\":\"%s\",\"value\":\"%s\"}", name_esc, value_esc);
+    free(name_esc);
+    free(value_esc);
+  }
+  fprintf(out, "],\"body\":");
+  print_json_body(out, body);
+  if (extra && *extra) {
+    fprintf(out, ",%s", extra);
+  }
+  fprintf(out, "}\n");
+}
+
+/* Reads a spilled body twice: once to check it, once to copy it out. */
+static void print_spilled_body(FILE *out, FILE *spill) {
+  char chunk[16384];
+  struct json_check check;
+  json_check_init(&check);
+  bool valid = true;
+  size_t n;
+  rewind(spill);
+  while (valid && (n = fread(chunk, 1, sizeof(chunk), spill)) > 0) {
+    valid = json_check_feed(&check, chunk, n);
+  }
+  valid = valid && json_check_finish(&check);
+  rewind(spill);
+  if (!valid) {
+    fputc('"', out);
+  }
+  while ((n = fread(chunk, 1, sizeof(chunk), spill)) > 0) {
+    if (valid) {
+      fwrite(chunk, 1, n, out);
+    } else {
+      json_write_escaped(out, chunk, n);
+    }
+  }
+  if (!valid) {
+    fputc('"', out);
+  }
+}
+
+bool write_raw_body(FILE *out, const struct response_buffer *body) {
+  if (!body->spill) {
+    return body->len == 0 || fwrite(body->data, 1, body->len, out) == body->len;
+  }
+  char chunk[16384];
+  size_t n;
+  bool ok = true;
+  rewind(body->spill);
+  while (ok && (n = fread(chunk, 1, sizeof(chunk), body->spill)) > 0) {
+    ok = fwrite(chunk, 1, n, out) == n;
+  }
+  return ok && !ferror(body->spill);
+}
+
+void print_json_body(FILE *out, const struct response_buffer *body) {
+  if (body && body->spill) {
+    print_spilled_body(out, body->spill);
+  } else if (body && body->len > 0 && is_valid_json(body->data, body->len)) {
+    fwrite(body->data, 1, body->len, out);
+  } else {
+    fputc('"', out);
+    if (body && body->len > 0) {
+      json_write_escaped(out, body->data, body->len);
+    }
+    fputc('"', out);
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef PINGA_RESPONSE_H
+#define PINGA_RESPONSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Defaults for response_set_budget. */
+#define RESPONSE_BODY_LIMIT (8u << 20)
+#define RESPONSE_TOTAL_LIMIT (64u << 20)
+
+struct response_buffer {
+  char *data;
+  size_t len;
+  size_t cap;  /* write_body: bytes charged against the memory budget */
+  FILE *spill; /* write_body: the body, once it moved to a temp file */
+};
+
+struct header_entry {
+  char *name;
+  char *value;
+};
+
+struct header_list {
+  struct header_entry *items;
+  size_t count;
+  size_t cap;
+};
+
+struct response_headers {
+  struct header_list headers;
+  char *status_line;
+};
+
+size_t write_stdout(void *ptr, size_t size, size_t nmemb, void *userdata);
+size_t write_discard(void *ptr, size_t size, size_t nmemb, void *userdata);
+size_t write_buffer(void *ptr, size_t size, size_t nmemb, void *userdata);
+/*
+ * Like write_buffer, but memory is bounded: a body that would pass the
+ * per-body limit, or push all bodies held by the process past the total,
+ * moves to an unlinked temp file and the rest of it is appended there.
+ */
+size_t write_body(void *ptr, size_t size, size_t nmemb, void *userdata);
+void response_set_budget(size_t per_body, size_t total);
+void response_buffer_free(struct response_buffer *buf);
+size_t write_header(void *ptr, size_t size, size_t nmemb, void *userdata);
+
+void header_list_free(struct header_list *list);
+int header_list_append(struct header_list *list, const char *name, const char *value);
+
+/* The body bytes as received, from memory or its temp file. False on a write error. */
+bool write_raw_body(FILE *out, const struct response_buffer *body);
+/* The body as a JSON value: as is when it is valid JSON, else a string. */
+void print_json_body(FILE *out, const struct response_buffer *body);
+/* `extra` holds additional envelope members (`"key":value,...`) or NULL. */
+void print_json_response(FILE *out, long status, const char *status_line,
+                         const struct header_list *headers,
+                         const struct response_buffer *body, const char *extra);
+
+#endif
@@ -0,0 +1,228 @@
+#include "scenario.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "util.h"
+
+#define MAX_SCENARIO_TOKENS 8192
+
+static int find_entry(const struct scenario *s, const char *name, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    if (strcmp(s->entries[i].name, name) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static bool parse_weight(const char *json, const jsmntok_t *tok, double *out) {
+  if (tok->type != JSMN_PRIMITIVE) {
+    return false;
+  }
+  char *text = dup_token_raw(json, tok);
+  char *end = NULL;
+  double value = text ? strtod(text, &end) : 0.0;
+  bool ok = end && *end == '\0' && value > 0.0 && value < 1e12;
+  free(text);
+  *out = value;
+  return ok;
+}
+
+static int load_entry(const char *path, const char *json, jsmntok_t *toks, int index,
+                      unsigned k, struct scenario_entry *e, double *weight,
+                      const char *const *resolve, int resolve_count) {
+  int config_idx =
+      toks[index].type == JSMN_OBJECT ? find_object_value(json, toks, index, "config") : -1;
+  char *config = config_idx >= 0 && toks[config_idx].type == JSMN_STRING
+                     ? dup_token_string(json, &toks[config_idx])
+                     : NULL;
+  if (!config) {
+    fprintf(err_stream(), "Scenario entry %u needs a config file.\n", k + 1);
+    return EXIT_REQUEST;
+  }
+  int name_idx = find_object_value(json, toks, index, "name");
+  e->name = name_idx >= 0 && toks[name_idx].type == JSMN_STRING
+                ? dup_token_string(json, &toks[name_idx])
+                : dup_string(config);
+  e->config = path_beside(path, config);
+  free(config);
+  if (!e->name || !e->config) {
+    fprintf(err_stream(), "Out of memory while reading the scenario.\n");
+    return EXIT_REQUEST;
+  }
+  int weight_idx = find_object_value(json, toks, index, "weight");
+  if (weight_idx < 0 || !parse_weight(json, &toks[weight_idx], weight)) {
+    fprintf(err_stream(), "Scenario entry '%s' needs a positive numeric weight.\n", e->name);
+    return EXIT_REQUEST;
+  }
+  int rc = request_load(e->config, &e->req);
+  if (rc != EXIT_OK) {
+    fprintf(err_stream(), "In scenario entry '%s' (%s).\n", e->name, e->config);
+    return rc;
+  }
+  if (request_reads_stdin(&e->req)) {
+    fprintf(err_stream(),
+            "Scenario entry '%s': multipart stdin parts apply to single requests only.\n",
+            e->name);
+    return EXIT_REQUEST;
+  }
+  for (int i = 0; i < resolve_count; i++) {
+    if (request_add_resolve(&e->req, resolve[i]) != 0) {
+      return EXIT_REQUEST;
+    }
+  }
+  return EXIT_OK;
+}
+
+/*
+ * Vose's alias method: scale every share by n, then repeatedly pair an
+ * underfull column with an overfull entry that tops it up to exactly 1.
+ */
+static int build_alias(struct scenario *s) {
+  unsigned n = s->count;
+  double *scaled = (double *)malloc(n * sizeof(double));
+  unsigned *small = (unsigned *)malloc(n * sizeof(unsigned));
+  unsigned *large = (unsigned *)malloc(n * sizeof(unsigned));
+  s->threshold = (uint64_t *)malloc(n * sizeof(uint64_t));
+  s->alias = (unsigned *)malloc(n * sizeof(unsigned));
+  int rc = EXIT_OK;
+  if (!scaled || !small || !large || !s->threshold || !s->alias) {
+    fprintf(err_stream(), "Out of memory while reading the scenario.\n");
+    rc = EXIT_REQUEST;
+  } else {
+    unsigned small_n = 0;
+    unsigned large_n = 0;
+    for (unsigned i = 0; i < n; i++) {
+      scaled[i] = s->entries[i].share * n;
+      if (scaled[i] < 1.0) {
+        small[small_n++] = i;
+      } else {
+        large[large_n++] = i;
+      }
+    }
+    while (small_n && large_n) {
+      unsigned lo = small[--small_n];
+      unsigned hi = large[--large_n];
+      s->threshold[lo] = (uint64_t)(scaled[lo] * 4294967296.0);
+      s->alias[lo] = hi;
+      scaled[hi] -= 1.0 - scaled[lo];
+      if (scaled[hi] < 1.0) {
+        small[small_n++] = hi;
+      } else {
+        large[large_n++] = hi;
+      }
+    }
+    /* Whatever is left is 1 up to rounding: always keep the column. */
+    while (large_n) {
+      unsigned i = large[--large_n];
+      s->threshold[i] = 1ull << 32;
+      s->alias[i] = i;
+    }
+    while (small_n) {
+      unsigned i = small[--small_n];
+      s->threshold[i] = 1ull << 32;
+      s->alias[i] = i;
+    }
+  }
+  free(scaled);
+  free(small);
+  free(large);
+  return rc;
+}
+
+int scenario_load(const char *path, const char *const *resolve, int resolve_count,
+                  struct scenario **out) {
+  *out = NULL;
+  size_t len = 0;
+  char *json = read_file(path, &len);
+  if (!json) {
+    fprintf(err_stream(), "Failed to read file: %s\n", path);
+    return EXIT_CONFIG;
+  }
+  jsmn_parser parser;
+  jsmntok_t *toks = NULL;
+  int count = 0;
+  int mix_idx = -1;
+  if (ensure_tokens_max(&parser, json, len, MAX_SCENARIO_TOKENS, &toks, &count) != 0 ||
+      count < 1 || toks[0].type != JSMN_OBJECT ||
+      (mix_idx = find_object_value(json, toks, 0, "mix")) < 0 ||
+      toks[mix_idx].type != JSMN_ARRAY || toks[mix_idx].size == 0) {
+    fprintf(err_stream(), "Invalid scenario: expected {\"mix\": [...]} in %s\n", path);
+    free(toks);
+    free(json);
+    return EXIT_CONFIG;
+  }
+  unsigned n = (unsigned)toks[mix_idx].size;
+  if (n > SCENARIO_MAX_ENTRIES) {
+    fprintf(err_stream(), "A scenario mixes at most %d configs.\n", SCENARIO_MAX_ENTRIES);
+    free(toks);
+    free(json);
+    return EXIT_REQUEST;
+  }
+  struct scenario *s = (struct scenario *)calloc(1, sizeof(struct scenario));
+  double *weights = (double *)calloc(n, sizeof(double));
+  if (s) {
+    s->entries = (struct scenario_entry *)calloc(n, sizeof(struct scenario_entry));
+  }
+  if (!s || !s->entries || !weights) {
+    fprintf(err_stream(), "Out of memory while reading the scenario.\n");
+    free(weights);
+    scenario_free(s);
+    free(toks);
+    free(json);
+    return EXIT_REQUEST;
+  }
+  int rc = EXIT_OK;
+  double total = 0.0;
+  int i = mix_idx + 1;
+  for (unsigned k = 0; k < n && rc == EXIT_OK; k++, i = skip_token(toks, i)) {
+    s->count = k + 1;
+    rc = load_entry(path, json, toks, i, k, &s->entries[k], &weights[k], resolve,
+                    resolve_count);
+    if (rc == EXIT_OK && find_entry(s, s->entries[k].name, k) >= 0) {
+      fprintf(err_stream(), "Duplicate scenario entry name '%s'.\n", s->entries[k].name);
+      rc = EXIT_REQUEST;
+    }
+    total += weights[k];
+  }
+  free(toks);
+  free(json);
+  if (rc == EXIT_OK) {
+    for (unsigned k = 0; k < n; k++) {
+      s->entries[k].share = weights[k] / total;
+    }
+    rc = build_alias(s);
+  }
+  free(weights);
+  if (rc != EXIT_OK) {
+    scenario_free(s);
+    return rc;
+  }
+  *out = s;
+  return EXIT_OK;
+}
+
+unsigned scenario_pick(const struct scenario *s, uint64_t random) {
+  /* High half picks the column (multiply-shift, no modulo), low half flips the coin. */
+  unsigned column = (unsigned)(((random >> 32) * s->count) >> 32);
+  return (random & 0xffffffffu) < s->threshold[column] ? column : s->alias[column];
+}
+
+void scenario_free(struct scenario *s) {
+  if (!s) {
+    return;
+  }
+  for (unsigned i = 0; i < s->count; i++) {
+    free(s->entries[i].name);
+    free(s->entries[i].config);
+    request_free(&s->entries[i].req);
+  }
+  free(s->entries);
+  free(s->threshold);
+  free(s->alias);
+  free(s);
+}
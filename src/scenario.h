@@ -0,0 +1,44 @@
+#ifndef PINGA_SCENARIO_H
+#define PINGA_SCENARIO_H
+
+#include <stdint.h>
+
+#include "request.h"
+
+#define SCENARIO_MAX_ENTRIES 256
+
+/*
+ * A scenario file mixes existing request configs by weight:
+ *
+ *   {"mix": [
+ *     {"config": "read.json", "weight": 70},
+ *     {"config": "search.json", "weight": 25, "name": "search"},
+ *     {"config": "write.json", "weight": 5}
+ *   ]}
+ *
+ * Every config is loaded once up front; a load run then draws the config of
+ * each request from a Vose alias table, one random number per draw.
+ */
+struct scenario_entry {
+  char *name; /* defaults to the config path as written */
+  char *config;
+  double share; /* weight / sum of weights */
+  struct request req;
+};
+
+struct scenario {
+  struct scenario_entry *entries;
+  unsigned count;
+  /* Column i yields i when the 32-bit coin is below threshold[i], else alias[i]. */
+  uint64_t *threshold;
+  unsigned *alias;
+};
+
+/* Returns an EXIT_* code; configs resolve relative to the scenario file. */
+int scenario_load(const char *path, const char *const *resolve, int resolve_count,
+                  struct scenario **out);
+/* Maps one uniform random 64-bit value to an entry index. */
+unsigned scenario_pick(const struct scenario *s, uint64_t random);
+void scenario_free(struct scenario *s);
+
+#endif
@@ -0,0 +1,53 @@
+#include "single.h"
+
+#include <stdlib.h>
+
+#include "util.h"
+
+void single_setup(CURL *curl, struct single_run *run) {
+  if (run->capture || (!run->opts.use_exit_codes && run->opts.include_headers)) {
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &run->headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &run->body);
+  } else if (run->opts.use_exit_codes) {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_discard);
+  } else {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_stdout);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, run->out);
+  }
+}
+
+int single_finish(CURL *curl, CURLcode res, struct single_run *run) {
+  long http_status = 0;
+  if (res == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+  }
+  if (res != CURLE_OK) {
+    fprintf(err_stream(), "\nRequest failed: %s\n", curl_easy_strerror(res));
+    return EXIT_HTTP;
+  }
+  return single_emit(run, http_status, run->headers.status_line, &run->headers.headers,
+                     &run->body);
+}
+
+int single_emit(struct single_run *run, long status, const char *status_line,
+                const struct header_list *headers, const struct response_buffer *body) {
+  if (!run->opts.use_exit_codes && run->opts.include_headers) {
+    print_json_response(run->out, status, status_line, headers, body, run->envelope_extra);
+  } else if (!run->opts.use_exit_codes && run->capture) {
+    /* Captured for the cache instead of going straight to the output. */
+    write_raw_body(run->out, body);
+  }
+  if (run->opts.use_exit_codes && status >= 400) {
+    return EXIT_RESPONSE;
+  }
+  return EXIT_OK;
+}
+
+void single_cleanup(struct single_run *run) {
+  response_buffer_free(&run->body);
+  header_list_free(&run->headers.headers);
+  free(run->headers.status_line);
+  run->headers.status_line = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef PINGA_SINGLE_H
+#define PINGA_SINGLE_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "response.h"
+
+struct single_options {
+  bool use_exit_codes;
+  bool include_headers;
+};
+
+/*
+ * Output state for one request in the classic (non-load) mode: the JSON
+ * envelope, the raw body or nothing, written to `out`.
+ */
+struct single_run {
+  struct single_options opts;
+  FILE *out;
+  struct response_buffer body;
+  struct response_headers headers;
+  const char *envelope_extra;
+  bool capture; /* buffer headers and body in every output mode (HTTP cache) */
+};
+
+void single_setup(CURL *curl, struct single_run *run);
+/* Emits the result of a finished transfer and returns the exit code. */
+int single_finish(CURL *curl, CURLcode res, struct single_run *run);
+/* Emits a response that did not come from the transfer, as single_finish would. */
+int single_emit(struct single_run *run, long status, const char *status_line,
+                const struct header_list *headers, const struct response_buffer *body);
+void single_cleanup(struct single_run *run);
+
+#endif
@@ -0,0 +1,319 @@
+#include "sink.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sched.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define RING_SLOTS 16384u
+#define BATCH_MAX 1024u
+
+/*
+ * Bounded MPSC queue after Vyukov: a slot whose turn equals the claim
+ * position is free for that producer, turn == pos + 1 means published, and
+ * the consumer hands it back one lap later with turn = pos + RING_SLOTS.
+ */
+struct slot {
+  atomic_size_t turn;
+  size_t pos; /* claim position, kept for commit */
+  uint64_t seq;
+  size_t len;
+  char data[SINK_RECORD_MAX];
+};
+
+struct held {
+  uint64_t seq;
+  size_t len;
+  bool used;
+  bool writing;
+  char data[SINK_RECORD_MAX];
+};
+
+struct sink {
+  int fd;
+  bool ordered;
+  bool failed;
+  struct slot *ring;
+  atomic_size_t tail;
+  size_t head;
+  atomic_bool closing;
+  pthread_t thread;
+
+  struct held *window;
+  uint64_t next;
+
+  struct batch {
+    const char *base[BATCH_MAX];
+    size_t len[BATCH_MAX];
+    struct held *cells[BATCH_MAX];
+    unsigned count;
+    unsigned cell_count;
+  } batch;
+  size_t released;
+  uint64_t written;
+};
+
+static void backoff(void) {
+#ifdef _WIN32
+  Sleep(0);
+#else
+  sched_yield();
+#endif
+}
+
+static void idle_wait(void) {
+#ifdef _WIN32
+  Sleep(1);
+#else
+  struct timespec ts = {0, 100000};
+  nanosleep(&ts, NULL);
+#endif
+}
+
+#ifdef _WIN32
+static int write_batch(int fd, const char **base, const size_t *len, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    size_t off = 0;
+    while (off < len[i]) {
+      int n = _write(fd, base[i] + off, (unsigned)(len[i] - off));
+      if (n <= 0) {
+        return -1;
+      }
+      off += (size_t)n;
+    }
+  }
+  return 0;
+}
+#else
+static int write_batch(int fd, const char **base, const size_t *len, unsigned count) {
+  struct iovec iov[BATCH_MAX];
+  for (unsigned i = 0; i < count; i++) {
+    iov[i].iov_base = (void *)base[i];
+    iov[i].iov_len = len[i];
+  }
+  struct iovec *cur = iov;
+  unsigned left = count;
+  while (left > 0) {
+    ssize_t n = writev(fd, cur, (int)left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    size_t done = (size_t)n;
+    while (left > 0 && done >= cur->iov_len) {
+      done -= cur->iov_len;
+      cur++;
+      left--;
+    }
+    if (left > 0) {
+      cur->iov_base = (char *)cur->iov_base + done;
+      cur->iov_len -= done;
+    }
+  }
+  return 0;
+}
+#endif
+
+/* Writes the batch, then returns its ring slots and window cells. */
+static void flush_batch(struct sink *sink) {
+  struct batch *b = &sink->batch;
+  if (b->count > 0 && !sink->failed) {
+    if (write_batch(sink->fd, b->base, b->len, b->count) != 0) {
+      sink->failed = true;
+    } else {
+      sink->written += b->count;
+    }
+  }
+  for (unsigned i = 0; i < b->cell_count; i++) {
+    b->cells[i]->writing = false;
+    b->cells[i]->used = false;
+  }
+  for (; sink->released < sink->head; sink->released++) {
+    struct slot *s = &sink->ring[sink->released % RING_SLOTS];
+    atomic_store_explicit(&s->turn, sink->released + RING_SLOTS, memory_order_release);
+  }
+  b->count = 0;
+  b->cell_count = 0;
+}
+
+static void batch_add(struct sink *sink, const char *data, size_t len, struct held *cell) {
+  struct batch *b = &sink->batch;
+  if (len == 0) {
+    /* A skipped seq: its place in the order is taken, nothing is written. */
+    if (cell) {
+      cell->used = false;
+    }
+    return;
+  }
+  if (b->count == BATCH_MAX) {
+    flush_batch(sink);
+  }
+  b->base[b->count] = data;
+  b->len[b->count] = len;
+  b->count++;
+  if (cell) {
+    cell->writing = true;
+    b->cells[b->cell_count++] = cell;
+  }
+}
+
+static void emit_ready(struct sink *sink) {
+  for (;;) {
+    struct held *cell = &sink->window[sink->next % SINK_REORDER_WINDOW];
+    if (!cell->used || cell->writing || cell->seq != sink->next) {
+      return;
+    }
+    batch_add(sink, cell->data, cell->len, cell);
+    sink->next++;
+  }
+}
+
+/* Gives up on the oldest gaps until seq fits in the window. */
+static void slide_window(struct sink *sink, uint64_t seq) {
+  while (seq >= sink->next + SINK_REORDER_WINDOW) {
+    struct held *cell = &sink->window[sink->next % SINK_REORDER_WINDOW];
+    if (cell->used && !cell->writing && cell->seq == sink->next) {
+      batch_add(sink, cell->data, cell->len, cell);
+    }
+    sink->next++;
+  }
+}
+
+static void take_ordered(struct sink *sink, struct slot *s) {
+  if (s->seq < sink->next) {
+    batch_add(sink, s->data, s->len, NULL);
+    return;
+  }
+  slide_window(sink, s->seq);
+  struct held *cell = &sink->window[s->seq % SINK_REORDER_WINDOW];
+  if (cell->writing) {
+    flush_batch(sink);
+  }
+  cell->seq = s->seq;
+  cell->len = s->len;
+  cell->used = true;
+  memcpy(cell->data, s->data, s->len);
+  emit_ready(sink);
+}
+
+static void *writer_main(void *arg) {
+  struct sink *sink = (struct sink *)arg;
+  for (;;) {
+    bool closing = atomic_load(&sink->closing);
+    struct slot *s = &sink->ring[sink->head % RING_SLOTS];
+    if (atomic_load_explicit(&s->turn, memory_order_acquire) == sink->head + 1) {
+      /* head moves past s only once s is queued, so a flush never frees it. */
+      if (sink->ordered) {
+        take_ordered(sink, s);
+      } else {
+        batch_add(sink, s->data, s->len, NULL);
+      }
+      sink->head++;
+      continue;
+    }
+    flush_batch(sink);
+    if (closing) {
+      break;
+    }
+    idle_wait();
+  }
+  if (sink->ordered) {
+    for (unsigned i = 0; i < SINK_REORDER_WINDOW; i++) {
+      emit_ready(sink);
+      sink->next++;
+    }
+    flush_batch(sink);
+  }
+  return NULL;
+}
+
+struct sink *sink_open(int fd, bool ordered) {
+  struct sink *sink = (struct sink *)calloc(1, sizeof(struct sink));
+  if (!sink) {
+    return NULL;
+  }
+  sink->fd = fd;
+  sink->ordered = ordered;
+  sink->ring = (struct slot *)calloc(RING_SLOTS, sizeof(struct slot));
+  if (ordered) {
+    sink->window = (struct held *)calloc(SINK_REORDER_WINDOW, sizeof(struct held));
+  }
+  if (!sink->ring || (ordered && !sink->window)) {
+    free(sink->ring);
+    free(sink->window);
+    free(sink);
+    return NULL;
+  }
+  for (size_t i = 0; i < RING_SLOTS; i++) {
+    atomic_init(&sink->ring[i].turn, i);
+  }
+  atomic_init(&sink->tail, 0);
+  atomic_init(&sink->closing, false);
+  if (pthread_create(&sink->thread, NULL, writer_main, sink) != 0) {
+    free(sink->ring);
+    free(sink->window);
+    free(sink);
+    return NULL;
+  }
+  return sink;
+}
+
+char *sink_reserve(struct sink *sink, uint64_t seq) {
+  size_t pos = atomic_load_explicit(&sink->tail, memory_order_relaxed);
+  struct slot *s;
+  for (;;) {
+    s = &sink->ring[pos % RING_SLOTS];
+    size_t turn = atomic_load_explicit(&s->turn, memory_order_acquire);
+    if (turn == pos) {
+      if (atomic_compare_exchange_weak_explicit(&sink->tail, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (turn < pos) {
+      backoff();
+      pos = atomic_load_explicit(&sink->tail, memory_order_relaxed);
+    } else {
+      pos = atomic_load_explicit(&sink->tail, memory_order_relaxed);
+    }
+  }
+  s->pos = pos;
+  s->seq = seq;
+  return s->data;
+}
+
+void sink_commit(struct sink *sink, char *record, size_t len) {
+  (void)sink;
+  struct slot *s = (struct slot *)(record - offsetof(struct slot, data));
+  s->len = len < SINK_RECORD_MAX ? len : SINK_RECORD_MAX;
+  atomic_store_explicit(&s->turn, s->pos + 1, memory_order_release);
+}
+
+void sink_skip(struct sink *sink, uint64_t seq) {
+  sink_commit(sink, sink_reserve(sink, seq), 0);
+}
+
+uint64_t sink_close(struct sink *sink) {
+  if (!sink) {
+    return 0;
+  }
+  atomic_store(&sink->closing, true);
+  pthread_join(sink->thread, NULL);
+  uint64_t written = sink->written;
+  free(sink->ring);
+  free(sink->window);
+  free(sink);
+  return written;
+}
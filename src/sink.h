@@ -0,0 +1,39 @@
+#ifndef PINGA_SINK_H
+#define PINGA_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Line-oriented result writer. Worker threads encode records straight into
+ * slots of a bounded lock-free MPSC ring; one writer thread drains the ring
+ * and hands whole batches to writev, so producers never touch stdio locks
+ * and lines never interleave.
+ *
+ * In ordered mode records come out in seq order as long as a record is no
+ * more than SINK_REORDER_WINDOW positions behind the newest one; anything
+ * later than that is written as soon as it arrives.
+ */
+#define SINK_RECORD_MAX 256u
+#define SINK_REORDER_WINDOW 4096u
+
+struct sink;
+
+/* Returns NULL if the writer thread could not be started. */
+struct sink *sink_open(int fd, bool ordered);
+
+/*
+ * Claims a slot for record seq (blocks while the ring is full) and returns
+ * a buffer of SINK_RECORD_MAX bytes; sink_commit publishes len bytes of it.
+ * Seqs must be unique and, in ordered mode, dense from 0.
+ */
+char *sink_reserve(struct sink *sink, uint64_t seq);
+void sink_commit(struct sink *sink, char *record, size_t len);
+/* Uses up seq without writing a line, so ordered output does not wait for it. */
+void sink_skip(struct sink *sink, uint64_t seq);
+
+/* Flushes everything, stops the writer and returns records written. */
+uint64_t sink_close(struct sink *sink);
+
+#endif
@@ -0,0 +1,81 @@
+#include "stats.h"
+
+#include <string.h>
+
+static unsigned bucket_index(uint64_t v) {
+  if (v < 2 * HIST_SUB_COUNT) {
+    return (unsigned)v;
+  }
+  unsigned msb = 63u - (unsigned)__builtin_clzll(v);
+  unsigned shift = msb - HIST_SUB_BITS;
+  unsigned idx = (shift + 1) * HIST_SUB_COUNT + (unsigned)((v >> shift) - HIST_SUB_COUNT);
+  return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+static uint64_t bucket_value(unsigned idx) {
+  if (idx < 2 * HIST_SUB_COUNT) {
+    return idx;
+  }
+  unsigned shift = idx / HIST_SUB_COUNT - 1;
+  uint64_t low = (uint64_t)(idx % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift;
+  return low + ((1ull << shift) >> 1);
+}
+
+void histogram_reset(struct histogram *h) {
+  memset(h, 0, sizeof(*h));
+}
+
+void histogram_record(struct histogram *h, uint64_t value_us) {
+  h->counts[bucket_index(value_us)]++;
+  if (h->total == 0 || value_us < h->min_us) {
+    h->min_us = value_us;
+  }
+  if (value_us > h->max_us) {
+    h->max_us = value_us;
+  }
+  h->total++;
+  h->sum_us += value_us;
+}
+
+void histogram_merge(struct histogram *dst, const struct histogram *src) {
+  if (src->total == 0) {
+    return;
+  }
+  for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+  if (dst->total == 0 || src->min_us < dst->min_us) {
+    dst->min_us = src->min_us;
+  }
+  if (src->max_us > dst->max_us) {
+    dst->max_us = src->max_us;
+  }
+  dst->total += src->total;
+  dst->sum_us += src->sum_us;
+}
+
+uint64_t histogram_quantile(const struct histogram *h, double q) {
+  if (h->total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(q * (double)h->total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t v = bucket_value(i);
+      if (v < h->min_us) {
+        return h->min_us;
+      }
+      return v > h->max_us ? h->max_us : v;
+    }
+  }
+  return h->max_us;
+}
+
+double histogram_mean(const struct histogram *h) {
+  return h->total ? (double)h->sum_us / (double)h->total : 0.0;
+}
@@ -0,0 +1,30 @@
+#ifndef PINGA_STATS_H
+#define PINGA_STATS_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear latency histogram over microseconds: exact below 64us, then 32
+ * sub-buckets per power of two (about 3% relative error). Fixed size, so
+ * recording never allocates and histograms merge by adding counts.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS (64u * HIST_SUB_COUNT)
+
+struct histogram {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t sum_us;
+  uint64_t min_us;
+  uint64_t max_us;
+};
+
+void histogram_reset(struct histogram *h);
+void histogram_record(struct histogram *h, uint64_t value_us);
+void histogram_merge(struct histogram *dst, const struct histogram *src);
+/* Value at quantile q (0..1), in microseconds. */
+uint64_t histogram_quantile(const struct histogram *h, double q);
+double histogram_mean(const struct histogram *h);
+
+#endif
@@ -0,0 +1,226 @@
+#include "stream.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "json.h"
+#include "load.h"
+#include "response.h"
+#include "stats.h"
+#include "util.h"
+
+#define STREAM_LINE_MAX (64u << 10)
+#define STREAM_FIELD_MAX 256u
+
+struct stream_run {
+  FILE *out;
+  CURL *curl;
+  bool sse;
+  uint64_t start_ns;
+  uint64_t first_byte_ns;
+  uint64_t last_event_ns;
+  uint64_t bytes;
+  uint64_t events;
+  uint64_t truncated;
+  struct histogram gaps;
+  bool saw_cr; /* a '\n' right after it ends no second line */
+  /* The line being read; line_bytes keeps counting past the cap. */
+  char line[STREAM_LINE_MAX];
+  size_t line_len;
+  uint64_t line_bytes;
+  /* SSE: the event being assembled from its field lines. */
+  char data[STREAM_LINE_MAX];
+  size_t data_len;
+  uint64_t data_bytes;
+  bool has_data;
+  char name[STREAM_FIELD_MAX];
+  char id[STREAM_FIELD_MAX];
+};
+
+struct stream_run *stream_new(FILE *out) {
+  struct stream_run *s = (struct stream_run *)calloc(1, sizeof(struct stream_run));
+  if (s) {
+    s->out = out;
+    histogram_reset(&s->gaps);
+  }
+  return s;
+}
+
+static void emit_event(struct stream_run *s, const char *data, size_t len, uint64_t bytes,
+                       uint64_t now) {
+  if (s->events) {
+    histogram_record(&s->gaps, (now - s->last_event_ns) / 1000);
+  }
+  s->last_event_ns = now;
+  bool cut = bytes > len;
+  s->truncated += cut;
+  if (s->out) {
+    fprintf(s->out, "{\"seq\":%llu,\"t_ms\":%.3f,\"bytes\":%llu,",
+            (unsigned long long)s->events, (double)(now - s->start_ns) / 1e6,
+            (unsigned long long)bytes);
+    if (s->name[0]) {
+      fputs("\"event\":\"", s->out);
+      json_write_escaped(s->out, s->name, strlen(s->name));
+      fputs("\",", s->out);
+    }
+    if (s->id[0]) {
+      fputs("\"id\":\"", s->out);
+      json_write_escaped(s->out, s->id, strlen(s->id));
+      fputs("\",", s->out);
+    }
+    struct response_buffer view = {.data = (char *)data, .len = len};
+    fputs("\"data\":", s->out);
+    print_json_body(s->out, &view);
+    fputs(cut ? ",\"truncated\":true}\n" : "}\n", s->out);
+    /* The point is to see each event when it arrives. */
+    fflush(s->out);
+  }
+  s->events++;
+}
+
+static void copy_field(char *dst, const char *value, size_t len) {
+  if (len >= STREAM_FIELD_MAX) {
+    len = STREAM_FIELD_MAX - 1;
+  }
+  memcpy(dst, value, len);
+  dst[len] = '\0';
+}
+
+/* One SSE line: a field of the pending event, a comment, or the blank line that ends it. */
+static void sse_line(struct stream_run *s, uint64_t now) {
+  if (s->line_bytes == 0) {
+    if (s->has_data) {
+      emit_event(s, s->data, s->data_len, s->data_bytes, now);
+    }
+    s->has_data = false;
+    s->data_len = 0;
+    s->data_bytes = 0;
+    s->name[0] = '\0';
+    s->id[0] = '\0';
+    return;
+  }
+  if (s->line[0] == ':') {
+    return;
+  }
+  const char *colon = (const char *)memchr(s->line, ':', s->line_len);
+  size_t name_len = colon ? (size_t)(colon - s->line) : s->line_len;
+  const char *value = colon ? colon + 1 : s->line + s->line_len;
+  if (value < s->line + s->line_len && *value == ' ') {
+    value++;
+  }
+  size_t value_len = (size_t)(s->line + s->line_len - value);
+  uint64_t value_bytes = s->line_bytes - (uint64_t)(value - s->line);
+  if (name_len == 4 && memcmp(s->line, "data", 4) == 0) {
+    /* Data lines join with '\n'. */
+    if (s->has_data) {
+      s->data_bytes++;
+      if (s->data_len < STREAM_LINE_MAX) {
+        s->data[s->data_len++] = '\n';
+      }
+    }
+    size_t room = STREAM_LINE_MAX - s->data_len;
+    size_t n = value_len < room ? value_len : room;
+    memcpy(s->data + s->data_len, value, n);
+    s->data_len += n;
+    s->data_bytes += value_bytes;
+    s->has_data = true;
+  } else if (name_len == 5 && memcmp(s->line, "event", 5) == 0) {
+    copy_field(s->name, value, value_len);
+  } else if (name_len == 2 && memcmp(s->line, "id", 2) == 0) {
+    copy_field(s->id, value, value_len);
+  }
+}
+
+static void end_line(struct stream_run *s, uint64_t now) {
+  if (s->sse) {
+    sse_line(s, now);
+  } else if (s->line_bytes > 0) {
+    emit_event(s, s->line, s->line_len, s->line_bytes, now);
+  }
+  s->line_len = 0;
+  s->line_bytes = 0;
+}
+
+static size_t on_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  struct stream_run *s = (struct stream_run *)userdata;
+  const char *p = (const char *)ptr;
+  size_t total = size * nmemb;
+  uint64_t now = now_ns();
+  if (s->bytes == 0 && total) {
+    char *type = NULL;
+    s->first_byte_ns = now;
+    curl_easy_getinfo(s->curl, CURLINFO_CONTENT_TYPE, &type);
+    s->sse = type && strncasecmp(type, "text/event-stream", 17) == 0;
+  }
+  s->bytes += total;
+  size_t i = 0;
+  if (s->saw_cr && i < total && p[i] == '\n') {
+    i++;
+  }
+  s->saw_cr = false;
+  while (i < total) {
+    size_t j = i;
+    while (j < total && p[j] != '\n' && p[j] != '\r') {
+      j++;
+    }
+    size_t room = STREAM_LINE_MAX - s->line_len;
+    size_t n = j - i < room ? j - i : room;
+    memcpy(s->line + s->line_len, p + i, n);
+    s->line_len += n;
+    s->line_bytes += j - i;
+    if (j == total) {
+      break;
+    }
+    end_line(s, now);
+    i = j + 1;
+    if (p[j] == '\r') {
+      if (i == total) {
+        s->saw_cr = true;
+      } else if (p[i] == '\n') {
+        i++;
+      }
+    }
+  }
+  return total;
+}
+
+void stream_setup(CURL *curl, struct stream_run *s) {
+  s->curl = curl;
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_data);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
+  s->start_ns = now_ns();
+}
+
+int stream_finish(CURL *curl, CURLcode res, struct stream_run *s, FILE *summary,
+                  bool use_exit_codes) {
+  uint64_t end = now_ns();
+  /* A last line without a newline is still an event; an unterminated SSE event is not. */
+  if (!s->sse && s->line_bytes > 0) {
+    end_line(s, end);
+  }
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (res != CURLE_OK) {
+    fprintf(err_stream(), "\nRequest failed: %s\n", curl_easy_strerror(res));
+  }
+  if (summary) {
+    double ttfb_ms = s->bytes ? (double)(s->first_byte_ns - s->start_ns) / 1e6 : 0.0;
+    fprintf(summary,
+            "{\"status\":%ld,\"framing\":\"%s\",\"events\":%llu,\"bytes\":%llu,"
+            "\"ttfb_ms\":%.3f,\"elapsed_ms\":%.3f,",
+            status, s->sse ? "sse" : "lines", (unsigned long long)s->events,
+            (unsigned long long)s->bytes, ttfb_ms, (double)(end - s->start_ns) / 1e6);
+    load_print_latency(summary, "gap_ms", &s->gaps);
+    fprintf(summary, "\"truncated\":%llu}\n", (unsigned long long)s->truncated);
+  }
+  if (res != CURLE_OK) {
+    return EXIT_HTTP;
+  }
+  return use_exit_codes && status >= 400 ? EXIT_RESPONSE : EXIT_OK;
+}
+
+void stream_free(struct stream_run *s) {
+  free(s);
+}
@@ -0,0 +1,26 @@
+#ifndef PINGA_STREAM_H
+#define PINGA_STREAM_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Streaming responses (--stream): the body is split into events as it
+ * arrives, with SSE framing for text/event-stream and one event per line
+ * otherwise, and each event is written as an NDJSON record right away. An
+ * event is held in a fixed buffer, so memory does not grow with the stream;
+ * longer events are cut and marked "truncated".
+ */
+struct stream_run;
+
+/* Records go to out; NULL only counts (--silent). NULL when out of memory. */
+struct stream_run *stream_new(FILE *out);
+/* Installs the body callback; the event clock starts here. */
+void stream_setup(CURL *curl, struct stream_run *s);
+/* Prints the summary to summary (unless NULL) and returns the exit code. */
+int stream_finish(CURL *curl, CURLcode res, struct stream_run *s, FILE *summary,
+                  bool use_exit_codes);
+void stream_free(struct stream_run *s);
+
+#endif
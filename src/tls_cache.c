@@ -0,0 +1,318 @@
+#include "tls_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#if defined(PINGA_HAVE_OPENSSL) && !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/crypto.h>
+#include <openssl/ssl.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * libcurl (before the 8.12 ssls export API) keeps sessions only in memory,
+ * so the cache hooks the OpenSSL context through CURLOPT_SSL_CTX_FUNCTION:
+ * a stored session is set on the SSL object when the handshake starts, and
+ * the new-session callback captures tickets as the server issues them.
+ */
+
+#define SESSION_MAGIC "pinga-tls-session 1"
+#define MAX_SESSION_FILE (64 * 1024)
+
+struct tls_cache {
+  char *path;
+  SSL_SESSION *loaded;
+  bool offered;
+  int resumed; /* -1 until a handshake completes */
+  unsigned char *fresh;
+  size_t fresh_len;
+  long long fresh_expiry;
+};
+
+static char *cache_file_path(const char *dir, const char *host, const char *port) {
+  size_t len = strlen(dir) + strlen(host) + strlen(port) + 8;
+  char *path = (char *)malloc(len);
+  if (!path) {
+    return NULL;
+  }
+  int n = snprintf(path, len, "%s/", dir);
+  for (const char *p = host; *p; p++) {
+    char c = *p;
+    bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || c == '.' || c == '-';
+    path[n++] = keep ? c : '_';
+  }
+  snprintf(path + n, len - (size_t)n, "_%s.tls", port);
+  return path;
+}
+
+/* Session files hold secrets: only trust private files owned by us. */
+static bool is_private(const struct stat *st) {
+  return st->st_uid == geteuid() && (st->st_mode & 077) == 0;
+}
+
+static int prepare_dir(const char *dir) {
+  struct stat st;
+  if (stat(dir, &st) != 0) {
+    if (errno != ENOENT || mkdir(dir, 0700) != 0 || stat(dir, &st) != 0) {
+      fprintf(err_stream(), "Failed to create TLS session cache directory: %s\n", dir);
+      return EXIT_CONFIG;
+    }
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    fprintf(err_stream(), "TLS session cache is not a directory: %s\n", dir);
+    return EXIT_CONFIG;
+  }
+  if (!is_private(&st)) {
+    fprintf(err_stream(),
+            "TLS session cache directory must be owned by you with mode 0700: %s\n", dir);
+    return EXIT_REQUEST;
+  }
+  return EXIT_OK;
+}
+
+static void load_session(struct tls_cache *cache) {
+  int fd = open(cache->path, O_RDONLY | O_NOFOLLOW);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !is_private(&st) ||
+      st.st_size <= 0 || st.st_size > MAX_SESSION_FILE) {
+    close(fd);
+    return;
+  }
+  unsigned char *data = (unsigned char *)malloc((size_t)st.st_size + 1);
+  ssize_t got = data ? read(fd, data, (size_t)st.st_size) : -1;
+  close(fd);
+  if (got != st.st_size) {
+    free(data);
+    return;
+  }
+  data[got] = '\0';
+
+  long long expiry = 0;
+  int header_len = 0;
+  if (sscanf((const char *)data, SESSION_MAGIC " %lld\n%n", &expiry, &header_len) != 1 ||
+      header_len <= 0) {
+    free(data);
+    return;
+  }
+  if (expiry <= (long long)time(NULL)) {
+    unlink(cache->path);
+    free(data);
+    return;
+  }
+  const unsigned char *der = data + header_len;
+  cache->loaded = d2i_SSL_SESSION(NULL, &der, (long)(got - header_len));
+  free(data);
+}
+
+static void on_info(const SSL *ssl, int where, int ret) {
+  (void)ret;
+  struct tls_cache *cache =
+      (struct tls_cache *)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  if (!cache) {
+    return;
+  }
+  if ((where & SSL_CB_HANDSHAKE_START) && cache->loaded && !cache->offered) {
+    SSL_set_session((SSL *)ssl, cache->loaded);
+    cache->offered = true;
+  }
+  if ((where & SSL_CB_HANDSHAKE_DONE) && cache->resumed < 0) {
+    cache->resumed = SSL_session_reused((SSL *)ssl) ? 1 : 0;
+  }
+}
+
+static int on_new_session(SSL *ssl, SSL_SESSION *session) {
+  struct tls_cache *cache =
+      (struct tls_cache *)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  if (!cache || !SSL_SESSION_is_resumable(session)) {
+    return 0;
+  }
+  int len = i2d_SSL_SESSION(session, NULL);
+  if (len <= 0) {
+    return 0;
+  }
+  unsigned char *der = (unsigned char *)malloc((size_t)len);
+  if (!der) {
+    return 0;
+  }
+  unsigned char *p = der;
+  i2d_SSL_SESSION(session, &p);
+  free(cache->fresh);
+  cache->fresh = der;
+  cache->fresh_len = (size_t)len;
+  cache->fresh_expiry =
+      (long long)SSL_SESSION_get_time(session) + (long long)SSL_SESSION_get_timeout(session);
+  /* 0: we copied the session and hold no reference to it. */
+  return 0;
+}
+
+static CURLcode on_ssl_ctx(CURL *curl, void *sslctx, void *userdata) {
+  (void)curl;
+  SSL_CTX *ctx = (SSL_CTX *)sslctx;
+  SSL_CTX_set_app_data(ctx, userdata);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, on_new_session);
+  SSL_CTX_set_info_callback(ctx, on_info);
+  return CURLE_OK;
+}
+
+/* The SSL_CTX handed to us must come from the OpenSSL we were built with. */
+static bool backend_matches(void) {
+  const curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  const char *ours = OpenSSL_version(OPENSSL_VERSION);
+  if (!info || !info->ssl_version || strncmp(info->ssl_version, "OpenSSL/", 8) != 0 ||
+      strncmp(ours, "OpenSSL ", 8) != 0) {
+    return false;
+  }
+  const char *theirs = info->ssl_version + 8;
+  size_t len = strcspn(ours + 8, " ");
+  return strncmp(theirs, ours + 8, len) == 0 && (theirs[len] == '\0' || theirs[len] == ' ');
+}
+
+int tls_cache_open(const char *dir, const char *url, struct tls_cache **out) {
+  *out = NULL;
+  CURLU *u = curl_url();
+  char *scheme = NULL;
+  char *host = NULL;
+  char *port = NULL;
+  if (!u || curl_url_set(u, CURLUPART_URL, url, 0) != CURLUE_OK ||
+      curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) != CURLUE_OK ||
+      curl_url_get(u, CURLUPART_HOST, &host, 0) != CURLUE_OK ||
+      curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) != CURLUE_OK) {
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(u);
+    return EXIT_OK;
+  }
+  int rc = EXIT_OK;
+  if (strcmp(scheme, "https") == 0) {
+    rc = prepare_dir(dir);
+    if (rc == EXIT_OK) {
+      struct tls_cache *cache = (struct tls_cache *)calloc(1, sizeof(struct tls_cache));
+      char *path = cache_file_path(dir, host, port);
+      if (!cache || !path) {
+        free(cache);
+        free(path);
+        fprintf(err_stream(), "Out of memory while opening TLS session cache.\n");
+        rc = EXIT_REQUEST;
+      } else {
+        cache->path = path;
+        cache->resumed = -1;
+        load_session(cache);
+        *out = cache;
+      }
+    }
+  }
+  curl_free(scheme);
+  curl_free(host);
+  curl_free(port);
+  curl_url_cleanup(u);
+  return rc;
+}
+
+int tls_cache_attach(struct tls_cache *cache, CURL *curl) {
+  if (!backend_matches()) {
+    fprintf(err_stream(),
+            "--tls-session-cache needs libcurl built against %s (libcurl uses %s).\n",
+            OpenSSL_version(OPENSSL_VERSION),
+            curl_version_info(CURLVERSION_NOW)->ssl_version);
+    return EXIT_REQUEST;
+  }
+  if (curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, on_ssl_ctx) != CURLE_OK ||
+      curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, cache) != CURLE_OK) {
+    fprintf(err_stream(), "--tls-session-cache is not supported by this libcurl.\n");
+    return EXIT_REQUEST;
+  }
+  return EXIT_OK;
+}
+
+void tls_cache_save(struct tls_cache *cache) {
+  if (!cache || !cache->fresh) {
+    return;
+  }
+  size_t tmp_len = strlen(cache->path) + 32;
+  char *tmp = (char *)malloc(tmp_len);
+  if (!tmp) {
+    return;
+  }
+  snprintf(tmp, tmp_len, "%s.%ld.tmp", cache->path, (long)getpid());
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+  if (fd < 0) {
+    free(tmp);
+    return;
+  }
+  char header[64];
+  int header_len = snprintf(header, sizeof(header), SESSION_MAGIC " %lld\n",
+                            cache->fresh_expiry);
+  bool ok = write(fd, header, (size_t)header_len) == header_len &&
+            write(fd, cache->fresh, cache->fresh_len) == (ssize_t)cache->fresh_len;
+  if (close(fd) != 0 || !ok || rename(tmp, cache->path) != 0) {
+    unlink(tmp);
+  }
+  free(tmp);
+}
+
+const char *tls_cache_result(const struct tls_cache *cache) {
+  if (!cache || cache->resumed < 0) {
+    return NULL;
+  }
+  return cache->resumed ? "hit" : "miss";
+}
+
+void tls_cache_free(struct tls_cache *cache) {
+  if (!cache) {
+    return;
+  }
+  if (cache->loaded) {
+    SSL_SESSION_free(cache->loaded);
+  }
+  free(cache->fresh);
+  free(cache->path);
+  free(cache);
+}
+
+#else
+
+struct tls_cache {
+  int unused;
+};
+
+int tls_cache_open(const char *dir, const char *url, struct tls_cache **out) {
+  (void)dir;
+  (void)url;
+  *out = NULL;
+  fprintf(err_stream(), "--tls-session-cache is not supported by this build.\n");
+  return EXIT_REQUEST;
+}
+
+int tls_cache_attach(struct tls_cache *cache, CURL *curl) {
+  (void)cache;
+  (void)curl;
+  return EXIT_REQUEST;
+}
+
+void tls_cache_save(struct tls_cache *cache) {
+  (void)cache;
+}
+
+const char *tls_cache_result(const struct tls_cache *cache) {
+  (void)cache;
+  return NULL;
+}
+
+void tls_cache_free(struct tls_cache *cache) {
+  (void)cache;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef PINGA_TLS_CACHE_H
+#define PINGA_TLS_CACHE_H
+
+#include <curl/curl.h>
+
+/*
+ * On-disk TLS session cache, one file per host:port under a private
+ * directory. The stored session is offered on the next handshake and the
+ * newest session the server hands out is written back after the transfer.
+ */
+struct tls_cache;
+
+/* Returns EXIT_OK and sets *out (NULL for non-https urls), or an EXIT_* code. */
+int tls_cache_open(const char *dir, const char *url, struct tls_cache **out);
+int tls_cache_attach(struct tls_cache *cache, CURL *curl);
+/* Persists the newest session; call after curl_easy_perform. */
+void tls_cache_save(struct tls_cache *cache);
+/* "hit" when the handshake resumed, "miss" for a full handshake, else NULL. */
+const char *tls_cache_result(const struct tls_cache *cache);
+void tls_cache_free(struct tls_cache *cache);
+
+#endif
@@ -0,0 +1,348 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define CHUNK_SIZE (64u << 10)
+/* Room checked before each request; its events take well under half of it. */
+#define EVENT_ROOM 2048u
+/* Chunks queued for the writer before workers wait for it. */
+#define MAX_PENDING 64u
+
+/*
+ * The array opens with the name of pid 0 so that every later event can
+ * lead with its own separator, whichever worker's chunk lands first.
+ */
+#define TRACE_HEADER \
+  "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" \
+  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"pinga\"}}"
+#define TRACE_FOOTER "\n]}\n"
+
+struct chunk {
+  struct chunk *next;
+  size_t len;
+  char data[CHUNK_SIZE];
+};
+
+struct trace {
+  FILE *file;
+  pthread_mutex_t lock;
+  pthread_cond_t queued;  /* the writer waits for chunks or closing */
+  pthread_cond_t drained; /* workers wait for the queue to shrink */
+  struct chunk *head;
+  struct chunk *tail;
+  unsigned pending;
+  struct chunk *spare;
+  bool closing;
+  bool failed;
+  pthread_t thread;
+};
+
+struct trace_buffer {
+  struct trace *trace;
+  unsigned pid;
+  struct chunk *chunk;
+};
+
+static void *writer_main(void *arg) {
+  struct trace *trace = (struct trace *)arg;
+  pthread_mutex_lock(&trace->lock);
+  for (;;) {
+    while (!trace->head && !trace->closing) {
+      pthread_cond_wait(&trace->queued, &trace->lock);
+    }
+    struct chunk *list = trace->head;
+    if (!list) {
+      break;
+    }
+    trace->head = trace->tail = NULL;
+    trace->pending = 0;
+    pthread_cond_broadcast(&trace->drained);
+    pthread_mutex_unlock(&trace->lock);
+    struct chunk *last = list;
+    for (struct chunk *c = list; c; c = c->next) {
+      if (!trace->failed && fwrite(c->data, 1, c->len, trace->file) != c->len) {
+        trace->failed = true;
+      }
+      last = c;
+    }
+    pthread_mutex_lock(&trace->lock);
+    last->next = trace->spare;
+    trace->spare = list;
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return NULL;
+}
+
+static struct chunk *take_chunk(struct trace *trace) {
+  pthread_mutex_lock(&trace->lock);
+  struct chunk *c = trace->spare;
+  if (c) {
+    trace->spare = c->next;
+  }
+  pthread_mutex_unlock(&trace->lock);
+  if (!c) {
+    c = (struct chunk *)malloc(sizeof(struct chunk));
+  }
+  if (c) {
+    c->next = NULL;
+    c->len = 0;
+  }
+  return c;
+}
+
+static void hand_over(struct trace *trace, struct chunk *c) {
+  pthread_mutex_lock(&trace->lock);
+  while (trace->pending >= MAX_PENDING) {
+    pthread_cond_wait(&trace->drained, &trace->lock);
+  }
+  if (trace->tail) {
+    trace->tail->next = c;
+  } else {
+    trace->head = c;
+  }
+  trace->tail = c;
+  trace->pending++;
+  pthread_cond_signal(&trace->queued);
+  pthread_mutex_unlock(&trace->lock);
+}
+
+int trace_open(const char *path, struct trace **out) {
+  *out = NULL;
+  struct trace *trace = (struct trace *)calloc(1, sizeof(struct trace));
+  if (!trace) {
+    fprintf(err_stream(), "Out of memory while opening the trace.\n");
+    return EXIT_HTTP;
+  }
+  trace->file = fopen(path, "wb");
+  if (!trace->file) {
+    fprintf(err_stream(), "Failed to open trace file: %s\n", path);
+    free(trace);
+    return EXIT_REQUEST;
+  }
+  fputs(TRACE_HEADER, trace->file);
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_cond_init(&trace->queued, NULL);
+  pthread_cond_init(&trace->drained, NULL);
+  if (pthread_create(&trace->thread, NULL, writer_main, trace) != 0) {
+    fprintf(err_stream(), "Failed to start the trace writer.\n");
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->queued);
+    pthread_cond_destroy(&trace->drained);
+    fclose(trace->file);
+    free(trace);
+    return EXIT_HTTP;
+  }
+  *out = trace;
+  return EXIT_OK;
+}
+
+void trace_close(struct trace *trace) {
+  if (!trace) {
+    return;
+  }
+  pthread_mutex_lock(&trace->lock);
+  trace->closing = true;
+  pthread_cond_signal(&trace->queued);
+  pthread_mutex_unlock(&trace->lock);
+  pthread_join(trace->thread, NULL);
+  fputs(TRACE_FOOTER, trace->file);
+  if (fclose(trace->file) != 0 || trace->failed) {
+    fprintf(err_stream(), "Warning: the trace file is incomplete.\n");
+  }
+  while (trace->spare) {
+    struct chunk *next = trace->spare->next;
+    free(trace->spare);
+    trace->spare = next;
+  }
+  pthread_mutex_destroy(&trace->lock);
+  pthread_cond_destroy(&trace->queued);
+  pthread_cond_destroy(&trace->drained);
+  free(trace);
+}
+
+struct trace_buffer *trace_buffer_new(struct trace *trace, unsigned pid) {
+  struct trace_buffer *b = (struct trace_buffer *)calloc(1, sizeof(struct trace_buffer));
+  if (!b) {
+    return NULL;
+  }
+  b->trace = trace;
+  b->pid = pid;
+  b->chunk = take_chunk(trace);
+  if (!b->chunk) {
+    free(b);
+    return NULL;
+  }
+  return b;
+}
+
+void trace_buffer_free(struct trace_buffer *b) {
+  if (!b) {
+    return;
+  }
+  if (b->chunk && b->chunk->len) {
+    hand_over(b->trace, b->chunk);
+  } else {
+    free(b->chunk);
+  }
+  free(b);
+}
+
+/* Returns where the next event goes, or NULL (events dropped) out of memory. */
+static char *reserve(struct trace_buffer *b) {
+  if (b->chunk && b->chunk->len + EVENT_ROOM > CHUNK_SIZE) {
+    hand_over(b->trace, b->chunk);
+    b->chunk = NULL;
+  }
+  if (!b->chunk) {
+    b->chunk = take_chunk(b->trace);
+  }
+  return b->chunk ? b->chunk->data + b->chunk->len : NULL;
+}
+
+/* snprintf is the bulk of the cost at high rates, so numbers are formatted by hand. */
+static char *put_str(char *p, const char *s) {
+  size_t len = strlen(s);
+  memcpy(p, s, len);
+  return p + len;
+}
+
+static char *put_u64(char *p, uint64_t v) {
+  char digits[20];
+  unsigned n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+/* Trace timestamps are microseconds; keep the nanoseconds as three decimals. */
+static char *put_us(char *p, uint64_t ns) {
+  p = put_u64(p, ns / 1000);
+  unsigned frac = (unsigned)(ns % 1000);
+  p[0] = '.';
+  p[1] = (char)('0' + frac / 100);
+  p[2] = (char)('0' + frac / 10 % 10);
+  p[3] = (char)('0' + frac % 10);
+  return p + 4;
+}
+
+static char *put_span(char *p, const char *name, uint64_t ts_ns, uint64_t dur_ns, unsigned pid,
+                      unsigned tid) {
+  p = put_str(p, ",\n{\"name\":\"");
+  p = put_str(p, name);
+  p = put_str(p, "\",\"ph\":\"X\",\"ts\":");
+  p = put_us(p, ts_ns);
+  p = put_str(p, ",\"dur\":");
+  p = put_us(p, dur_ns);
+  p = put_str(p, ",\"pid\":");
+  p = put_u64(p, pid);
+  p = put_str(p, ",\"tid\":");
+  p = put_u64(p, tid);
+  return p;
+}
+
+/* A child span between two of libcurl's cumulative phase times (us). */
+static char *put_phase(char *p, const char *name, uint64_t base_ns, curl_off_t from,
+                       curl_off_t to, unsigned pid, unsigned tid) {
+  if (to <= from) {
+    return p;
+  }
+  p = put_span(p, name, base_ns + (uint64_t)from * 1000, (uint64_t)(to - from) * 1000, pid, tid);
+  *p++ = '}';
+  return p;
+}
+
+void trace_track(struct trace_buffer *b, unsigned tid) {
+  char *start = reserve(b);
+  if (!start) {
+    return;
+  }
+  char *p = start;
+  if (tid == 1) {
+    p = put_str(p, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    p = put_u64(p, b->pid);
+    p = put_str(p, ",\"tid\":0,\"args\":{\"name\":\"worker ");
+    p = put_u64(p, b->pid);
+    p = put_str(p, "\"}}");
+  }
+  p = put_str(p, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+  p = put_u64(p, b->pid);
+  p = put_str(p, ",\"tid\":");
+  p = put_u64(p, tid);
+  p = put_str(p, ",\"args\":{\"name\":\"slot ");
+  p = put_u64(p, tid);
+  p = put_str(p, "\"}}");
+  b->chunk->len += (size_t)(p - start);
+}
+
+/*
+ * libcurl's phase times run from when it started the transfer, which can be
+ * later than curl_multi_add_handle (a slot waiting for a connection), so
+ * the wall time it does not account for is shown as queue wait up front.
+ * On a reused connection the DNS, connect and TLS times are zero and those
+ * spans are left out; send runs up to the start of the request write and
+ * ttfb from there to the first response byte.
+ */
+void trace_request(struct trace_buffer *b, unsigned tid, CURL *easy, uint64_t start_ns,
+                   uint64_t wall_ns, uint64_t seq, long status, CURLcode res,
+                   uint64_t bytes) {
+  char *start = reserve(b);
+  if (!start) {
+    return;
+  }
+  curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, first_byte = 0, total = 0;
+  curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+  curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &tls);
+  curl_easy_getinfo(easy, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+  curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+  uint64_t total_ns = (uint64_t)total * 1000;
+  uint64_t queue_ns = wall_ns > total_ns ? wall_ns - total_ns : 0;
+  uint64_t base_ns = start_ns + queue_ns;
+  unsigned pid = b->pid;
+
+  char *p = put_span(start, "request", start_ns, wall_ns, pid, tid);
+  p = put_str(p, ",\"args\":{\"seq\":");
+  p = put_u64(p, seq);
+  p = put_str(p, ",\"status\":");
+  p = put_u64(p, status > 0 ? (uint64_t)status : 0);
+  p = put_str(p, ",\"bytes\":");
+  p = put_u64(p, bytes);
+  if (res != CURLE_OK) {
+    p = put_str(p, ",\"error\":\"");
+    p = put_str(p, curl_easy_strerror(res));
+    *p++ = '"';
+  }
+  p = put_str(p, "}}");
+  if (queue_ns >= 1000) {
+    p = put_span(p, "queue", start_ns, queue_ns, pid, tid);
+    *p++ = '}';
+  }
+  /* Phase ends are cumulative; a zero means the phase did not happen. */
+  curl_off_t mark = 0;
+  p = put_phase(p, "dns", base_ns, mark, dns, pid, tid);
+  mark = dns > mark ? dns : mark;
+  p = put_phase(p, "connect", base_ns, mark, connect, pid, tid);
+  mark = connect > mark ? connect : mark;
+  p = put_phase(p, "tls", base_ns, mark, tls, pid, tid);
+  mark = tls > mark ? tls : mark;
+  p = put_phase(p, "send", base_ns, mark, pretransfer, pid, tid);
+  mark = pretransfer > mark ? pretransfer : mark;
+  if (first_byte > 0) {
+    p = put_phase(p, "ttfb", base_ns, mark, first_byte, pid, tid);
+    mark = first_byte > mark ? first_byte : mark;
+    p = put_phase(p, "receive", base_ns, mark, total, pid, tid);
+  }
+  b->chunk->len += (size_t)(p - start);
+}
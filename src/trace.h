@@ -0,0 +1,40 @@
+#ifndef PINGA_TRACE_H
+#define PINGA_TRACE_H
+
+#include <curl/curl.h>
+#include <stdint.h>
+
+/*
+ * Chrome trace-event (Perfetto, chrome://tracing) export for load runs. Each
+ * worker is a process and each transfer slot a thread, so a slot's track
+ * follows the keep-alive connection it reuses. Every request becomes a
+ * "request" span with child spans for the phases libcurl timed.
+ *
+ * Workers format events into their own trace_buffer and hand it over in
+ * 64 KB chunks; one writer thread drains the chunks to the file, so the
+ * per-request cost is a few hundred bytes of formatting and no locking.
+ */
+struct trace;
+struct trace_buffer;
+
+/* Returns an EXIT_* code. */
+int trace_open(const char *path, struct trace **out);
+/* Everything handed over is written before the file is closed. */
+void trace_close(struct trace *trace);
+
+/* One per worker thread; pid numbers the worker from 1. NULL when out of memory. */
+struct trace_buffer *trace_buffer_new(struct trace *trace, unsigned pid);
+/* Hands over what is left and frees the buffer. */
+void trace_buffer_free(struct trace_buffer *b);
+
+/* Names the worker's slot tid (from 1). */
+void trace_track(struct trace_buffer *b, unsigned tid);
+/*
+ * Records a finished transfer that was added to its multi handle start_ns
+ * after the start of the run and finished wall_ns later.
+ */
+void trace_request(struct trace_buffer *b, unsigned tid, CURL *easy, uint64_t start_ns,
+                   uint64_t wall_ns, uint64_t seq, long status, CURLcode res,
+                   uint64_t bytes);
+
+#endif
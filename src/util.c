@@ -0,0 +1,270 @@
+#include "util.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+char *read_file(const char *path, size_t *out_len) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return NULL;
+  }
+  if (fseek(fp, 0, SEEK_END) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  long len = ftell(fp);
+  if (len < 0) {
+    fclose(fp);
+    return NULL;
+  }
+  rewind(fp);
+  char *buf = (char *)malloc((size_t)len + 1);
+  if (!buf) {
+    fclose(fp);
+    return NULL;
+  }
+  size_t read_len = fread(buf, 1, (size_t)len, fp);
+  fclose(fp);
+  if (read_len != (size_t)len) {
+    free(buf);
+    return NULL;
+  }
+  buf[len] = '\0';
+  if (out_len) {
+    *out_len = (size_t)len;
+  }
+  return buf;
+}
+
+int map_file(const char *path, struct mapped_file *out) {
+  memset(out, 0, sizeof(*out));
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+  out->data = (const char *)data;
+  out->len = (size_t)st.st_size;
+  out->mapped = true;
+  return 0;
+#else
+  size_t len = 0;
+  char *data = read_file(path, &len);
+  if (!data) {
+    return -1;
+  }
+  out->data = data;
+  out->len = len;
+  return 0;
+#endif
+}
+
+void unmap_file(struct mapped_file *file) {
+#ifndef _WIN32
+  if (file->mapped) {
+    munmap((void *)file->data, file->len);
+  } else {
+    free((void *)file->data);
+  }
+#else
+  free((void *)file->data);
+#endif
+  memset(file, 0, sizeof(*file));
+}
+
+char *dup_string(const char *src) {
+  size_t len = strlen(src);
+  char *out = (char *)malloc(len + 1);
+  if (!out) {
+    return NULL;
+  }
+  memcpy(out, src, len + 1);
+  return out;
+}
+
+char *path_beside(const char *file, const char *path) {
+  const char *slash = strrchr(file, '/');
+  if (path[0] == '/' || !slash) {
+    return dup_string(path);
+  }
+  size_t dir_len = (size_t)(slash - file) + 1;
+  char *out = (char *)malloc(dir_len + strlen(path) + 1);
+  if (out) {
+    memcpy(out, file, dir_len);
+    strcpy(out + dir_len, path);
+  }
+  return out;
+}
+
+void trim_whitespace(char *str) {
+  char *end = str + strlen(str);
+  while (end > str && (*(end - 1) == ' ' || *(end - 1) == '\t')) {
+    end--;
+  }
+  *end = '\0';
+  while (*str == ' ' || *str == '\t') {
+    memmove(str, str + 1, strlen(str));
+  }
+}
+
+static _Thread_local FILE *err_override;
+
+FILE *err_stream(void) {
+  return err_override ? err_override : stderr;
+}
+
+void set_err_stream(FILE *stream) {
+  err_override = stream;
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t wall_clock_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+void sleep_ns(uint64_t ns) {
+#ifdef _WIN32
+  Sleep((DWORD)((ns + 999999) / 1000000));
+#else
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ns / 1000000000ull);
+  ts.tv_nsec = (long)(ns % 1000000000ull);
+  nanosleep(&ts, NULL);
+#endif
+}
+
+bool parse_duration(const char *text, uint64_t *out_ns) {
+  if (!text || !*text) {
+    return false;
+  }
+  errno = 0;
+  char *end = NULL;
+  double value = strtod(text, &end);
+  if (errno != 0 || end == text || value < 0) {
+    return false;
+  }
+  double scale = 1e9;
+  if (strcmp(end, "ms") == 0) {
+    scale = 1e6;
+  } else if (strcmp(end, "s") == 0 || *end == '\0') {
+    scale = 1e9;
+  } else if (strcmp(end, "m") == 0) {
+    scale = 60e9;
+  } else if (strcmp(end, "h") == 0) {
+    scale = 3600e9;
+  } else {
+    return false;
+  }
+  /* nan, inf and anything past UINT64_MAX nanoseconds cannot be converted. */
+  if (!isfinite(value) || value * scale >= 18446744073709551616.0) {
+    return false;
+  }
+  *out_ns = (uint64_t)(value * scale);
+  return true;
+}
+
+bool parse_count(const char *text, uint64_t *out) {
+  if (!text || !*text || *text == '-') {
+    return false;
+  }
+  errno = 0;
+  char *end = NULL;
+  unsigned long long value = strtoull(text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0') {
+    return false;
+  }
+  *out = (uint64_t)value;
+  return true;
+}
+
+bool parse_size(const char *text, uint64_t *out) {
+  if (!text || !*text || *text == '-') {
+    return false;
+  }
+  errno = 0;
+  char *end = NULL;
+  unsigned long long value = strtoull(text, &end, 10);
+  if (errno != 0 || end == text) {
+    return false;
+  }
+  unsigned shift = 0;
+  if (*end == 'k' || *end == 'K') {
+    shift = 10;
+  } else if (*end == 'm' || *end == 'M') {
+    shift = 20;
+  } else if (*end == 'g' || *end == 'G') {
+    shift = 30;
+  }
+  if (shift) {
+    end++;
+  }
+  if (*end != '\0' || (shift && value > (UINT64_MAX >> shift))) {
+    return false;
+  }
+  *out = (uint64_t)value << shift;
+  return true;
+}
+
+FILE *temp_file(void) {
+#ifdef _WIN32
+  return tmpfile();
+#else
+  const char *dir = getenv("TMPDIR");
+  if (!dir || !*dir) {
+    dir = "/tmp";
+  }
+  size_t len = strlen(dir) + sizeof("/pinga-XXXXXX");
+  char *path = (char *)malloc(len);
+  if (!path) {
+    return NULL;
+  }
+  snprintf(path, len, "%s/pinga-XXXXXX", dir);
+  int fd = mkstemp(path);
+  if (fd >= 0) {
+    unlink(path);
+  }
+  free(path);
+  FILE *fp = fd >= 0 ? fdopen(fd, "w+b") : NULL;
+  if (!fp && fd >= 0) {
+    close(fd);
+  }
+  return fp;
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef PINGA_UTIL_H
+#define PINGA_UTIL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  EXIT_OK = 0,
+  EXIT_CONFIG = 64,
+  EXIT_REQUEST = 65,
+  EXIT_HTTP = 66,
+  EXIT_RESPONSE = 67
+};
+
+char *read_file(const char *path, size_t *out_len);
+
+/*
+ * Read-only view of a whole file: mmap'd where available, read into memory
+ * otherwise. data is not NUL-terminated and is NULL for an empty file.
+ */
+struct mapped_file {
+  const char *data;
+  size_t len;
+  bool mapped;
+};
+
+int map_file(const char *path, struct mapped_file *out);
+void unmap_file(struct mapped_file *file);
+char *dup_string(const char *src);
+/* path as written in file: relative paths resolve against file's directory. */
+char *path_beside(const char *file, const char *path);
+void trim_whitespace(char *str);
+
+/* Diagnostics stream, stderr unless a caller (the daemon) redirects it. */
+FILE *err_stream(void);
+void set_err_stream(FILE *stream);
+
+/* Monotonic clock in nanoseconds; only differences are meaningful. */
+uint64_t now_ns(void);
+/* Milliseconds since the Unix epoch. */
+uint64_t wall_clock_ms(void);
+void sleep_ns(uint64_t ns);
+
+/* Parses "250ms", "10s", "5m", "1h" or a bare number of seconds. */
+bool parse_duration(const char *text, uint64_t *out_ns);
+bool parse_count(const char *text, uint64_t *out);
+/* Parses a byte count with an optional k, m or g (binary) suffix: "512k". */
+bool parse_size(const char *text, uint64_t *out);
+
+/*
+ * Read/write temp file that is already unlinked (in $TMPDIR, else /tmp), so
+ * nothing is left behind however the process ends.
+ */
+FILE *temp_file(void);
+
+#endif
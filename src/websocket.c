@@ -0,0 +1,499 @@
+#include "websocket.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <curl/curl.h>
+
+#include "json.h"
+#include "load.h"
+#include "util.h"
+
+/* curl_ws_send() and curl_ws_recv() arrived in libcurl 7.86.0. */
+#if !defined(_WIN32) && LIBCURL_VERSION_NUM >= 0x075600
+#define PINGA_HAVE_WS 1
+#include <poll.h>
+#endif
+
+/* libcurl frames a message in its 64 KB upload buffer. */
+#define WS_MESSAGE_MAX 60000u
+/* Unanswered messages per connection in rate mode; ping-pong keeps one. */
+#define WS_WINDOW 64u
+/* How long replies still in flight are waited for once sending stops. */
+#define WS_DRAIN_NS 2000000000ull
+#define WS_RECV_BUFFER (64u << 10)
+
+static bool parse_number(const char *json, const jsmntok_t *tok, double max, double *out) {
+  if (tok->type != JSMN_PRIMITIVE) {
+    return false;
+  }
+  char *text = dup_token_raw(json, tok);
+  char *end = NULL;
+  double value = text ? strtod(text, &end) : 0.0;
+  bool ok = end && *end == '\0' && value > 0.0 && value <= max;
+  free(text);
+  *out = value;
+  return ok;
+}
+
+static bool parse_whole(const char *json, const jsmntok_t *tok, uint64_t max, uint64_t *out) {
+  char *text = tok->type == JSMN_PRIMITIVE ? dup_token_raw(json, tok) : NULL;
+  bool ok = text && parse_count(text, out) && *out > 0 && *out <= max;
+  free(text);
+  return ok;
+}
+
+static int parse_section(const char *json, jsmntok_t *toks, int index,
+                         struct websocket_options *opts) {
+  if (toks[index].type != JSMN_OBJECT) {
+    fprintf(err_stream(), "Invalid websocket: expected object (got %s).\n",
+            tok_type_name(toks[index].type));
+    return EXIT_REQUEST;
+  }
+  int idx = find_object_value(json, toks, index, "message");
+  if (idx < 0) {
+    fprintf(err_stream(), "Missing required field: websocket.message\n");
+    return EXIT_REQUEST;
+  }
+  /* A string is sent as its decoded text, any other JSON value as written. */
+  if (toks[idx].type == JSMN_STRING) {
+    opts->message = dup_token_unescaped(json, &toks[idx], &opts->message_len);
+  } else if ((opts->message = dup_token_raw(json, &toks[idx])) != NULL) {
+    opts->message_len = strlen(opts->message);
+  }
+  if (!opts->message) {
+    fprintf(err_stream(), "Invalid websocket.message value.\n");
+    return EXIT_REQUEST;
+  }
+  if (gen_compile(opts->message, opts->message_len, &opts->message_gen) != 0) {
+    return EXIT_REQUEST;
+  }
+  size_t max_len = opts->message_gen ? gen_max_len(opts->message_gen) : opts->message_len;
+  if (max_len > WS_MESSAGE_MAX) {
+    fprintf(err_stream(), "websocket.message may be up to %u bytes.\n", WS_MESSAGE_MAX);
+    return EXIT_REQUEST;
+  }
+
+  idx = find_object_value(json, toks, index, "binary");
+  if (idx >= 0) {
+    if (!jsoneq(json, &toks[idx], "true") && !jsoneq(json, &toks[idx], "false")) {
+      fprintf(err_stream(), "Invalid websocket.binary: expected true or false.\n");
+      return EXIT_REQUEST;
+    }
+    opts->binary = jsoneq(json, &toks[idx], "true");
+  }
+  uint64_t value = 1;
+  idx = find_object_value(json, toks, index, "connections");
+  if (idx >= 0 && !parse_whole(json, &toks[idx], WEBSOCKET_MAX_CONNECTIONS, &value)) {
+    fprintf(err_stream(), "Invalid websocket.connections: expected 1 to %u.\n",
+            WEBSOCKET_MAX_CONNECTIONS);
+    return EXIT_REQUEST;
+  }
+  opts->connections = (unsigned)value;
+  idx = find_object_value(json, toks, index, "rate");
+  if (idx >= 0 && !parse_number(json, &toks[idx], 1e7, &opts->rate)) {
+    fprintf(err_stream(), "Invalid websocket.rate: expected messages per second.\n");
+    return EXIT_REQUEST;
+  }
+  idx = find_object_value(json, toks, index, "messages");
+  if (idx >= 0 && !parse_whole(json, &toks[idx], UINT64_MAX, &opts->messages)) {
+    fprintf(err_stream(), "Invalid websocket.messages: expected a positive count.\n");
+    return EXIT_REQUEST;
+  }
+  idx = find_object_value(json, toks, index, "duration");
+  if (idx >= 0) {
+    char *text = dup_token_string(json, &toks[idx]);
+    bool ok = text && parse_duration(text, &opts->duration_ns) && opts->duration_ns > 0;
+    free(text);
+    if (!ok) {
+      fprintf(err_stream(), "Invalid websocket.duration: expected a duration like \"30s\".\n");
+      return EXIT_REQUEST;
+    }
+  }
+  return EXIT_OK;
+}
+
+int websocket_load(const char *config_path, struct websocket_options *opts, bool *found) {
+  memset(opts, 0, sizeof(*opts));
+  *found = false;
+  size_t json_len = 0;
+  char *json = read_file(config_path, &json_len);
+  if (!json) {
+    fprintf(err_stream(), "Failed to read file: %s\n", config_path);
+    return EXIT_CONFIG;
+  }
+  jsmn_parser parser;
+  jsmntok_t *toks = NULL;
+  int count = 0;
+  int rc = EXIT_OK;
+  if (ensure_tokens(&parser, json, json_len, &toks, &count) != 0 || count < 1 ||
+      toks[0].type != JSMN_OBJECT) {
+    /* request_load reports the broken config. */
+  } else {
+    int idx = find_object_value(json, toks, 0, "websocket");
+    if (idx >= 0) {
+      *found = true;
+      rc = parse_section(json, toks, idx, opts);
+    }
+  }
+  free(toks);
+  free(json);
+  if (rc != EXIT_OK) {
+    websocket_options_free(opts);
+  }
+  return rc;
+}
+
+void websocket_options_free(struct websocket_options *opts) {
+  gen_free(opts->message_gen);
+  free(opts->message);
+  memset(opts, 0, sizeof(*opts));
+}
+
+#ifdef PINGA_HAVE_WS
+
+struct ws_conn {
+  CURL *curl;
+  curl_socket_t fd;
+  bool open;
+  bool blocked; /* out is part sent; the rest goes on POLLOUT */
+  char *out;    /* the message being sent, rendered in place */
+  size_t out_len;
+  size_t out_sent; /* bytes of out libcurl has taken so far */
+  /* Send times of unanswered messages, oldest at head. */
+  uint64_t sent_ns[WS_WINDOW];
+  unsigned head;
+  unsigned pending;
+};
+
+struct ws_run {
+  const struct websocket_options *opts;
+  struct websocket_report *report;
+  struct ws_conn *conns;
+  struct pollfd *fds;
+  unsigned open;
+  uint64_t claimed;
+  uint64_t last_ns;
+  struct gen_rng rng;
+  char buf[WS_RECV_BUFFER];
+};
+
+static bool url_is_ws(const char *url) {
+  return strncasecmp(url, "ws://", 5) == 0 || strncasecmp(url, "wss://", 6) == 0;
+}
+
+static bool curl_has_ws(void) {
+  const curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  for (const char *const *p = info->protocols; *p; p++) {
+    if (strcmp(*p, "ws") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void ws_drop(struct ws_run *run, struct ws_conn *c, const char *why) {
+  if (run->report->errors++ == 0) {
+    fprintf(err_stream(), "WebSocket connection %u: %s\n", (unsigned)(c - run->conns) + 1,
+            why);
+  }
+  c->open = false;
+  c->blocked = false;
+  run->open--;
+}
+
+/*
+ * Sends what is left of c->out; false when the connection is gone or the
+ * rest has to wait. The RTT clock starts once the whole frame is out.
+ */
+static bool ws_send(struct ws_run *run, struct ws_conn *c, uint64_t now) {
+  size_t sent = 0;
+  unsigned flags = run->opts->binary ? CURLWS_BINARY : CURLWS_TEXT;
+  CURLcode res = curl_ws_send(c->curl, c->out + c->out_sent, c->out_len - c->out_sent, &sent,
+                              0, flags);
+  if (res != CURLE_OK && res != CURLE_AGAIN) {
+    ws_drop(run, c, curl_easy_strerror(res));
+    return false;
+  }
+  c->out_sent += sent;
+  if (c->out_sent < c->out_len || (res == CURLE_AGAIN && sent == 0)) {
+    c->blocked = true;
+    return false;
+  }
+  c->blocked = false;
+  c->out_sent = 0;
+  c->sent_ns[(c->head + c->pending) % WS_WINDOW] = now;
+  c->pending++;
+  run->report->sent++;
+  run->report->bytes_sent += c->out_len;
+  run->last_ns = now;
+  return true;
+}
+
+static void ws_send_next(struct ws_run *run, struct ws_conn *c, uint64_t now) {
+  uint64_t seq = run->claimed++;
+  if (run->opts->message_gen) {
+    c->out_len = gen_render(run->opts->message_gen, &run->rng, seq, c->out);
+  }
+  ws_send(run, c, now);
+}
+
+/* Reads until the socket is dry; each complete message answers the oldest send. */
+static void ws_receive(struct ws_run *run, struct ws_conn *c) {
+  for (;;) {
+    size_t n = 0;
+    const struct curl_ws_frame *meta = NULL;
+    /* The frame pointer became const in later libcurl headers; void * fits both. */
+    CURLcode res = curl_ws_recv(c->curl, run->buf, sizeof(run->buf), &n, (void *)&meta);
+    if (res == CURLE_AGAIN) {
+      return;
+    }
+    if (res != CURLE_OK) {
+      ws_drop(run, c, curl_easy_strerror(res));
+      return;
+    }
+    uint64_t now = now_ns();
+    if (meta->flags & CURLWS_CLOSE) {
+      ws_drop(run, c, "closed by the server");
+      return;
+    }
+    /* libcurl answers pings itself. */
+    if (meta->flags & CURLWS_PING) {
+      continue;
+    }
+    run->report->bytes_received += n;
+    if (meta->bytesleft > 0 || (meta->flags & CURLWS_CONT)) {
+      continue;
+    }
+    run->report->received++;
+    run->last_ns = now;
+    if (c->pending) {
+      histogram_record(&run->report->rtt, (now - c->sent_ns[c->head]) / 1000);
+      c->head = (c->head + 1) % WS_WINDOW;
+      c->pending--;
+    }
+  }
+}
+
+static int ws_connect(struct ws_run *run, const struct request *req, struct ws_conn *c) {
+  c->curl = curl_easy_init();
+  if (!c->curl) {
+    fprintf(err_stream(), "Failed to init curl.\n");
+    return EXIT_HTTP;
+  }
+  request_apply(c->curl, req);
+  curl_easy_setopt(c->curl, CURLOPT_CONNECT_ONLY, 2L);
+  curl_easy_setopt(c->curl, CURLOPT_NOSIGNAL, 1L);
+  uint64_t start = now_ns();
+  CURLcode res = curl_easy_perform(c->curl);
+  long status = 0;
+  curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &status);
+  if (res != CURLE_OK || status != 101) {
+    if (res != CURLE_OK) {
+      fprintf(err_stream(), "WebSocket handshake failed: %s\n", curl_easy_strerror(res));
+    } else {
+      fprintf(err_stream(), "WebSocket upgrade refused: HTTP %ld\n", status);
+    }
+    return EXIT_HTTP;
+  }
+  histogram_record(&run->report->connect, (now_ns() - start) / 1000);
+  curl_easy_getinfo(c->curl, CURLINFO_ACTIVESOCKET, &c->fd);
+  c->open = true;
+  run->open++;
+  return EXIT_OK;
+}
+
+static bool more_to_send(const struct ws_run *run, uint64_t now, uint64_t deadline) {
+  uint64_t limit = run->opts->messages;
+  return run->open > 0 && now < deadline && (!limit || run->claimed < limit);
+}
+
+/* Rate mode: hands every message that is due to the next connection with room. */
+static uint64_t send_due(struct ws_run *run, uint64_t start, uint64_t now, uint64_t deadline,
+                         unsigned *next) {
+  unsigned n = run->opts->connections;
+  while (more_to_send(run, now, deadline)) {
+    uint64_t due = start + (uint64_t)((double)run->claimed * 1e9 / run->opts->rate);
+    if (due > now) {
+      return due;
+    }
+    struct ws_conn *c = NULL;
+    for (unsigned k = 0; k < n && !c; k++) {
+      struct ws_conn *cand = &run->conns[(*next + k) % n];
+      if (cand->open && !cand->blocked && cand->pending < WS_WINDOW) {
+        c = cand;
+        *next = (unsigned)(cand - run->conns + 1) % n;
+      }
+    }
+    if (!c) {
+      /* Every window is full: the message goes out late, when a reply frees one. */
+      return UINT64_MAX;
+    }
+    ws_send_next(run, c, now);
+  }
+  return UINT64_MAX;
+}
+
+static void ws_loop(struct ws_run *run) {
+  const struct websocket_options *opts = run->opts;
+  unsigned n = opts->connections;
+  uint64_t start = now_ns();
+  uint64_t deadline = opts->duration_ns ? start + opts->duration_ns : UINT64_MAX;
+  uint64_t drain_until = 0;
+  unsigned next = 0;
+  run->last_ns = start;
+  for (;;) {
+    uint64_t now = now_ns();
+    uint64_t wake = UINT64_MAX;
+    if (opts->rate > 0) {
+      wake = send_due(run, start, now, deadline, &next);
+    } else {
+      for (unsigned i = 0; i < n && more_to_send(run, now, deadline); i++) {
+        struct ws_conn *c = &run->conns[i];
+        if (c->open && !c->blocked && c->pending == 0) {
+          ws_send_next(run, c, now);
+        }
+      }
+    }
+    bool sending = more_to_send(run, now, deadline);
+    unsigned waiting = 0;
+    for (unsigned i = 0; i < n; i++) {
+      const struct ws_conn *c = &run->conns[i];
+      waiting += c->open && (c->pending || c->blocked);
+    }
+    if (!sending) {
+      if (!waiting) {
+        break;
+      }
+      if (!drain_until) {
+        drain_until = now + WS_DRAIN_NS;
+      } else if (now >= drain_until) {
+        break;
+      }
+      wake = drain_until;
+    } else if (deadline < wake) {
+      wake = deadline;
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+      const struct ws_conn *c = &run->conns[i];
+      run->fds[i].fd = c->open ? c->fd : -1;
+      run->fds[i].events = (short)(POLLIN | (c->blocked ? POLLOUT : 0));
+      run->fds[i].revents = 0;
+    }
+    int timeout_ms = 100;
+    if (wake != UINT64_MAX) {
+      uint64_t left = wake > now ? wake - now : 0;
+      timeout_ms = left < 100000000ull ? (int)((left + 999999) / 1000000) : 100;
+    }
+    if (poll(run->fds, n, timeout_ms) <= 0) {
+      continue;
+    }
+    for (unsigned i = 0; i < n; i++) {
+      struct ws_conn *c = &run->conns[i];
+      short revents = run->fds[i].revents;
+      if (!c->open || !revents) {
+        continue;
+      }
+      if (c->blocked && (revents & POLLOUT)) {
+        ws_send(run, c, now_ns());
+      }
+      if (c->open && (revents & (POLLIN | POLLERR | POLLHUP))) {
+        ws_receive(run, c);
+      }
+    }
+  }
+  run->report->elapsed_ns = run->last_ns - start;
+}
+
+int websocket_run(const struct request *req, const struct websocket_options *opts,
+                  struct websocket_report *report) {
+  memset(report, 0, sizeof(*report));
+  histogram_reset(&report->connect);
+  histogram_reset(&report->rtt);
+  report->connections = opts->connections;
+  report->ping_pong = opts->rate <= 0;
+  if (!url_is_ws(req->url)) {
+    fprintf(err_stream(), "A websocket config needs a ws:// or wss:// url.\n");
+    return EXIT_REQUEST;
+  }
+  if (!curl_has_ws()) {
+    fprintf(err_stream(), "This libcurl was built without WebSocket support.\n");
+    return EXIT_HTTP;
+  }
+  struct ws_run *run = (struct ws_run *)calloc(1, sizeof(struct ws_run));
+  struct ws_conn *conns = (struct ws_conn *)calloc(opts->connections, sizeof(struct ws_conn));
+  struct pollfd *fds = (struct pollfd *)calloc(opts->connections, sizeof(struct pollfd));
+  /* One message buffer per connection, sized once; static messages need none. */
+  size_t max_len = opts->message_gen ? gen_max_len(opts->message_gen) : 0;
+  char *out = max_len ? (char *)malloc(max_len * opts->connections) : NULL;
+  if (!run || !conns || !fds || (max_len && !out)) {
+    fprintf(err_stream(), "Out of memory while setting up WebSocket connections.\n");
+    free(run);
+    free(conns);
+    free(fds);
+    free(out);
+    return EXIT_HTTP;
+  }
+  run->opts = opts;
+  run->report = report;
+  run->conns = conns;
+  run->fds = fds;
+  gen_rng_seed(&run->rng, now_ns() ^ (uint64_t)(uintptr_t)run);
+  for (unsigned i = 0; i < opts->connections; i++) {
+    conns[i].out = max_len ? out + (size_t)i * max_len : opts->message;
+    conns[i].out_len = opts->message_len;
+  }
+
+  int rc = EXIT_OK;
+  for (unsigned i = 0; rc == EXIT_OK && i < opts->connections; i++) {
+    rc = ws_connect(run, req, &conns[i]);
+  }
+  if (rc == EXIT_OK) {
+    ws_loop(run);
+    for (unsigned i = 0; i < opts->connections; i++) {
+      report->lost += conns[i].pending;
+    }
+  }
+  for (unsigned i = 0; i < opts->connections; i++) {
+    if (conns[i].open) {
+      size_t sent = 0;
+      curl_ws_send(conns[i].curl, "", 0, &sent, 0, CURLWS_CLOSE);
+    }
+    curl_easy_cleanup(conns[i].curl);
+  }
+  free(out);
+  free(fds);
+  free(conns);
+  free(run);
+  return rc;
+}
+
+#else
+
+int websocket_run(const struct request *req, const struct websocket_options *opts,
+                  struct websocket_report *report) {
+  (void)req;
+  (void)opts;
+  memset(report, 0, sizeof(*report));
+  fprintf(err_stream(), "WebSocket mode needs libcurl 7.86 or newer on a POSIX system.\n");
+  return EXIT_HTTP;
+}
+
+#endif
+
+void websocket_print_report(FILE *out, const struct websocket_report *report) {
+  double elapsed_s = (double)report->elapsed_ns / 1e9;
+  fprintf(out,
+          "{\"mode\":\"%s\",\"connections\":%u,\"sent\":%llu,\"received\":%llu,"
+          "\"lost\":%llu,\"errors\":%llu,\"elapsed_ms\":%.3f,\"messages_per_sec\":%.1f,",
+          report->ping_pong ? "ping-pong" : "rate", report->connections,
+          (unsigned long long)report->sent, (unsigned long long)report->received,
+          (unsigned long long)report->lost, (unsigned long long)report->errors,
+          elapsed_s * 1000.0, elapsed_s > 0 ? (double)report->received / elapsed_s : 0.0);
+  load_print_latency(out, "connect_ms", &report->connect);
+  load_print_latency(out, "rtt_ms", &report->rtt);
+  fprintf(out, "\"bytes_sent\":%llu,\"bytes_received\":%llu}\n",
+          (unsigned long long)report->bytes_sent, (unsigned long long)report->bytes_received);
+}
@@ -0,0 +1,65 @@
+#ifndef PINGA_WEBSOCKET_H
+#define PINGA_WEBSOCKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "generate.h"
+#include "request.h"
+#include "stats.h"
+
+/*
+ * WebSocket mode, for configs with a "websocket" section:
+ *
+ *   {"url": "wss://chat.example.com/socket",
+ *    "headers": {"Authorization": "Bearer abc"},
+ *    "websocket": {"message": {"seq": "{{seq}}", "text": "{{rand_str:32}}"},
+ *                  "connections": 50, "rate": 2000, "duration": "30s"}}
+ *
+ * Every connection is upgraded once (url, headers, resolve and unix_socket
+ * come from the config as usual), then messages go out over all of them:
+ * ping-pong sends the next message on a connection once the previous one
+ * came back, "rate" sends that many messages per second in total. Replies
+ * are matched to sends in order, so the peer is expected to echo.
+ */
+#define WEBSOCKET_MAX_CONNECTIONS 10000u
+
+struct websocket_options {
+  char *message;
+  size_t message_len;
+  struct gen_template *message_gen; /* NULL when the message has no placeholders */
+  bool binary;
+  unsigned connections;
+  double rate;          /* messages per second over all connections; 0 for ping-pong */
+  uint64_t messages;    /* total to send; 0 to send until duration_ns */
+  uint64_t duration_ns;
+};
+
+/*
+ * Returns EXIT_OK and sets *found when the config has a websocket section,
+ * or an EXIT_* code after reporting a bad one.
+ */
+int websocket_load(const char *config_path, struct websocket_options *opts, bool *found);
+void websocket_options_free(struct websocket_options *opts);
+
+struct websocket_report {
+  unsigned connections;
+  bool ping_pong;
+  uint64_t sent;
+  uint64_t received;
+  uint64_t lost;   /* sent but not answered before the run ended */
+  uint64_t errors; /* connections that failed or were closed mid-run */
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+  uint64_t elapsed_ns;
+  struct histogram connect; /* handshake time per connection */
+  struct histogram rtt;
+};
+
+/* Returns EXIT_HTTP when a connection cannot be upgraded, else EXIT_OK. */
+int websocket_run(const struct request *req, const struct websocket_options *opts,
+                  struct websocket_report *report);
+void websocket_print_report(FILE *out, const struct websocket_report *report);
+
+#endif
@@ -0,0 +1,680 @@
+#include "workflow.h"
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "json.h"
+#include "request.h"
+#include "response.h"
+#include "util.h"
+
+#define MAX_WORKFLOW_TOKENS 65536
+/* Responses that captures read from; larger ones fail the capture. */
+#define MAX_CAPTURE_TOKENS (1 << 20)
+
+enum step_state { STEP_WAITING, STEP_RUNNING, STEP_OK, STEP_FAILED, STEP_SKIPPED };
+
+struct capture {
+  char *name;
+  char *path;   /* "$.a.b[0]", or NULL for a header */
+  char *header;
+  char *value;
+};
+
+struct step {
+  char *name;
+  char *config;
+  struct request req;
+  unsigned *needs;
+  unsigned need_count;
+  bool always;
+  struct capture *captures;
+  unsigned capture_count;
+  bool json_capture;
+  enum step_state state;
+  CURL *easy;
+  curl_mime *mime;
+  struct response_buffer body;
+  struct response_headers headers;
+  uint64_t started_ns;
+  long status;
+  const char *error; /* why the step failed or was skipped */
+  char *missing;     /* capture that found nothing */
+};
+
+struct workflow {
+  struct step *steps;
+  unsigned step_count;
+};
+
+static bool is_name_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Capture names are placeholders; step names may also use '-' and '.'. */
+static bool valid_name(const char *name, bool step) {
+  if (!*name) {
+    return false;
+  }
+  for (const char *p = name; *p; p++) {
+    if (!is_name_char(*p) && !(step && (*p == '-' || *p == '.'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* "$", then any run of ".key" and "[index]". */
+static bool valid_path(const char *path) {
+  if (path[0] != '$') {
+    return false;
+  }
+  const char *p = path + 1;
+  while (*p) {
+    if (*p == '.') {
+      size_t n = strcspn(p + 1, ".[");
+      if (n == 0) {
+        return false;
+      }
+      p += 1 + n;
+    } else if (*p == '[') {
+      size_t n = strspn(p + 1, "0123456789");
+      if (n == 0 || p[1 + n] != ']') {
+        return false;
+      }
+      p += n + 2;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int find_step(const struct workflow *wf, const char *name, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    if (strcmp(wf->steps[i].name, name) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static int parse_captures(const char *json, jsmntok_t *toks, int index, struct step *s) {
+  if (toks[index].type != JSMN_OBJECT) {
+    fprintf(err_stream(), "Step '%s': capture must be an object.\n", s->name);
+    return EXIT_REQUEST;
+  }
+  unsigned count = (unsigned)toks[index].size / 2;
+  s->captures = (struct capture *)calloc(count ? count : 1, sizeof(struct capture));
+  if (!s->captures) {
+    fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+    return EXIT_REQUEST;
+  }
+  int i = index + 1;
+  for (unsigned k = 0; k < count; k++, i = skip_token(toks, i + 1)) {
+    struct capture *c = &s->captures[s->capture_count++];
+    c->name = dup_token_string(json, &toks[i]);
+    char *spec = toks[i + 1].type == JSMN_STRING ? dup_token_string(json, &toks[i + 1]) : NULL;
+    if (!c->name || !spec) {
+      free(spec);
+      fprintf(err_stream(), "Step '%s': capture values must be strings.\n", s->name);
+      return EXIT_REQUEST;
+    }
+    if (!valid_name(c->name, false)) {
+      free(spec);
+      fprintf(err_stream(), "Step '%s': capture name '%s' must be letters, digits or '_'.\n",
+              s->name, c->name);
+      return EXIT_REQUEST;
+    }
+    if (strncmp(spec, "header:", 7) == 0 && spec[7]) {
+      c->header = dup_string(spec + 7);
+      free(spec);
+      if (!c->header) {
+        fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+        return EXIT_REQUEST;
+      }
+    } else if (valid_path(spec)) {
+      c->path = spec;
+      s->json_capture = true;
+    } else {
+      fprintf(err_stream(),
+              "Step '%s': capture '%s' must be a JSON path ($.a.b[0]) or header:Name.\n",
+              s->name, c->name);
+      free(spec);
+      return EXIT_REQUEST;
+    }
+  }
+  return EXIT_OK;
+}
+
+static int parse_needs(const struct workflow *wf, const char *json, jsmntok_t *toks, int index,
+                       struct step *s) {
+  if (toks[index].type != JSMN_ARRAY) {
+    fprintf(err_stream(), "Step '%s': needs must be an array of step names.\n", s->name);
+    return EXIT_REQUEST;
+  }
+  s->needs = (unsigned *)calloc((size_t)toks[index].size + 1, sizeof(unsigned));
+  if (!s->needs) {
+    fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+    return EXIT_REQUEST;
+  }
+  int i = index + 1;
+  for (int k = 0; k < toks[index].size; k++, i = skip_token(toks, i)) {
+    char *name = toks[i].type == JSMN_STRING ? dup_token_string(json, &toks[i]) : NULL;
+    int found = name ? find_step(wf, name, wf->step_count) : -1;
+    if (found < 0 || (unsigned)found == (unsigned)(s - wf->steps)) {
+      fprintf(err_stream(), "Step '%s': needs unknown step '%s'.\n", s->name,
+              name ? name : "?");
+      free(name);
+      return EXIT_REQUEST;
+    }
+    free(name);
+    s->needs[s->need_count++] = (unsigned)found;
+  }
+  return EXIT_OK;
+}
+
+/* Kahn's algorithm: every step must be reachable without a cycle. */
+static int check_cycles(const struct workflow *wf) {
+  unsigned n = wf->step_count;
+  unsigned *pending = (unsigned *)calloc(n, sizeof(unsigned));
+  unsigned *queue = (unsigned *)calloc(n, sizeof(unsigned));
+  if (!pending || !queue) {
+    free(pending);
+    free(queue);
+    fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+    return EXIT_REQUEST;
+  }
+  unsigned head = 0;
+  unsigned tail = 0;
+  for (unsigned i = 0; i < n; i++) {
+    pending[i] = wf->steps[i].need_count;
+    if (pending[i] == 0) {
+      queue[tail++] = i;
+    }
+  }
+  while (head < tail) {
+    unsigned done = queue[head++];
+    for (unsigned i = 0; i < n; i++) {
+      for (unsigned k = 0; k < wf->steps[i].need_count; k++) {
+        if (wf->steps[i].needs[k] == done && --pending[i] == 0) {
+          queue[tail++] = i;
+        }
+      }
+    }
+  }
+  int rc = EXIT_OK;
+  for (unsigned i = 0; i < n && tail < n; i++) {
+    if (pending[i]) {
+      fprintf(err_stream(), "Workflow has a dependency cycle through step '%s'.\n",
+              wf->steps[i].name);
+      rc = EXIT_REQUEST;
+      break;
+    }
+  }
+  free(pending);
+  free(queue);
+  return rc;
+}
+
+static int load_step(const char *path, const char *json, jsmntok_t *toks, int index,
+                     struct step *s, const char *const *resolve, int resolve_count) {
+  if (toks[index].type != JSMN_OBJECT) {
+    fprintf(err_stream(), "Workflow steps must be objects.\n");
+    return EXIT_REQUEST;
+  }
+  int config_idx = find_object_value(json, toks, index, "config");
+  char *config = config_idx >= 0 && toks[config_idx].type == JSMN_STRING
+                     ? dup_token_string(json, &toks[config_idx])
+                     : NULL;
+  if (!config) {
+    fprintf(err_stream(), "Step '%s' needs a config file.\n", s->name);
+    return EXIT_REQUEST;
+  }
+  s->config = path_beside(path, config);
+  free(config);
+  if (!s->config) {
+    fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+    return EXIT_REQUEST;
+  }
+  int rc = request_load(s->config, &s->req);
+  if (rc != EXIT_OK) {
+    fprintf(err_stream(), "In step '%s' (%s).\n", s->name, s->config);
+    return rc;
+  }
+  if (request_reads_stdin(&s->req)) {
+    fprintf(err_stream(), "Step '%s': multipart stdin parts apply to single requests only.\n",
+            s->name);
+    return EXIT_REQUEST;
+  }
+  for (int i = 0; i < resolve_count; i++) {
+    if (request_add_resolve(&s->req, resolve[i]) != 0) {
+      return EXIT_REQUEST;
+    }
+  }
+  int always_idx = find_object_value(json, toks, index, "always");
+  s->always = always_idx >= 0 && toks[always_idx].type == JSMN_PRIMITIVE &&
+              json[toks[always_idx].start] == 't';
+  int capture_idx = find_object_value(json, toks, index, "capture");
+  return capture_idx >= 0 ? parse_captures(json, toks, capture_idx, s) : EXIT_OK;
+}
+
+int workflow_load(const char *path, const char *const *resolve, int resolve_count,
+                  struct workflow **out) {
+  *out = NULL;
+  size_t len = 0;
+  char *json = read_file(path, &len);
+  if (!json) {
+    fprintf(err_stream(), "Failed to read file: %s\n", path);
+    return EXIT_CONFIG;
+  }
+  jsmn_parser parser;
+  jsmntok_t *toks = NULL;
+  int count = 0;
+  int steps_idx = -1;
+  if (ensure_tokens_max(&parser, json, len, MAX_WORKFLOW_TOKENS, &toks, &count) != 0 ||
+      count < 1 || toks[0].type != JSMN_OBJECT ||
+      (steps_idx = find_object_value(json, toks, 0, "steps")) < 0 ||
+      toks[steps_idx].type != JSMN_ARRAY || toks[steps_idx].size == 0) {
+    fprintf(err_stream(), "Invalid workflow: expected {\"steps\": [...]} in %s\n", path);
+    free(toks);
+    free(json);
+    return EXIT_CONFIG;
+  }
+  struct workflow *wf = (struct workflow *)calloc(1, sizeof(struct workflow));
+  unsigned n = (unsigned)toks[steps_idx].size;
+  struct step *steps = wf ? (struct step *)calloc(n, sizeof(struct step)) : NULL;
+  if (!steps) {
+    fprintf(err_stream(), "Out of memory while reading the workflow.\n");
+    free(wf);
+    free(toks);
+    free(json);
+    return EXIT_REQUEST;
+  }
+  wf->steps = steps;
+  /* Names first, so needs can point forward. */
+  int rc = EXIT_OK;
+  int i = steps_idx + 1;
+  for (unsigned k = 0; k < n && rc == EXIT_OK; k++, i = skip_token(toks, i)) {
+    int name_idx = toks[i].type == JSMN_OBJECT ? find_object_value(json, toks, i, "name") : -1;
+    if (name_idx >= 0 && toks[name_idx].type == JSMN_STRING) {
+      steps[k].name = dup_token_string(json, &toks[name_idx]);
+    }
+    if (!steps[k].name || !valid_name(steps[k].name, true)) {
+      fprintf(err_stream(), "Workflow step %u needs a name of letters, digits, '_', '-' or '.'.\n",
+              k + 1);
+      rc = EXIT_REQUEST;
+    } else if (find_step(wf, steps[k].name, k) >= 0) {
+      fprintf(err_stream(), "Duplicate workflow step name '%s'.\n", steps[k].name);
+      rc = EXIT_REQUEST;
+    }
+    wf->step_count = k + 1;
+  }
+  i = steps_idx + 1;
+  for (unsigned k = 0; k < n && rc == EXIT_OK; k++, i = skip_token(toks, i)) {
+    rc = load_step(path, json, toks, i, &steps[k], resolve, resolve_count);
+    int needs_idx = rc == EXIT_OK ? find_object_value(json, toks, i, "needs") : -1;
+    if (needs_idx >= 0) {
+      rc = parse_needs(wf, json, toks, needs_idx, &steps[k]);
+    }
+  }
+  free(toks);
+  free(json);
+  if (rc == EXIT_OK) {
+    rc = check_cycles(wf);
+  }
+  if (rc != EXIT_OK) {
+    workflow_free(wf);
+    return rc;
+  }
+  *out = wf;
+  return EXIT_OK;
+}
+
+void workflow_free(struct workflow *wf) {
+  if (!wf) {
+    return;
+  }
+  for (unsigned i = 0; i < wf->step_count; i++) {
+    struct step *s = &wf->steps[i];
+    for (unsigned k = 0; k < s->capture_count; k++) {
+      free(s->captures[k].name);
+      free(s->captures[k].path);
+      free(s->captures[k].header);
+      free(s->captures[k].value);
+    }
+    free(s->captures);
+    free(s->needs);
+    free(s->name);
+    free(s->config);
+    free(s->missing);
+    request_free(&s->req);
+    if (s->easy) {
+      curl_easy_cleanup(s->easy);
+    }
+    curl_mime_free(s->mime);
+    response_buffer_free(&s->body);
+    header_list_free(&s->headers.headers);
+    free(s->headers.status_line);
+  }
+  free(wf->steps);
+  free(wf);
+}
+
+/* ---- running ---- */
+
+static size_t write_ignore(void *ptr, size_t size, size_t nmemb, void *userdata) {
+  (void)ptr;
+  (void)userdata;
+  return size * nmemb;
+}
+
+/* Walks $.a.b[0] through the tokens; -1 when a key or index is missing. */
+static int follow_path(const char *json, jsmntok_t *toks, const char *path) {
+  int idx = 0;
+  const char *p = path + 1;
+  char key[256];
+  while (*p && idx >= 0) {
+    if (*p == '.') {
+      size_t n = strcspn(p + 1, ".[");
+      if (n >= sizeof(key)) {
+        return -1;
+      }
+      memcpy(key, p + 1, n);
+      key[n] = '\0';
+      idx = find_object_value(json, toks, idx, key);
+      p += 1 + n;
+    } else {
+      long want = strtol(p + 1, NULL, 10);
+      if (toks[idx].type != JSMN_ARRAY || want >= toks[idx].size) {
+        return -1;
+      }
+      int elem = idx + 1;
+      for (long k = 0; k < want; k++) {
+        elem = skip_token(toks, elem);
+      }
+      idx = elem;
+      p = strchr(p, ']') + 1;
+    }
+  }
+  return idx;
+}
+
+static char *capture_header(const struct step *s, const char *name) {
+  for (size_t i = 0; i < s->headers.headers.count; i++) {
+    const struct header_entry *h = &s->headers.headers.items[i];
+    if (strcasecmp(h->name, name) == 0) {
+      return dup_string(h->value);
+    }
+  }
+  return NULL;
+}
+
+/* Fills every capture; false (with s->error set) when one found nothing. */
+static bool run_captures(struct step *s) {
+  jsmntok_t *toks = NULL;
+  int count = 0;
+  if (s->json_capture) {
+    jsmn_parser parser;
+    if (s->body.spill || !s->body.data ||
+        ensure_tokens_max(&parser, s->body.data, s->body.len, MAX_CAPTURE_TOKENS, &toks,
+                          &count) != 0 ||
+        count < 1) {
+      free(toks);
+      s->error = s->body.spill ? "response too large to capture from" : "response is not JSON";
+      return false;
+    }
+  }
+  bool ok = true;
+  for (unsigned i = 0; i < s->capture_count && ok; i++) {
+    struct capture *c = &s->captures[i];
+    if (c->header) {
+      c->value = capture_header(s, c->header);
+    } else {
+      int idx = follow_path(s->body.data, toks, c->path);
+      if (idx >= 0) {
+        c->value = toks[idx].type == JSMN_STRING
+                       ? dup_token_unescaped(s->body.data, &toks[idx], NULL)
+                       : dup_token_raw(s->body.data, &toks[idx]);
+      }
+    }
+    /* A line break would split a header line the value lands in. */
+    if (!c->value || strpbrk(c->value, "\r\n")) {
+      free(c->value);
+      c->value = NULL;
+      s->missing = dup_string(c->name);
+      s->error = "capture found nothing";
+      ok = false;
+    }
+  }
+  free(toks);
+  return ok;
+}
+
+/* Values captured by every step s needs, directly or through others. */
+static size_t collect_vars(const struct workflow *wf, unsigned index, bool *seen,
+                           struct request_var *vars, size_t count) {
+  const struct step *s = &wf->steps[index];
+  for (unsigned k = 0; k < s->need_count; k++) {
+    unsigned dep = s->needs[k];
+    if (seen[dep]) {
+      continue;
+    }
+    seen[dep] = true;
+    const struct step *d = &wf->steps[dep];
+    for (unsigned i = 0; i < d->capture_count; i++) {
+      if (d->captures[i].value) {
+        vars[count].name = d->captures[i].name;
+        vars[count].value = d->captures[i].value;
+        count++;
+      }
+    }
+    count = collect_vars(wf, dep, seen, vars, count);
+  }
+  return count;
+}
+
+static bool start_step(struct workflow *wf, CURLM *multi, unsigned index, uint64_t seq) {
+  struct step *s = &wf->steps[index];
+  size_t total = 0;
+  for (unsigned i = 0; i < wf->step_count; i++) {
+    total += wf->steps[i].capture_count;
+  }
+  bool *seen = (bool *)calloc(wf->step_count, sizeof(bool));
+  struct request_var *vars =
+      (struct request_var *)calloc(total ? total : 1, sizeof(struct request_var));
+  bool ok = seen && vars;
+  if (ok) {
+    size_t count = collect_vars(wf, index, seen, vars, 0);
+    ok = request_expand(&s->req, seq) == EXIT_OK &&
+         request_substitute(&s->req, vars, count) == EXIT_OK;
+  }
+  free(seen);
+  free(vars);
+  if (!ok || !(s->easy = curl_easy_init())) {
+    s->error = "failed to prepare the request";
+    return false;
+  }
+  request_apply(s->easy, &s->req);
+  if (s->req.part_count && !(s->mime = request_mime(s->easy, &s->req))) {
+    s->error = "failed to build the multipart body";
+    return false;
+  }
+  curl_easy_setopt(s->easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(s->easy, CURLOPT_WRITEFUNCTION, s->json_capture ? write_body : write_ignore);
+  curl_easy_setopt(s->easy, CURLOPT_WRITEDATA, &s->body);
+  curl_easy_setopt(s->easy, CURLOPT_HEADERFUNCTION, write_header);
+  curl_easy_setopt(s->easy, CURLOPT_HEADERDATA, &s->headers);
+  curl_easy_setopt(s->easy, CURLOPT_PRIVATE, s);
+  s->started_ns = now_ns();
+  if (curl_multi_add_handle(multi, s->easy) != CURLM_OK) {
+    s->error = "failed to queue the request";
+    return false;
+  }
+  s->state = STEP_RUNNING;
+  return true;
+}
+
+static void print_step(FILE *out, const struct workflow *wf, const struct step *s,
+                       uint64_t start_ns) {
+  if (!out) {
+    return;
+  }
+  fprintf(out, "{\"step\":\"%s\",\"state\":\"%s\"", s->name,
+          s->state == STEP_OK ? "ok" : s->state == STEP_FAILED ? "failed" : "skipped");
+  if (s->started_ns) {
+    fprintf(out, ",\"status\":%ld,\"start_ms\":%.3f,\"latency_ms\":%.3f", s->status,
+            (double)(s->started_ns - start_ns) / 1e6,
+            (double)(now_ns() - s->started_ns) / 1e6);
+  }
+  if (s->capture_count) {
+    fprintf(out, ",\"captured\":[");
+    bool first = true;
+    for (unsigned i = 0; i < s->capture_count; i++) {
+      if (s->captures[i].value) {
+        fprintf(out, "%s\"%s\"", first ? "" : ",", s->captures[i].name);
+        first = false;
+      }
+    }
+    fputc(']', out);
+  }
+  if (s->error) {
+    char *error = json_escape(s->error);
+    fprintf(out, ",\"error\":\"%s\"", error ? error : "");
+    free(error);
+  }
+  if (s->missing) {
+    fprintf(out, ",\"capture\":\"%s\"", s->missing);
+  }
+  if (s->state == STEP_SKIPPED) {
+    fprintf(out, ",\"needs\":[");
+    for (unsigned k = 0; k < s->need_count; k++) {
+      fprintf(out, "%s\"%s\"", k ? "," : "", wf->steps[s->needs[k]].name);
+    }
+    fputc(']', out);
+  }
+  fprintf(out, "}\n");
+  fflush(out);
+}
+
+static void finish_step(struct workflow *wf, struct step *s, CURLcode res,
+                        const struct workflow_options *opts, struct workflow_report *report,
+                        uint64_t start_ns) {
+  if (res != CURLE_OK) {
+    s->error = curl_easy_strerror(res);
+    report->transfer_errors++;
+  } else {
+    curl_easy_getinfo(s->easy, CURLINFO_RESPONSE_CODE, &s->status);
+    if (s->status >= 400) {
+      s->error = "HTTP error status";
+    }
+  }
+  bool ok = !s->error && run_captures(s);
+  s->state = ok ? STEP_OK : STEP_FAILED;
+  if (ok) {
+    report->ok++;
+  } else {
+    report->failed++;
+  }
+  print_step(opts->steps, wf, s, start_ns);
+  /* The body only fed the captures. */
+  response_buffer_free(&s->body);
+}
+
+/*
+ * Starts every waiting step whose needs have all finished, and skips the
+ * ones that depend on a failure. Returns how many steps changed state.
+ */
+static unsigned schedule(struct workflow *wf, CURLM *multi, unsigned *in_flight,
+                         const struct workflow_options *opts, struct workflow_report *report,
+                         uint64_t start_ns) {
+  unsigned changed = 0;
+  for (unsigned i = 0; i < wf->step_count; i++) {
+    struct step *s = &wf->steps[i];
+    if (s->state != STEP_WAITING) {
+      continue;
+    }
+    bool ready = true;
+    bool blocked = false;
+    for (unsigned k = 0; k < s->need_count; k++) {
+      enum step_state dep = wf->steps[s->needs[k]].state;
+      ready = ready && dep != STEP_WAITING && dep != STEP_RUNNING;
+      blocked = blocked || dep == STEP_FAILED || dep == STEP_SKIPPED;
+    }
+    if (!ready) {
+      continue;
+    }
+    if (blocked && !s->always) {
+      s->state = STEP_SKIPPED;
+      s->error = "a step it needs did not succeed";
+      report->skipped++;
+      print_step(opts->steps, wf, s, start_ns);
+      changed++;
+      continue;
+    }
+    if (opts->concurrency && *in_flight >= opts->concurrency) {
+      continue;
+    }
+    if (start_step(wf, multi, i, i)) {
+      (*in_flight)++;
+    } else {
+      s->state = STEP_FAILED;
+      report->failed++;
+      print_step(opts->steps, wf, s, start_ns);
+    }
+    changed++;
+  }
+  return changed;
+}
+
+int workflow_run(struct workflow *wf, const struct workflow_options *opts,
+                 struct workflow_report *report) {
+  memset(report, 0, sizeof(*report));
+  report->steps = wf->step_count;
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    fprintf(err_stream(), "Failed to init curl multi handle.\n");
+    return EXIT_HTTP;
+  }
+  uint64_t start = now_ns();
+  unsigned in_flight = 0;
+  for (;;) {
+    while (schedule(wf, multi, &in_flight, opts, report, start) > 0) {
+    }
+    if (in_flight == 0) {
+      break;
+    }
+    int running = 0;
+    curl_multi_perform(multi, &running);
+    CURLMsg *msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      void *priv = NULL;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+      struct step *s = (struct step *)priv;
+      CURLcode res = msg->data.result;
+      curl_multi_remove_handle(multi, s->easy);
+      in_flight--;
+      finish_step(wf, s, res, opts, report, start);
+    }
+    if (in_flight > 0 && running > 0) {
+      curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+  }
+  report->elapsed_ns = now_ns() - start;
+  curl_multi_cleanup(multi);
+  return EXIT_OK;
+}
+
+void workflow_print_report(FILE *out, const struct workflow_report *report) {
+  fprintf(out,
+          "{\"steps\":%u,\"ok\":%u,\"failed\":%u,\"skipped\":%u,\"elapsed_ms\":%.3f}\n",
+          report->steps, report->ok, report->failed, report->skipped,
+          (double)report->elapsed_ns / 1e6);
+}
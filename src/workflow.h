@@ -0,0 +1,47 @@
+#ifndef PINGA_WORKFLOW_H
+#define PINGA_WORKFLOW_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A workflow file names steps, each an existing request config:
+ *
+ *   {"steps": [
+ *     {"name": "login", "config": "login.json",
+ *      "capture": {"token": "$.access_token", "sid": "header:Set-Cookie"}},
+ *     {"name": "orders", "config": "orders.json", "needs": ["login"]},
+ *     {"name": "logout", "config": "logout.json", "needs": ["orders"], "always": true}
+ *   ]}
+ *
+ * A step starts as soon as every step it needs has finished, so independent
+ * steps run concurrently. Values captured by a step fill {name} placeholders
+ * in the steps that (directly or transitively) need it. A failed step skips
+ * its dependents unless they are marked "always".
+ */
+struct workflow;
+
+/* Returns an EXIT_* code; step configs are loaded and checked up front. */
+int workflow_load(const char *path, const char *const *resolve, int resolve_count,
+                  struct workflow **out);
+void workflow_free(struct workflow *wf);
+
+struct workflow_options {
+  unsigned concurrency; /* steps in flight, 0 for no limit */
+  FILE *steps;          /* one JSON line per finished or skipped step, or NULL */
+};
+
+struct workflow_report {
+  unsigned steps;
+  unsigned ok;
+  unsigned failed; /* transfer error, HTTP status >= 400 or a missing capture */
+  unsigned skipped;
+  unsigned transfer_errors;
+  uint64_t elapsed_ns;
+};
+
+int workflow_run(struct workflow *wf, const struct workflow_options *opts,
+                 struct workflow_report *report);
+void workflow_print_report(FILE *out, const struct workflow_report *report);
+
+#endif